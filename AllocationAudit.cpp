@@ -0,0 +1,120 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+#include "AllocationAudit.h"
+
+#if LED_RING_ALLOC_AUDIT
+
+#if defined(ARDUINO) && !defined(LED_RING_HOST)
+#error "The allocation audit replaces operator new, which the ESP8266 core already defines. Use it in a host build."
+#endif
+
+#include <cstdlib>
+#include <new>
+#include "Logger.h"
+
+// the linker's --wrap sends the calls to malloc and friends here, and the originals to __real_*
+extern "C" {
+    void* __real_malloc(size_t size);
+    void* __real_realloc(void* memory, size_t size);
+    void* __real_calloc(size_t count, size_t size);
+    void __real_free(void* memory);
+}
+
+namespace {
+    bool is_armed = false;
+    uint32_t allocation_count = 0;
+    uint32_t reported_count = 0;
+    size_t last_size = 0;
+
+    void count_allocation(const size_t size) {
+        if (!is_armed) return;
+        allocation_count++;
+        last_size = size;
+    }
+
+    void* allocate(const size_t size) {
+        count_allocation(size);
+        // malloc(0) may return nullptr, which new must not
+        return __real_malloc(size > 0 ? size : 1);
+    }
+}
+
+namespace allocation_audit {
+    void arm() {
+        is_armed = true;
+        allocation_count = 0;
+        reported_count = 0;
+    }
+
+    uint32_t allocations() { return allocation_count; }
+
+    size_t lastSize() { return last_size; }
+
+    bool verify() {
+        if (allocation_count != reported_count) {
+            LOG_ERROR("%u heap allocations after setup (last %zu bytes)", allocation_count, last_size);
+            reported_count = allocation_count;
+        }
+        return allocation_count == 0;
+    }
+
+    void fail() {
+        utilities::logger::flush();
+        _Exit(1);
+    }
+}
+
+extern "C" {
+    void* __wrap_malloc(const size_t size) {
+        count_allocation(size);
+        return __real_malloc(size);
+    }
+
+    void* __wrap_realloc(void* memory, const size_t size) {
+        count_allocation(size);
+        return __real_realloc(memory, size);
+    }
+
+    void* __wrap_calloc(const size_t count, const size_t size) {
+        count_allocation(count * size);
+        return __real_calloc(count, size);
+    }
+
+    void __wrap_free(void* memory) {
+        __real_free(memory);
+    }
+}
+
+void* operator new(const size_t size) {
+    void* memory = allocate(size);
+    if (memory == nullptr) throw std::bad_alloc();
+    return memory;
+}
+
+void* operator new[](const size_t size) {
+    return operator new(size);
+}
+
+void* operator new(const size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void* operator new[](const size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void operator delete(void* memory) noexcept { __real_free(memory); }
+void operator delete[](void* memory) noexcept { __real_free(memory); }
+void operator delete(void* memory, size_t) noexcept { __real_free(memory); }
+void operator delete[](void* memory, size_t) noexcept { __real_free(memory); }
+
+#endif
@@ -0,0 +1,47 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// Checks that the steady state loop doesn't allocate: with about 40 KB of heap, allocations fragment it over weeks
+// of uptime. Build with LED_RING_ALLOC_AUDIT=1 on the host to count every operator new after arm(), and link with
+// -Wl,--wrap=malloc,--wrap=realloc,--wrap=calloc,--wrap=free to count the C allocations as well.
+// The ESP8266 core defines operator new itself, so on the device the audit is always off and costs nothing.
+
+#ifndef HEADER_ALLOCATION_AUDIT
+#define HEADER_ALLOCATION_AUDIT
+
+#ifndef LED_RING_ALLOC_AUDIT
+#define LED_RING_ALLOC_AUDIT 0
+#endif
+
+#include <cstddef>
+#include <cstdint>
+
+namespace allocation_audit {
+#if LED_RING_ALLOC_AUDIT
+    // from now on allocations count, e.g. at the end of setup()
+    void arm();
+    // allocations since arm(), and the size of the last one
+    uint32_t allocations();
+    size_t lastSize();
+    // Returns false if anything was allocated since arm(). Logs an error when that number went up.
+    bool verify();
+    // flushes the log and ends the program with exit code 1, for when verify() failed
+    [[noreturn]] void fail();
+#else
+    inline void arm() {}
+    inline uint32_t allocations() { return 0; }
+    inline size_t lastSize() { return 0; }
+    inline bool verify() { return true; }
+    inline void fail() {}
+#endif
+}
+
+#endif
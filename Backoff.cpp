@@ -0,0 +1,35 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+#include "Backoff.h"
+
+Backoff::Backoff(const unsigned long initialDelay, const unsigned long maxDelay)
+    : _initialDelay(initialDelay), _maxDelay(maxDelay) {}
+
+bool Backoff::isDue(const unsigned long now) const {
+    if (_failures == 0) return true;
+    // signed difference so this keeps working when millis() wraps
+    return static_cast<long>(now - _nextAttempt) >= 0;
+}
+
+void Backoff::failed(const unsigned long now, const uint32_t random) {
+    if (_failures < UINT16_MAX) _failures++;
+    const unsigned long ceiling = _failures == 1 ? _initialDelay : _delay * 2;
+    _delay = ceiling > _maxDelay ? _maxDelay : ceiling;
+    // "equal jitter": at least half the delay, so retries don't get too close, plus a random part of the other half
+    const unsigned long half = _delay / 2;
+    _nextAttempt = now + half + (half > 0 ? random % (half + 1) : 0);
+}
+
+void Backoff::succeeded() {
+    _failures = 0;
+    _delay = 0;
+}
@@ -0,0 +1,41 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// Exponential backoff with jitter for connection attempts. The delay doubles with every failure up to a maximum,
+// and a random part spreads the retries of devices that lost the connection at the same time (e.g. a broker restart).
+
+#ifndef HEADER_BACKOFF
+#define HEADER_BACKOFF
+
+#include <cstdint>
+
+class Backoff {
+public:
+    // ms
+    Backoff(unsigned long initialDelay, unsigned long maxDelay);
+    bool isDue(unsigned long now) const;
+    // random is any random number, e.g. from ESP.random()
+    void failed(unsigned long now, uint32_t random);
+    // the next attempt may start right away
+    void succeeded();
+
+    uint16_t failures() const { return _failures; }
+    unsigned long currentDelay() const { return _delay; }
+
+private:
+    unsigned long _initialDelay;
+    unsigned long _maxDelay;
+    unsigned long _delay = 0;
+    unsigned long _nextAttempt = 0;
+    uint16_t _failures = 0;
+};
+
+#endif
@@ -0,0 +1,227 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+
+#include <algorithm>
+#include "ColorConversion.h"
+#include "Progmem.h"
+
+namespace {
+    // percentage (0-100) to byte (0-255), rounded. Used for both saturation and value.
+    const uint8_t kPercentToByte[101] PROGMEM = {
+          0,   3,   5,   8,  10,  13,  15,  18,  20,  23,  26,  28,  31,  33,  36,  38,
+         41,  43,  46,  48,  51,  54,  56,  59,  61,  64,  66,  69,  71,  74,  77,  79,
+         82,  84,  87,  89,  92,  94,  97,  99, 102, 105, 107, 110, 112, 115, 117, 120,
+        122, 125, 128, 130, 133, 135, 138, 140, 143, 145, 148, 150, 153, 156, 158, 161,
+        163, 166, 168, 171, 173, 176, 179, 181, 184, 186, 189, 191, 194, 196, 199, 201,
+        204, 207, 209, 212, 214, 217, 219, 222, 224, 227, 230, 232, 235, 237, 240, 242,
+        245, 247, 250, 252, 255
+    };
+
+    // hue (0-360) to position on the color wheel in 1/256 sectors (0-1535). 360 wraps to 0.
+    const uint16_t kHueToPosition[361] PROGMEM = {
+           0,    4,    9,   13,   17,   21,   26,   30,   34,   38,   43,   47,
+          51,   55,   60,   64,   68,   73,   77,   81,   85,   90,   94,   98,
+         102,  107,  111,  115,  119,  124,  128,  132,  137,  141,  145,  149,
+         154,  158,  162,  166,  171,  175,  179,  183,  188,  192,  196,  201,
+         205,  209,  213,  218,  222,  226,  230,  235,  239,  243,  247,  252,
+         256,  260,  265,  269,  273,  277,  282,  286,  290,  294,  299,  303,
+         307,  311,  316,  320,  324,  329,  333,  337,  341,  346,  350,  354,
+         358,  363,  367,  371,  375,  380,  384,  388,  393,  397,  401,  405,
+         410,  414,  418,  422,  427,  431,  435,  439,  444,  448,  452,  457,
+         461,  465,  469,  474,  478,  482,  486,  491,  495,  499,  503,  508,
+         512,  516,  521,  525,  529,  533,  538,  542,  546,  550,  555,  559,
+         563,  567,  572,  576,  580,  585,  589,  593,  597,  602,  606,  610,
+         614,  619,  623,  627,  631,  636,  640,  644,  649,  653,  657,  661,
+         666,  670,  674,  678,  683,  687,  691,  695,  700,  704,  708,  713,
+         717,  721,  725,  730,  734,  738,  742,  747,  751,  755,  759,  764,
+         768,  772,  777,  781,  785,  789,  794,  798,  802,  806,  811,  815,
+         819,  823,  828,  832,  836,  841,  845,  849,  853,  858,  862,  866,
+         870,  875,  879,  883,  887,  892,  896,  900,  905,  909,  913,  917,
+         922,  926,  930,  934,  939,  943,  947,  951,  956,  960,  964,  969,
+         973,  977,  981,  986,  990,  994,  998, 1003, 1007, 1011, 1015, 1020,
+        1024, 1028, 1033, 1037, 1041, 1045, 1050, 1054, 1058, 1062, 1067, 1071,
+        1075, 1079, 1084, 1088, 1092, 1097, 1101, 1105, 1109, 1114, 1118, 1122,
+        1126, 1131, 1135, 1139, 1143, 1148, 1152, 1156, 1161, 1165, 1169, 1173,
+        1178, 1182, 1186, 1190, 1195, 1199, 1203, 1207, 1212, 1216, 1220, 1225,
+        1229, 1233, 1237, 1242, 1246, 1250, 1254, 1259, 1263, 1267, 1271, 1276,
+        1280, 1284, 1289, 1293, 1297, 1301, 1306, 1310, 1314, 1318, 1323, 1327,
+        1331, 1335, 1340, 1344, 1348, 1353, 1357, 1361, 1365, 1370, 1374, 1378,
+        1382, 1387, 1391, 1395, 1399, 1404, 1408, 1412, 1417, 1421, 1425, 1429,
+        1434, 1438, 1442, 1446, 1451, 1455, 1459, 1463, 1468, 1472, 1476, 1481,
+        1485, 1489, 1493, 1498, 1502, 1506, 1510, 1515, 1519, 1523, 1527, 1532,
+           0
+    };
+
+    // gamma 2.2, so steps in value look equally large
+    const uint8_t kGamma[256] PROGMEM = {
+          0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+          3,   3,   3,   3,   3,   4,   4,   4,   4,   5,   5,   5,   5,   6,   6,   6,
+          6,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,  10,  11,  11,  11,  12,
+         12,  13,  13,  13,  14,  14,  15,  15,  16,  16,  17,  17,  18,  18,  19,  19,
+         20,  20,  21,  22,  22,  23,  23,  24,  25,  25,  26,  26,  27,  28,  28,  29,
+         30,  30,  31,  32,  33,  33,  34,  35,  35,  36,  37,  38,  39,  39,  40,  41,
+         42,  43,  43,  44,  45,  46,  47,  48,  49,  49,  50,  51,  52,  53,  54,  55,
+         56,  57,  58,  59,  60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  70,  71,
+         73,  74,  75,  76,  77,  78,  79,  81,  82,  83,  84,  85,  87,  88,  89,  90,
+         91,  93,  94,  95,  97,  98,  99, 100, 102, 103, 105, 106, 107, 109, 110, 111,
+        113, 114, 116, 117, 119, 120, 121, 123, 124, 126, 127, 129, 130, 132, 133, 135,
+        137, 138, 140, 141, 143, 145, 146, 148, 149, 151, 153, 154, 156, 158, 159, 161,
+        163, 165, 166, 168, 170, 172, 173, 175, 177, 179, 181, 182, 184, 186, 188, 190,
+        192, 194, 196, 197, 199, 201, 203, 205, 207, 209, 211, 213, 215, 217, 219, 221,
+        223, 225, 227, 229, 231, 234, 236, 238, 240, 242, 244, 246, 248, 251, 253, 255
+    };
+
+    // The same gamma 2.2 in 8.8 fixed point, so full is 0xFF00 and the low byte is the part between two 8 bit levels.
+    // The dithering turns that part into how often the next level is shown.
+    const uint16_t kGamma16[256] PROGMEM = {
+            0,     0,     2,     4,     7,    11,    17,    24,    32,    42,    53,    65,
+           78,    94,   110,   128,   148,   169,   191,   216,   241,   269,   298,   328,
+          360,   394,   430,   467,   506,   547,   589,   633,   679,   726,   776,   827,
+          880,   934,   991,  1049,  1109,  1171,  1235,  1300,  1368,  1437,  1508,  1581,
+         1656,  1733,  1812,  1893,  1975,  2060,  2146,  2235,  2325,  2417,  2512,  2608,
+         2706,  2806,  2908,  3013,  3119,  3227,  3337,  3450,  3564,  3680,  3798,  3919,
+         4041,  4166,  4292,  4421,  4552,  4685,  4819,  4956,  5096,  5237,  5380,  5525,
+         5673,  5823,  5974,  6128,  6284,  6442,  6603,  6765,  6930,  7097,  7266,  7437,
+         7610,  7786,  7963,  8143,  8325,  8509,  8696,  8885,  9075,  9268,  9464,  9661,
+         9861, 10063, 10267, 10474, 10682, 10893, 11107, 11322, 11540, 11760, 11982, 12207,
+        12433, 12663, 12894, 13128, 13363, 13602, 13842, 14085, 14330, 14578, 14827, 15080,
+        15334, 15591, 15850, 16111, 16375, 16641, 16909, 17180, 17453, 17729, 18006, 18287,
+        18569, 18854, 19141, 19431, 19723, 20017, 20314, 20613, 20915, 21218, 21525, 21833,
+        22144, 22458, 22774, 23092, 23413, 23736, 24062, 24390, 24720, 25053, 25388, 25726,
+        26066, 26408, 26753, 27101, 27451, 27803, 28158, 28515, 28875, 29237, 29602, 29969,
+        30338, 30710, 31085, 31462, 31841, 32223, 32608, 32995, 33384, 33776, 34170, 34567,
+        34967, 35369, 35773, 36180, 36589, 37001, 37416, 37833, 38252, 38674, 39099, 39526,
+        39956, 40388, 40823, 41260, 41700, 42142, 42587, 43034, 43484, 43937, 44392, 44849,
+        45310, 45772, 46238, 46706, 47176, 47649, 48125, 48603, 49084, 49567, 50053, 50542,
+        51033, 51526, 52023, 52522, 53023, 53527, 54034, 54543, 55055, 55570, 56087, 56607,
+        57129, 57654, 58182, 58712, 59245, 59780, 60318, 60859, 61402, 61948, 62497, 63048,
+        63602, 64159, 64718, 65280
+    };
+
+    // rounded x / 255 for x up to 255 * 255, without a division
+    inline uint8_t div255(const uint16_t x) {
+        const uint32_t rounded = x + 128U;
+        return static_cast<uint8_t>((rounded + (rounded >> 8)) >> 8);
+    }
+
+    // rounded a * b / 65536
+    inline uint32_t scale16(const uint32_t a, const uint32_t b) {
+        return (a * b + 0x8000U) >> 16;
+    }
+
+    // a linear 8.8 level (full is 0xFF00) through the gamma 2.2 table, interpolating between its entries
+    inline uint16_t gamma16_of(const uint16_t level) {
+        const uint8_t index = level >> 8;
+        const uint16_t low = pgm_read_word(&kGamma16[index]);
+        if (index == 255) return low;
+        const uint16_t high = pgm_read_word(&kGamma16[index + 1]);
+        return static_cast<uint16_t>(low + (((high - low) * static_cast<uint32_t>(level & 0xFF) + 0x80) >> 8));
+    }
+}
+
+namespace color {
+    RgbPixel hsv_to_rgb(const HsvPixel& pixel) {
+        const uint8_t value = pgm_read_byte(&kPercentToByte[pixel.value > 100 ? 100 : pixel.value]);
+        const uint8_t saturation = pgm_read_byte(&kPercentToByte[pixel.saturation > 100 ? 100 : pixel.saturation]);
+        if (saturation == 0) return { value, value, value };
+
+        const uint16_t position = pgm_read_word(&kHueToPosition[pixel.hue > 360 ? 360 : pixel.hue]);
+        const uint8_t sector = position >> 8;
+        const uint8_t fraction = position & 0xFF;
+
+        const uint8_t p = div255(value * (255 - saturation));
+        const uint8_t q = div255(value * (255 - div255(saturation * fraction)));
+        const uint8_t t = div255(value * (255 - div255(saturation * (255 - fraction))));
+
+        switch (sector) {
+            case 0: return { value, t, p };
+            case 1: return { q, value, p };
+            case 2: return { p, value, t };
+            case 3: return { p, q, value };
+            case 4: return { t, p, value };
+            default: return { value, p, q };
+        }
+    }
+
+    void hsv_to_rgb(const HsvPixel* pixels, RgbPixel* output, const uint16_t count) {
+        for (uint16_t i = 0; i < count; i++) {
+            const RgbPixel rgb = hsv_to_rgb(pixels[i]);
+            output[i] = { gamma(rgb.red), gamma(rgb.green), gamma(rgb.blue) };
+        }
+    }
+
+    // The same conversion in fixed point: value as an 8.8 level, saturation and the position in the sector in 1/65536.
+    // Going through 8 bits first would leave only the 256 levels of the gamma table, which is what dithering is for.
+    void hsv_to_rgb16(const HsvPixel* pixels, Rgb16Pixel* output, const uint16_t count) {
+        for (uint16_t i = 0; i < count; i++) {
+            const HsvPixel& pixel = pixels[i];
+            // percent * 0xFF00 / 100 and percent * 65535 / 100 (capped, so the products below stay within 32 bits)
+            const auto value = static_cast<uint16_t>(((pixel.value > 100 ? 100 : pixel.value) * 167117U + 128) >> 8);
+            const uint32_t saturation = std::min<uint32_t>(((pixel.saturation > 100 ? 100 : pixel.saturation) * 167772U + 128) >> 8, 0xFFFF);
+            if (saturation == 0) {
+                const uint16_t level = gamma16_of(value);
+                output[i] = { level, level, level };
+                continue;
+            }
+            const uint16_t hue = pixel.hue >= 360 ? 0 : pixel.hue;
+            const uint8_t sector = pgm_read_word(&kHueToPosition[hue]) >> 8;
+            // degrees into the sector * 65536 / 60
+            const uint32_t fraction = ((hue - 60U * sector) * 69905U + 32) >> 6;
+
+            const uint16_t v = gamma16_of(value);
+            const uint16_t p = gamma16_of(static_cast<uint16_t>(scale16(value, 0x10000 - saturation)));
+            const uint16_t q = gamma16_of(static_cast<uint16_t>(scale16(value, 0x10000 - scale16(saturation, fraction))));
+            const uint16_t t = gamma16_of(static_cast<uint16_t>(scale16(value, 0x10000 - scale16(saturation, 0x10000 - fraction))));
+
+            switch (sector) {
+                case 0: output[i] = { v, t, p }; break;
+                case 1: output[i] = { q, v, p }; break;
+                case 2: output[i] = { p, v, t }; break;
+                case 3: output[i] = { p, q, v }; break;
+                case 4: output[i] = { t, p, v }; break;
+                default: output[i] = { v, p, q }; break;
+            }
+        }
+    }
+
+    // First order sigma-delta per channel: the part that didn't make it into this frame is added to the next one.
+    // Over 256 frames the average level is exact to 1/256 of a step.
+    bool dither(const Rgb16Pixel* pixels, uint8_t* errors, RgbPixel* output, const uint16_t count, const uint8_t minFraction) {
+        bool isDithering = false;
+        // one channel: at most 0xFF00 + 0xFF, so nothing overflows and the result is at most 255
+        const auto channel = [minFraction, &isDithering](const uint16_t level, uint8_t& error) -> uint8_t {
+            const uint8_t fraction = level & 0xFF;
+            if (fraction < minFraction || 256 - fraction < minFraction) {
+                return static_cast<uint8_t>((level + 0x80) >> 8);
+            }
+            isDithering = true;
+            const uint16_t sum = level + error;
+            error = sum & 0xFF;
+            return static_cast<uint8_t>(sum >> 8);
+        };
+        for (uint16_t i = 0; i < count; i++) {
+            const Rgb16Pixel& pixel = pixels[i];
+            uint8_t* error = errors + 3 * i;
+            output[i] = { channel(pixel.red, error[0]), channel(pixel.green, error[1]), channel(pixel.blue, error[2]) };
+        }
+        return isDithering;
+    }
+
+    uint8_t gamma(const uint8_t level) {
+        return pgm_read_byte(&kGamma[level]);
+    }
+
+    uint16_t gamma16(const uint8_t level) {
+        return pgm_read_word(&kGamma16[level]);
+    }
+}
@@ -0,0 +1,43 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+
+// Integer HSV to RGB conversion. The ESP8266 has no FPU, so the float HsbColor path of NeoPixelBus
+// is expensive once every pixel of every frame needs converting. The divisions are replaced by tables in flash.
+
+#ifndef HEADER_COLOR_CONVERSION
+#define HEADER_COLOR_CONVERSION
+
+#include <cstdint>
+#include "Pixel.h"
+
+namespace color {
+    // Converts without gamma correction. Stays within two steps (of 255) of the rounded HsbColor float conversion.
+    RgbPixel hsv_to_rgb(const HsvPixel& pixel);
+
+    // Converts a whole frame in one go, gamma corrected for the LEDs
+    void hsv_to_rgb(const HsvPixel* pixels, RgbPixel* output, uint16_t count);
+
+    // As above, but keeps the gamma corrected levels at 16 bits (8.8 fixed point, full is 0xFF00) for dither().
+    // Converts in fixed point without rounding to 8 bits on the way, to within 4/256 of a step of the exact levels.
+    void hsv_to_rgb16(const HsvPixel* pixels, Rgb16Pixel* output, uint16_t count);
+
+    // Temporal dithering to 8 bits. errors has 3 bytes per pixel, carried from frame to frame.
+    // A level is only dithered if its part between two 8 bit levels (in 1/256) is at least minFraction away from both,
+    // as otherwise the next level shows too rarely and flickers. Other levels are rounded to 8 bits.
+    // Returns true if a level was dithered, i.e. the next frame can differ.
+    bool dither(const Rgb16Pixel* pixels, uint8_t* errors, RgbPixel* output, uint16_t count, uint8_t minFraction);
+
+    uint8_t gamma(uint8_t level);
+    uint16_t gamma16(uint8_t level);
+}
+
+#endif
@@ -14,121 +14,193 @@
 #include "Utilities.h"
 
 using utilities::clamp;
+using utilities::parse_ints;
+using utilities::snprintf_t;
 
-Controller::Controller(LedRingDriver* ledDriver, FirmwareManager* fwManager, MqttDriver* mqtt, const char* version)
-    : _ledDriver(ledDriver), _fwManager(fwManager), _currentFirmwareVersion(version), _mqtt(mqtt) {}
-
-void Controller::addStateSink(LedStateSink* sink) {
-    if (_sinkCount < kMaxSinks) {
-        _sinks[_sinkCount++] = {.sink = sink, .pending = true };
-    } 
+Controller::Controller(LedRingDriver* ledDriver, FirmwareManager* fwManager, MqttDriver* mqtt, PresetStore* presets,
+                       SinkEntry* sinks, const uint8_t sinkCount, const char* version)
+    : _sinks(sinks), _sinkCount(sinkCount), _ledDriver(ledDriver), _fwManager(fwManager), _currentFirmwareVersion(version), _mqtt(mqtt), _presets(presets) {
+    for (uint8_t i = 0; i < _sinkCount; i++) {
+        if (_sinks[i].policy == CommitPolicy::Immediate) _immediateSinks |= 1UL << i;
+    }
 }
 
-void Controller::beginLed(const LedState& ledState) {
+void Controller::beginLed(const LedState* ledStates) {
     _ledDriver->begin();
-    _newState = ledState;
+    for (uint8_t i = 0; i < kSegmentCount; i++) {
+        _newState[i] = ledStates[i];
+    }
     commitNewState();
 }
 
+void Controller::joinGroups(GroupStore* groups) {
+    _groups = groups;
+    _mqtt->setGroups(groups);
+    publishGroups();
+}
+
 void Controller::listenToMqtt() {
-    _mqtt->setReceivedPropertyCallback([this](const char* node, const char* property, const char* payload) {
-        this->handleMqttMessage(node, property, payload);
-    });
-    Serial.println("Setting OTA state Idle");
+    _mqtt->setPropertyHandler(SettableProperty::Color, MqttPropertyHandler::bind<&Controller::processColor>(this));
+    _mqtt->setPropertyHandler(SettableProperty::Mode, MqttPropertyHandler::bind<&Controller::processMode>(this));
+    _mqtt->setPropertyHandler(SettableProperty::Scene, MqttPropertyHandler::bind<&Controller::processScene>(this));
+    _mqtt->setPropertyHandler(SettableProperty::StorePreset, MqttPropertyHandler::bind<&Controller::processPresetStore>(this));
+    _mqtt->setPropertyHandler(SettableProperty::RecallPreset, MqttPropertyHandler::bind<&Controller::processPresetRecall>(this));
+    _mqtt->setPropertyHandler(SettableProperty::DeletePreset, MqttPropertyHandler::bind<&Controller::processPresetDelete>(this));
+    _mqtt->setPropertyHandler(SettableProperty::FirmwareUpdate, MqttPropertyHandler::bind<&Controller::processFirmwareUpdate>(this));
+    if (_groups != nullptr) {
+        _mqtt->setPropertyHandler(SettableProperty::Groups, MqttPropertyHandler::bind<&Controller::processGroups>(this));
+    }
+    _fwManager->setProgressHandler(FirmwareProgressHandler::bind<&Controller::processFirmwareProgress>(this));
+    LOG_DEBUG("Setting OTA state Idle");
     setOtaStatus(kOtaStatusIdle);
 }
 
-void Controller::loop() {
-    processPendingSinks();
-    _mqtt->loop();
-    
-    if (_newState != _committedState) {
-        Serial.printf("Committing new state %d, %d, %d\n", _newState.hue, _newState.saturation, _newState.value);
-        commitNewState();
-    }
-    if (strlen(_firmwareVersionRequested) > 0) {
-        Serial.printf("Processing OTA request for %s\n", _firmwareVersionRequested);
-        processOtaRequest();
-    }
+void Controller::schedule(TaskScheduler* scheduler) {
+    _scheduler = scheduler;
+    _renderTask = scheduler->add(TaskScheduler::Task::bind<&Controller::runRender>(this));
+    _commitTask = scheduler->add(TaskScheduler::Task::bind<&Controller::runCommit>(this));
+    _sinkTask = scheduler->add(TaskScheduler::Task::bind<&Controller::runSinks>(this));
+    scheduler->add(TaskScheduler::Task::bind<&Controller::runMqtt>(this));
+    if (_realtime != nullptr) scheduler->add(TaskScheduler::Task::bind<&Controller::runRealtime>(this));
 }
 
 // *** private methods ***
 
-// this will set the leds, commit to flash and publish to mqtt
+// This sets the leds right away. Slower sinks like flash and MQTT are done later by processPendingSinks.
 void Controller::commitNewState() {
-    if (_committedState == _newState) return;
+    uint8_t changedSegments = 0;
+    for (uint8_t segment = 0; segment < kSegmentCount; segment++) {
+        if (_committedState[segment] == _newState[segment]) continue;
+        const LedState& state = _newState[segment];
+        LOG_DEBUG("Committing new state %d, %d, %d to segment %d", state.hue, state.saturation, state.value, segment);
+        _committedState[segment] = state;
+        changedSegments |= 1 << segment;
+        _ledDriver->setTransition(segment, _transitionMillis[segment]);
+    }
+    // a scene that didn't change anything must not fade a later change
+    memset(_transitionMillis, 0, sizeof(_transitionMillis));
+    _lastStateChange = millis();
+    if (changedSegments == 0) return;
 
-    for (auto& entry : _sinks) {
-          Serial.println("Committing to sink");
-          if (!commitSingleSink(&entry, _newState)) {
-            Serial.print("Setting pending");
-            entry.pending = true;
-        }
+    for (uint8_t i = 0; i < _sinkCount; i++) {
+        _sinks[i].pendingSegments |= changedSegments;
+        _pendingSinks |= 1UL << i;
+    }
+    // only visit the immediate sinks, lowest bit first
+    for (uint32_t immediate = _pendingSinks & _immediateSinks; immediate != 0; immediate &= immediate - 1) {
+        commitSingleSink(static_cast<uint8_t>(__builtin_ctz(immediate)));
     }
-    _committedState = _newState;
-    Serial.printf("_sinks[2].pending = %d\n", _sinks[2].pending);
 }
 
-bool Controller::commitSingleSink(SinkEntry* entry, const LedState& ledState) {
-    if (entry->sink->acceptsUpdate()) {
-        Serial.println("Accepts update");
-        entry->sink->onStateCommitted(ledState);
-        entry->pending = false;
-        return true;
+// Pushes the segments the sink doesn't have yet
+bool Controller::commitSingleSink(const uint8_t index) {
+    SinkEntry& entry = _sinks[index];
+    if (entry.accepts != nullptr && !entry.accepts(entry.sink)) {
+        LOG_DEBUG("Does not accept update");
+        return false;
     }
-    Serial.print("Does not accept update");
-    return false;
+    for (uint8_t pending = entry.pendingSegments; pending != 0; pending &= pending - 1) {
+        const uint8_t segment = static_cast<uint8_t>(__builtin_ctz(pending));
+        entry.commit(entry.sink, segment, _committedState[segment]);
+    }
+    entry.pendingSegments = 0;
+    _pendingSinks &= ~(1UL << index);
+    entry.lastCommit = millis();
+    return true;
+}
+
+bool Controller::isDue(const SinkEntry& entry, const unsigned long now) const {
+    return millisUntilDue(entry, now) == 0;
 }
 
-// callback 
-void Controller::handleMqttMessage(const char* node, const char* property, const char* payload) {
-    if (!node) return;
-    Serial.printf("Handing Mqtt message node=%s property=%s payload=%s\n", node, property, payload);
-    if (strcmp(node, kLedNode) == 0) {
-        Serial.printf("Processing led property %s\n", property);
-        processLedProperty(property, payload);
-    } else if (strcmp(node, kFirmwareNode) == 0) {
-        Serial.printf("Processing fw property %s\n", property);
-        processFirmwareProperty(property, payload);
+bool Controller::parsePreset(const char* payload, const size_t length, uint8_t& preset) {
+    int value;
+    if (parse_ints(payload, length, &value, 1) != 1 || value < 0 || value >= PresetStore::kPresetCount) {
+        LOG_WARNING("Ignoring invalid preset number");
+        return false;
     }
+    preset = static_cast<uint8_t>(value);
+    return true;
 }
 
-void Controller::processFirmwareProperty(const char* property, const char* payload) {
-    if (!property) return;
-    if (strcmp(property, kUpdateProperty) == 0) {
-        // copy over the version as an indication there is work to be done
-        strlcpy(_firmwareVersionRequested, payload, sizeof(_firmwareVersionRequested));
-        setOtaStatus(kOtaStatusPending);
-        // publish back the reqested version to MQTT (topic without /set) to indicate work in progress
-        _mqtt->publishFirmwareProperty(kUpdateProperty, payload);
+unsigned long Controller::millisUntilDue(const SinkEntry& entry, const unsigned long now) const {
+    unsigned long elapsed;
+    switch (entry.policy) {
+        case CommitPolicy::RateLimited:
+            elapsed = now - entry.lastCommit;
+            break;
+        case CommitPolicy::Debounced:
+            elapsed = now - _lastStateChange;
+            break;
+        default:
+            // an immediate sink that didn't accept the update yet
+            return 0;
     }
+    return elapsed >= entry.interval ? 0 : entry.interval - elapsed;
 }
 
-void Controller::processLedProperty(const char* property, const char* payload) {
+bool Controller::hasNewState() const {
+    for (uint8_t segment = 0; segment < kSegmentCount; segment++) {
+        if (_newState[segment] != _committedState[segment]) return true;
+    }
+    return false;
+}
+
+// *** MQTT property handlers ***
+
+void Controller::processColor(const uint8_t segment, const char* payload, const size_t length) {
     // Only HSV externally
-    if (strcmp(property, kColorProperty) == 0) {
-        int h, s, v;
-        if (sscanf(payload, "%d,%d,%d", &h, &s, &v) == 3) {
-            _newState.hue = clamp(h, 0, 360);
-            _newState.saturation = clamp(s, 0, 100);
-            _newState.value = clamp(v, 0, 100);
-        }
-    } else if (strcmp(property, "mode") == 0) {
-        const long mode = strtol(payload, nullptr, 10);
-        _newState.mode = clamp(static_cast<uint8_t>(mode), 0, 255);
+    int hsv[3];
+    if (parse_ints(payload, length, hsv, 3) == 3) {
+        LedState& newState = _newState[segment];
+        newState.hue = clamp(hsv[0], 0, 360);
+        newState.saturation = clamp(hsv[1], 0, 100);
+        newState.value = clamp(hsv[2], 0, 100);
+        requestCommit();
+    }
+}
+
+// The download blocks the loop, so this publishes right away, and keeps the log going
+void Controller::processFirmwareProgress(const uint8_t percent) {
+    char status[kOtaStatusBufferSize];
+    if (snprintf_t(status, "%s %u%%", kOtaStatusUpdating, percent)) {
+        _mqtt->publishFirmwareProperty(kStatusProperty, status);
+    }
+    _mqtt->flush();
+    utilities::logger::drain();
+}
+
+void Controller::processFirmwareUpdate(uint8_t, const char* payload, const size_t length) {
+    // copy over the version as an indication there is work to be done
+    const size_t copyLength = std::min(length, sizeof(_firmwareVersionRequested) - 1);
+    memcpy(_firmwareVersionRequested, payload, copyLength);
+    _firmwareVersionRequested[copyLength] = '\0';
+    setOtaStatus(kOtaStatusPending);
+    // publish back the reqested version to MQTT (topic without /set) to indicate work in progress
+    _mqtt->publishFirmwareProperty(kUpdateProperty, _firmwareVersionRequested);
+}
+
+void Controller::processMode(const uint8_t segment, const char* payload, const size_t length) {
+    int mode;
+    if (parse_ints(payload, length, &mode, 1) == 1) {
+        _newState[segment].mode = clamp(mode, 0, 255);
+        requestCommit();
     }
 }
 
 void Controller::processOtaRequest() {
-    Serial.printf("Processing OTA request '%s' (now '')", _firmwareVersionRequested, _currentFirmwareVersion);
-    if (_firmwareVersionRequested && strcmp(_firmwareVersionRequested, _currentFirmwareVersion) == 0) {
+    LOG_INFO("Processing OTA request '%s' (now '%s')", _firmwareVersionRequested, _currentFirmwareVersion);
+    if (strcmp(_firmwareVersionRequested, _currentFirmwareVersion) == 0) {
         // Already current, so reset request
-        Serial.println("Already current. Setting OTA state Idle");
+        LOG_DEBUG("Already current. Setting OTA state Idle");
         setOtaStatus(kOtaStatusIdle, "Already current");
         return;
     }
 
     setOtaStatus(kOtaStatusUpdating);
+    // the download blocks the loop until it fails or restarts, so publish and log what's waiting now
+    _mqtt->flush();
+    utilities::logger::flush();
     if (!_fwManager->update(_firmwareVersionRequested)) {
         // The update failed, reset request
         // It might have marked the state lost, so mark ready again
@@ -142,19 +214,145 @@ void Controller::processOtaRequest() {
     // Does not return if successful (reboots)
 }
 
-void Controller::processPendingSinks() {
-    
-    for (auto& entry : _sinks) {
-      if (entry.pending) {
-          commitSingleSink(&entry, _committedState);
-      }
-  }
+// Commits at most one sink per call, so slow sinks don't add up in a single pass
+void Controller::processPendingSinks(const unsigned long now) {
+    if (_pendingSinks == 0) return;
+    for (uint8_t i = 0; i < _sinkCount; i++) {
+        const uint8_t index = (_nextPendingSink + i) % _sinkCount;
+        if (!isPending(index) || !isDue(_sinks[index], now)) continue;
+        _nextPendingSink = (index + 1) % _sinkCount;
+        commitSingleSink(index);
+        return;
+    }
+}
+
+// Color, mode and transition in one message, so they are committed, persisted and published together
+void Controller::processScene(const uint8_t segment, const char* payload, const size_t length) {
+    // hue, saturation, value, mode and optionally the transition time
+    int values[5];
+    const size_t count = parse_ints(payload, length, values, 5);
+    if (count < 4) {
+        LOG_WARNING("Ignoring invalid scene");
+        return;
+    }
+    LedState& newState = _newState[segment];
+    newState.hue = clamp(values[0], 0, 360);
+    newState.saturation = clamp(values[1], 0, 100);
+    newState.value = clamp(values[2], 0, 100);
+    newState.mode = clamp(values[3], 0, 255);
+    _transitionMillis[segment] = count == 5 ? clamp(values[4], 0, kMaxTransitionMillis) : 0;
+    requestCommit();
+}
+
+// Commands to a group arrive via the same handlers as the device's own, and the resulting state is published
+// by the rate limited MQTT sink like any other change. So every member reports once, to its own topics.
+void Controller::processGroups(uint8_t, const char* payload, const size_t length) {
+    // The payload is in the MQTT client's buffer, and unsubscribing reuses that. So parse it into a copy first.
+    GroupStore::GroupList groups;
+    if (!GroupStore::parse(payload, length, groups)) {
+        LOG_WARNING("Invalid groups '%.*s'", static_cast<int>(length), payload);
+        return;
+    }
+    _mqtt->leaveGroups();
+    if (_groups->set(groups)) {
+        LOG_INFO("Groups set (writes %u, erases %u)", _groups->writes(), _groups->erases());
+    } else {
+        LOG_ERROR("Could not store the groups");
+    }
+    _mqtt->joinGroups();
+    publishGroups();
+}
+
+void Controller::processPresetDelete(const uint8_t segment, const char* payload, const size_t length) {
+    uint8_t preset;
+    if (!parsePreset(payload, length, preset)) return;
+    _presets->remove(preset);
+    LOG_INFO("Deleted preset %d (segment %d)", preset, segment);
+}
+
+void Controller::processPresetRecall(const uint8_t segment, const char* payload, const size_t length) {
+    uint8_t preset;
+    if (!parsePreset(payload, length, preset)) return;
+    // goes through the normal commit path, so the leds, flash and MQTT follow as with any other change
+    if (!_presets->recall(preset, _newState[segment])) {
+        LOG_WARNING("Preset %d not found", preset);
+        return;
+    }
+    LOG_INFO("Recalled preset %d into segment %d in %lu us (reads %u, writes %u, erases %u)",
+        preset, segment, _presets->lastRecallMicros(), _presets->reads(), _presets->writes(), _presets->erases());
+    requestCommit();
+}
+
+// Stores the latest requested state, so a color set in the same tick is included
+void Controller::processPresetStore(const uint8_t segment, const char* payload, const size_t length) {
+    uint8_t preset;
+    if (!parsePreset(payload, length, preset)) return;
+    if (_presets->store(preset, _newState[segment])) {
+        LOG_INFO("Stored segment %d as preset %d", segment, preset);
+    }
+}
+
+void Controller::publishGroups() {
+    char list[GroupStore::kMaxListSize];
+    static_assert(sizeof(list) <= sizeof(QueuedMessage::payload), "Group list doesn't fit in a queued message");
+    if (_groups->serialize(list, sizeof(list))) {
+        _mqtt->publishDeviceProperty(kGroupsProperty, list);
+    }
+}
+
+// Called by the MQTT handlers when they changed the new state, so it's committed in the same scheduler pass
+void Controller::requestCommit() {
+    if (_scheduler != nullptr) _scheduler->trigger(_commitTask);
+}
+
+unsigned long Controller::runCommit(unsigned long) {
+    if (hasNewState()) {
+        commitNewState();
+        // a pending push, and the sinks' due times, may have changed
+        _scheduler->trigger(_renderTask);
+        _scheduler->trigger(_sinkTask);
+    }
+    return TaskScheduler::kIdle;
+}
+
+unsigned long Controller::runMqtt(unsigned long) {
+    _mqtt->loop();
+    if (strlen(_firmwareVersionRequested) > 0) {
+        LOG_INFO("Processing OTA request for %s", _firmwareVersionRequested);
+        processOtaRequest();
+    }
+    return kMqttPollInterval * 1000UL;
+}
+
+unsigned long Controller::runRealtime(unsigned long) {
+    // a frame may wait for the end of the push period, and the animations restart when the stream ends
+    if (_realtime->loop()) _scheduler->trigger(_renderTask);
+    return _realtime->microsUntilDue();
+}
+
+unsigned long Controller::runRender(unsigned long) {
+    static_assert(LedRingDriver::kNothingDue == TaskScheduler::kIdle, "Nothing due should mean idle");
+    _ledDriver->loop();
+    return _ledDriver->microsUntilDue();
+}
+
+// Commits one due sink per run, and runs again when the next pending one is due
+unsigned long Controller::runSinks(unsigned long) {
+    const unsigned long now = millis();
+    processPendingSinks(now);
+    unsigned long wait = TaskScheduler::kIdle;
+    for (uint32_t pending = _pendingSinks; pending != 0; pending &= pending - 1) {
+        const SinkEntry& entry = _sinks[__builtin_ctz(pending)];
+        const unsigned long entryWait = entry.policy == CommitPolicy::Immediate ? kRetryInterval : millisUntilDue(entry, now);
+        if (entryWait * 1000UL < wait) wait = entryWait * 1000UL;
+    }
+    return wait;
 }
 
 void Controller::setOtaStatus(const char* status, const char* error) {
     _mqtt->publishFirmwareProperty(kStatusProperty, status);
     if (strcmp(status, kOtaStatusIdle) == 0 || strcmp(status, kOtaStatusFailed) == 0) {
-        Serial.printf("resetting OTA request (status %s)\n", status);
+        LOG_DEBUG("resetting OTA request (status %s)", status);
         _firmwareVersionRequested[0] = 0;
         _mqtt->publishFirmwareProperty(kUpdateProperty, "");
     }
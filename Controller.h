@@ -13,30 +13,44 @@
 #define HEADER_CONTROLLER
 
 #include "LedRingDriver.h"
+#include "LedRingConfig.h"
 #include "FirmwareManager.h"
+#include "GroupStore.h"
 #include "LedState.h"
 #include "LedStateSink.h"
 #include "MqttDriver.h"
-
-struct SinkEntry {
-    LedStateSink* sink;
-    bool pending;
-};
+#include "PresetStore.h"
+#include "RealtimeReceiver.h"
+#include "TaskScheduler.h"
 
 class Controller {
 public:
-    Controller(LedRingDriver* ledDriver, FirmwareManager* fwManager, MqttDriver* mqtt, const char* version);
-    static constexpr uint8_t kMaxSinks = 3;
-    void addStateSink(LedStateSink* sink);
-    void beginLed(const LedState& ledState);
-    void listenToMqtt();
-    // Called by MqttDriver when a property setter message arrives
-    void handleMqttMessage(const char* node, const char* property, const char* payload);
+    // pending sinks are tracked in a 32 bit mask
+    static constexpr uint8_t kMaxSinks = 32;
+    static constexpr uint8_t kSegmentCount = led_ring_config::kSegmentCount;
 
-    // Called periodically in loop to handle any pending tasks
-    void loop();
+    // The sinks get the committed states in table order. The table is built with make_sink, and must outlive the Controller.
+    template <size_t SinkCount>
+    Controller(LedRingDriver* ledDriver, FirmwareManager* fwManager, MqttDriver* mqtt, PresetStore* presets, SinkEntry (&sinks)[SinkCount], const char* version)
+        : Controller(ledDriver, fwManager, mqtt, presets, sinks, SinkCount, version) {
+        static_assert(SinkCount > 0 && SinkCount <= kMaxSinks, "Need between 1 and 32 sinks");
+    }
+    // expects kSegmentCount states
+    void beginLed(const LedState* ledStates);
+    void listenToMqtt();
+    // Makes the device listen to the groups in the store as well, and lets them be set via MQTT. Call before listenToMqtt.
+    void joinGroups(GroupStore* groups);
+    // realtime streams override the committed state while active. Call before schedule.
+    void streamRealtime(RealtimeReceiver* receiver) { _realtime = receiver; }
+    // Adds the tasks for rendering, MQTT, committing new states and the slower sinks. Call after beginLed.
+    void schedule(TaskScheduler* scheduler);
 
  private:
+    Controller(LedRingDriver* ledDriver, FirmwareManager* fwManager, MqttDriver* mqtt, PresetStore* presets, SinkEntry* sinks, uint8_t sinkCount, const char* version);
+    // how often to check for MQTT messages. A message that changes the state triggers a commit right away.
+    static constexpr unsigned long kMqttPollInterval = 20; // ms
+    // when an immediate sink didn't accept an update, try again after this time
+    static constexpr unsigned long kRetryInterval = 50; // ms
     static constexpr int kFirmwareVersionBufferSize = 50;
     static constexpr bool kResetOtaRequest = true;
     static constexpr auto kOtaStatusIdle = "idle";
@@ -44,24 +58,62 @@ public:
     static constexpr auto kOtaStatusUpdating = "updating";
     static constexpr auto kOtaStatusFailed = "failed";
     static constexpr auto kOtaStatusCurrent = "current";
+    static constexpr int kOtaStatusBufferSize = 20;    // e.g. updating 100%
+    static constexpr int kMaxTransitionMillis = 60000;
     void commitNewState();
-    static bool commitSingleSink(SinkEntry* entry, const LedState& ledState);
-    void processFirmwareProperty(const char* property, const char* payload);
-    void processLedProperty(const char* property, const char* payload);
+    bool commitSingleSink(uint8_t index);
+    bool hasNewState() const;
+    bool isDue(const SinkEntry& entry, unsigned long now) const;
+    bool isPending(uint8_t index) const { return (_pendingSinks & (1UL << index)) != 0; }
+    unsigned long millisUntilDue(const SinkEntry& entry, unsigned long now) const;
+    void requestCommit();
+    // scheduled tasks, returning the microseconds until they need to run again
+    unsigned long runCommit(unsigned long nowMicros);
+    unsigned long runMqtt(unsigned long nowMicros);
+    unsigned long runRealtime(unsigned long nowMicros);
+    unsigned long runRender(unsigned long nowMicros);
+    unsigned long runSinks(unsigned long nowMicros);
+    // MQTT property handlers
+    void processColor(uint8_t segment, const char* payload, size_t length);
+    void processFirmwareProgress(uint8_t percent);
+    void processFirmwareUpdate(uint8_t segment, const char* payload, size_t length);
+    void processGroups(uint8_t segment, const char* payload, size_t length);
+    void processMode(uint8_t segment, const char* payload, size_t length);
     void processOtaRequest();
-    void processPendingSinks();
+    void processPendingSinks(unsigned long now);
+    void processScene(uint8_t segment, const char* payload, size_t length);
+    void processPresetDelete(uint8_t segment, const char* payload, size_t length);
+    void processPresetRecall(uint8_t segment, const char* payload, size_t length);
+    void processPresetStore(uint8_t segment, const char* payload, size_t length);
+    static bool parsePreset(const char* payload, size_t length, uint8_t& preset);
+    void publishGroups();
     void setOtaStatus(const char* status, const char* error = "");
 
-    uint8_t _sinkCount = 0;
-    SinkEntry _sinks[kMaxSinks] = { };
+    SinkEntry* _sinks;
+    uint8_t _sinkCount;
+    // bit per sink that doesn't have the committed state yet, and per sink with the Immediate policy
+    uint32_t _pendingSinks = 0;
+    uint32_t _immediateSinks = 0;
     LedRingDriver* _ledDriver;
     FirmwareManager* _fwManager;
     const char* _currentFirmwareVersion;
     char _firmwareVersionRequested[kFirmwareVersionBufferSize] = { 0 };
     MqttDriver* _mqtt;
-    
-    LedState _committedState = {};
-    LedState _newState = {};
+    PresetStore* _presets;
+    GroupStore* _groups = nullptr;
+    RealtimeReceiver* _realtime = nullptr;
+    TaskScheduler* _scheduler = nullptr;
+    uint8_t _commitTask = TaskScheduler::kNoTask;
+    uint8_t _renderTask = TaskScheduler::kNoTask;
+    uint8_t _sinkTask = TaskScheduler::kNoTask;
+    unsigned long _lastStateChange = 0;
+    // index of the next deferred sink to look at, so they take turns
+    uint8_t _nextPendingSink = 0;
+
+    LedState _committedState[kSegmentCount] = {};
+    LedState _newState[kSegmentCount] = {};
+    // transition for the next commit of each segment, set by a scene. Only lasts one commit pass.
+    uint16_t _transitionMillis[kSegmentCount] = {};
 };
 
 #endif
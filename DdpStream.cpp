@@ -0,0 +1,138 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+#include <cstring>
+#include "DdpStream.h"
+
+namespace {
+    // header: flags, sequence, data type, destination id, offset (4 bytes, big endian), length (2 bytes, big endian)
+    constexpr size_t kHeaderSize = 10;
+    constexpr size_t kTimeCodeSize = 4;
+    constexpr uint8_t kVersionMask = 0xC0;
+    constexpr uint8_t kVersion1 = 0x40;
+    constexpr uint8_t kTimeCodeFlag = 0x10;
+    constexpr uint8_t kStorageFlag = 0x08;
+    constexpr uint8_t kReplyFlag = 0x04;
+    constexpr uint8_t kQueryFlag = 0x02;
+    constexpr uint8_t kPushFlag = 0x01;
+    constexpr uint8_t kSequenceMask = 0x0F;
+    constexpr uint8_t kSequenceCount = 15;   // 1-15, 0 means not used
+    constexpr uint8_t kUndefinedType = 0x00;
+    constexpr uint8_t kRgb8Type = 0x0B;
+    constexpr uint8_t kDisplayId = 1;
+    constexpr uint8_t kAllId = 255;
+
+    static_assert(sizeof(RgbPixel) == 3, "DDP data is packed RGB");
+
+    uint32_t read_big_endian(const uint8_t* data, const uint8_t size) {
+        uint32_t value = 0;
+        for (uint8_t i = 0; i < size; i++) value = value << 8 | data[i];
+        return value;
+    }
+}
+
+bool DdpStream::feed(const uint8_t* packet, const size_t length, const unsigned long nowMicros) {
+    if (length < kHeaderSize) return false;
+    const uint8_t flags = packet[0];
+    if ((flags & kVersionMask) != kVersion1) return false;
+    // we don't answer queries or keep configuration
+    if ((flags & (kQueryFlag | kReplyFlag | kStorageFlag)) != 0) return false;
+    const uint8_t type = packet[2];
+    if (type != kUndefinedType && type != kRgb8Type) return false;
+    const uint8_t id = packet[3];
+    if (id != kDisplayId && id != kAllId) return false;
+
+    const size_t dataStart = kHeaderSize + ((flags & kTimeCodeFlag) != 0 ? kTimeCodeSize : 0);
+    const uint32_t offset = read_big_endian(packet + 4, 4);
+    const uint16_t dataLength = static_cast<uint16_t>(read_big_endian(packet + 8, 2));
+    if (length < dataStart + dataLength) return false;
+
+    const uint8_t sequence = packet[1] & kSequenceMask;
+    if (sequence != 0 && _lastSequence != 0) {
+        const uint8_t expected = _lastSequence % kSequenceCount + 1;
+        const uint8_t ahead = static_cast<uint8_t>((sequence - expected + kSequenceCount) % kSequenceCount);
+        // More than half the cycle ahead is more likely a packet that was overtaken by later ones. But if the next
+        // packet follows on from it, more than half a cycle was lost instead, so take up the stream from there.
+        const bool isLate = ahead > kSequenceCount / 2;
+        if (isLate && (_lateSequence == 0 || sequence != _lateSequence % kSequenceCount + 1)) {
+            _latePackets++;
+            _lateSequence = sequence;
+            return true;
+        }
+        // the packet before this one was dropped as late, but it did arrive
+        _gaps += isLate ? ahead - 1 : ahead;
+    }
+    _lastSequence = sequence;
+    _lateSequence = 0;
+    _lastPacket = nowMicros;
+    _hasPackets = true;
+
+    // pixels beyond our LEDs are ignored
+    constexpr size_t kAssemblySize = sizeof(_assembly);
+    if (offset < kAssemblySize) {
+        const size_t copyLength = dataLength < kAssemblySize - offset ? dataLength : kAssemblySize - offset;
+        memcpy(reinterpret_cast<uint8_t*>(_assembly) + offset, packet + dataStart, copyLength);
+    }
+    if ((flags & kPushFlag) != 0) complete(nowMicros);
+    return true;
+}
+
+const RgbPixel* DdpStream::next(const unsigned long nowMicros) {
+    if (_depth == 0 || !isDue(_jitter[_head], nowMicros)) return nullptr;
+    // if more are due we fell behind, so only the newest is worth showing
+    while (_depth > 1 && isDue(_jitter[(_head + 1) % kJitterFrames], nowMicros)) {
+        _head = (_head + 1) % kJitterFrames;
+        _depth--;
+        _skippedFrames++;
+    }
+    memcpy(_shown, _jitter[_head].pixels, sizeof(_shown));
+    _head = (_head + 1) % kJitterFrames;
+    _depth--;
+    _shownFrames++;
+    return _shown;
+}
+
+unsigned long DdpStream::microsUntilDue(const unsigned long nowMicros) const {
+    if (_depth == 0) return kNothingDue;
+    const unsigned long waited = nowMicros - _jitter[_head].arrival;
+    return waited >= kPlayoutDelayMicros ? 0 : kPlayoutDelayMicros - waited;
+}
+
+bool DdpStream::isActive(const unsigned long nowMicros) const {
+    return _hasPackets && nowMicros - _lastPacket < kTimeoutMicros;
+}
+
+void DdpStream::end() {
+    _hasPackets = false;
+    _lastSequence = 0;
+    _lateSequence = 0;
+    _depth = 0;
+}
+
+// *** private methods ***
+
+void DdpStream::complete(const unsigned long nowMicros) {
+    _frames++;
+    if (_depth == kJitterFrames) {
+        // the oldest frame makes room; the sender is faster than we can show
+        _head = (_head + 1) % kJitterFrames;
+        _depth--;
+        _overrunFrames++;
+    }
+    Frame& frame = _jitter[(_head + _depth) % kJitterFrames];
+    memcpy(frame.pixels, _assembly, sizeof(frame.pixels));
+    frame.arrival = nowMicros;
+    _depth++;
+}
+
+bool DdpStream::isDue(const Frame& frame, const unsigned long nowMicros) const {
+    return nowMicros - frame.arrival >= kPlayoutDelayMicros;
+}
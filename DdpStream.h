@@ -0,0 +1,87 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// Assembles realtime frames from DDP packets (Distributed Display Protocol, http://www.3waylabs.com/ddp/).
+// A frame can take several packets; the one with the push flag completes it. Complete frames wait in a small
+// jitter buffer and are played out a fixed delay after they arrived, so uneven arrival doesn't show as stutter.
+// A missing packet leaves its pixels as they were in the previous frame, and is counted as a gap. A packet from
+// before the last one is dropped as late, unless the next packet follows on from it: then a burst of more than half
+// the sequence cycle was lost, and the stream goes on from there.
+// Time is passed in (microseconds) so this can run without Arduino.
+
+#ifndef HEADER_DDP_STREAM
+#define HEADER_DDP_STREAM
+
+#include <cstddef>
+#include <cstdint>
+#include "LedRingConfig.h"
+#include "Pixel.h"
+
+class DdpStream {
+public:
+    static constexpr uint16_t kPort = 4048;
+    static constexpr size_t kMaxPacketSize = 14 + 1440;     // header with time code, and the maximum data size
+    static constexpr uint16_t kLedCount = led_ring_config::kLedCount;
+    // the stream ends if no packets arrive for this long, and the normal output takes over again
+    static constexpr unsigned long kTimeoutMicros = 2500000;
+    // how long complete frames wait before they are shown, to absorb uneven arrival
+    static constexpr unsigned long kPlayoutDelayMicros = 10000;
+    static constexpr uint8_t kJitterFrames = 4;
+
+    // returns false if the packet isn't a DDP data packet for us
+    bool feed(const uint8_t* packet, size_t length, unsigned long nowMicros);
+    // The newest frame that is due, or nullptr if there is none. Older due frames are skipped.
+    // Valid until the next call to feed or next.
+    const RgbPixel* next(unsigned long nowMicros);
+    // 0 if a frame is due, kNothingDue if none is waiting
+    unsigned long microsUntilDue(unsigned long nowMicros) const;
+    bool isActive(unsigned long nowMicros) const;
+    // forgets the stream after it timed out, so a new one starts clean
+    void end();
+
+    static constexpr unsigned long kNothingDue = 0xFFFFFFFFUL;
+
+    uint32_t frames() const { return _frames; }
+    uint32_t shownFrames() const { return _shownFrames; }
+    uint32_t skippedFrames() const { return _skippedFrames; }
+    uint32_t overrunFrames() const { return _overrunFrames; }
+    // missed sequence numbers, and packets that arrived after a later one
+    uint32_t gaps() const { return _gaps; }
+    uint32_t latePackets() const { return _latePackets; }
+
+private:
+    struct Frame {
+        RgbPixel pixels[kLedCount];
+        unsigned long arrival;
+    };
+
+    void complete(unsigned long nowMicros);
+    bool isDue(const Frame& frame, unsigned long nowMicros) const;
+
+    // the frame being assembled starts as a copy of the previous one
+    RgbPixel _assembly[kLedCount] = {};
+    Frame _jitter[kJitterFrames] = {};
+    RgbPixel _shown[kLedCount] = {};
+    uint8_t _head = 0;      // oldest waiting frame
+    uint8_t _depth = 0;
+    uint8_t _lastSequence = 0;  // 0 if the sender doesn't use sequence numbers
+    uint8_t _lateSequence = 0;  // the packet just dropped as late, 0 if the last one wasn't
+    bool _hasPackets = false;
+    unsigned long _lastPacket = 0;
+    uint32_t _frames = 0;
+    uint32_t _shownFrames = 0;
+    uint32_t _skippedFrames = 0;
+    uint32_t _overrunFrames = 0;
+    uint32_t _gaps = 0;
+    uint32_t _latePackets = 0;
+};
+
+#endif
@@ -0,0 +1,61 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// A callback that never allocates, unlike std::function: an object pointer and a function pointer.
+// It is either a plain function (or a lambda without captures), or a member function bound to an object
+// with e.g. MqttPropertyHandler::bind<&Controller::processColor>(this). The object must outlive the delegate.
+
+#ifndef HEADER_DELEGATE
+#define HEADER_DELEGATE
+
+#include <utility>
+
+template <typename Signature>
+class Delegate;
+
+template <typename Result, typename... Arguments>
+class Delegate<Result(Arguments...)> {
+public:
+    using Function = Result (*)(Arguments...);
+
+    constexpr Delegate() = default;
+    // A plain function, or anything that converts to one such as a lambda without captures.
+    // Not explicit, so these convert as they did for std::function.
+    template <typename Callable, typename = decltype(static_cast<Function>(std::declval<Callable>()))>
+    Delegate(Callable callable) : _target(reinterpret_cast<void*>(static_cast<Function>(callable))), _invoke(&invokeFunction) {}
+
+    template <auto Method, typename Target>
+    static constexpr Delegate bind(Target* target) {
+        return Delegate(target, &invokeMethod<Method, Target>);
+    }
+
+    Result operator()(Arguments... arguments) const { return _invoke(_target, arguments...); }
+    explicit operator bool() const { return _invoke != nullptr; }
+
+private:
+    using Invoker = Result (*)(void* target, Arguments... arguments);
+
+    constexpr Delegate(void* target, const Invoker invoke) : _target(target), _invoke(invoke) {}
+
+    static Result invokeFunction(void* target, Arguments... arguments) {
+        return reinterpret_cast<Function>(target)(arguments...);
+    }
+
+    template <auto Method, typename Target>
+    static Result invokeMethod(void* target, Arguments... arguments) {
+        return (static_cast<Target*>(target)->*Method)(arguments...);
+    }
+
+    void* _target = nullptr;
+    Invoker _invoke = nullptr;
+};
+
+#endif
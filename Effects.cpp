@@ -0,0 +1,77 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+#include "Effects.h"
+
+namespace {
+    // Effects are frame based, so these are in frames. At 30 fps a breath takes 4 seconds.
+    constexpr uint32_t kBreathePeriod = 120;
+    constexpr uint32_t kRainbowPeriod = 360;
+    constexpr uint32_t kCometStepFrames = 3;
+    constexpr uint8_t kCometTailLength = 4;
+
+    void render_solid(const LedState& state, uint32_t, HsvPixel* pixels, const uint16_t count) {
+        for (uint16_t i = 0; i < count; i++) {
+            pixels[i] = { state.hue, state.saturation, state.value };
+        }
+    }
+
+    // triangle wave between 10% and 100% of the state's value
+    void render_breathe(const LedState& state, const uint32_t frame, HsvPixel* pixels, const uint16_t count) {
+        constexpr uint32_t halfPeriod = kBreathePeriod / 2;
+        const uint32_t phase = frame % kBreathePeriod;
+        const uint32_t level = phase < halfPeriod ? phase : kBreathePeriod - phase;
+        const auto value = static_cast<uint8_t>(state.value * (10 + 90 * level / halfPeriod) / 100);
+        for (uint16_t i = 0; i < count; i++) {
+            pixels[i] = { state.hue, state.saturation, value };
+        }
+    }
+
+    // spreads the full hue circle over the ring and rotates it, starting at the state's hue
+    void render_rainbow(const LedState& state, const uint32_t frame, HsvPixel* pixels, const uint16_t count) {
+        const uint32_t offset = state.hue + frame % kRainbowPeriod * 360 / kRainbowPeriod;
+        for (uint16_t i = 0; i < count; i++) {
+            const auto hue = static_cast<uint16_t>((offset + 360UL * i / count) % 360);
+            pixels[i] = { hue, state.saturation, state.value };
+        }
+    }
+
+    // a single pixel running around the ring with a fading tail
+    void render_comet(const LedState& state, const uint32_t frame, HsvPixel* pixels, const uint16_t count) {
+        if (count == 0) return;
+        const auto head = static_cast<uint16_t>(frame / kCometStepFrames % count);
+        for (uint16_t i = 0; i < count; i++) {
+            const uint16_t distance = (head + count - i) % count;
+            const uint8_t value = distance < kCometTailLength
+                ? static_cast<uint8_t>(state.value * (kCometTailLength - distance) / kCometTailLength)
+                : 0;
+            pixels[i] = { state.hue, state.saturation, value };
+        }
+    }
+
+    // indexed by mode
+    constexpr Effect kEffects[] = {
+        { "solid", render_solid, false },
+        { "breathe", render_breathe, true },
+        { "rainbow", render_rainbow, true },
+        { "comet", render_comet, true }
+    };
+}
+
+namespace effects {
+    const Effect* find(const uint8_t mode) {
+        return mode < count() ? &kEffects[mode] : &kEffects[kSolid];
+    }
+
+    uint8_t count() {
+        return sizeof(kEffects) / sizeof(kEffects[0]);
+    }
+}
@@ -0,0 +1,43 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// Effects render one frame of HSV pixels from the committed LedState and a frame number.
+// They are selected by LedState::mode. There are no Arduino dependencies here so effects can be rendered on a host too.
+
+#ifndef HEADER_EFFECTS
+#define HEADER_EFFECTS
+
+#include <cstdint>
+#include "LedState.h"
+#include "Pixel.h"
+
+using EffectRenderer = void (*)(const LedState& state, uint32_t frame, HsvPixel* pixels, uint16_t count);
+
+struct Effect {
+    const char* name;
+    EffectRenderer render;
+    bool animated;  // static effects only need rendering when the state changes
+};
+
+namespace effects {
+    enum Mode : uint8_t {
+        kSolid = 0,
+        kBreathe = 1,
+        kRainbow = 2,
+        kComet = 3
+    };
+
+    // returns the effect for the mode, or the solid effect if the mode is unknown
+    const Effect* find(uint8_t mode);
+    uint8_t count();
+}
+
+#endif
@@ -9,47 +9,251 @@
 //    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 //    See the License for the specific language governing permissions and limitations under the License.
 
+
 #include <ESP.h>
 #include <ESP8266HTTPClient.h>
-#include <ESP8266httpUpdate.h>
+#include <Updater.h>
 #include <WiFiClient.h>
 
+#include "Backoff.h"
 #include "FirmwareManager.h" 
 #include "Utilities.h"
 
 using utilities::snprintf_t;
-using utilities::build_url;
+
+namespace {
+    constexpr auto kDigestExtension = ".sha256";
+    // the preferred one first; the server decides by having the file or not
+    constexpr const char* kImageExtensions[] = { ".gz", "" };
+    constexpr auto kContentRangeHeader = "Content-Range";
+
+    int hex_value(const char digit) {
+        if (digit >= '0' && digit <= '9') return digit - '0';
+        if (digit >= 'a' && digit <= 'f') return digit - 'a' + 10;
+        if (digit >= 'A' && digit <= 'F') return digit - 'A' + 10;
+        return -1;
+    }
+
+    // expects at least 2 * size hex digits; anything after that (e.g. the file name from sha256sum) is ignored
+    bool parse_hex(const char* text, const size_t length, uint8_t* bytes, const size_t size) {
+        if (length < 2 * size) return false;
+        for (size_t i = 0; i < size; i++) {
+            const int high = hex_value(text[2 * i]);
+            const int low = hex_value(text[2 * i + 1]);
+            if (high < 0 || low < 0) return false;
+            bytes[i] = static_cast<uint8_t>(high << 4 | low);
+        }
+        return true;
+    }
+}
 
 void FirmwareManager::begin(WiFiClient* client, const char* baseUrl, const char* machineId) {
     _client = client;
-    build_url(_baseUrl, sizeof(_baseUrl), baseUrl, machineId);
-	  strlcat(_baseUrl, ".", sizeof(_baseUrl));
+    // a truncated base would fetch from somewhere else, so leave it empty and let update() fail
+    if (!snprintf_t(_baseUrl, "%s%s.", baseUrl, machineId)) {
+        LOG_ERROR("Firmware base URL too long");
+        _baseUrl[0] = '\0';
+    }
 }
 
 bool FirmwareManager::update(const char* version) {
-	  Serial.printf("Updating firmware to %s\n", version);
-	  ESPhttpUpdate.setLedPin(LED_BUILTIN, LOW);
-
-	  char imageUrl[kBaseUrlSize];
-	  build_url(imageUrl, sizeof(imageUrl), _baseUrl, version);
-    Serial.printf("Fetching %s\n", imageUrl);
-
-  	t_httpUpdate_return returnValue = ESPhttpUpdate.update(*_client, imageUrl);
-  
-  	switch(returnValue) {
-    		case HTTP_UPDATE_OK:
-      			// never returns
-      			return true;
-    		case HTTP_UPDATE_FAILED:
-      			snprintf_t(_errorMessage, "%s (%d)", ESPhttpUpdate.getLastErrorString().c_str(), ESPhttpUpdate.getLastError());
-      			Serial.printf("OTA update failed: %s\n", _errorMessage);
-      			return false;
-    
-    		case HTTP_UPDATE_NO_UPDATES:            
-      			// ignore, will not happen as it only occurs when the server returns 304 Not Modified
-           
-    		default:
-      			// should not happen
-    			return true;
-  	}
+    LOG_INFO("Updating firmware to %s", version);
+    if (_baseUrl[0] == '\0') {
+        fail("URL too long");
+        return false;
+    }
+    char imageUrl[kBaseUrlSize];
+    bool isMissing = true;
+    for (const char* extension : kImageExtensions) {
+        char digestUrl[kBaseUrlSize];
+        if (!snprintf_t(imageUrl, "%s%s%s", _baseUrl, version, extension) ||
+            !snprintf_t(digestUrl, "%s%s", imageUrl, kDigestExtension)) {
+            fail("URL too long");
+            return false;
+        }
+        if (fetchDigest(digestUrl, isMissing)) break;
+        if (!isMissing) return false;
+    }
+    if (isMissing) {
+        fail("No SHA-256 digest found");
+        return false;
+    }
+
+    LOG_INFO("Fetching %s", imageUrl);
+    _received = 0;
+    _size = 0;
+    _reportedPercent = 0;
+    br_sha256_init(&_sha);
+    Backoff backoff(kInitialRetryDelay, kMaxRetryDelay);
+    for (uint8_t attempt = 1; ; attempt++) {
+        const DownloadResult result = download(imageUrl);
+        if (result == DownloadResult::Complete) break;
+        if (result == DownloadResult::Failed) {
+            abortImage();
+            return false;
+        }
+        if (attempt >= kMaxAttempts) {
+            abortImage();
+            snprintf_t(_errorMessage, "Interrupted at %u of %u bytes after %u attempts",
+                static_cast<unsigned>(_received), static_cast<unsigned>(_size), attempt);
+            LOG_ERROR("OTA update failed: %s", _errorMessage);
+            return false;
+        }
+        backoff.failed(millis(), ESP.random());
+        LOG_WARNING("Download interrupted at %u of %u bytes, resuming", static_cast<unsigned>(_received), static_cast<unsigned>(_size));
+        while (!backoff.isDue(millis())) {
+            delay(10);
+        }
+    }
+    LOG_INFO("Firmware verified and written, restarting");
+    utilities::logger::flush();
+    delay(100);
+    ESP.restart();
+    return true;
+}
+
+// *** private methods ***
+
+// Not finished, so this discards what was written, and a next begin() starts over
+void FirmwareManager::abortImage() {
+    if (_isImageStarted) Update.end();
+    _isImageStarted = false;
+}
+
+// Continues the download from _received. The SHA-256 is updated as the data comes in,
+// and checked before the last chunk is written, so a bad image is never committed.
+// On failure the image is left as is; update() aborts it.
+FirmwareManager::DownloadResult FirmwareManager::download(const char* url) {
+    HTTPClient http;
+    if (!http.begin(*_client, url)) return fail("Invalid firmware URL");
+    http.setTimeout(kStallTimeout);
+    const char* headers[] = { kContentRangeHeader };
+    http.collectHeaders(headers, 1);
+    if (_received > 0) {
+        char range[32];
+        snprintf_t(range, "bytes=%u-", static_cast<unsigned>(_received));
+        http.addHeader("Range", range);
+    }
+    const int code = http.GET();
+    // no connection; try again
+    if (code < 0) return DownloadResult::Interrupted;
+
+    if (_received == 0) {
+        if (!startImage(code, http.getSize())) return DownloadResult::Failed;
+    } else if (code != HTTP_CODE_PARTIAL_CONTENT || !isExpectedRange(http.header(kContentRangeHeader).c_str())) {
+        // the flash can't be rewound, so we can't start over
+        return fail("Server can't resume the download");
+    }
+
+    WiFiClient* stream = http.getStreamPtr();
+    uint8_t buffer[kChunkSize];
+    unsigned long lastData = millis();
+    while (_received < _size) {
+        const size_t available = stream->available();
+        if (available == 0) {
+            if (!stream->connected() || millis() - lastData >= kStallTimeout) return DownloadResult::Interrupted;
+            delay(1);
+            continue;
+        }
+        const size_t wanted = std::min({ available, sizeof(buffer), _size - _received });
+        const int length = stream->read(buffer, wanted);
+        if (length <= 0) continue;
+        lastData = millis();
+        br_sha256_update(&_sha, buffer, length);
+        _received += length;
+        if (_received == _size) {
+            uint8_t digest[kDigestSize];
+            br_sha256_out(&_sha, digest);
+            if (memcmp(digest, _expectedDigest, kDigestSize) != 0) return fail("SHA-256 digest mismatch");
+        }
+        if (Update.write(buffer, length) != static_cast<size_t>(length)) return failUpdate();
+        reportProgress();
+    }
+    http.end();
+    _isImageStarted = false;
+    if (!Update.end()) return failUpdate();
+    return DownloadResult::Complete;
+}
+
+bool FirmwareManager::fetchDigest(const char* url, bool& isMissing) {
+    isMissing = false;
+    HTTPClient http;
+    if (!http.begin(*_client, url)) {
+        fail("Invalid digest URL");
+        return false;
+    }
+    http.setTimeout(kStallTimeout);
+    const int code = http.GET();
+    if (code == HTTP_CODE_NOT_FOUND) {
+        LOG_INFO("No %s", url);
+        isMissing = true;
+        return false;
+    }
+    if (code != HTTP_CODE_OK) {
+        char message[40];
+        snprintf_t(message, "No SHA-256 digest (HTTP %d)", code);
+        fail(message);
+        return false;
+    }
+    // into a buffer rather than a String; only the start matters. Not more than the file has, so it doesn't wait for a timeout.
+    char text[kDigestTextSize];
+    const int size = http.getSize();
+    const size_t wanted = size > 0 ? std::min(static_cast<size_t>(size), sizeof(text)) : sizeof(text);
+    const size_t length = http.getStreamPtr()->readBytes(text, wanted);
+    http.end();
+    if (!parse_hex(text, length, _expectedDigest, kDigestSize)) {
+        fail("Invalid SHA-256 digest");
+        return false;
+    }
+    return true;
+}
+
+FirmwareManager::DownloadResult FirmwareManager::fail(const char* message) {
+    snprintf_t(_errorMessage, "%s", message);
+    LOG_ERROR("OTA update failed: %s", _errorMessage);
+    return DownloadResult::Failed;
+}
+
+FirmwareManager::DownloadResult FirmwareManager::failUpdate() {
+    char message[32];
+    snprintf_t(message, "Flash update error %u", Update.getError());
+    return fail(message);
+}
+
+// Content-Range: bytes <first>-<last>/<size>, which must continue where we are
+bool FirmwareManager::isExpectedRange(const char* contentRange) const {
+    unsigned long first, last, size;
+    if (sscanf(contentRange, "bytes %lu-%lu/%lu", &first, &last, &size) != 3) return false;
+    return first == _received && size == _size && last + 1 == _size;
+}
+
+void FirmwareManager::reportProgress() {
+    const auto percent = static_cast<uint8_t>(static_cast<uint64_t>(_received) * 100 / _size);
+    if (percent < _reportedPercent + kProgressStep && _received < _size) return;
+    _reportedPercent = percent;
+    if (_progressHandler) _progressHandler(percent);
+}
+
+// the first response, which tells the size
+bool FirmwareManager::startImage(const int code, const int size) {
+    if (code != HTTP_CODE_OK) {
+        char message[40];
+        snprintf_t(message, "Could not fetch image (HTTP %d)", code);
+        fail(message);
+        return false;
+    }
+    // the size is needed for resuming and to know when to check the digest, so no chunked encoding
+    if (size <= 0) {
+        fail("Image size unknown");
+        return false;
+    }
+    // an earlier attempt may have started the image before it got any data
+    abortImage();
+    if (!Update.begin(size)) {
+        failUpdate();
+        return false;
+    }
+    _isImageStarted = true;
+    _size = size;
+    return true;
 }
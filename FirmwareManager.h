@@ -9,25 +9,78 @@
 //    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 //    See the License for the specific language governing permissions and limitations under the License.
 
+
 // Since the device won't be in a place that's easily reachable, we let it update itself via OTA.
 // We use the MQTT $fw/update property to request an update to a specific version.
-// It looks for a specified url: https://base-url/path/device-name.version for the build image (if its current version isn't the same).
+// It looks for a specified url: https://base-url/path/device-name.version for the build image (if its current version isn't the same),
+// and for its SHA-256 digest (as written by sha256sum) at the same url with .sha256 appended.
+// A gzip compressed image (device-name.version.gz, with device-name.version.gz.sha256) is preferred if it exists.
+// It is written to flash as is: the bootloader unpacks it while copying it into place, so there is no
+// decompression window in RAM and the digest is that of the .gz file.
+// The image is streamed into flash in chunks. If the connection drops, the download continues where it stopped
+// with an HTTP Range request, and the new image is only committed if its digest matches.
 
 #ifndef HEADER_FIRMWARE_MANAGER
 #define HEADER_FIRMWARE_MANAGER
 
 #include <WiFiClient.h>
+#include <bearssl/bearssl_hash.h>
+#include "Delegate.h"
+
+// gets the percentage downloaded
+using FirmwareProgressHandler = Delegate<void(uint8_t percent)>;
 
 class FirmwareManager {
 public:
     void begin(WiFiClient* client, const char* baseUrl, const char* machineId);
+    // Does not return if successful (restarts)
     bool update(const char* version);
+    void setProgressHandler(FirmwareProgressHandler handler) { _progressHandler = handler; }
     const char* errorMessage() const { return _errorMessage; }
+    // bytes received of the last update, and its size
+    size_t received() const { return _received; }
+    size_t size() const { return _size; }
 private:
-	  static constexpr int kErrorBufferSize = 255;
-	  static constexpr int kBaseUrlSize = 100;
-	  WiFiClient* _client = nullptr;
+    enum class DownloadResult : uint8_t {
+        Complete,
+        Interrupted,    // worth resuming
+        Failed
+    };
+
+    static constexpr int kErrorBufferSize = 255;
+    static constexpr int kBaseUrlSize = 100;
+    static constexpr size_t kDigestSize = 32;
+    // the hex digest, and a bit of the file name sha256sum adds after it
+    static constexpr size_t kDigestTextSize = 2 * kDigestSize + 8;
+    static constexpr size_t kChunkSize = 1024;
+    static constexpr uint8_t kMaxAttempts = 5;
+    // a connection that doesn't deliver data for this long is considered dropped
+    static constexpr uint16_t kStallTimeout = 5000; // ms
+    static constexpr unsigned long kInitialRetryDelay = 1000; // ms
+    static constexpr unsigned long kMaxRetryDelay = 8000; // ms
+    static constexpr uint8_t kProgressStep = 10; // percent
+
+    void abortImage();
+    DownloadResult download(const char* url);
+    // isMissing tells whether the server doesn't have the digest, e.g. because there is no compressed image
+    bool fetchDigest(const char* url, bool& isMissing);
+    DownloadResult fail(const char* message);
+    // Update's error text is a String, so this reports its error code instead
+    DownloadResult failUpdate();
+    bool isExpectedRange(const char* contentRange) const;
+    void reportProgress();
+    bool startImage(int code, int size);
+
+    WiFiClient* _client = nullptr;
     char _baseUrl[kBaseUrlSize] = { 0 };
     char _errorMessage[kErrorBufferSize] = { 0 }; 
+    FirmwareProgressHandler _progressHandler;
+    uint8_t _expectedDigest[kDigestSize] = {};
+    br_sha256_context _sha = {};
+    size_t _received = 0;
+    size_t _size = 0;
+    uint8_t _reportedPercent = 0;
+    // Update.begin() was called, and the image is neither finished nor aborted
+    bool _isImageStarted = false;
 };
 #endif
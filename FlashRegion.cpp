@@ -0,0 +1,45 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+
+#include <ESP.h>
+#include <flash_hal.h>
+#include "FlashRegion.h"
+
+EspFlashRegion::EspFlashRegion(const uint16_t firstSector, const uint16_t sectorCount)
+    : _firstSector(firstSector), _sectorCount(sectorCount) {}
+
+bool EspFlashRegion::read(const uint32_t offset, uint32_t* data, const size_t size) {
+    if (!isInRange(offset, size)) return false;
+    return ESP.flashRead(FS_PHYS_ADDR + _firstSector * kSectorSize + offset, data, size);
+}
+
+bool EspFlashRegion::write(const uint32_t offset, const uint32_t* data, const size_t size) {
+    if (!isInRange(offset, size)) return false;
+    return ESP.flashWrite(FS_PHYS_ADDR + _firstSector * kSectorSize + offset, data, size);
+}
+
+bool EspFlashRegion::eraseSector(const uint16_t sector) {
+    if (sector >= _sectorCount || !isInPartition()) return false;
+    return ESP.flashEraseSector(FS_PHYS_ADDR / kSectorSize + _firstSector + sector);
+}
+
+bool EspFlashRegion::isInPartition() const {
+    return (_firstSector + _sectorCount) * kSectorSize <= FS_PHYS_SIZE;
+}
+
+// *** private methods ***
+
+bool EspFlashRegion::isInRange(const uint32_t offset, const size_t size) const {
+    const uint32_t regionSize = static_cast<uint32_t>(_sectorCount) * kSectorSize;
+    // also make sure we don't run into the sector after the file system partition
+    return offset % 4 == 0 && size % 4 == 0 && offset <= regionSize && size <= regionSize - offset && isInPartition();
+}
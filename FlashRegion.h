@@ -0,0 +1,73 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+
+// A range of whole flash sectors, with offsets relative to the start of the range.
+// Flash can only be written after erasing, and erases go per 4 KB sector and wear the flash out eventually.
+// Reads and writes must be 4 byte aligned.
+
+#ifndef HEADER_FLASH_REGION
+#define HEADER_FLASH_REGION
+
+#include <cstddef>
+#include <cstdint>
+
+// Which sectors of the file system partition are used for what
+namespace flash_layout {
+    constexpr uint16_t kJournalFirstSector = 0;
+    constexpr uint16_t kJournalSectorCount = 4;
+    // one sector per preset, so the preset number is the index
+    constexpr uint16_t kPresetFirstSector = kJournalFirstSector + kJournalSectorCount;
+    constexpr uint16_t kPresetCount = 16;
+    // the MQTT groups the device is a member of
+    constexpr uint16_t kGroupSector = kPresetFirstSector + kPresetCount;
+    // what the file system partition must at least have
+    constexpr uint16_t kSectorCount = kGroupSector + 1;
+}
+
+class FlashRegion {
+public:
+    static constexpr uint32_t kSectorSize = 4096;
+
+    FlashRegion() = default;
+    FlashRegion(const FlashRegion&) = delete;
+    FlashRegion& operator=(const FlashRegion&) = delete;
+    FlashRegion(FlashRegion&&) = delete;
+    FlashRegion& operator=(FlashRegion&&) = delete;
+
+    virtual ~FlashRegion() = default;
+    virtual uint16_t sectorCount() const = 0;
+    virtual bool read(uint32_t offset, uint32_t* data, size_t size) = 0;
+    virtual bool write(uint32_t offset, const uint32_t* data, size_t size) = 0;
+    virtual bool eraseSector(uint16_t sector) = 0;
+};
+
+// Flash of the ESP8266 itself. We use the file system partition, so the build needs one (e.g. 4MB (FS:2MB)),
+// and the sketch must not use LittleFS/SPIFFS.
+class EspFlashRegion : public FlashRegion {
+public:
+    // firstSector is relative to the start of the file system partition
+    EspFlashRegion(uint16_t firstSector, uint16_t sectorCount);
+    uint16_t sectorCount() const override { return _sectorCount; }
+    // false if the file system partition is too small for the region, e.g. with a flash layout without one
+    bool isInPartition() const;
+    bool read(uint32_t offset, uint32_t* data, size_t size) override;
+    bool write(uint32_t offset, const uint32_t* data, size_t size) override;
+    bool eraseSector(uint16_t sector) override;
+
+private:
+    bool isInRange(uint32_t offset, size_t size) const;
+
+    uint16_t _firstSector;
+    uint16_t _sectorCount;
+};
+
+#endif
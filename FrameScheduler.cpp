@@ -0,0 +1,50 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+#include "FrameScheduler.h"
+
+FrameScheduler::FrameScheduler(const uint16_t framesPerSecond, const unsigned long budgetMicros)
+    : _periodMicros(1000000UL / (framesPerSecond > 0 ? framesPerSecond : 1)), _budgetMicros(budgetMicros) {}
+
+bool FrameScheduler::isDue(const unsigned long nowMicros) {
+    // signed difference so this keeps working when micros() wraps
+    const auto lateness = static_cast<long>(nowMicros - _nextFrameMicros);
+    if (lateness < 0) return false;
+
+    // frames we missed are dropped, but still advance the frame number so animations keep their speed
+    const auto missed = static_cast<uint32_t>(static_cast<unsigned long>(lateness) / _periodMicros);
+    _droppedFrames += missed;
+    _frame += missed + 1;
+    _nextFrameMicros += (missed + 1) * _periodMicros;
+    return true;
+}
+
+unsigned long FrameScheduler::microsUntilDue(const unsigned long nowMicros) const {
+    const auto lateness = static_cast<long>(nowMicros - _nextFrameMicros);
+    return lateness >= 0 ? 0 : static_cast<unsigned long>(-lateness);
+}
+
+void FrameScheduler::frameRendered(const unsigned long startMicros, const unsigned long endMicros) {
+    const unsigned long duration = endMicros - startMicros;
+    _renderedFrames++;
+    if (duration > _maxRenderMicros) _maxRenderMicros = duration;
+    if (duration > _budgetMicros) {
+        // give the time back to the rest of the loop by skipping the next frame
+        _overBudgetFrames++;
+        _droppedFrames++;
+        _frame++;
+        _nextFrameMicros += _periodMicros;
+    }
+}
+
+void FrameScheduler::resume(const unsigned long nowMicros) {
+    _nextFrameMicros = nowMicros;
+}
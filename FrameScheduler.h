@@ -0,0 +1,50 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// Decides when the next animation frame is due, given a target frame rate.
+// If we fall behind we skip frames instead of catching up, so the network stack gets its share of the loop.
+// A frame that took longer than the budget also costs the next frame, for the same reason.
+// Time is passed in (microseconds) so this can run without Arduino.
+
+#ifndef HEADER_FRAME_SCHEDULER
+#define HEADER_FRAME_SCHEDULER
+
+#include <cstdint>
+
+class FrameScheduler {
+public:
+    FrameScheduler(uint16_t framesPerSecond, unsigned long budgetMicros);
+    bool isDue(unsigned long nowMicros);
+    // 0 if a frame is due
+    unsigned long microsUntilDue(unsigned long nowMicros) const;
+    void frameRendered(unsigned long startMicros, unsigned long endMicros);
+    // continue from now, so time without animations doesn't count as dropped frames
+    void resume(unsigned long nowMicros);
+
+    uint32_t frame() const { return _frame; }
+    uint32_t renderedFrames() const { return _renderedFrames; }
+    uint32_t droppedFrames() const { return _droppedFrames; }
+    uint32_t overBudgetFrames() const { return _overBudgetFrames; }
+    unsigned long maxRenderMicros() const { return _maxRenderMicros; }
+    unsigned long periodMicros() const { return _periodMicros; }
+
+private:
+    unsigned long _periodMicros;
+    unsigned long _budgetMicros;
+    unsigned long _nextFrameMicros = 0;
+    uint32_t _frame = 0;
+    uint32_t _renderedFrames = 0;
+    uint32_t _droppedFrames = 0;
+    uint32_t _overBudgetFrames = 0;
+    unsigned long _maxRenderMicros = 0;
+};
+
+#endif
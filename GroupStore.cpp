@@ -0,0 +1,112 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+
+#include <cstring>
+#include "GroupStore.h"
+#include "Utilities.h"
+
+using utilities::copy_string;
+using utilities::crc32;
+using utilities::snprintf_t;
+
+GroupStore::GroupStore() : _flash(flash_layout::kGroupSector, 1) {}
+
+bool GroupStore::begin() {
+    GroupRecord record;
+    const bool isValid = _flash.read(0, reinterpret_cast<uint32_t*>(&record), sizeof(record))
+        && record.magic == kMagic && record.size == sizeof(GroupRecord) && record.crc == crcOf(record) && record.groups.count <= kMaxGroups;
+    if (isValid) _record = record;
+    return isValid && count() > 0;
+}
+
+// the payload is not zero terminated
+bool GroupStore::parse(const char* list, const size_t length, GroupList& groups) {
+    groups = {};
+    if (length == strlen(kNoGroups) && strncmp(list, kNoGroups, length) == 0) return true;
+    size_t start = 0;
+    while (start <= length) {
+        const char* separator = static_cast<const char*>(memchr(list + start, ',', length - start));
+        const size_t end = separator == nullptr ? length : static_cast<size_t>(separator - list);
+        const char* name = list + start;
+        const size_t nameLength = end - start;
+        if (groups.count >= kMaxGroups || !isValidName(name, nameLength)) return false;
+        if (nameLength == strlen(kBroadcastGroup) && strncmp(name, kBroadcastGroup, nameLength) == 0) return false;
+        for (uint8_t i = 0; i < groups.count; i++) {
+            if (strlen(groups.names[i]) == nameLength && strncmp(name, groups.names[i], nameLength) == 0) return false;
+        }
+        memcpy(groups.names[groups.count], name, nameLength);
+        groups.names[groups.count][nameLength] = '\0';
+        groups.count++;
+        start = end + 1;
+    }
+    return true;
+}
+
+bool GroupStore::set(const GroupList& groups) {
+    if (memcmp(&groups, &_record.groups, sizeof(GroupList)) == 0) return true;
+    GroupRecord record = {};
+    record.groups = groups;
+    record.magic = kMagic;
+    record.size = sizeof(GroupRecord);
+    record.crc = crcOf(record);
+
+    if (!rewrite(record)) {
+        // the sector may be erased, so put the old groups back. If that fails too, a restart finds none, so keep none.
+        if (_record.magic == kMagic && !rewrite(_record)) _record = {};
+        return false;
+    }
+    _record = record;
+    return true;
+}
+
+bool GroupStore::isMember(const char* group, const size_t length) const {
+    if (length == strlen(kBroadcastGroup) && strncmp(group, kBroadcastGroup, length) == 0) return true;
+    for (uint8_t i = 0; i < count(); i++) {
+        if (strlen(name(i)) == length && strncmp(group, name(i), length) == 0) return true;
+    }
+    return false;
+}
+
+bool GroupStore::serialize(char* buffer, const size_t size) const {
+    if (count() == 0) return copy_string(buffer, size, kNoGroups);
+    size_t used = 0;
+    for (uint8_t i = 0; i < count(); i++) {
+        if (!snprintf_t(buffer + used, size - used, i == 0 ? "%s" : ",%s", name(i))) return false;
+        used += strlen(buffer + used);
+    }
+    return true;
+}
+
+// *** private methods ***
+
+// erases the sector and writes the record
+bool GroupStore::rewrite(const GroupRecord& record) {
+    if (!_flash.eraseSector(0)) return false;
+    _erases++;
+    if (!_flash.write(0, reinterpret_cast<const uint32_t*>(&record), sizeof(record))) return false;
+    _writes++;
+    return true;
+}
+
+uint32_t GroupStore::crcOf(const GroupRecord& record) {
+    return crc32(&record, offsetof(GroupRecord, crc));
+}
+
+// a Homie ID, so it can be used as a topic level
+bool GroupStore::isValidName(const char* name, const size_t length) {
+    if (length == 0 || length > kMaxNameLength || name[0] == '-') return false;
+    for (size_t i = 0; i < length; i++) {
+        const char c = name[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-')) return false;
+    }
+    return true;
+}
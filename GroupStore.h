@@ -0,0 +1,79 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+
+// The MQTT groups the device is a member of, so one message to homie/$broadcast/<group>/... reaches every member.
+// Set as a comma separated list of Homie IDs (lowercase letters, digits and hyphens), or - to leave all groups.
+// Kept in its own flash sector. Changing the groups is rare, so every change is an erase and a write,
+// and setting the same list again (e.g. a retained set message after reconnecting) doesn't write at all.
+
+#ifndef HEADER_GROUP_STORE
+#define HEADER_GROUP_STORE
+
+#include <cstddef>
+#include <cstdint>
+#include "FlashRegion.h"
+
+class GroupStore {
+public:
+    static constexpr uint8_t kMaxGroups = 4;
+    // so the whole list fits in a published payload
+    static constexpr size_t kMaxNameLength = 15;
+    // every device is in this one, so it can't be set
+    static constexpr auto kBroadcastGroup = "all";
+    static constexpr auto kNoGroups = "-";
+    // the longest list, with separators and terminator
+    static constexpr size_t kMaxListSize = kMaxGroups * (kMaxNameLength + 1);
+
+    struct GroupList {
+        uint8_t count;
+        char names[kMaxGroups][kMaxNameLength + 1];
+    };
+
+    GroupStore();
+    // reads the groups from flash. Returns false if there were none.
+    bool begin();
+    // Copies the names out of the list, so that may be a buffer that gets reused afterwards. It needn't be zero terminated.
+    static bool parse(const char* list, size_t length, GroupList& groups);
+    // Returns false if the groups couldn't be stored. The old ones are written back then; if that fails too,
+    // the device is in no groups, which is also what a restart finds.
+    bool set(const GroupList& groups);
+    uint8_t count() const { return _record.groups.count; }
+    const char* name(uint8_t index) const { return _record.groups.names[index]; }
+    // whether the device listens to the group, which includes the broadcast group. The name needn't be zero terminated.
+    bool isMember(const char* group, size_t length) const;
+    // comma separated, or kNoGroups if there are none
+    bool serialize(char* buffer, size_t size) const;
+
+    uint32_t writes() const { return _writes; }
+    uint32_t erases() const { return _erases; }
+
+private:
+    struct alignas(4) GroupRecord {
+        uint16_t magic;
+        uint16_t size;
+        GroupList groups;
+        uint32_t crc;
+    };
+
+    static constexpr uint16_t kMagic = 0x4752;
+
+    static uint32_t crcOf(const GroupRecord& record);
+    bool rewrite(const GroupRecord& record);
+    static bool isValidName(const char* name, size_t length);
+
+    EspFlashRegion _flash;
+    GroupRecord _record = {};
+    uint32_t _writes = 0;
+    uint32_t _erases = 0;
+};
+
+#endif
@@ -0,0 +1,123 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+
+#include <cstring>
+#include "Journal.h"
+#include "Utilities.h"
+
+using utilities::crc32;
+
+Journal::Journal(FlashRegion* flash, const uint16_t payloadSize)
+    : _flash(flash), _payloadSize(payloadSize) {
+    // flash writes go per 4 bytes
+    _recordSize = static_cast<uint16_t>((sizeof(RecordHeader) + payloadSize + sizeof(uint32_t) + 3) & ~3U);
+    _recordsPerSector = static_cast<uint16_t>(FlashRegion::kSectorSize / _recordSize);
+}
+
+bool Journal::begin(void* payload) {
+    _scanReads = 0;
+    _nextSlot = 0;
+    _nextSequence = 1;
+    _needsErase = true;
+    if (_recordSize > kMaxRecordSize || _flash->sectorCount() == 0) return false;
+    uint32_t buffer[kMaxRecordSize / sizeof(uint32_t)];
+    const auto* header = reinterpret_cast<const RecordHeader*>(buffer);
+
+    // The sector that was started last has the highest sequence number in its first slot. If writing that slot
+    // failed, the records after it still count, so then the first valid one is used.
+    bool found = false;
+    uint16_t newestSector = 0;
+    uint32_t newestSequence = 0;
+    for (uint16_t sector = 0; sector < _flash->sectorCount(); sector++) {
+        const uint32_t sectorStart = static_cast<uint32_t>(sector) * _recordsPerSector;
+        SlotState state = readSlot(sectorStart, buffer);
+        for (uint32_t slot = 1; state == SlotState::Invalid && slot < _recordsPerSector; slot++) {
+            state = readSlot(sectorStart + slot, buffer);
+        }
+        if (state != SlotState::Valid) continue;
+        if (!found || header->sequence > newestSequence) {
+            found = true;
+            newestSector = sector;
+            newestSequence = header->sequence;
+        }
+    }
+    // Nothing there (or something else). Start at the beginning, erasing first.
+    if (!found) return false;
+
+    // Records are written in order, so the used slots of a sector come first. Find the first erased one.
+    const uint32_t firstSlot = static_cast<uint32_t>(newestSector) * _recordsPerSector;
+    uint32_t low = 1;
+    uint32_t high = _recordsPerSector;
+    while (low < high) {
+        const uint32_t middle = (low + high) / 2;
+        if (readSlot(firstSlot + middle, buffer) == SlotState::Erased) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+
+    // The last record may have been cut short by a reset, so take the newest one that is valid.
+    // The sector has a valid record, so this ends.
+    uint32_t slot = firstSlot + low - 1;
+    while (readSlot(slot, buffer) != SlotState::Valid) slot--;
+    memcpy(payload, reinterpret_cast<const uint8_t*>(buffer) + sizeof(RecordHeader), _payloadSize);
+    _nextSequence = header->sequence + 1;
+
+    // continue after the used slots, in the next sector if this one is full
+    _nextSlot = (firstSlot + low) % slotCount();
+    _needsErase = low >= _recordsPerSector;
+    return true;
+}
+
+bool Journal::append(const void* payload) {
+    if (_recordSize > kMaxRecordSize || _flash->sectorCount() == 0) return false;
+    if (_needsErase) {
+        if (!_flash->eraseSector(static_cast<uint16_t>(_nextSlot / _recordsPerSector))) return false;
+        _erases++;
+        _needsErase = false;
+    }
+
+    uint32_t buffer[kMaxRecordSize / sizeof(uint32_t)] = {};
+    auto* bytes = reinterpret_cast<uint8_t*>(buffer);
+    const RecordHeader header = { _nextSequence, kMagic, _payloadSize };
+    memcpy(bytes, &header, sizeof(header));
+    memcpy(bytes + sizeof(header), payload, _payloadSize);
+    const uint32_t crc = crc32(bytes, sizeof(header) + _payloadSize);
+    memcpy(bytes + sizeof(header) + _payloadSize, &crc, sizeof(crc));
+
+    const bool written = _flash->write(offsetOf(_nextSlot), buffer, _recordSize);
+    // Move on even if the write failed; the slot is no longer erased, and begin() skips invalid records.
+    _nextSequence++;
+    _nextSlot = (_nextSlot + 1) % slotCount();
+    _needsErase = _nextSlot % _recordsPerSector == 0;
+    if (written) _writes++;
+    return written;
+}
+
+// *** private methods ***
+
+uint32_t Journal::offsetOf(const uint32_t slot) const {
+    return slot / _recordsPerSector * FlashRegion::kSectorSize + slot % _recordsPerSector * _recordSize;
+}
+
+Journal::SlotState Journal::readSlot(const uint32_t slot, uint32_t* buffer) {
+    _scanReads++;
+    if (!_flash->read(offsetOf(slot), buffer, _recordSize)) return SlotState::Invalid;
+    const auto* header = reinterpret_cast<const RecordHeader*>(buffer);
+    if (header->sequence == kErased) return SlotState::Erased;
+    if (header->magic != kMagic || header->payloadSize != _payloadSize) return SlotState::Invalid;
+    uint32_t crc;
+    const auto* bytes = reinterpret_cast<const uint8_t*>(buffer);
+    memcpy(&crc, bytes + sizeof(RecordHeader) + _payloadSize, sizeof(crc));
+    return crc == crc32(bytes, sizeof(RecordHeader) + _payloadSize) ? SlotState::Valid : SlotState::Invalid;
+}
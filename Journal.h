@@ -0,0 +1,69 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+
+// Append-only log of fixed size records in a flash region, to spread the wear over several sectors.
+// Every record has a sequence number and a CRC. A sector is only erased when the log moves into it,
+// so with N sectors of R records each, a sector gets erased once every N * R writes instead of on every write.
+// At boot we read the first record of each sector to find the newest sector, and then binary search within it.
+// A sector whose first record failed to write is read on to its first valid one.
+
+#ifndef HEADER_JOURNAL
+#define HEADER_JOURNAL
+
+#include <cstdint>
+#include "FlashRegion.h"
+
+class Journal {
+public:
+    // header, payload and CRC, so this limits the payload to 52 bytes
+    static constexpr uint16_t kMaxRecordSize = 64;
+
+    Journal(FlashRegion* flash, uint16_t payloadSize);
+    // Finds the newest valid record and copies its payload. Returns false if the journal is empty.
+    bool begin(void* payload);
+    bool append(const void* payload);
+
+    uint16_t recordSize() const { return _recordSize; }
+    uint32_t erases() const { return _erases; }
+    uint32_t writes() const { return _writes; }
+    // flash reads the last begin() needed
+    uint32_t scanReads() const { return _scanReads; }
+
+private:
+    struct RecordHeader {
+        uint32_t sequence;      // all ones if the slot is still erased
+        uint16_t magic;
+        uint16_t payloadSize;
+    };
+
+    static constexpr uint16_t kMagic = 0x4A52;
+    static constexpr uint32_t kErased = 0xFFFFFFFF;
+
+    enum class SlotState : uint8_t { Erased, Invalid, Valid };
+
+    uint32_t offsetOf(uint32_t slot) const;
+    SlotState readSlot(uint32_t slot, uint32_t* buffer);
+    uint32_t slotCount() const { return static_cast<uint32_t>(_recordsPerSector) * _flash->sectorCount(); }
+
+    FlashRegion* _flash;
+    uint16_t _payloadSize;
+    uint16_t _recordSize;
+    uint16_t _recordsPerSector;
+    uint32_t _nextSlot = 0;
+    uint32_t _nextSequence = 1;
+    bool _needsErase = true;    // whether the sector of _nextSlot must be erased before writing to it
+    uint32_t _erases = 0;
+    uint32_t _writes = 0;
+    uint32_t _scanReads = 0;
+};
+
+#endif
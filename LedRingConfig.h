@@ -0,0 +1,73 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+
+// Wiring of the LED rings. Rings are daisy chained on one output pin, and each ring (segment) 
+// has its own state and Homie node. Everything is known at compile time so buffers can be sized statically.
+// Change kSegments for other ring sizes, e.g. { { "led", 24 } } or { { "led", 16 }, { "led2", 60 } }.
+
+#ifndef HEADER_LED_RING_CONFIG
+#define HEADER_LED_RING_CONFIG
+
+#include <cstdint>
+#include <cstring>
+#ifdef ARDUINO
+#include <NeoPixelBus.h>
+#endif
+
+struct LedSegment {
+    const char* node;   // Homie node name, e.g. led
+    uint16_t ledCount;
+};
+
+namespace led_ring_config {
+#ifdef ARDUINO
+    // Tried FastLED first, but got interference issues with WiFi. NeoPixelBus is more stable.
+    // NeoEsp8266BitBang800KbpsMethod allows for a chosen GPIO port (unlike some other methods requiring the TX pin).
+    using ColorFeature = NeoGrbFeature;
+    using OutputMethod = NeoEsp8266BitBang800KbpsMethod;
+
+    // D5 is GPIO14
+    constexpr uint8_t kOutputPin = D5;
+#endif
+    // the segment layout below is plain C++, so code that only needs the sizes also builds without the Arduino core
+
+    // the first segment keeps the node name 'led' so existing subscribers keep working
+    constexpr LedSegment kSegments[] = {
+        { "led", 12 }
+    };
+
+    constexpr uint8_t kSegmentCount = sizeof(kSegments) / sizeof(kSegments[0]);
+    constexpr uint8_t kNoSegment = 0xFF;
+
+    // pending segments are tracked in a byte
+    static_assert(kSegmentCount > 0 && kSegmentCount <= 8, "Need between 1 and 8 segments");
+
+    constexpr uint16_t segment_offset(const uint8_t segment) {
+        uint16_t offset = 0;
+        for (uint8_t i = 0; i < segment && i < kSegmentCount; i++) {
+            offset += kSegments[i].ledCount;
+        }
+        return offset;
+    }
+
+    constexpr uint16_t kLedCount = segment_offset(kSegmentCount);
+
+    // returns kNoSegment if the node is not a LED segment
+    inline uint8_t find_segment(const char* node) {
+        for (uint8_t i = 0; i < kSegmentCount; i++) {
+            if (strcmp(node, kSegments[i].node) == 0) return i;
+        }
+        return kNoSegment;
+    }
+}
+
+#endif
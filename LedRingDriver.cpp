@@ -9,42 +9,204 @@
 //    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 //    See the License for the specific language governing permissions and limitations under the License.
 
-#include "LedRingDriver.h"
-#include "Utilities.h"
 
-using utilities::scale_clamped;
+#include "LedRingDriver.h"
+#include "ColorConversion.h"
+#include "Logger.h"
+#include "Stats.h"
 
-// D5 is GPIO14
-static constexpr uint8_t kGpioPort = D5;
-static constexpr uint16_t kLedCount = 12;
+using led_ring_config::ColorFeature;
+using led_ring_config::OutputMethod;
+using led_ring_config::kOutputPin;
+using led_ring_config::segment_offset;
 
-// Tried FastLED first, but got interference issues with WiFi. NeoPixelBus is more stable.
-// NeoEsp8266BitBang800KbpsMethod allows for a chosen GPIO port (unlike some other methods requiring the TX pin).
+// The bit-bang method disables interrupts during Show(), so we only push frames that differ from what the LEDs 
+// already show, and at most once per push period: the frame period, the dither period while dithering,
+// or the realtime period while streaming.
 
-NeoPixelBus<NeoGrbFeature, NeoEsp8266BitBang800KbpsMethod> ledring(kLedCount, kGpioPort);
+NeoPixelBus<ColorFeature, OutputMethod> ledring(LedRingDriver::kLedCount, kOutputPin);
 
 void LedRingDriver::begin() {
+    for (auto& segment : _segments) {
+        segment.effect = effects::find(effects::kSolid);
+    }
+    // different starting errors, so pixels with the same level don't all switch in the same frame
+    for (uint16_t i = 0; i < sizeof(_ditherErrors); i++) {
+        _ditherErrors[i] = static_cast<uint8_t>(i * 97);
+    }
     ledring.Begin();
     ledring.Show();
+    const unsigned long now = micros();
+    // allow the first frame to be pushed right away
+    _lastPushMicros = now - _scheduler.periodMicros();
+    _scheduler.resume(now);
 }
 
-void LedRingDriver::onStateCommitted(const LedState& state) {
-    renderSolidHsv(state);
+void LedRingDriver::loop() {
+    // a realtime stream replaces the rendered frames, so don't spend time on them
+    if (!_isRealtime && isAnimated() && _scheduler.isDue(micros())) {
+        const unsigned long start = micros();
+        for (uint8_t i = 0; i < kSegmentCount; i++) {
+            if (isAnimated(_segments[i])) renderSegment(i);
+        }
+        requestPush();
+        _scheduler.frameRendered(start, micros());
+        reportDroppedFrames();
+    }
+    // a frame coalesced earlier may be due now
+    push();
 }
 
-void LedRingDriver::renderSolidHsv(const LedState& ledState) {
+unsigned long LedRingDriver::microsUntilDue() const {
+    const unsigned long now = micros();
+    unsigned long wait = !_isRealtime && isAnimated() ? _scheduler.microsUntilDue(now) : kNothingDue;
+    if (_pushPending || _isDithering) {
+        const unsigned long sincePush = now - _lastPushMicros;
+        const unsigned long pushWait = sincePush >= pushPeriodMicros() ? 0 : pushPeriodMicros() - sincePush;
+        if (pushWait < wait) wait = pushWait;
+    }
+    return wait;
+}
 
-    char colorBuffer[50];
-    ledState.serializeHsv(colorBuffer, sizeof(colorBuffer));
-    Serial.printf("In: %s; ", colorBuffer);
-    HsbColor color(
-        scale_clamped(ledState.hue, 0, 360, 0.0f, 1.0f),
-        scale_clamped(ledState.saturation, 0, 100, 0.0f, 1.0f),
-        scale_clamped(ledState.value, 0, 100, 0.0f, 1.0f));
-    Serial.printf("Out: %.3f, %.3f, %.3f\n", color.H, color.S, color.B);
+void LedRingDriver::onStateCommitted(const uint8_t segment, const LedState& state) {
+    if (segment >= kSegmentCount) return;
+    Segment& target = _segments[segment];
+    const Effect* effect = effects::find(state.mode);
+    if (effect != target.effect) {
+        LOG_INFO("Switching %s to effect '%s'", led_ring_config::kSegments[segment].node, effect->name);
+        // don't count the time without animations as dropped frames
+        if (effect->animated && !isAnimated()) _scheduler.resume(micros());
+        target.effect = effect;
+        target.startFrame = _scheduler.frame();
+    }
+    if (target.transitionMillis > 0) {
+        const uint16_t offset = segment_offset(segment);
+        memcpy(_fadeFrom + offset, _output + offset, led_ring_config::kSegments[segment].ledCount * sizeof(Rgb16Pixel));
+        if (!isAnimated()) _scheduler.resume(micros());
+        const uint32_t frames = static_cast<uint32_t>(target.transitionMillis) * kFramesPerSecond / 1000;
+        target.fadeFrames = static_cast<uint16_t>(std::max<uint32_t>(frames, 1));
+        target.fadeStartFrame = _scheduler.frame();
+        target.transitionMillis = 0;
+    } else {
+        target.fadeFrames = 0;
+    }
+    target.state = state;
+    // render right away so a state change doesn't wait for the next frame
+    renderSegment(segment);
+    requestPush();
+}
+
+void LedRingDriver::showRealtime(const RgbPixel* pixels) {
+    _isRealtime = true;
+    memcpy(_realtime, pixels, sizeof(_realtime));
+    requestPush();
+}
+
+void LedRingDriver::endRealtime() {
+    if (!_isRealtime) return;
+    _isRealtime = false;
+    // animations continue from now rather than counting the stream as dropped frames
+    _scheduler.resume(micros());
+    requestPush();
+}
+
+void LedRingDriver::setTransition(const uint8_t segment, const uint16_t millis) {
+    if (segment >= kSegmentCount) return;
+    _segments[segment].transitionMillis = millis;
+}
+
+// *** private methods ***
+
+// Mixes the fade's start pixels into the freshly rendered ones, with a weight that moves to the rendered pixels per frame
+void LedRingDriver::blendFade(const uint8_t segment) {
+    Segment& source = _segments[segment];
+    const uint32_t elapsed = _scheduler.frame() - source.fadeStartFrame;
+    if (elapsed >= source.fadeFrames) {
+        source.fadeFrames = 0;
+        return;
+    }
+    const int32_t weight = static_cast<int32_t>((elapsed << 8) / source.fadeFrames);
+    const uint16_t offset = segment_offset(segment);
+    const uint16_t count = led_ring_config::kSegments[segment].ledCount;
+    for (uint16_t i = offset; i < offset + count; i++) {
+        const Rgb16Pixel& from = _fadeFrom[i];
+        Rgb16Pixel& to = _output[i];
+        to.red = static_cast<uint16_t>(from.red + (((to.red - from.red) * weight) >> 8));
+        to.green = static_cast<uint16_t>(from.green + (((to.green - from.green) * weight) >> 8));
+        to.blue = static_cast<uint16_t>(from.blue + (((to.blue - from.blue) * weight) >> 8));
+    }
+}
+
+bool LedRingDriver::isAnimated() const {
+    for (const auto& segment : _segments) {
+        if (isAnimated(segment)) return true;
+    }
+    return false;
+}
+
+unsigned long LedRingDriver::pushPeriodMicros() const {
+    if (_isRealtime) return kRealtimePushPeriodMicros;
+    return _isDithering ? kDitherPeriodMicros : _scheduler.periodMicros();
+}
+
+void LedRingDriver::push() {
+    if (!_pushPending && !_isDithering) return;
+    const unsigned long now = micros();
+    if (now - _lastPushMicros < pushPeriodMicros()) return;
+
+    // a dither tick is not a requested push, so it doesn't count as avoided when unchanged
+    const bool isRequested = _pushPending;
+    _pushPending = false;
+    const RgbPixel* source = _realtime;
+    if (_isRealtime) {
+        _isDithering = false;
+    } else {
+        constexpr auto minFraction = static_cast<uint8_t>(std::min<unsigned long>(kMinDitherFraction, kNoDithering));
+        _isDithering = color::dither(_output, _ditherErrors, _dithered, kLedCount, minFraction);
+        source = _dithered;
+    }
+    if (memcmp(source, _pushed, sizeof(_pushed)) == 0) {
+        if (isRequested) _unchangedPushes++;
+        // the next dithered frame can differ, so look again one dither period from now
+        if (_isDithering) _lastPushMicros = now;
+        return;
+    }
     for (uint16_t i = 0; i < kLedCount; i++) {
-        ledring.SetPixelColor(i, color);
+        const RgbPixel& pixel = source[i];
+        ledring.SetPixelColor(i, RgbColor(pixel.red, pixel.green, pixel.blue));
+    }
+    {
+        STATS_TIME(Stage::LedShow);
+        ledring.Show();
     }
+    memcpy(_pushed, source, sizeof(_pushed));
+    _lastPushMicros = now;
+    _pushes++;
+}
 
-    ledring.Show();
+void LedRingDriver::renderSegment(const uint8_t segment) {
+    const Segment& source = _segments[segment];
+    const uint16_t offset = segment_offset(segment);
+    const uint16_t count = led_ring_config::kSegments[segment].ledCount;
+    source.effect->render(source.state, _scheduler.frame() - source.startFrame, _frame + offset, count);
+    color::hsv_to_rgb16(_frame + offset, _output + offset, count);
+    if (source.fadeFrames != 0) blendFade(segment);
+}
+
+void LedRingDriver::reportDroppedFrames() {
+    const uint32_t dropped = _scheduler.droppedFrames();
+    if (dropped == _reportedDroppedFrames) return;
+    const unsigned long now = millis();
+    if (now - _lastDropReport < kDropReportInterval) return;
+    LOG_WARNING("Dropped %u frames (total %u of %u, max render %lu us)",
+        dropped - _reportedDroppedFrames, dropped, _scheduler.renderedFrames(), _scheduler.maxRenderMicros());
+    _reportedDroppedFrames = dropped;
+    _lastDropReport = now;
+}
+
+void LedRingDriver::requestPush() {
+    // a frame that was never pushed is replaced by this one
+    if (_pushPending) _coalescedPushes++;
+    _pushPending = true;
+    push();
 }
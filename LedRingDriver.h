@@ -12,16 +12,110 @@
 #ifndef HEADER_LEDDRIVER
 #define HEADER_LEDDRIVER
 
-#include <NeoPixelBus.h>
+#include <algorithm>
+#include <climits>
+#include "Effects.h"
+#include "FrameScheduler.h"
+#include "LedRingConfig.h"
 #include "LedState.h"
-#include "LedStateSink.h"
 
-class LedRingDriver: public LedStateSink {
+// While a level is between two 8 bit levels, frames are pushed faster so the dithering averages out without visible
+// flicker. Show() disables interrupts for about 30 us per LED, so longer rings get a lower rate, keeping Show() at
+// a quarter of the time at most.
+namespace dither_timing {
+    constexpr unsigned long kMinPeriodMicros = 2500;
+    constexpr unsigned long period_micros(const uint16_t ledCount) {
+        return std::max(kMinPeriodMicros, 4 * (30UL * ledCount + 50));
+    }
+
+    // A level between two 8 bit levels shows the nearer one most of the time and the other in pulses. Those pulses must
+    // come at least this often, or they are seen as flicker; levels too close to an 8 bit level are rounded instead.
+    // So e.g. 12 LEDs (400 Hz) dither fractions from 39/256 up to 217/256, but 60 LEDs (135 Hz) only from 114 to 142,
+    // 29 of the 255 levels between two 8 bit levels. From 68 LEDs on, nothing dithers and the ring shows 8 bit levels.
+    constexpr unsigned long kMinPulseHz = 60;
+    constexpr unsigned long min_fraction(const uint16_t ledCount) {
+        return (kMinPulseHz * 256 * period_micros(ledCount) + 999999) / 1000000;
+    }
+}
+
+class LedRingDriver {
 public:
+    static constexpr uint16_t kLedCount = led_ring_config::kLedCount;
+    static constexpr uint8_t kSegmentCount = led_ring_config::kSegmentCount;
+    static constexpr uint16_t kFramesPerSecond = 30;
+    // realtime streams can push faster than the effects render
+    static constexpr unsigned long kRealtimePushPeriodMicros = 10000;
+    static constexpr unsigned long kDitherPeriodMicros = dither_timing::period_micros(kLedCount);
+    static constexpr unsigned long kMinDitherFraction = dither_timing::min_fraction(kLedCount);
+    // for rings where no fraction can be dithered without flicker
+    static constexpr uint8_t kNoDithering = 129;
+    static constexpr unsigned long kFrameBudgetMicros = 5000;
+    // returned by microsUntilDue() if there is nothing to do until the state changes
+    static constexpr unsigned long kNothingDue = ULONG_MAX;
+
     void begin();
-    void renderSolidHsv(const LedState& ledState);
-    bool acceptsUpdate() override { return true; }
-    void onStateCommitted(const LedState& state) override;
+    // Renders the next frame of animated effects, and pushes a pending frame, when due. Run as a scheduled task by the Controller.
+    void loop();
+    // when loop() needs to run again: the next animation frame, or the end of the frame period for a pending push
+    unsigned long microsUntilDue() const;
+    void onStateCommitted(uint8_t segment, const LedState& state);
+    // Fades the segment from what it shows now to the next committed state, instead of switching right away. 0 switches.
+    void setTransition(uint8_t segment, uint16_t millis);
+    // Shows a frame of kLedCount pixels from a realtime stream instead of the committed state, until endRealtime
+    void showRealtime(const RgbPixel* pixels);
+    void endRealtime();
+    bool isRealtime() const { return _isRealtime; }
+    const FrameScheduler& scheduler() const { return _scheduler; }
+
+    // Show() calls done, and the ones avoided because the frame didn't change or was replaced within the frame period
+    uint32_t pushes() const { return _pushes; }
+    uint32_t unchangedPushes() const { return _unchangedPushes; }
+    uint32_t coalescedPushes() const { return _coalescedPushes; }
+    uint32_t avoidedPushes() const { return _unchangedPushes + _coalescedPushes; }
+
+private:
+    static constexpr unsigned long kDropReportInterval = 10000; // ms
+
+    struct Segment {
+        LedState state;
+        const Effect* effect;
+        uint32_t startFrame;    // effects start at frame 0 when selected
+        uint16_t transitionMillis;  // for the next committed state
+        uint16_t fadeFrames;        // 0 if not fading
+        uint32_t fadeStartFrame;
+    };
+
+    void blendFade(uint8_t segment);
+    bool isAnimated() const;
+    unsigned long pushPeriodMicros() const;
+    bool isAnimated(const Segment& segment) const { return segment.effect->animated || segment.fadeFrames != 0; }
+    void push();
+    void renderSegment(uint8_t segment);
+    void reportDroppedFrames();
+    void requestPush();
+
+    Segment _segments[kSegmentCount] = {};
+    HsvPixel _frame[kLedCount] = {};
+    // gamma corrected, 8.8 fixed point
+    Rgb16Pixel _output[kLedCount] = {};
+    // what the fading segments showed when their transition started
+    Rgb16Pixel _fadeFrom[kLedCount] = {};
+    // the dithered output, and per channel what is carried over to the next frame
+    RgbPixel _dithered[kLedCount] = {};
+    uint8_t _ditherErrors[3 * kLedCount] = {};
+    // keeps pushing at the dither period, also without a requested push
+    bool _isDithering = false;
+    RgbPixel _pushed[kLedCount] = {};
+    RgbPixel _realtime[kLedCount] = {};
+    bool _isRealtime = false;
+    bool _pushPending = false;
+    unsigned long _lastPushMicros = 0;
+    uint32_t _pushes = 0;
+    uint32_t _unchangedPushes = 0;
+    uint32_t _coalescedPushes = 0;
+    FrameScheduler _scheduler{kFramesPerSecond, kFrameBudgetMicros};
+    uint32_t _reportedDroppedFrames = 0;
+    unsigned long _lastDropReport = 0;
 };
 
 #endif
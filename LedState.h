@@ -19,7 +19,7 @@ struct LedState {
     uint16_t hue;
     uint8_t saturation;
     uint8_t value;
-    uint8_t mode;   // will be an enum later, 0 = static, 1 = animation, etc.
+    uint8_t mode;   // selects the effect, see effects::Mode. Unknown modes render as solid.
 
     bool operator==(const LedState& other) const;
     bool operator!=(const LedState& other) const;
@@ -9,22 +9,69 @@
 //    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 //    See the License for the specific language governing permissions and limitations under the License.
 
+// A state sink gets the committed state of each segment, e.g. the LEDs, flash or MQTT.
+// Sinks are bound by type when the sink table is built, so there is no virtual base class. A sink has
+//   void onStateCommitted(uint8_t segment, const LedState& state);
+// and, only if it can't always take an update,
+//   bool acceptsUpdate();
+// Sinks without acceptsUpdate are never asked.
+
 #ifndef HEADER_LED_STATE_SINK
 #define HEADER_LED_STATE_SINK
 
+#include <cstdint>
+#include <utility>
 #include "LedState.h"
 
-class LedStateSink {
-public:
-    LedStateSink() = default;
-    LedStateSink(const LedStateSink&) = delete;
-    LedStateSink& operator=(const LedStateSink&) = delete;
-    LedStateSink(LedStateSink&&) = delete;
-    LedStateSink& operator=(LedStateSink&&) = delete;
-
-    virtual ~LedStateSink() = default;
-    virtual void onStateCommitted(const LedState& state) = 0;
-    virtual bool acceptsUpdate();
+// When a sink gets a committed state
+enum class CommitPolicy : uint8_t {
+    Immediate,      // right away, e.g. the LEDs
+    RateLimited,    // at most once per interval, with the latest state, e.g. MQTT
+    Debounced       // once the state hasn't changed for the interval, e.g. flash
 };
 
+using SinkCommitFunction = void (*)(void* sink, uint8_t segment, const LedState& state);
+using SinkAcceptsFunction = bool (*)(void* sink);
+
+struct SinkEntry {
+    void* sink;
+    SinkCommitFunction commit;
+    SinkAcceptsFunction accepts;    // nullptr if the sink always accepts
+    CommitPolicy policy;
+    unsigned long interval;         // ms, not used for Immediate
+    unsigned long lastCommit;
+    uint8_t pendingSegments;        // bit per segment the sink doesn't have yet
+};
+
+namespace state_sink {
+    // the sink type is known here, so these call the member directly and the compiler can inline it
+    template <typename Sink>
+    void commit(void* sink, const uint8_t segment, const LedState& state) {
+        static_cast<Sink*>(sink)->onStateCommitted(segment, state);
+    }
+
+    template <typename Sink>
+    bool accepts(void* sink) {
+        return static_cast<Sink*>(sink)->acceptsUpdate();
+    }
+
+    // picks accepts<Sink> if the sink has acceptsUpdate, and nullptr if not
+    template <typename Sink>
+    constexpr auto accepts_function(int) -> decltype(std::declval<Sink&>().acceptsUpdate(), SinkAcceptsFunction()) {
+        return &accepts<Sink>;
+    }
+
+    template <typename Sink>
+    constexpr SinkAcceptsFunction accepts_function(long) {
+        return nullptr;
+    }
+}
+
+// Builds an entry for the Controller's sink table, e.g.
+//   SinkEntry sinks[] = { make_sink(&leds), make_sink(&flash, CommitPolicy::Debounced, 2000) };
+template <typename Sink>
+constexpr SinkEntry make_sink(Sink* sink, const CommitPolicy policy = CommitPolicy::Immediate, const unsigned long interval = 0) {
+    return { sink, &state_sink::commit<Sink>, state_sink::accepts_function<Sink>(0), policy, interval, 0, 0 };
+}
+
 #endif
@@ -0,0 +1,123 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+#include <cstdarg>
+#include <cstdio>
+#include "Logger.h"
+
+namespace utilities {
+    namespace logger {
+        namespace {
+            write_callback writer = nullptr;
+            room_callback room = nullptr;
+            bool isDeferred = false;
+
+            char lines[kLineCount][kLineSize];
+            uint8_t lengths[kLineCount] = {};
+            uint8_t head = 0;
+            uint8_t count = 0;
+            // how much of the line at head was written already
+            uint8_t written = 0;
+            uint32_t droppedLines = 0;
+            uint32_t unreportedDrops = 0;
+
+            static_assert(kLineSize <= UINT8_MAX, "Line lengths must fit in a byte");
+
+            // formats into line, ending with a newline. Returns the length.
+            uint8_t format_line(char* line, const char* format, va_list arguments) {
+                // leave room for the newline
+                const int used = vsnprintf(line, kLineSize - 1, format, arguments);
+                if (used < 0) return 0;
+                size_t length = static_cast<size_t>(used) < kLineSize - 1 ? used : kLineSize - 2;
+                line[length++] = '\n';
+                return static_cast<uint8_t>(length);
+            }
+
+            char* next_free_line() {
+                if (count == kLineCount) {
+                    droppedLines++;
+                    unreportedDrops++;
+                    return nullptr;
+                }
+                return lines[(head + count) % kLineCount];
+            }
+
+            void commit_line(const uint8_t length) {
+                lengths[(head + count) % kLineCount] = length;
+                count++;
+            }
+
+            void report_drops() {
+                if (unreportedDrops == 0 || count == kLineCount) return;
+                char* line = lines[(head + count) % kLineCount];
+                const int used = snprintf(line, kLineSize, "(%u log lines dropped)\n", static_cast<unsigned>(unreportedDrops));
+                if (used <= 0 || static_cast<size_t>(used) >= kLineSize) return;
+                commit_line(static_cast<uint8_t>(used));
+                unreportedDrops = 0;
+            }
+
+            // writes up to maxBytes of the buffered lines
+            void write_buffered(size_t maxBytes) {
+                while (count > 0 && maxBytes > 0) {
+                    const size_t remaining = lengths[head] - written;
+                    const size_t chunk = remaining < maxBytes ? remaining : maxBytes;
+                    writer(lines[head] + written, chunk);
+                    maxBytes -= chunk;
+                    written += chunk;
+                    if (written < lengths[head]) return;
+                    written = 0;
+                    head = (head + 1) % kLineCount;
+                    count--;
+                }
+            }
+        }
+
+        void begin(const write_callback write, const room_callback roomAvailable) {
+            writer = write;
+            room = roomAvailable;
+        }
+
+        void defer() {
+            isDeferred = true;
+        }
+
+        // the level only matters at compile time, see LOG_LEVEL
+        void log(Level, const char* format, ...) {
+            if (writer == nullptr) return;
+            va_list arguments;
+            va_start(arguments, format);
+            if (isDeferred) {
+                char* line = next_free_line();
+                if (line != nullptr) commit_line(format_line(line, format, arguments));
+            } else {
+                char line[kLineSize];
+                writer(line, format_line(line, format, arguments));
+            }
+            va_end(arguments);
+        }
+
+        void drain() {
+            if (writer == nullptr) return;
+            report_drops();
+            write_buffered(room == nullptr ? SIZE_MAX : room());
+        }
+
+        void flush() {
+            if (writer == nullptr) return;
+            report_drops();
+            write_buffered(SIZE_MAX);
+        }
+
+        uint32_t dropped() {
+            return droppedLines;
+        }
+    }
+}
@@ -0,0 +1,86 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// Levelled logging. Writing a line to serial at 115200 baud takes milliseconds, so once deferred, lines are
+// formatted into a ring buffer and written by drain() as far as the output can take them without blocking.
+// If the buffer is full, lines are dropped and counted. Lines below LOG_LEVEL are not compiled in at all.
+
+#ifndef HEADER_LOGGER
+#define HEADER_LOGGER
+
+#include <cstddef>
+#include <cstdint>
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARNING 2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_NONE 4
+
+// e.g. -DLOG_LEVEL=LOG_LEVEL_WARNING for a release
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+namespace utilities {
+    namespace logger {
+        enum class Level : uint8_t {
+            Debug = LOG_LEVEL_DEBUG,
+            Info = LOG_LEVEL_INFO,
+            Warning = LOG_LEVEL_WARNING,
+            Error = LOG_LEVEL_ERROR
+        };
+
+        // writes text that doesn't need to be zero terminated
+        using write_callback = void(*)(const char* text, size_t length);
+        // how many bytes can be written without blocking
+        using room_callback = size_t(*)();
+
+        constexpr uint8_t kLineCount = 16;
+        constexpr size_t kLineSize = 96;    // including the newline; longer lines are truncated
+
+        void begin(write_callback write, room_callback room);
+        // Until this is called, lines are written right away (e.g. during setup, where blocking doesn't matter)
+        void defer();
+        void log(Level level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+        // call when idle
+        void drain();
+        // writes everything that's buffered, blocking. Use before a restart.
+        void flush();
+        uint32_t dropped();
+    }
+}
+
+#if LOG_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) utilities::logger::log(utilities::logger::Level::Debug, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do { } while (false)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...) utilities::logger::log(utilities::logger::Level::Info, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do { } while (false)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_WARNING
+#define LOG_WARNING(...) utilities::logger::log(utilities::logger::Level::Warning, __VA_ARGS__)
+#else
+#define LOG_WARNING(...) do { } while (false)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) utilities::logger::log(utilities::logger::Level::Error, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do { } while (false)
+#endif
+
+#endif
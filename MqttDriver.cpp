@@ -10,78 +10,317 @@
 //    See the License for the specific language governing permissions and limitations under the License.
 
 #include <ESP.h>
-#include <PubSubClient.h>
 #include "LedState.h"
+#include "FlashRegion.h"
 #include "MqttDriver.h"
 #include "Utilities.h"
 #include "secrets.h"
 
 using utilities::snprintf_t;
-using utilities::build_topic;
-using utilities::next_token;
+using utilities::hash_string;
+
+
+namespace {
+    constexpr auto kDeviceNode = "device";
+    constexpr auto kIntegerType = "integer";
+    constexpr auto kStringType = "string";
+    constexpr auto kColorType = "color";
+    constexpr auto kByteFormat = "0-255";
+    constexpr auto kColorHsvFormat = "hsv";
+    constexpr auto kNoFormat = "";
+    constexpr auto kPresetFormat = "0-15";
+    // hue,saturation,value,mode with an optional transition time in ms, e.g. 120,100,50,0,2000
+    constexpr auto kSceneFormat = "h,s,v,mode[,ms]";
+    constexpr auto kHomiePrefix = "homie/";
+    constexpr auto kBroadcastPrefix = "$broadcast/";
+    static_assert(flash_layout::kPresetCount == 16, "kPresetFormat must match the number of presets");
+
+    constexpr bool kSettable = true;
+    constexpr bool kNotRetained = false;
+
+    // group messages change the look, but not what the device stores or runs
+    constexpr bool accepts_group_command(const SettableProperty property) {
+        return property == SettableProperty::Color || property == SettableProperty::Mode ||
+            property == SettableProperty::Scene || property == SettableProperty::RecallPreset;
+    }
 
-PubSubClient mqttClient;
+    // The Homie description is generated at compile time into a table in flash.
+    // Paths are relative to homie/<device>/. Making the sizes too small gives a compile error.
+    constexpr size_t kAnnouncementPathSize = 40;
+    constexpr size_t kAnnouncementPayloadSize = 48;
+
+    struct Announcement {
+        char path[kAnnouncementPathSize];
+        char payload[kAnnouncementPayloadSize];
+    };
+
+    struct AnnouncementText {
+        char text[kAnnouncementPayloadSize];
+    };
+
+    // appends text to a zero terminated buffer
+    constexpr void append(char* target, const char* text) {
+        size_t end = 0;
+        while (target[end] != '\0') end++;
+        size_t i = 0;
+        for (; text[i] != '\0'; i++) {
+            target[end + i] = text[i];
+        }
+        target[end + i] = '\0';
+    }
 
-void MqttDriver::begin(Client* client, const char* clientName) {
-    mqttClient.setClient(*client);
-    _clientName = clientName;
-    mqttClient.setBufferSize(512);
-    mqttClient.setServer(kConfigMqttBroker, kConfigMqttPort);
-    mqttClient.setCallback([this](const char* topic, const uint8_t* payload, const unsigned int length) {
-        this->mqttCallback(topic, payload, length);
-    });
-    if (!connect()) {
-        Serial.printf("Could not connect to MQTT broker: state %d\n", mqttClient.state());     
+    // comma separated list, as used by $nodes and $properties
+    template <typename... Items>
+    constexpr AnnouncementText join(const char* first, Items... items) {
+        AnnouncementText list = {};
+        append(list.text, first);
+        for (const char* item : { items... }) {
+            append(list.text, ",");
+            append(list.text, item);
+        }
+        return list;
     }
-}
 
-bool MqttDriver::connect() {
-    if (isConnected()) return true;
-  
-    snprintf_t(_topicBuffer, kBaseTopicTemplate, _clientName, kStateProperty);
-    bool connectionSucceeded;
-    if (strlen(kConfigMqttUser) == 0) {
-        connectionSucceeded = mqttClient.connect(kConfigDeviceName, _topicBuffer, kWillQos, kRetainWill, kStateLost);
-    } else {
-        connectionSucceeded = mqttClient.connect(kConfigDeviceName, kConfigMqttUser, kConfigMqttPassword, _topicBuffer, kWillQos, kRetainWill, kStateLost);
+    constexpr AnnouncementText make_node_list() {
+        AnnouncementText list = {};
+        append(list.text, kDeviceNode);
+        for (const auto& segment : led_ring_config::kSegments) {
+            append(list.text, ",");
+            append(list.text, segment.node);
+        }
+        append(list.text, ",");
+        append(list.text, kFirmwareNode);
+        return list;
     }
-    if (!connectionSucceeded) {
-        Serial.println("Could not connect to MQTT broker");
-        return false;
+
+    constexpr AnnouncementText kNodeList = make_node_list();
+    constexpr AnnouncementText kDeviceProperties = join(kMacAddressProperty, kIpAddressProperty, kGroupsProperty);
+    constexpr AnnouncementText kLedProperties = join(kColorProperty, kModeProperty, kSceneProperty, kStoreProperty, kRecallProperty, kDeleteProperty);
+    constexpr AnnouncementText kFirmwareProperties = join(kNameProperty, kVersionProperty, kStatusProperty, kUpdateProperty, kErrorProperty);
+
+    // Counts the announcements, so the table can be sized
+    struct AnnouncementCounter {
+        size_t count = 0;
+        constexpr void add(const char*, const char*, const char*, const char*) { count++; }
+    };
+
+    template <size_t Count>
+    struct AnnouncementTable {
+        Announcement entries[Count] = {};
+        size_t count = 0;
+
+        // node and property can be nullptr for device and node attributes
+        constexpr void add(const char* node, const char* property, const char* attribute, const char* payload) {
+            Announcement& entry = entries[count++];
+            for (const char* part : { node, property }) {
+                if (part == nullptr) continue;
+                append(entry.path, part);
+                append(entry.path, "/");
+            }
+            append(entry.path, attribute);
+            append(entry.payload, payload);
+        }
+    };
+
+    template <typename Target>
+    constexpr void describe_node(Target& target, const char* node, const char* properties) {
+        target.add(node, nullptr, "$name", node);
+        target.add(node, nullptr, "$properties", properties);
     }
-    if (announceDevice()) {
-        subscribeSetters();
-        return true;
-    } 
-    Serial.println("Could not announce device on MQTT");
-    return false; 
+
+    template <typename Target>
+    constexpr void describe_property(Target& target, const char* node, const char* property, 
+                                     const char* dataType, const char* format, const bool settable, const bool retained = true) {
+        target.add(node, property, "$name", property);
+        target.add(node, property, "$datatype", dataType);
+        if (format[0] != '\0') target.add(node, property, "$format", format);
+        if (settable) target.add(node, property, "$settable", "true");
+        // commands like recalling a preset have no state to keep
+        if (!retained) target.add(node, property, "$retained", "false");
+    }
+
+    // $homie, $state and $name are not in here, as they are published right after connecting
+    template <typename Target>
+    constexpr void describe_device(Target& target) {
+        target.add(nullptr, nullptr, "$nodes", kNodeList.text);
+
+        describe_node(target, kDeviceNode, kDeviceProperties.text);
+        describe_property(target, kDeviceNode, kMacAddressProperty, kStringType, kNoFormat, !kSettable);
+        describe_property(target, kDeviceNode, kIpAddressProperty, kStringType, kNoFormat, !kSettable);
+        describe_property(target, kDeviceNode, kGroupsProperty, kStringType, kNoFormat, kSettable);
+
+        for (const auto& segment : led_ring_config::kSegments) {
+            describe_node(target, segment.node, kLedProperties.text);
+            describe_property(target, segment.node, kColorProperty, kColorType, kColorHsvFormat, kSettable);
+            describe_property(target, segment.node, kModeProperty, kIntegerType, kByteFormat, kSettable);
+            // the resulting state is published as color and mode
+            describe_property(target, segment.node, kSceneProperty, kStringType, kSceneFormat, kSettable, kNotRetained);
+            describe_property(target, segment.node, kStoreProperty, kIntegerType, kPresetFormat, kSettable, kNotRetained);
+            describe_property(target, segment.node, kRecallProperty, kIntegerType, kPresetFormat, kSettable, kNotRetained);
+            describe_property(target, segment.node, kDeleteProperty, kIntegerType, kPresetFormat, kSettable, kNotRetained);
+        }
+
+        describe_node(target, kFirmwareNode, kFirmwareProperties.text);
+        describe_property(target, kFirmwareNode, kNameProperty, kStringType, kNoFormat, !kSettable);
+        describe_property(target, kFirmwareNode, kVersionProperty, kStringType, kNoFormat, !kSettable);
+        describe_property(target, kFirmwareNode, kStatusProperty, kStringType, kNoFormat, !kSettable);
+        describe_property(target, kFirmwareNode, kUpdateProperty, kStringType, kNoFormat, kSettable);
+        describe_property(target, kFirmwareNode, kErrorProperty, kStringType, kNoFormat, !kSettable);
+    }
+
+    constexpr size_t count_announcements() {
+        AnnouncementCounter counter;
+        describe_device(counter);
+        return counter.count;
+    }
+
+    constexpr size_t kAnnouncementCount = count_announcements();
+
+    constexpr AnnouncementTable<kAnnouncementCount> make_announcements() {
+        AnnouncementTable<kAnnouncementCount> table;
+        describe_device(table);
+        return table;
+    }
+
+    const AnnouncementTable<kAnnouncementCount> kAnnouncements PROGMEM = make_announcements();
+
+#if LED_RING_STATS
+    constexpr auto kStatsNode = "$stats";
+    constexpr size_t kStatsPathSize = 32;
+    constexpr size_t kStatsPayloadSize = 64;
+
+    unsigned long to_micros(const uint64_t cycles) {
+        return static_cast<unsigned long>(stats::cycles_to_micros(static_cast<uint32_t>(cycles)));
+    }
+
+    // Formats $stats entry index into path and payload. Reading a stage or the lateness starts a new period for them.
+    bool format_stats(const uint8_t index, const unsigned long interval, const MqttTraffic& traffic,
+                      char (&path)[kStatsPathSize], char (&payload)[kStatsPayloadSize]) {
+        switch (index) {
+            case 0:
+                return snprintf_t(path, "%s/interval", kStatsNode) && snprintf_t(payload, "%lu", interval / 1000);
+            case 1:
+                return snprintf_t(path, "%s/uptime", kStatsNode) && snprintf_t(payload, "%lu", millis() / 1000);
+            case 2:
+                return snprintf_t(path, "%s/freeheap", kStatsNode) && snprintf_t(payload, "%u", ESP.getFreeHeap());
+            case 3:
+                return snprintf_t(path, "%s/fragmentation", kStatsNode) && snprintf_t(payload, "%u", ESP.getHeapFragmentation());
+            case 4:
+                return snprintf_t(path, "%s/maxblock", kStatsNode) && snprintf_t(payload, "%u", ESP.getMaxFreeBlockSize());
+            case 5: {
+                // task runs, late runs, max lateness (us)
+                const stats::LatenessStats& lateness = stats::lateness();
+                const bool ok = snprintf_t(path, "%s/lateness", kStatsNode) &&
+                    snprintf_t(payload, "%u,%u,%lu", lateness.runs, lateness.slips, lateness.maxLateness);
+                stats::reset_lateness();
+                return ok;
+            }
+            case 6:
+                // messages published, bytes published, commands received, since the start
+                return snprintf_t(path, "%s/mqtt", kStatsNode) &&
+                    snprintf_t(payload, "%u,%u,%u", traffic.published, traffic.publishedBytes, traffic.received);
+            default:
+                break;
+        }
+        const auto stage = static_cast<Stage>((index - 7) / 2);
+        const stats::StageStats& entry = stats::stage(stage);
+        if ((index - 7) % 2 == 0) {
+            // count, min, avg, max (us)
+            const uint64_t average = entry.count == 0 ? 0 : entry.totalCycles / entry.count;
+            return snprintf_t(path, "%s/%s", kStatsNode, stats::stage_name(stage)) &&
+                snprintf_t(payload, "%u,%lu,%lu,%lu", entry.count, to_micros(entry.minCycles), to_micros(average), to_micros(entry.maxCycles));
+        }
+        const uint32_t* bucket = entry.histogram;
+        const bool ok = snprintf_t(path, "%s/%s-histogram", kStatsNode, stats::stage_name(stage)) &&
+            snprintf_t(payload, "%u,%u,%u,%u,%u,%u", bucket[0], bucket[1], bucket[2], bucket[3], bucket[4], bucket[5]);
+        static_assert(stats::kBucketCount == 6, "Update the histogram format");
+        stats::reset_stage(stage);
+        return ok;
+    }
+#endif
+}
+
+MqttDriver* MqttDriver::_instances[kMaxInstances] = {};
+
+MqttDriver::~MqttDriver() {
+    if (_slot != kNoSlot) _instances[_slot] = nullptr;
+}
+
+void MqttDriver::begin(Client* client, const char* clientName) {
+    begin(client, clientName, kConfigMqttBroker, kConfigMqttPort);
+}
+
+void MqttDriver::begin(Client* client, const char* clientName, const char* broker, const uint16_t port) {
+    _client.setClient(*client);
+    _clientName = clientName;
+    _clientNameLength = strlen(clientName);
+    _client.setBufferSize(512);
+    _client.setServer(broker, port);
+    _client.setCallback(claimForwarder());
+    _client.setSocketTimeout(kSocketTimeout);
 }
 
 void MqttDriver::disconnect() {
     if (isConnected()) {
-        setState(kStateDisconnected);
-        mqttClient.disconnect();    
+        publishStateNow(kStateDisconnected);
+        _client.disconnect();    
     }
 }
 
 bool MqttDriver::isConnected() {
-    return mqttClient.connected();
+    return _client.connected();
 }
 
 bool MqttDriver::loop() {
-    if (!mqttClient.connected()) connect();
-    return mqttClient.loop();
+    const unsigned long now = millis();
+    if (!_client.connected() && (_state == MqttState::Announcing || _state == MqttState::Ready)) {
+        LOG_WARNING("Lost MQTT connection (state %d)", _client.state());
+        // wait a bit even after a good connection, so a flapping broker doesn't get hammered
+        connectionFailed(now);
+    }
+    switch (_state) {
+        case MqttState::WaitingForNetwork:
+            if (_isNetworkAvailable) _state = MqttState::WaitingToRetry;
+            return false;
+        case MqttState::WaitingToRetry:
+            if (!_isNetworkAvailable) {
+                _state = MqttState::WaitingForNetwork;
+            } else if (_backoff.isDue(now)) {
+                connect(now);
+            }
+            return false;
+        case MqttState::Announcing:
+            continueAnnouncement();
+            break;
+        case MqttState::Ready:
+            drainPublishQueue();
+#if LED_RING_STATS
+            continueStats();
+#endif
+            break;
+    }
+    STATS_TIME(Stage::MqttLoop);
+    return _client.loop();
+}
+
+void MqttDriver::flush() {
+    if (_state != MqttState::Ready || !isConnected()) return;
+    while (const QueuedMessage* message = _publishQueue.front()) {
+        if (!publishEntity(_clientName, message->path, message->payload)) break;
+        _publishQueue.acknowledge();
+    }
+    _client.loop();
 }
 
-void MqttDriver::onStateCommitted(const LedState& state) {
+void MqttDriver::onStateCommitted(const uint8_t segment, const LedState& state) {
     char buffer[kColorBufferSize]; 
     if (state.serializeHsv(buffer, sizeof(buffer))) {
-        Serial.printf("Publishing color %s\n", buffer);
-        publishLedProperty(kColorProperty, buffer);  
+        LOG_DEBUG("Publishing color %s", buffer);
+        publishLedProperty(segment, kColorProperty, buffer);  
     }
 
     if (state.serializeMode(buffer, sizeof(buffer))) {
-        publishLedProperty(kModeProperty, buffer);  
+        publishLedProperty(segment, kModeProperty, buffer);  
     }
 }
 
@@ -89,8 +328,9 @@ void MqttDriver::publishDeviceProperty(const char* propertyName, const char* pay
     publishProperty(kDeviceNode, propertyName, payload);
 }
 
-void MqttDriver::publishLedProperty(const char* property, const char* payload) {
-    publishProperty(kLedNode, property, payload);
+void MqttDriver::publishLedProperty(const uint8_t segment, const char* property, const char* payload) {
+    if (segment >= led_ring_config::kSegmentCount) return;
+    publishProperty(led_ring_config::kSegments[segment].node, property, payload);
 }
 
 void MqttDriver::publishFirmwareProperty(const char* property, const char* payload) {
@@ -99,155 +339,286 @@ void MqttDriver::publishFirmwareProperty(const char* property, const char* paylo
 
 void MqttDriver::publishProperty(const char* node, const char* property, const char* payload) {
     char path[kBaseTopicBufferSize];
-    strlcpy(path, node, sizeof(path));
-    strlcat(path, "/", sizeof(path));
-    strlcat(path, property, sizeof(path));
-    Serial.printf("Publishing %s to %s\n", payload, path);
-    publishEntity(_clientName, path, payload);
+    if (!snprintf_t(path, "%s/%s", node, property)) {
+        LOG_ERROR("Path %s/%s too long", node, property);
+        return;
+    }
+    LOG_DEBUG("Queueing %s to %s", payload, path);
+    _publishQueue.push(path, payload);
+}
+
+void MqttDriver::joinGroups() {
+    updateGroupSubscriptions(true);
+}
+
+void MqttDriver::leaveGroups() {
+    updateGroupSubscriptions(false);
+}
+
+void MqttDriver::setPropertyHandler(const SettableProperty property, MqttPropertyHandler handler) {
+    if (property >= SettableProperty::Count) return;
+    _propertyHandlers[static_cast<uint8_t>(property)] = handler;
 }
 
 void MqttDriver::setState(const char* state) {
-    publishEntity(_clientName, kStateProperty, state);  
+    _publishQueue.push(kStateProperty, state);  
 }
 
 // *** private methods ***
 
-bool MqttDriver::announceDevice() {
-    if (_wasAnnounced) return true;
-    char baseTopic[kBaseTopicBufferSize];
-    char payload[kPayloadBufferSize];
+void MqttDriver::addRoute(const char* node, const char* name, const SettableProperty property, const uint8_t segment) {
+    char path[kBaseTopicBufferSize];
+    if (!snprintf_t(path, "%s/%s/set", node, name)) return;
+    size_t length;
+    const uint32_t hash = hash_string(path, length);
+    uint8_t slot = hash & (kRouteTableSize - 1);
+    while (_routes[slot].length != 0) {
+        if (_routes[slot].matches(hash, length, path)) {
+            LOG_ERROR("Duplicate route %s, ignoring", path);
+            return;
+        }
+        slot = (slot + 1) & (kRouteTableSize - 1);
+    }
+    _routes[slot] = { hash, static_cast<uint16_t>(length), property, segment, node, name };
+    if (snprintf_t(_topicBuffer, kBaseTopicTemplate, _clientName, path)) {
+        _client.subscribe(_topicBuffer);
+    }
+}
 
-    // homie
-    if (!publishEntity(_clientName, "$homie", "4.0")) return false;
-    setState(kStateInit);
+MqttDriver::CallbackForwarder MqttDriver::claimForwarder() {
+    static constexpr ForwarderTable kForwarders = makeForwarders(std::make_index_sequence<kMaxInstances>());
+    if (_slot == kNoSlot) {
+        for (uint16_t slot = 0; slot < kMaxInstances; slot++) {
+            if (_instances[slot] != nullptr) continue;
+            _instances[slot] = this;
+            _slot = slot;
+            break;
+        }
+    }
+    if (_slot == kNoSlot) {
+        LOG_ERROR("No room for another MQTT driver (max %u), so it won't get commands", kMaxInstances);
+        return nullptr;
+    }
+    return kForwarders.entries[_slot];
+}
 
-    // $name and $nodes
-    publishEntity(_clientName, "$name", _clientName);
-    snprintf_t(payload, "%s,%s", kDeviceNode, kLedNode, kFirmwareNode);
-    publishEntity(_clientName, "$nodes", payload);
-
-    // Device node
-    snprintf_t(payload, "%s,%s", kMacAddressProperty, kIpAddressProperty);
-    build_topic(baseTopic, sizeof(baseTopic), _clientName, kDeviceNode);
-    announceNode(baseTopic, kDeviceNode, payload);
-    
-    // Device properties
-    build_topic(baseTopic, sizeof(baseTopic), _clientName, kDeviceNode, kMacAddressProperty);
-    announceProperty(baseTopic, kMacAddressProperty, kStringType, "", false);
-    build_topic(baseTopic, sizeof(baseTopic), _clientName, kDeviceNode, kIpAddressProperty);
-    announceProperty(baseTopic, kIpAddressProperty, kStringType, "", false);
-
-    // LED node
-    build_topic(baseTopic, sizeof(baseTopic), _clientName, kLedNode);
-    snprintf_t(payload, "%s,%s", kColorProperty, kModeProperty);
-    announceNode(baseTopic, kLedNode, payload);
-
-    // LED properties
-    build_topic(baseTopic, sizeof(baseTopic), _clientName, kLedNode, kColorProperty);
-    announceProperty(baseTopic, kColorProperty, kColorType, kColorHsvFormat, true); 
-
-    build_topic(baseTopic, sizeof(baseTopic), _clientName, kLedNode, kModeProperty);
-    announceProperty(baseTopic, kModeProperty, kIntegerType, kByteFormat, true);
-
-    // Firmware node
-    build_topic(baseTopic, sizeof(baseTopic), _clientName, kFirmwareNode);
-    snprintf_t(payload, "%s,%s,%s,%s", kNameProperty, kVersionProperty, kStatusProperty, kUpdateProperty, kErrorProperty);
-    announceNode(baseTopic, kFirmwareNode, payload);
-    
-    // Firmware properties
-    build_topic(baseTopic, sizeof(baseTopic), _clientName, kFirmwareNode, kNameProperty);
-    announceProperty(baseTopic, kNameProperty, kStringType, "", false); 
-
-    build_topic(baseTopic, sizeof(baseTopic), _clientName, kFirmwareNode, kVersionProperty);
-    announceProperty(baseTopic, kVersionProperty, kStringType, "", false); 
-
-    build_topic(baseTopic, sizeof(baseTopic), _clientName, kFirmwareNode, kStatusProperty);
-    announceProperty(baseTopic, kStatusProperty, kStringType, "", false); 
-
-    build_topic(baseTopic, sizeof(baseTopic), _clientName, kFirmwareNode, kUpdateProperty);
-    announceProperty(baseTopic, kStatusProperty, kStringType, "", true); 
-
-    build_topic(baseTopic, sizeof(baseTopic), _clientName, kFirmwareNode, kErrorProperty);
-    announceProperty(baseTopic, kErrorProperty, kStringType, "", false); 
+// a single attempt; the TLS handshake and waiting for the broker are bounded by the client and socket timeouts
+bool MqttDriver::connect(const unsigned long now) {
+    snprintf_t(_topicBuffer, kBaseTopicTemplate, _clientName, kStateProperty);
+    bool connectionSucceeded;
+    if (strlen(kConfigMqttUser) == 0) {
+        connectionSucceeded = _client.connect(_clientName, _topicBuffer, kWillQos, kRetainWill, kStateLost);
+    } else {
+        connectionSucceeded = _client.connect(_clientName, kConfigMqttUser, kConfigMqttPassword, _topicBuffer, kWillQos, kRetainWill, kStateLost);
+    }
+    if (!connectionSucceeded) {
+        connectionFailed(now);
+        LOG_WARNING("Could not connect to MQTT broker (state %d), retrying in about %lu s", _client.state(), _backoff.currentDelay() / 1000);
+        return false;
+    }
+    _backoff.succeeded();
+    subscribeSetters();
+    // the will may have set the state to lost, so don't assume the broker has our last state
+    _publishQueue.forget(kStateProperty);
+    // the description is retained, so once is enough. Homie wants ready again after a will set it to lost.
+    if (_wasAnnounced) {
+        setState(kStateReady);
+        _state = MqttState::Ready;
+        return true;
+    }
+    if (startAnnouncement()) return true;
+    LOG_ERROR("Could not announce device on MQTT");
+    _client.disconnect();
+    connectionFailed(now);
+    return false; 
+}
 
-    setState(kStateReady);
+void MqttDriver::connectionFailed(const unsigned long now) {
+    _backoff.failed(now, ESP.random());
+    _state = MqttState::WaitingToRetry;
+}
+
+// publishes Homie description messages until the time slice is used up
+void MqttDriver::continueAnnouncement() {
+    const unsigned long start = micros();
+    Announcement announcement;
+    do {
+        memcpy_P(&announcement, &kAnnouncements.entries[_announcementIndex], sizeof(announcement));
+        if (!snprintf_t(_topicBuffer, kBaseTopicTemplate, _clientName, announcement.path)) return;
+        // try again next time
+        if (!_client.publish(_topicBuffer, announcement.payload, kRetainMessage)) return;
+        countPublish(_topicBuffer, announcement.payload);
+        _announcementIndex++;
+    } while (_announcementIndex < kAnnouncementCount && micros() - start < kPublishSliceMicros);
+
+    if (_announcementIndex < kAnnouncementCount) return;
+    _state = MqttState::Ready;
     _wasAnnounced = true;
-    return true;
+    setState(kStateReady);
 }
 
-void MqttDriver::announceNode(const char* baseTopic, const char* name, const char* properties) {
-    publishEntity(baseTopic, "$name", name);
-    publishEntity(baseTopic, "$properties", properties);
+// publishes queued messages until the queue is empty or the time slice is used up
+void MqttDriver::drainPublishQueue() {
+    if (!isConnected()) return;
+    const unsigned long start = micros();
+    while (const QueuedMessage* message = _publishQueue.front()) {
+        // leave it in the queue, it gets published after reconnecting
+        if (!publishEntity(_clientName, message->path, message->payload)) return;
+        _publishQueue.acknowledge();
+        if (micros() - start >= kPublishSliceMicros) return;
+    }
 }
 
-void MqttDriver::announceProperty(const char* baseTopic, const char* name, const char* dataType, const char* format, bool settable) {
-    publishEntity(baseTopic, "$name", name);
-    publishEntity(baseTopic, "$datatype", dataType);
-    if (strlen(format) > 0) {
-        publishEntity(baseTopic, "$format", format);
+#if LED_RING_STATS
+// One $stats entry per call, and only when no state updates are waiting, so the stats never delay those.
+// Published directly as they change every time, so coalescing and deduplication wouldn't help.
+void MqttDriver::continueStats() {
+    const unsigned long now = millis();
+    if (_statsIndex >= kStatsEntryCount) {
+        if (now - _lastStatsRound < kStatsInterval) return;
+        _lastStatsRound = now;
+        _statsIndex = 0;
     }
-    if (settable) {
-        publishEntity(baseTopic, "$settable", "true");
+    if (_publishQueue.depth() > 0 || !isConnected()) return;
+    char path[kStatsPathSize];
+    char payload[kStatsPayloadSize];
+    if (format_stats(_statsIndex, kStatsInterval, _traffic, path, payload)) {
+        publishEntity(_clientName, path, payload);
     }
+    _statsIndex++;
 }
+#endif
 
-void MqttDriver::mqttCallback(const char* topic, const uint8_t* payload, const unsigned length) {
-    // ignore messages with an empty payload or a payload too long to be uint8_t.
-    Serial.printf("Called with topic %s", topic);
-    if (length == 0 || length > kPayloadBufferSize) return;
-
-    char topicCopy[kTopicBufferSize];
-    strlcpy(topicCopy, topic, sizeof(topicCopy));
-    const char* node;
-    const char* property;
-    bool isSetter;
-    if (!tryParseTopic(topicCopy, node, property, isSetter)) return;
+void MqttDriver::countPublish(const char* topic, const char* payload) {
+    _traffic.published++;
+    _traffic.publishedBytes += strlen(topic) + strlen(payload);
+}
 
-    char payloadStr[kPayloadBufferSize];
-    for (unsigned int i = 0; i < length; i++) {
-        payloadStr[i] = static_cast<char>(payload[i]);
+const MqttDriver::TopicRoute* MqttDriver::findRoute(const char* path) const {
+    size_t length;
+    const uint32_t hash = hash_string(path, length);
+    uint8_t slot = hash & (kRouteTableSize - 1);
+    // the table is never full, so there is always an empty slot to end the search
+    while (_routes[slot].length != 0) {
+        if (_routes[slot].matches(hash, length, path)) return &_routes[slot];
+        slot = (slot + 1) & (kRouteTableSize - 1);
     }
-    payloadStr[length] = 0;
+    return nullptr;
+}
 
-    Serial.printf(", payload %s\n", payloadStr);
+template <uint16_t Slot>
+void MqttDriver::forwardCallback(char* topic, uint8_t* payload, const unsigned int length) {
+    if (_instances[Slot] != nullptr) _instances[Slot]->mqttCallback(topic, payload, length);
+}
 
-    if (_propertyCallback) {
-        _propertyCallback(node, property, payloadStr);
+void MqttDriver::mqttCallback(const char* topic, const uint8_t* payload, const unsigned length) {
+    // ignore messages with an empty payload
+    if (length == 0) return;
+    bool isGroupTopic;
+    const char* path = routePath(topic, isGroupTopic);
+    const TopicRoute* route = path == nullptr ? nullptr : findRoute(path);
+    if (route == nullptr || (isGroupTopic && !accepts_group_command(route->property))) {
+        LOG_WARNING("Ignoring message on %s", topic);
+        return;
+    }
+
+    _traffic.received++;
+    const auto& handler = _propertyHandlers[static_cast<uint8_t>(route->property)];
+    if (handler) {
+        handler(route->segment, reinterpret_cast<const char*>(payload), length);
     } 
 }
 
 bool MqttDriver::publishEntity(const char* baseTopic, const char* entity, const char* payload) {
-    if (!mqttClient.connected() && !connect()) return false;
+    if (!_client.connected()) return false;
 
     if (!snprintf_t(_topicBuffer, kBaseTopicTemplate, baseTopic, entity)) return false;
-    return mqttClient.publish(_topicBuffer, payload, kRetainMessage);
+    if (!_client.publish(_topicBuffer, payload, kRetainMessage)) return false;
+    countPublish(_topicBuffer, payload);
+    return true;
+}
+
+// bypasses the queue, for when the order matters
+bool MqttDriver::publishStateNow(const char* state) {
+    _publishQueue.forget(kStateProperty);
+    return publishEntity(_clientName, kStateProperty, state);
+}
+
+bool MqttDriver::TopicRoute::matches(const uint32_t pathHash, const size_t pathLength, const char* path) const {
+    if (hash != pathHash || length != pathLength) return false;
+    const size_t nodeLength = strlen(node);
+    const size_t nameLength = strlen(name);
+    return strncmp(path, node, nodeLength) == 0 && path[nodeLength] == '/' &&
+        strncmp(path + nodeLength + 1, name, nameLength) == 0 && strcmp(path + nodeLength + 1 + nameLength, "/set") == 0;
+}
+
+const char* MqttDriver::routePath(const char* topic, bool& isGroupTopic) const {
+    isGroupTopic = false;
+    const size_t homieLength = strlen(kHomiePrefix);
+    if (strncmp(topic, kHomiePrefix, homieLength) != 0) return nullptr;
+    const char* rest = topic + homieLength;
+    if (strncmp(rest, _clientName, _clientNameLength) == 0 && rest[_clientNameLength] == '/') {
+        return rest + _clientNameLength + 1;
+    }
+    const size_t broadcastLength = strlen(kBroadcastPrefix);
+    if (_groups == nullptr || strncmp(rest, kBroadcastPrefix, broadcastLength) != 0) return nullptr;
+    const char* group = rest + broadcastLength;
+    const char* end = strchr(group, '/');
+    if (end == nullptr || !_groups->isMember(group, end - group)) return nullptr;
+    isGroupTopic = true;
+    return end + 1;
+}
+
+bool MqttDriver::startAnnouncement() {
+    if (!publishEntity(_clientName, "$homie", "4.0")) return false;
+    publishStateNow(kStateInit);
+    publishEntity(_clientName, "$name", _clientName);
+    // the rest is published in slices from loop()
+    _announcementIndex = 0;
+    _state = MqttState::Announcing;
+    return true;
 }
 
 void MqttDriver::subscribeSetters() {
-    char topic[kTopicBufferSize];
+    for (auto& route : _routes) {
+        route = {};
+    }
+    struct Setter {
+        const char* name;
+        SettableProperty property;
+    };
+    constexpr Setter segmentSetters[kSegmentSetterCount] = {
+        { kColorProperty, SettableProperty::Color },
+        { kModeProperty, SettableProperty::Mode },
+        { kSceneProperty, SettableProperty::Scene },
+        { kStoreProperty, SettableProperty::StorePreset },
+        { kRecallProperty, SettableProperty::RecallPreset },
+        { kDeleteProperty, SettableProperty::DeletePreset }
+    };
+
+    for (uint8_t segment = 0; segment < led_ring_config::kSegmentCount; segment++) {
+        const char* node = led_ring_config::kSegments[segment].node;
+        for (const auto& setter : segmentSetters) {
+            addRoute(node, setter.name, setter.property, segment);
+        }
+    }
+    addRoute(kFirmwareNode, kUpdateProperty, SettableProperty::FirmwareUpdate, 0);
+    addRoute(kDeviceNode, kGroupsProperty, SettableProperty::Groups, 0);
+    updateGroupSubscriptions(true);
+}
 
-    const char* properties[] = { kColorProperty, kModeProperty };
-    for (const char* property : properties) {
-        if (snprintf_t(topic, "homie/%s/%s/%s/set", _clientName, kLedNode, property)) {
-            mqttClient.subscribe(topic);
+// One wildcard subscription per group; the routes filter out what groups can't set.
+// Not subscribed yet if we're not connected, and after connecting subscribeSetters takes care of it.
+void MqttDriver::updateGroupSubscriptions(const bool isJoining) {
+    if (_groups == nullptr || !_client.connected()) return;
+    char topic[kTopicBufferSize];
+    for (uint8_t i = 0; i <= _groups->count(); i++) {
+        const char* group = i < _groups->count() ? _groups->name(i) : GroupStore::kBroadcastGroup;
+        if (!snprintf_t(topic, kGroupTopicTemplate, group)) continue;
+        if (isJoining) {
+            _client.subscribe(topic);
+        } else {
+            _client.unsubscribe(topic);
         }
     }
-    if (snprintf_t(topic, "homie/%s/$fw/update/set", _clientName)) {
-        mqttClient.subscribe(topic);
-    }    
-}
-
-bool MqttDriver::tryParseTopic(char* copyTopic, const char*& node, const char*& property, bool& isSetter) {
-    constexpr int delimiter = '/';
-	// only pass messages like homie/device/node/property[/set]
-	// ignore the first two, as the subscription ensures they are correct
-	if (next_token(&copyTopic, delimiter) == nullptr) return false; 
-    if (next_token(&copyTopic, delimiter) == nullptr) return false; 
-    node = next_token(&copyTopic, delimiter);
-    if (node == nullptr) return false;
-    property = next_token(&copyTopic, delimiter);
-    if (property == nullptr) return false;
-    const auto set = next_token(&copyTopic, delimiter);
-    isSetter = set && strcmp(set, "set") == 0;
-    return true;
 }
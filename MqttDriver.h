@@ -15,23 +15,56 @@
 #ifndef HEADER_MQTTDRIVER
 #define HEADER_MQTTDRIVER
 
-#include <functional>
 #include <Client.h>
+#include <PubSubClient.h>
+#include <utility>
 
+#include "Backoff.h"
+#include "Delegate.h"
+#include "GroupStore.h"
+#include "LedRingConfig.h"
 #include "LedState.h"
-#include "LedStateSink.h"
+#include "PublishQueue.h"
+#include "Stats.h"
+
+// The properties that can be set via MQTT. Each gets its own handler.
+enum class SettableProperty : uint8_t {
+    Color,
+    Mode,
+    Scene,
+    StorePreset,
+    RecallPreset,
+    DeletePreset,
+    FirmwareUpdate,
+    Groups,
+    Count
+};
+
+// The payload is not zero terminated and only valid during the call. Segment is only relevant for LED properties.
+using MqttPropertyHandler = Delegate<void(uint8_t segment, const char* payload, size_t length)>;
 
-using MqttPropertyCallback = std::function<void(const char* node, const char* property, const char* payload)>;
+// Messages and bytes (topic and payload) sent to the broker, and commands received
+struct MqttTraffic {
+    uint32_t published;
+    uint32_t publishedBytes;
+    uint32_t received;
+};
 
 // the constants we need outside the class as well
 
 constexpr auto kMacAddressProperty = "mac-address";
 constexpr auto kIpAddressProperty = "ip-address";
+// comma separated list of the groups the device listens to, see GroupStore
+constexpr auto kGroupsProperty = "groups";
 
-constexpr auto kLedNode = "led";
 constexpr auto kFirmwareNode = "$fw";
 constexpr auto kColorProperty = "color";
 constexpr auto kModeProperty = "mode";
+// color, mode and transition time in one message, applied as a single state change
+constexpr auto kSceneProperty = "scene";
+constexpr auto kStoreProperty = "store";
+constexpr auto kRecallProperty = "recall";
+constexpr auto kDeleteProperty = "delete";
 
 constexpr auto kStateInit = "init";
 constexpr auto kStateReady = "ready";
@@ -44,54 +77,156 @@ constexpr auto kStatusProperty = "status";
 constexpr auto kUpdateProperty = "update";
 constexpr auto kErrorProperty = "error";
 
-class MqttDriver : public LedStateSink {
+// How many drivers can receive commands at the same time. The device has one; a host simulation of a fleet needs more.
+#ifndef LED_RING_MQTT_INSTANCES
+#define LED_RING_MQTT_INSTANCES 1
+#endif
+
+// Connecting is stepped from loop(), so a missing network or broker never holds up the rest
+enum class MqttState : uint8_t {
+    WaitingForNetwork,
+    WaitingToRetry,
+    Announcing,
+    Ready
+};
+
+class MqttDriver {
 public:
+    static constexpr uint16_t kMaxInstances = LED_RING_MQTT_INSTANCES;
+
+    MqttDriver() = default;
+    ~MqttDriver();
+    MqttDriver(const MqttDriver&) = delete;
+    MqttDriver& operator=(const MqttDriver&) = delete;
+
+    // Doesn't connect yet, that's done by loop() once the network is available. The client name is also the
+    // device name in the topics. Uses the broker from the configuration unless given.
     void begin(Client* client, const char* clientName);
-    bool connect();
+    void begin(Client* client, const char* clientName, const char* broker, uint16_t port);
     void disconnect();
     bool isConnected();
-    void onStateCommitted(const LedState& state) override;
-    bool acceptsUpdate() override { return isConnected(); }
+    void setNetworkAvailable(bool isAvailable) { _isNetworkAvailable = isAvailable; }
+    MqttState state() const { return _state; }
+    void onStateCommitted(uint8_t segment, const LedState& state);
     bool loop();
     void publishDeviceProperty(const char* propertyName, const char* payload);
-    void publishLedProperty(const char* property, const char* payload);
+    void publishLedProperty(uint8_t segment, const char* property, const char* payload);
     void publishFirmwareProperty(const char* property, const char* payload);
+    // queued, published from loop()
     void publishProperty(const char* node, const char* property, const char* payload);
+    // Publishes the queue right away and keeps the connection alive, for when loop() won't run for a while
+    void flush();
+    const PublishQueue& publishQueue() const { return _publishQueue; }
+    const MqttTraffic& traffic() const { return _traffic; }
     void setState(const char* state);
-    void setReceivedPropertyCallback(MqttPropertyCallback cb) { _propertyCallback = cb; }
+    void setPropertyHandler(SettableProperty property, MqttPropertyHandler handler);
+    // Color, mode, scene and recall can also be set via homie/$broadcast/<group>/<node>/<property>/set for the groups
+    // in the store. Call leaveGroups before changing them, and joinGroups after.
+    void setGroups(const GroupStore* groups) { _groups = groups; }
+    void joinGroups();
+    void leaveGroups();
 
 private:
     static constexpr auto kTopicBufferSize = 255;
     static constexpr auto kBaseTopicBufferSize = 200;   // just node/property
     static constexpr auto kColorBufferSize = 20;        // should be plenty for 3 uints and 2 commas
-    static constexpr auto kPayloadBufferSize = 100;     // longest is the $properties list
+
+    // The setters we subscribe to: color, mode, scene and the preset commands per segment, plus the firmware update and
+    // the groups. Routes are by the path below the device or group, so groups don't need routes of their own.
+    static constexpr uint8_t kSegmentSetterCount = 6;
+    static constexpr uint8_t kMaxRoutes = led_ring_config::kSegmentCount * kSegmentSetterCount + 2;
+    // open addressing, so keep it at most half full. Must be a power of 2.
+    static constexpr uint8_t kRouteTableSize = kMaxRoutes <= 8 ? 16 : kMaxRoutes <= 16 ? 32 : kMaxRoutes <= 32 ? 64 : 128;
+    static constexpr auto kPropertyCount = static_cast<uint8_t>(SettableProperty::Count);
+    static_assert(kRouteTableSize >= 2 * kMaxRoutes, "Route table too small");
 
     static constexpr auto kBaseTopicTemplate = "homie/%s/%s";
-    static constexpr auto kIntegerType = "integer";
-    static constexpr auto kStringType = "string";
-    static constexpr auto kColorType = "color";
+    static constexpr auto kGroupTopicTemplate = "homie/$broadcast/%s/+/+/set";
+    // publishing the Homie description or the queue stops after this time, and continues in the next loop
+    static constexpr unsigned long kPublishSliceMicros = 5000;
 
     static constexpr int kWillQos = 1;
     static constexpr bool kRetainWill = true;
     static constexpr bool kRetainMessage = true;
     static constexpr auto kStateProperty = "$state";
-    static constexpr auto kDeviceNode = "device";
-
-    static constexpr auto kByteFormat = "0-255";
-    static constexpr auto kColorHsvFormat = "hsv";
+    // PubSubClient waits this long (s) for the broker's answer while connecting
+    static constexpr uint16_t kSocketTimeout = 2;
+    static constexpr unsigned long kInitialRetryDelay = 1000; // ms
+    static constexpr unsigned long kMaxRetryDelay = 60000; // ms
+    static constexpr uint16_t kNoSlot = UINT16_MAX;
+
+    // PubSubClient gets a plain function per driver, which its std::function keeps without allocating
+    using CallbackForwarder = void (*)(char* topic, uint8_t* payload, unsigned int length);
+    struct ForwarderTable {
+        CallbackForwarder entries[kMaxInstances];
+    };
+    template <uint16_t Slot>
+    static void forwardCallback(char* topic, uint8_t* payload, unsigned int length);
+    template <size_t... Slots>
+    static constexpr ForwarderTable makeForwarders(std::index_sequence<Slots...>) {
+        return { { &forwardCallback<Slots>... } };
+    }
+    // the driver per slot, nullptr if free
+    static MqttDriver* _instances[kMaxInstances];
+    uint16_t _slot = kNoSlot;
 
     const char* _clientName = nullptr;
+    size_t _clientNameLength = 0;
+    const GroupStore* _groups = nullptr;
     bool _wasAnnounced = false;
+    bool _isNetworkAvailable = false;
+    MqttState _state = MqttState::WaitingForNetwork;
+    Backoff _backoff{kInitialRetryDelay, kMaxRetryDelay};
+    uint16_t _announcementIndex = 0;
     char _topicBuffer[kTopicBufferSize] = { };
-    MqttPropertyCallback _propertyCallback = nullptr;
+    MqttPropertyHandler _propertyHandlers[kPropertyCount] = { };
+
+    // Entries with length 0 are empty. The group subscriptions are wildcards, so anyone can send any path to them.
+    // Hash and length only narrow the search down; the path is <node>/<property>/set, compared with the names.
+    struct TopicRoute {
+        uint32_t hash;
+        uint16_t length;
+        SettableProperty property;
+        uint8_t segment;
+        const char* node;
+        const char* name;
+
+        bool matches(uint32_t pathHash, size_t pathLength, const char* path) const;
+    };
+    TopicRoute _routes[kRouteTableSize] = { };
+    PublishQueue _publishQueue;
+    // one per driver, so several can run side by side, e.g. to simulate a fleet on a host
+    PubSubClient _client;
+    MqttTraffic _traffic = {};
+
+#if LED_RING_STATS
+    static constexpr unsigned long kStatsInterval = 60000; // ms
+    // interval, uptime, freeheap, fragmentation, maxblock, lateness, mqtt, and a summary and histogram per stage
+    static constexpr uint8_t kStatsEntryCount = 7 + 2 * stats::kStageCount;
+    unsigned long _lastStatsRound = 0;
+    uint8_t _statsIndex = kStatsEntryCount;
+    void continueStats();
+#endif
 
-    bool announceDevice();
-    void announceNode(const char* baseTopic, const char* name, const char* properties);
-    void announceProperty(const char* baseTopic, const char* name, const char* dataType, const char* format, bool settable);
+    // subscribes to homie/<device>/<node>/<name>/set. Node and name must be string constants, as the route keeps them.
+    void addRoute(const char* node, const char* name, SettableProperty property, uint8_t segment);
+    // a forwarder for this driver, or nullptr if all are taken
+    CallbackForwarder claimForwarder();
+    // one connection attempt, bounded by the client and socket timeouts
+    bool connect(unsigned long now);
+    void connectionFailed(unsigned long now);
+    void continueAnnouncement();
+    void countPublish(const char* topic, const char* payload);
+    void drainPublishQueue();
     void mqttCallback(const char* topic, const uint8_t* payload, unsigned int length);
     bool publishEntity(const char* baseTopic, const char* entity, const char* payload);
+    bool publishStateNow(const char* state);
+    const TopicRoute* findRoute(const char* path) const;
+    // the path below homie/<device>/ or below the group, or nullptr if the topic is neither
+    const char* routePath(const char* topic, bool& isGroupTopic) const;
+    bool startAnnouncement();
     void subscribeSetters();
-    static bool tryParseTopic(char* copyTopic, const char*& node, const char*& property, bool& isSetter);
+    void updateGroupSubscriptions(bool isJoining);
 };
 
 #endif
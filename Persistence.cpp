@@ -12,47 +12,69 @@
 #include "Persistence.h"
 #include <EEPROM.h>
 #include <ESP.h>
+#include "Logger.h"
+#include "Stats.h"
 
-void Persistence::begin() {
-    // set last save time to before the save interval so a new put saves immediately
-    _lastSaveTime = millis() - kMinSaveInterval - 1;
-    EEPROM.begin(kSaveSize);
+Persistence::Persistence() :
+    _flash(flash_layout::kJournalFirstSector, flash_layout::kJournalSectorCount), 
+    _journal(&_flash, sizeof(_state.ledState)) {}
 
-    EEPROM.get(0, _state);
-    Serial.printf("Read from to EEPROM: %04x h=%d\n", _state.magicNumber, _state.ledState.hue);
+void Persistence::begin() {
+    // the first to use the flash at boot, so this checks the whole layout
+    const EspFlashRegion layout(0, flash_layout::kSectorCount);
+    if (!layout.isInPartition()) {
+        LOG_ERROR("No file system partition of %u sectors, so nothing is saved", flash_layout::kSectorCount);
+    }
+    const unsigned long start = micros();
+    bool isValid = _journal.begin(_state.ledState);
+    LOG_INFO("Read journal in %lu us (%u reads): h=%d", micros() - start, _journal.scanReads(), _state.ledState[0].hue);
 
-    if (_state.magicNumber != kMagicNumber || !_state.ledState.isValid()) {
-        LedState::setDefault(_state.ledState); 
-        put(&_state.ledState);
+    if (!isValid) {
+        isValid = readEeprom();
+    }
+    for (const auto& ledState : _state.ledState) {
+        isValid = isValid && ledState.isValid();
+    }
+    _state.magicNumber = kMagicNumber;
+    if (!isValid) {
+        for (auto& ledState : _state.ledState) {
+            LedState::setDefault(ledState);
+        }
+        save();
     }
 }
 
 const LedState* Persistence::get() {
   // if begin wasn't called yet, do it first 
     if (_state.magicNumber != kMagicNumber) begin();
-    return &_state.ledState;
+    return _state.ledState;
+}
+
+bool Persistence::put(const uint8_t segment, const LedState* state) {
+    if (segment >= led_ring_config::kSegmentCount) return false;
+    if (_state.ledState[segment] == *state) return true;
+    _state.ledState[segment] = *state;
+    STATS_TIME(Stage::FlashCommit);
+    save();
+    return true;
 }
 
-bool Persistence::put(const LedState* state) {
-    if (_state.ledState == *state) return true;
-    _pendingState = *state;
-    _putPending = true;
-    return update();
+// *** private methods ***
+
+// migrates the state from before the journal
+bool Persistence::readEeprom() {
+    EEPROM.begin(kSaveSize);
+    EEPROM.get(0, _state);
+    EEPROM.end();
+    LOG_INFO("Read from EEPROM: %04x h=%d", _state.magicNumber, _state.ledState[0].hue);
+    if (_state.magicNumber != kMagicNumber) return false;
+    save();
+    return true;
 }
 
-bool Persistence::update() {
-    if (!_putPending) return true;
-    const unsigned long now = millis();
-
-    if (now - _lastSaveTime >= kMinSaveInterval) {
-        _state.magicNumber = kMagicNumber;
-        _state.ledState = _pendingState;
-        Serial.printf("Writing to EEPROM: %04x h=%d\n", _state.magicNumber, _state.ledState.hue);
-        EEPROM.put(0, _state);
-        EEPROM.commit();
-        _lastSaveTime = now;
-        _putPending = false;
-        return true;
+void Persistence::save() {
+    LOG_DEBUG("Writing to journal: h=%d", _state.ledState[0].hue);
+    if (!_journal.append(_state.ledState)) {
+        LOG_ERROR("Could not write to journal");
     }
-    return false;
 }
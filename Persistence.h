@@ -12,33 +12,43 @@
 #ifndef HEADER_PERSISTENCE
 #define HEADER_PERSISTENCE
 
+// Keeps the LED state in a journal spread over several flash sectors (see Journal).
+// Earlier versions kept it in EEPROM. That is migrated when the journal is still empty.
+
+#include "FlashRegion.h"
+#include "Journal.h"
+#include "LedRingConfig.h"
 #include "LedState.h"
-#include "LedStateSink.h"
 #include <cstdint>
 
+// the pre-journal EEPROM layout
 struct PersistedLedState {
     uint16_t magicNumber; // initialized to 0 which is different from the magic number
-    LedState ledState;
+    LedState ledState[led_ring_config::kSegmentCount];
 };
 
-class Persistence: public LedStateSink {
+class Persistence {
 public:
+    Persistence();
     void  begin();
-    void onStateCommitted(const LedState& state) override { put(&state); }
-    bool acceptsUpdate() override { return true; }
+    void onStateCommitted(const uint8_t segment, const LedState& state) { put(segment, &state); }
+    // returns led_ring_config::kSegmentCount states
     const LedState* get();
-    bool put(const LedState* ledState);
-    bool update();
+    // writes right away. The Controller debounces, see CommitPolicy.
+    bool put(uint8_t segment, const LedState* ledState);
+    const Journal& journal() const { return _journal; }
 
 private:
-    static constexpr uint8_t kSaveSize = sizeof(PersistedLedState);
-    static constexpr uint16_t kMagicNumber = 0xBABE;
-    static constexpr unsigned long kMinSaveInterval = 1000; // 1 second
+    static constexpr uint16_t kSaveSize = sizeof(PersistedLedState);
+    // a different number of segments changes the layout, so that invalidates what was saved
+    static constexpr uint16_t kMagicNumber = 0xBABE + led_ring_config::kSegmentCount - 1;
+
+    bool readEeprom();
+    void save();
 
+    EspFlashRegion _flash;
+    Journal _journal;
     PersistedLedState _state = {};
-    LedState _pendingState = {};          
-    bool _putPending = false;
-    unsigned long _lastSaveTime = 0;  
 };
 
 #endif
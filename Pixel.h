@@ -0,0 +1,43 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+
+#ifndef HEADER_PIXEL
+#define HEADER_PIXEL
+
+#include <cstdint>
+
+// Same ranges as LedState: hue 0-360, saturation and value 0-100
+struct HsvPixel {
+    uint16_t hue;
+    uint8_t saturation;
+    uint8_t value;
+};
+
+struct RgbPixel {
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+
+    bool operator==(const RgbPixel& other) const {
+        return red == other.red && green == other.green && blue == other.blue;
+    }
+    bool operator!=(const RgbPixel& other) const { return !(*this == other); }
+};
+
+// 8.8 fixed point per channel, full is 0xFF00. The LEDs get 8 bits, so the fraction is shown by temporal dithering.
+struct Rgb16Pixel {
+    uint16_t red;
+    uint16_t green;
+    uint16_t blue;
+};
+
+#endif
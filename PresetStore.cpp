@@ -0,0 +1,60 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+
+#include <ESP.h>
+#include <cstddef>
+#include "PresetStore.h"
+#include "Utilities.h"
+
+using utilities::crc32;
+
+PresetStore::PresetStore() : _flash(flash_layout::kPresetFirstSector, kPresetCount) {}
+
+bool PresetStore::store(const uint8_t preset, const LedState& state) {
+    if (preset >= kPresetCount || !state.isValid()) return false;
+    PresetRecord record = {};
+    record.magic = kMagic;
+    record.size = sizeof(LedState);
+    record.state = state;
+    record.crc = crcOf(record);
+
+    if (!_flash.eraseSector(preset)) return false;
+    _erases++;
+    if (!_flash.write(preset * FlashRegion::kSectorSize, reinterpret_cast<const uint32_t*>(&record), sizeof(record))) return false;
+    _writes++;
+    return true;
+}
+
+bool PresetStore::recall(const uint8_t preset, LedState& state) {
+    if (preset >= kPresetCount) return false;
+    const unsigned long start = micros();
+    PresetRecord record;
+    _reads++;
+    const bool isValid = _flash.read(preset * FlashRegion::kSectorSize, reinterpret_cast<uint32_t*>(&record), sizeof(record))
+        && record.magic == kMagic && record.size == sizeof(LedState) && record.crc == crcOf(record) && record.state.isValid();
+    if (isValid) state = record.state;
+    _lastRecallMicros = micros() - start;
+    return isValid;
+}
+
+bool PresetStore::remove(const uint8_t preset) {
+    if (preset >= kPresetCount) return false;
+    if (!_flash.eraseSector(preset)) return false;
+    _erases++;
+    return true;
+}
+
+// *** private methods ***
+
+uint32_t PresetStore::crcOf(const PresetRecord& record) {
+    return crc32(&record, offsetof(PresetRecord, crc));
+}
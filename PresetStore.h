@@ -0,0 +1,58 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+
+// Numbered presets of a LedState in flash, so a look can be recalled with just its number.
+// Every preset has its own flash sector, so recalling one is a single read without any scanning,
+// storing one is an erase and a write, and deleting one is an erase.
+
+#ifndef HEADER_PRESET_STORE
+#define HEADER_PRESET_STORE
+
+#include <cstdint>
+#include "FlashRegion.h"
+#include "LedState.h"
+
+class PresetStore {
+public:
+    static constexpr uint8_t kPresetCount = flash_layout::kPresetCount;
+
+    PresetStore();
+    bool store(uint8_t preset, const LedState& state);
+    // returns false if the preset doesn't exist
+    bool recall(uint8_t preset, LedState& state);
+    bool remove(uint8_t preset);
+
+    uint32_t reads() const { return _reads; }
+    uint32_t writes() const { return _writes; }
+    uint32_t erases() const { return _erases; }
+    unsigned long lastRecallMicros() const { return _lastRecallMicros; }
+
+private:
+    struct alignas(4) PresetRecord {
+        uint16_t magic;
+        uint16_t size;
+        LedState state;
+        uint32_t crc;
+    };
+
+    static constexpr uint16_t kMagic = 0x5052;
+
+    static uint32_t crcOf(const PresetRecord& record);
+
+    EspFlashRegion _flash;
+    uint32_t _reads = 0;
+    uint32_t _writes = 0;
+    uint32_t _erases = 0;
+    unsigned long _lastRecallMicros = 0;
+};
+
+#endif
@@ -0,0 +1,31 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// Tables in flash. On the ESP8266 they need the pgm_read functions; elsewhere (e.g. when measuring
+// the pure C++ parts on a PC) they are ordinary constants, so the same code compiles without the Arduino core.
+
+#ifndef HEADER_PROGMEM
+#define HEADER_PROGMEM
+
+#ifdef ARDUINO
+#include <pgmspace.h>
+#else
+#include <cstdint>
+#include <cstring>
+
+#define PROGMEM
+#define pgm_read_byte(address) (*reinterpret_cast<const uint8_t*>(address))
+#define pgm_read_word(address) (*reinterpret_cast<const uint16_t*>(address))
+#define pgm_read_dword(address) (*reinterpret_cast<const uint32_t*>(address))
+#define memcpy_P memcpy
+#endif
+
+#endif
@@ -0,0 +1,95 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+
+#include "PublishQueue.h"
+#include "Utilities.h"
+
+using utilities::copy_string;
+
+bool PublishQueue::push(const char* path, const char* payload) {
+    QueuedMessage* message = find(path);
+    if (message != nullptr) {
+        _coalesced++;
+        // going back to what the broker already has means there's nothing to send anymore
+        if (wasPublished(path, payload)) {
+            message->sequence = 0;
+            _depth--;
+            return true;
+        }
+        copy_string(message->payload, sizeof(message->payload), payload);
+        return true;
+    }
+    if (wasPublished(path, payload)) {
+        _suppressed++;
+        return true;
+    }
+    for (auto& candidate : _messages) {
+        if (candidate.sequence != 0) continue;
+        copy_string(candidate.path, sizeof(candidate.path), path);
+        copy_string(candidate.payload, sizeof(candidate.payload), payload);
+        candidate.sequence = _nextSequence++;
+        _depth++;
+        return true;
+    }
+    _dropped++;
+    return false;
+}
+
+const QueuedMessage* PublishQueue::front() const {
+    const QueuedMessage* oldest = nullptr;
+    for (const auto& message : _messages) {
+        if (message.sequence == 0) continue;
+        if (oldest == nullptr || message.sequence < oldest->sequence) oldest = &message;
+    }
+    return oldest;
+}
+
+void PublishQueue::acknowledge() {
+    auto* message = const_cast<QueuedMessage*>(front());
+    if (message == nullptr) return;
+    Published* published = findPublished(message->path);
+    if (published == nullptr) published = findPublished("");
+    // if all slots are taken we just can't suppress duplicates for this topic
+    if (published != nullptr) {
+        copy_string(published->path, sizeof(published->path), message->path);
+        copy_string(published->payload, sizeof(published->payload), message->payload);
+    }
+    message->sequence = 0;
+    _depth--;
+}
+
+void PublishQueue::forget(const char* path) {
+    Published* published = findPublished(path);
+    if (published != nullptr) *published = {};
+}
+
+// *** private methods ***
+
+QueuedMessage* PublishQueue::find(const char* path) {
+    for (auto& message : _messages) {
+        if (message.sequence != 0 && strcmp(message.path, path) == 0) return &message;
+    }
+    return nullptr;
+}
+
+// an empty path finds a free slot
+PublishQueue::Published* PublishQueue::findPublished(const char* path) {
+    for (auto& published : _published) {
+        if (strcmp(published.path, path) == 0) return &published;
+    }
+    return nullptr;
+}
+
+bool PublishQueue::wasPublished(const char* path, const char* payload) {
+    const Published* published = findPublished(path);
+    return published != nullptr && strcmp(published->payload, payload) == 0;
+}
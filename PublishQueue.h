@@ -0,0 +1,69 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+
+// Fixed size queue of outbound retained MQTT messages. It keeps only the latest value per topic,
+// and drops values that are the same as what was last published to that topic.
+// Since the values are retained, the broker still has the last published one, so the result is the same. 
+// Messages stay queued until they are published, so they survive a reconnect.
+
+#ifndef HEADER_PUBLISH_QUEUE
+#define HEADER_PUBLISH_QUEUE
+
+#include <cstddef>
+#include <cstdint>
+#include "LedRingConfig.h"
+
+struct QueuedMessage {
+    char path[32];      // relative to the device topic, e.g. $fw/status
+    char payload[64];
+    uint32_t sequence;  // order of arrival, 0 if the slot is free
+};
+
+class PublishQueue {
+public:
+    // device properties, $state, firmware properties, and color and mode per segment
+    static constexpr uint8_t kCapacity = 9 + 2 * led_ring_config::kSegmentCount;
+
+    bool push(const char* path, const char* payload);
+    // the oldest message, or nullptr if the queue is empty
+    const QueuedMessage* front() const;
+    // call after front() was published successfully
+    void acknowledge();
+    // for topics that changed outside our control, e.g. $state by the will
+    void forget(const char* path);
+
+    uint8_t depth() const { return _depth; }
+    uint32_t coalesced() const { return _coalesced; }
+    uint32_t suppressed() const { return _suppressed; }
+    uint32_t dropped() const { return _dropped; }
+
+private:
+    // Copies rather than hashes, so a collision can't suppress a changed value: the broker would keep the old one.
+    struct Published {
+        char path[sizeof(QueuedMessage::path)];  // empty if the slot is free
+        char payload[sizeof(QueuedMessage::payload)];
+    };
+
+    QueuedMessage* find(const char* path);
+    Published* findPublished(const char* path);
+    bool wasPublished(const char* path, const char* payload);
+
+    QueuedMessage _messages[kCapacity] = {};
+    Published _published[kCapacity] = {};
+    uint32_t _nextSequence = 1;
+    uint8_t _depth = 0;
+    uint32_t _coalesced = 0;
+    uint32_t _suppressed = 0;
+    uint32_t _dropped = 0;
+};
+
+#endif
@@ -0,0 +1,57 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+#include <WiFiUdp.h>
+#include "RealtimeReceiver.h"
+#include "Logger.h"
+
+WiFiUDP realtimeUdp;
+
+void RealtimeReceiver::begin() {
+    realtimeUdp.begin(DdpStream::kPort);
+    LOG_INFO("Listening for DDP on port %u", DdpStream::kPort);
+}
+
+bool RealtimeReceiver::loop() {
+    for (uint8_t i = 0; i < kMaxPacketsPerRun; i++) {
+        const int size = realtimeUdp.parsePacket();
+        if (size <= 0) break;
+        const int length = realtimeUdp.read(_packet, sizeof(_packet));
+        if (length > 0) _stream.feed(_packet, static_cast<size_t>(length), micros());
+    }
+
+    const unsigned long now = micros();
+    if (!_stream.isActive(now)) {
+        if (_isStreaming) {
+            LOG_INFO("DDP stream stopped (so far frames %u, shown %u, skipped %u, overruns %u, gaps %u, late %u)",
+                _stream.frames(), _stream.shownFrames(), _stream.skippedFrames(), _stream.overrunFrames(), _stream.gaps(), _stream.latePackets());
+            _isStreaming = false;
+            _stream.end();
+            _ledDriver->endRealtime();
+            return true;
+        }
+        return false;
+    }
+    if (!_isStreaming) {
+        LOG_INFO("DDP stream started");
+        _isStreaming = true;
+    }
+    const RgbPixel* frame = _stream.next(now);
+    if (frame == nullptr) return false;
+    _ledDriver->showRealtime(frame);
+    return true;
+}
+
+unsigned long RealtimeReceiver::microsUntilDue() const {
+    if (!_isStreaming) return kIdlePollMicros;
+    const unsigned long frameWait = _stream.microsUntilDue(micros());
+    return frameWait < kActivePollMicros ? frameWait : kActivePollMicros;
+}
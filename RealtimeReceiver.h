@@ -0,0 +1,47 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// Receives realtime pixel streams as DDP over plain UDP (port 4048), e.g. from xLights, Hyperion or LedFx.
+// While a stream is active its frames go straight to the LEDs and override the committed state.
+// When it stops, the LEDs show the committed state again. MQTT keeps working meanwhile, and the committed state
+// still follows commands, so it is up to date when the stream ends.
+
+#ifndef HEADER_REALTIME_RECEIVER
+#define HEADER_REALTIME_RECEIVER
+
+#include "DdpStream.h"
+#include "LedRingDriver.h"
+
+class RealtimeReceiver {
+public:
+    explicit RealtimeReceiver(LedRingDriver* ledDriver) : _ledDriver(ledDriver) {}
+    // (re)binds the port. Call when the network (re)connected.
+    void begin();
+    // Reads waiting packets and shows the frame that is due. Returns true if the LEDs got a frame or the stream ended.
+    bool loop();
+    // when loop() needs to run again
+    unsigned long microsUntilDue() const;
+    const DdpStream& stream() const { return _stream; }
+
+private:
+    // how often to look for packets while no stream is active, and while one is
+    static constexpr unsigned long kIdlePollMicros = 20000;
+    static constexpr unsigned long kActivePollMicros = 2000;
+    // bounds the time spent reading in one run, so a flood of packets doesn't starve the rest
+    static constexpr uint8_t kMaxPacketsPerRun = 8;
+
+    LedRingDriver* _ledDriver;
+    DdpStream _stream;
+    bool _isStreaming = false;
+    uint8_t _packet[DdpStream::kMaxPacketSize] = {};
+};
+
+#endif
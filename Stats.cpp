@@ -0,0 +1,91 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+#include "Stats.h"
+
+namespace stats {
+    const char* stage_name(const Stage stage) {
+        switch (stage) {
+            case Stage::Loop: return "loop";
+            case Stage::MqttLoop: return "mqtt";
+            case Stage::LedShow: return "show";
+            case Stage::FlashCommit: return "flash";
+            default: return "unknown";
+        }
+    }
+}
+
+#if LED_RING_STATS
+
+#include <ESP.h>
+
+namespace stats {
+    namespace {
+        // a task may run this late before it counts as a slip
+        constexpr unsigned long kSlackMicros = 10000;
+
+        StageStats stages[kStageCount] = {};
+        LatenessStats latenessStats = {};
+
+        uint8_t bucket_of(const uint32_t micros) {
+            uint8_t bucket = 0;
+            // 64 us for the first bucket, then a factor 4 per bucket
+            for (uint32_t limit = 64; bucket < kBucketCount - 1 && micros >= limit; limit <<= 2) {
+                bucket++;
+            }
+            return bucket;
+        }
+    }
+
+    void record(const Stage stage, const uint32_t cycles) {
+        StageStats& entry = stages[static_cast<uint8_t>(stage)];
+        if (entry.count == 0 || cycles < entry.minCycles) entry.minCycles = cycles;
+        if (cycles > entry.maxCycles) entry.maxCycles = cycles;
+        entry.count++;
+        entry.totalCycles += cycles;
+        entry.histogram[bucket_of(cycles_to_micros(cycles))]++;
+    }
+
+    void record_lateness(const unsigned long lateness) {
+        latenessStats.runs++;
+        if (lateness > kSlackMicros) latenessStats.slips++;
+        if (lateness > latenessStats.maxLateness) latenessStats.maxLateness = lateness;
+    }
+
+    const StageStats& stage(const Stage stage) {
+        return stages[static_cast<uint8_t>(stage)];
+    }
+
+    const LatenessStats& lateness() {
+        return latenessStats;
+    }
+
+    void reset_stage(const Stage stage) {
+        stages[static_cast<uint8_t>(stage)] = {};
+    }
+
+    void reset_lateness() {
+        latenessStats = {};
+    }
+
+    uint32_t cycles_to_micros(const uint32_t cycles) {
+        return cycles / ESP.getCpuFreqMHz();
+    }
+
+    // the cycle counter wraps after about 53 s at 80 MHz, but unsigned subtraction handles that for shorter stages
+    ScopedStageTimer::ScopedStageTimer(const Stage stage) : _stage(stage), _start(ESP.getCycleCount()) {}
+
+    ScopedStageTimer::~ScopedStageTimer() {
+        record(_stage, ESP.getCycleCount() - _start);
+    }
+}
+
+#endif
@@ -0,0 +1,89 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// Run time statistics of the main stages, measured with the CPU cycle counter and published as Homie $stats.
+// Build with LED_RING_STATS=0 (e.g. -DLED_RING_STATS=0 for a release) to compile all of it out.
+
+#ifndef HEADER_STATS
+#define HEADER_STATS
+
+#ifndef LED_RING_STATS
+#define LED_RING_STATS 1
+#endif
+
+#include <cstdint>
+
+enum class Stage : uint8_t {
+    Loop,
+    MqttLoop,
+    LedShow,
+    FlashCommit,
+    Count
+};
+
+namespace stats {
+    // buckets are a factor 4 apart: <64, <256, <1024, <4096, <16384 and >=16384 microseconds
+    constexpr uint8_t kBucketCount = 6;
+    constexpr uint8_t kStageCount = static_cast<uint8_t>(Stage::Count);
+
+    struct StageStats {
+        uint32_t count;
+        uint32_t minCycles;
+        uint32_t maxCycles;
+        uint64_t totalCycles;
+        uint32_t histogram[kBucketCount];
+    };
+
+    // how late scheduled tasks ran
+    struct LatenessStats {
+        uint32_t runs;
+        uint32_t slips;                 // runs that started more than kSlackMicros late
+        unsigned long maxLateness;      // us
+    };
+
+    // the name is used in the $stats topic, so keep it short
+    const char* stage_name(Stage stage);
+
+#if LED_RING_STATS
+    void record(Stage stage, uint32_t cycles);
+    void record_lateness(unsigned long lateness);
+    const StageStats& stage(Stage stage);
+    const LatenessStats& lateness();
+    // starts a new measurement period, so min and max are per period
+    void reset_stage(Stage stage);
+    void reset_lateness();
+    uint32_t cycles_to_micros(uint32_t cycles);
+
+    class ScopedStageTimer {
+    public:
+        explicit ScopedStageTimer(Stage stage);
+        ~ScopedStageTimer();
+        ScopedStageTimer(const ScopedStageTimer&) = delete;
+        ScopedStageTimer& operator=(const ScopedStageTimer&) = delete;
+    private:
+        Stage _stage;
+        uint32_t _start;
+    };
+#endif
+}
+
+#if LED_RING_STATS
+#define STATS_CONCAT_INNER(a, b) a##b
+#define STATS_CONCAT(a, b) STATS_CONCAT_INNER(a, b)
+// times the rest of the enclosing scope
+#define STATS_TIME(stage) stats::ScopedStageTimer STATS_CONCAT(statsTimer, __LINE__)(stage)
+#define STATS_LATENESS(lateness) stats::record_lateness(lateness)
+#else
+#define STATS_TIME(stage) do { } while (false)
+#define STATS_LATENESS(lateness) do { } while (false)
+#endif
+
+#endif
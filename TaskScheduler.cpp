@@ -0,0 +1,82 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+#include "TaskScheduler.h"
+#include "Stats.h"
+
+static_assert(TaskScheduler::kMaxTasks <= 8, "Tasks that ran in a pass are tracked in a byte");
+
+TaskScheduler::TaskScheduler(const Clock clock) : _clock(clock) {}
+
+uint8_t TaskScheduler::add(Task task) {
+    if (_taskCount >= kMaxTasks) return kNoTask;
+    _tasks[_taskCount] = { task, _clock(), true };
+    return _taskCount++;
+}
+
+void TaskScheduler::trigger(const uint8_t task) {
+    if (task >= _taskCount) return;
+    _tasks[task].deadline = _clock();
+    _tasks[task].isWaiting = true;
+    _triggers++;
+}
+
+unsigned long TaskScheduler::run() {
+    _passes++;
+    // every task runs at most once per pass, so a task that is always due can't starve the others
+    uint8_t ran = 0;
+    unsigned long now = _clock();
+    for (uint8_t index = earliestDue(now, ran); index != kNoTask; index = earliestDue(now, ran)) {
+        Entry& entry = _tasks[index];
+        ran |= 1 << index;
+        STATS_LATENESS(now - entry.deadline);
+        // before running, so a trigger from within the task stands
+        entry.isWaiting = false;
+        const unsigned long wait = entry.task(now);
+        _taskRuns++;
+        now = _clock();
+        if (wait == kIdle) continue;
+        const unsigned long deadline = now + wait;
+        // keep an earlier deadline from a trigger
+        if (!entry.isWaiting || static_cast<long>(deadline - entry.deadline) < 0) {
+            entry.deadline = deadline;
+            entry.isWaiting = true;
+        }
+    }
+    return untilNextDeadline(now);
+}
+
+// *** private methods ***
+
+// Linear, as there are only a few tasks. Returns kNoTask if none is due.
+uint8_t TaskScheduler::earliestDue(const unsigned long now, const uint8_t excluded) const {
+    uint8_t earliest = kNoTask;
+    for (uint8_t i = 0; i < _taskCount; i++) {
+        const Entry& entry = _tasks[i];
+        if (!entry.isWaiting || (excluded & (1 << i)) != 0) continue;
+        // signed difference so this keeps working when the clock wraps
+        if (static_cast<long>(now - entry.deadline) < 0) continue;
+        if (earliest == kNoTask || static_cast<long>(entry.deadline - _tasks[earliest].deadline) < 0) earliest = i;
+    }
+    return earliest;
+}
+
+unsigned long TaskScheduler::untilNextDeadline(const unsigned long now) const {
+    unsigned long wait = kIdle;
+    for (uint8_t i = 0; i < _taskCount; i++) {
+        const Entry& entry = _tasks[i];
+        if (!entry.isWaiting) continue;
+        const auto remaining = static_cast<long>(entry.deadline - now);
+        if (remaining <= 0) return 0;
+        if (static_cast<unsigned long>(remaining) < wait) wait = remaining;
+    }
+    return wait;
+}
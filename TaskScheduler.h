@@ -0,0 +1,65 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// Runs tasks when they are due instead of polling everything in every loop. After running, a task says when
+// it wants to run again, and events (e.g. an MQTT message that changed the state) can trigger a task right away.
+// The loop can then sleep until the earliest deadline.
+
+#ifndef HEADER_TASK_SCHEDULER
+#define HEADER_TASK_SCHEDULER
+
+#include <climits>
+#include <cstdint>
+#include "Delegate.h"
+
+class TaskScheduler {
+public:
+    // returned by a task that only needs to run when triggered
+    static constexpr unsigned long kIdle = ULONG_MAX;
+    static constexpr uint8_t kMaxTasks = 8;
+    static constexpr uint8_t kNoTask = 0xFF;
+
+    // returns the current time in microseconds, e.g. micros()
+    using Clock = unsigned long(*)();
+    // gets the current time, and returns the microseconds until it wants to run again, or kIdle
+    using Task = Delegate<unsigned long(unsigned long nowMicros)>;
+
+    explicit TaskScheduler(Clock clock);
+    // the task first runs at the next run(). Returns kNoTask if there's no room.
+    uint8_t add(Task task);
+    // makes the task run as soon as possible; can be called from within a task
+    void trigger(uint8_t task);
+    // Runs the due tasks, earliest deadline first. Returns the microseconds until the next deadline, or kIdle.
+    unsigned long run();
+
+    uint32_t passes() const { return _passes; }
+    uint32_t taskRuns() const { return _taskRuns; }
+    uint32_t triggers() const { return _triggers; }
+
+private:
+    struct Entry {
+        Task task;
+        unsigned long deadline;
+        bool isWaiting;     // false if idle until triggered
+    };
+
+    uint8_t earliestDue(unsigned long now, uint8_t excluded) const;
+    unsigned long untilNextDeadline(unsigned long now) const;
+
+    Clock _clock;
+    Entry _tasks[kMaxTasks] = {};
+    uint8_t _taskCount = 0;
+    uint32_t _passes = 0;
+    uint32_t _taskRuns = 0;
+    uint32_t _triggers = 0;
+};
+
+#endif
@@ -14,18 +14,24 @@
 
 namespace utilities {
 
-    log_callback logger = nullptr;
-
-    void build_topic(char* buffer, size_t size, const char* base, const char* sub1, const char* sub2) {
-        strlcpy(buffer, base, size);
-        strlcat(buffer, "/", size);
-        strlcat(buffer, sub1, size);
+    void build_topic(char* buffer, const size_t size, const char* base, const char* sub1, const char* sub2) {
+        // one pass over the buffer instead of rescanning it for every part
         if (sub2) {
-            strlcat(buffer, "/", size);
-            strlcat(buffer, sub2, size);
+            snprintf_t(buffer, size, "%s/%s/%s", base, sub1, sub2);
+        } else {
+            snprintf_t(buffer, size, "%s/%s", base, sub1);
         }
     }
 
+    bool copy_string(char* buffer, const size_t size, const char* source) {
+        if (size == 0) return false;
+        const size_t length = strnlen(source, size);
+        const size_t copyLength = length < size ? length : size - 1;
+        memcpy(buffer, source, copyLength);
+        buffer[copyLength] = '\0';
+        return copyLength == length;
+    }
+
     int clamp(int value, const int min, const int max) {
         if (min == max) return min;
 
@@ -65,8 +71,56 @@ namespace utilities {
         return token;
     }
 
-    void build_url(char* buffer, size_t size, const char* base, const char* child) {
-        strlcpy(buffer, base, size);
-        strlcat(buffer, child, size);
+    uint32_t crc32(const void* data, const size_t length, uint32_t crc) {
+        // bitwise, as the records we check are small and a table would cost 1 KB
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        crc = ~crc;
+        for (size_t i = 0; i < length; i++) {
+            crc ^= bytes[i];
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ (0xEDB88320UL & (0 - (crc & 1)));
+            }
+        }
+        return ~crc;
+    }
+
+    uint32_t hash_string(const char* text, size_t& length) {
+        constexpr uint32_t fnvPrime = 16777619UL;
+        uint32_t hash = 2166136261UL;
+        const char* current = text;
+        while (*current != '\0') {
+            hash ^= static_cast<uint8_t>(*current++);
+            hash *= fnvPrime;
+        }
+        length = current - text;
+        return hash;
+    }
+
+    size_t parse_ints(const char* text, const size_t length, int* values, const size_t maxCount, const char delimiter) {
+        size_t index = 0;
+        size_t parsed = 0;
+        while (parsed < maxCount) {
+            while (index < length && text[index] == ' ') index++;
+            bool isNegative = false;
+            if (index < length && (text[index] == '-' || text[index] == '+')) {
+                isNegative = text[index] == '-';
+                index++;
+            }
+            if (index >= length || text[index] < '0' || text[index] > '9') break;
+            long value = 0;
+            while (index < length && text[index] >= '0' && text[index] <= '9') {
+                // saturate rather than overflow, callers clamp anyway
+                if (value < 100000000L) value = value * 10 + (text[index] - '0');
+                index++;
+            }
+            values[parsed++] = static_cast<int>(isNegative ? -value : value);
+            if (index >= length || text[index] != delimiter) break;
+            index++;
+        }
+        return parsed;
+    }
+
+    void build_url(char* buffer, const size_t size, const char* base, const char* child) {
+        snprintf_t(buffer, size, "%s%s", base, child);
     }
 }
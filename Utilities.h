@@ -14,29 +14,21 @@
 
 #include <cstdio>
 #include <cstring>
+#include <cstdint>
 #include <algorithm>
+#include "Logger.h"
 
 namespace utilities {
 
-    using log_callback = void(*)(const char*);
-
-    extern log_callback logger;
-
-    inline void set_logger(const log_callback log) { logger = log; }
-
     template <typename... Arguments>
     bool snprintf_t(char* buffer, const size_t size, const char* const format, Arguments ... arguments) {
         const int usedSize = snprintf(buffer, size, format, arguments...);
         if (usedSize >= 0 && static_cast<size_t>(usedSize) < size) return true;
-        if (logger) {
-            char message[64];
-            if (usedSize < 0) {
-                snprintf(message, sizeof(message), "snprintf error (returned %d)", usedSize);
-            }
-            else {
-                snprintf(message, sizeof(message), "snprintf truncated (wanted %d, max %zu)", usedSize, size);
-            }
-            logger(message);
+        if (usedSize < 0) {
+            LOG_WARNING("snprintf error (returned %d)", usedSize);
+        }
+        else {
+            LOG_WARNING("snprintf truncated (wanted %d, max %zu)", usedSize, size);
         }
         if (size > 0) {
             buffer[size - 1] = '\0';
@@ -49,6 +41,10 @@ namespace utilities {
         return snprintf_t(buffer, BufferSize, format, arguments...);
     }
 
+    // Like strlcpy (which not every C library has): copies at most size - 1 characters and always terminates.
+    // Returns false if the source didn't fit.
+    bool copy_string(char* buffer, size_t size, const char* source);
+
     int clamp(int value, int min, int max);
     void build_url(char* buffer, size_t size, const char* base, const char* child);
     void build_topic(char* buffer, size_t size, const char* base, const char* sub1, const char* sub2 = nullptr);
@@ -56,6 +52,16 @@ namespace utilities {
     // thread safe alternative for strtok
     char* next_token(char** start, int delimiter);
 
+    // CRC-32 (IEEE), as used by zip
+    uint32_t crc32(const void* data, size_t length, uint32_t crc = 0);
+
+    // 32 bit FNV-1a hash of a zero terminated string. Also returns the length, as that comes for free.
+    uint32_t hash_string(const char* text, size_t& length);
+
+    // Parses up to maxCount delimited integers from a text that doesn't need to be zero terminated.
+    // Returns the number of integers parsed; stops at the first one that isn't valid.
+    size_t parse_ints(const char* text, size_t length, int* values, size_t maxCount, char delimiter = ',');
+
     int scale_clamped(int value, int inMin, int inMax, int outMin, int outMax);
     float scale_clamped(int value, int inMin, int inMax, float outMin, float outMax);
 
@@ -18,44 +18,182 @@
 
 #include <cstdint>
 #include <cstring>
+#include <type_traits>
 
+using utilities::hash_string;
 using utilities::snprintf_t;
 
 constexpr auto kLocalHostIp = "127.0.0.1";
 
 namespace {
-    BearSSL::WiFiClientSecure wifi_client;
+    // A full TLS handshake takes seconds of CPU on an ESP8266. This keeps a session per host (the broker and the
+    // firmware server), so reconnecting can resume it instead. That needs a server with a session cache
+    // (e.g. Mosquitto and nginx have one); otherwise every connection is a miss.
+    class SessionCachingClient : public BearSSL::WiFiClientSecure {
+    public:
+        using BearSSL::WiFiClientSecure::connect;
+
+        // Asks the server for records of at most this size, so the receive buffer can be that small instead of 16 KB.
+        // Servers without the max fragment length extension need the full buffer, which this only takes if the heap
+        // has room for it; otherwise it refuses to connect.
+        void preferFragmentLength(const uint16_t length) { _fragmentLength = length; }
+
+        int connect(const char* host, const uint16_t port) override {
+            if (_fragmentLength != 0) {
+                const bool isSupported = probeMaxFragmentLength(host, port, _fragmentLength);
+                if (!isSupported) {
+                    const uint32_t largestBlock = ESP.getMaxFreeBlockSize();
+                    if (largestBlock < kMaxRecordSize + kHeapReserve) {
+                        LOG_ERROR("%s needs a %d byte TLS buffer, largest free block is %u", host, kMaxRecordSize, largestBlock);
+                        return 0;
+                    }
+                    LOG_WARNING("%s can't limit TLS records to %u bytes, using %d", host, _fragmentLength, kMaxRecordSize);
+                }
+                setBufferSizes(isSupported ? _fragmentLength : kMaxRecordSize, kTransmitBufferSize);
+            }
+            BearSSL::Session& session = sessionFor(host, port);
+            setSession(&session);
+            // Only the core's client can see the session parameters, so the session is compared as a whole:
+            // resuming keeps the ID and the master secret, a full handshake replaces them.
+            BearSSL::Session previous;
+            memcpy(&previous, &session, sizeof(session));
+
+            const unsigned long start = millis();
+            const int result = BearSSL::WiFiClientSecure::connect(host, port);
+            if (result == 0) return result;
+
+            const bool isResumed = memcmp(&previous, &kNoSession, sizeof(previous)) != 0 &&
+                memcmp(&previous, &session, sizeof(session)) == 0;
+            if (isResumed) _hits++; else _misses++;
+            LOG_INFO("TLS session with %s %s in %lu ms (hits %u, misses %u)",
+                host, isResumed ? "resumed" : "negotiated", millis() - start, _hits, _misses);
+            return result;
+        }
+
+        int connect(const String& host, const uint16_t port) override {
+            return connect(host.c_str(), port);
+        }
+
+        uint32_t hits() const { return _hits; }
+        uint32_t misses() const { return _misses; }
+
+    private:
+        static constexpr uint8_t kSessionCount = 2;
+        static constexpr int kMaxRecordSize = 16384;
+        static constexpr int kTransmitBufferSize = 512;
+        // what the rest of the firmware needs to keep running next to a full record buffer (see WifiDriver.h)
+        static constexpr uint32_t kHeapReserve = 8192;
+        static_assert(std::is_trivially_copyable<BearSSL::Session>::value, "Sessions are copied and compared bytewise");
+        // what a session looks like before its first handshake
+        static const BearSSL::Session kNoSession;
+
+        struct CachedSession {
+            uint32_t hostHash;      // 0 if free
+            uint16_t port;
+            BearSSL::Session session;
+        };
+
+        // replaces the oldest entry if the host is new
+        BearSSL::Session& sessionFor(const char* host, const uint16_t port) {
+            size_t length;
+            uint32_t hash = hash_string(host, length);
+            if (hash == 0) hash = 1;
+            for (auto& cached : _sessions) {
+                if (cached.hostHash == hash && cached.port == port) return cached.session;
+            }
+            CachedSession& entry = _sessions[_nextEntry];
+            _nextEntry = (_nextEntry + 1) % kSessionCount;
+            entry.hostHash = hash;
+            entry.port = port;
+            entry.session = BearSSL::Session();
+            return entry.session;
+        }
+
+        CachedSession _sessions[kSessionCount] = {};
+        uint8_t _nextEntry = 0;
+        uint32_t _hits = 0;
+        uint32_t _misses = 0;
+        uint16_t _fragmentLength = 0;
+    };
+
+    const BearSSL::Session SessionCachingClient::kNoSession;
+
+    // the firmware download runs next to the MQTT connection, so it keeps its TLS buffers small if it can
+    constexpr uint16_t kFirmwareFragmentLength = 4096;
+
+    SessionCachingClient wifi_client;
+    SessionCachingClient firmware_client;
     BearSSL::X509List ca_cert(kConfigRootCaCertificate);
 }
 
-bool WifiDriver::begin() {
+void WifiDriver::begin() {
     WiFi.mode(WIFI_STA);
-    wifi_client.setTrustAnchors(&ca_cert);
+    // we retry ourselves, with a backoff
+    WiFi.setAutoReconnect(false);
+    for (SessionCachingClient* client : { &wifi_client, &firmware_client }) {
+        client->setTrustAnchors(&ca_cert);
+        client->setTimeout(kClientTimeout);
+    }
+    firmware_client.preferFragmentLength(kFirmwareFragmentLength);
     if (!WiFi.hostname(kConfigDeviceName)) {
-        Serial.println("Could not set host name");
+        LOG_WARNING("Could not set host name");
     }
+    LOG_INFO("Connecting to WiFi");
     WiFi.begin(kConfigSsid, kConfigWifiPassword);
-    Serial.print("Connecting");
-    int attempts = 0;
-    while (WiFi.status() != WL_CONNECTED && attempts < 20) {
-        delay(500);
-        attempts++;
-        Serial.print(".");
-    }
-    return isConnected();
+    _state = WifiState::Connecting;
+    _attemptStart = millis();
 }
 
 WiFiClient* WifiDriver::client() {
     return &wifi_client;
 }
 
+WiFiClient* WifiDriver::firmwareClient() {
+    return &firmware_client;
+}
+
+uint32_t WifiDriver::sessionHits() const {
+    return wifi_client.hits() + firmware_client.hits();
+}
+
+uint32_t WifiDriver::sessionMisses() const {
+    return wifi_client.misses() + firmware_client.misses();
+}
+
 bool WifiDriver::isConnected() { 
     return WiFi.status() == WL_CONNECTED; 
 }
 
-void WifiDriver::reconnect() {
-    if (isConnected()) return;
-    WiFi.reconnect();
+bool WifiDriver::loop() {
+    const unsigned long now = millis();
+    switch (_state) {
+        case WifiState::Connecting:
+            if (isConnected()) {
+                connected();
+                return true;
+            }
+            if (now - _attemptStart >= kConnectTimeout) {
+                _backoff.failed(now, ESP.random());
+                _state = WifiState::WaitingToRetry;
+                LOG_WARNING("Could not connect to WiFi, retrying in about %lu s", _backoff.currentDelay() / 1000);
+            }
+            return false;
+        case WifiState::Connected:
+            if (!isConnected()) {
+                LOG_WARNING("Lost WiFi connection");
+                startAttempt(now);
+            }
+            return false;
+        case WifiState::WaitingToRetry:
+            // the attempt may still have succeeded after we gave up on it; reconnecting would drop that link
+            if (isConnected()) {
+                connected();
+                return true;
+            }
+            if (_backoff.isDue(now)) startAttempt(now);
+            return false;
+    }
+    return false;
 }
 
 const char* WifiDriver::macAddress() {
@@ -76,5 +214,22 @@ const char* WifiDriver::ipAddress() {
 }
 
 void WifiDriver::printStatus() {
-    Serial.printf("\nConnected to SSID: %s, IP: %s, name: %s, Mac address: %s\n", WiFi.SSID(), ipAddress(), WiFi.hostname().c_str(), macAddress() );
+    // from the configuration, as WiFi.SSID() and WiFi.hostname() return Strings
+    LOG_INFO("Connected to SSID: %s, IP: %s, name: %s, Mac address: %s", kConfigSsid, ipAddress(), kConfigDeviceName, macAddress());
+}
+
+// *** private methods ***
+
+void WifiDriver::connected() {
+    _state = WifiState::Connected;
+    _backoff.succeeded();
+    // the address may have changed
+    _ipAddress[0] = '\0';
+    printStatus();
+}
+
+void WifiDriver::startAttempt(const unsigned long now) {
+    WiFi.reconnect();
+    _state = WifiState::Connecting;
+    _attemptStart = now;
 }
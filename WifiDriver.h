@@ -12,30 +12,63 @@
 // This class connects to Wifi and prepares for using TLS connections
 // The assumption is that you have your own Root CA certificate that has signed the certificates of the devices and the hosts you use.
 // This way, you can use TLS without swithching on the insecure flag.
-// The interface hides the TLS complexity by exposing a normal WiFiClient that MQTTDriver and FirmwareManager can use.
+// The interface hides the TLS complexity by exposing normal WiFiClients that MQTTDriver and FirmwareManager can use.
+// They each get their own, so the MQTT connection stays up (and can report progress) during a firmware download.
+//
+// Heap budget: a TLS client holds its receive and transmit buffers plus about 5 KB of BearSSL state while connected.
+// The MQTT client keeps the default 16 KB receive buffer, as not every broker can limit its record size: about 22 KB.
+// The firmware client asks for records of at most 4 KB (the max fragment length extension), which makes it about
+// 10 KB, so both fit in the roughly 40 KB that is free once WiFi is up. A server without the extension would need
+// another 22 KB in the middle of an OTA update. The firmware client then only connects if the largest free block
+// can take the 16 KB buffer with 8 KB to spare, and fails the download otherwise instead of running out of heap.
 // So should you e.g. want to use normal HTTP instead, all you need to change is this class.
 
 #ifndef HEADER_WIFIDRIVER
 #define HEADER_WIFIDRIVER
 
 #include "WiFiClient.h"
+#include "Backoff.h"
+
+// Connecting happens in the background: begin() only starts it, and loop() follows up without waiting.
+enum class WifiState : uint8_t {
+    Connecting,
+    Connected,
+    WaitingToRetry
+};
 
 class WifiDriver {
 public:
-    bool begin();
+    void begin();
     WiFiClient* client();
+    WiFiClient* firmwareClient();
     const char* macAddress();
     const char* ipAddress();
     void printStatus();
-    void loop() { if (!isConnected()) reconnect(); }
+    // Call periodically. Returns true if the connection was just made.
+    bool loop();
 
     bool isConnected();
-    void reconnect();
+    WifiState state() const { return _state; }
+    // TLS connections that resumed an earlier session, and the ones that needed a full handshake
+    uint32_t sessionHits() const;
+    uint32_t sessionMisses() const;
 private:
     static constexpr int kMacAddressSize = 14;
     static constexpr int kIpAddressSize = 16;
+    // give up on an attempt after this time, and try again after a backoff
+    static constexpr unsigned long kConnectTimeout = 15000; // ms
+    static constexpr unsigned long kInitialRetryDelay = 2000; // ms
+    static constexpr unsigned long kMaxRetryDelay = 120000; // ms
+    // bounds how long a TLS connection attempt can keep the loop waiting
+    static constexpr uint16_t kClientTimeout = 2000; // ms
+
+    void connected();
+    void startAttempt(unsigned long now);
+
     char _macAddress[kMacAddressSize] = {0};
     char _ipAddress[kIpAddressSize] = {0};
-    bool _isConnected = false;
+    WifiState _state = WifiState::Connecting;
+    unsigned long _attemptStart = 0;
+    Backoff _backoff{kInitialRetryDelay, kMaxRetryDelay};
 };
 #endif
@@ -0,0 +1,81 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+#include "Device.h"
+#include "secrets.h"
+
+namespace {
+    constexpr auto kVersion = "host";
+}
+
+Device::Device(const char* name, host::Flash* flash)
+    : _flash(flash),
+      _scheduler(micros),
+      _sinks{
+          make_sink(&_leds, CommitPolicy::Immediate),
+          make_sink(&_persistence, CommitPolicy::Debounced, kPersistenceDebounce),
+          make_sink(&_mqtt, CommitPolicy::RateLimited, kMqttStateInterval)
+      },
+      _controller(&_leds, &_firmware, &_mqtt, &_presets, _sinks, kVersion) {
+    strlcpy(_name, name, sizeof(_name));
+}
+
+void Device::begin(const char* broker, const uint16_t port) {
+    selectFlash();
+    _persistence.begin();
+    _controller.beginLed(_persistence.get());
+    _firmware.begin(&_firmwareClient, kConfigBaseFirmwareUrl, _name);
+    _mqtt.begin(&_client, _name, broker, port);
+    _groups.begin();
+    _controller.joinGroups(&_groups);
+    _controller.listenToMqtt();
+    _mqtt.publishFirmwareProperty(kNameProperty, _name);
+    _mqtt.publishFirmwareProperty(kVersionProperty, kVersion);
+    _controller.schedule(&_scheduler);
+    _scheduler.add(TaskScheduler::Task::bind<&Device::checkNetwork>(this));
+}
+
+unsigned long Device::step() {
+    selectFlash();
+    return _scheduler.run();
+}
+
+void Device::sleep(const unsigned long waitMicros) {
+    if (waitMicros >= kMinSleepMicros) {
+        delay(std::min(waitMicros, kMaxSleepMicros) / 1000);
+    } else {
+        yield();
+    }
+}
+
+void Device::run(const unsigned long micros) {
+    const uint64_t end = host::now_micros() + micros;
+    while (host::now_micros() < end) {
+        const uint64_t left = end - host::now_micros();
+        sleep(static_cast<unsigned long>(std::min<uint64_t>(step(), left)));
+    }
+}
+
+bool Device::settle(const unsigned long maxMicros) {
+    const uint64_t end = host::now_micros() + maxMicros;
+    while (host::now_micros() < end) {
+        sleep(step());
+        if (_mqtt.state() == MqttState::Ready && _mqtt.publishQueue().depth() == 0) return true;
+    }
+    return false;
+}
+
+// *** private methods ***
+
+unsigned long Device::checkNetwork(unsigned long) {
+    _mqtt.setNetworkAvailable(host::is_link_up());
+    return kNetworkCheckInterval * 1000UL;
+}
@@ -0,0 +1,86 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// The firmware of one LED ring wired up like the sketch does it, for the host tests and simulations: the same
+// drivers, stores, sinks and tasks, talking MQTT through a WiFiClient of its own and keeping its flash in a
+// host::Flash of its own, so several devices can run side by side. The realtime stream and the WiFi driver use
+// globals, so they are left out; the network counts as available while the fake WiFi link is up.
+// Meant for the virtual clock (host::use_virtual_clock).
+
+#ifndef HEADER_BENCH_DEVICE
+#define HEADER_BENCH_DEVICE
+
+#include <ESP8266WiFi.h>
+
+#include "Controller.h"
+#include "FirmwareManager.h"
+#include "GroupStore.h"
+#include "Host.h"
+#include "LedRingDriver.h"
+#include "MqttDriver.h"
+#include "Persistence.h"
+#include "PresetStore.h"
+#include "TaskScheduler.h"
+
+class Device {
+public:
+    static constexpr size_t kMaxNameSize = 32;
+    static constexpr unsigned long kNetworkCheckInterval = 500; // ms
+    static constexpr unsigned long kPersistenceDebounce = 2000; // ms
+    static constexpr unsigned long kMqttStateInterval = 250; // ms
+    static constexpr unsigned long kMinSleepMicros = 1000;
+    static constexpr unsigned long kMaxSleepMicros = 100000;
+
+    // The name is also the MQTT client name. Without a flash of its own, the device uses the default one.
+    explicit Device(const char* name, host::Flash* flash = nullptr);
+    Device(const Device&) = delete;
+    Device& operator=(const Device&) = delete;
+
+    // what setup() does: restores the state, shows it, and starts connecting to the broker
+    void begin(const char* broker, uint16_t port);
+    // One pass of loop() without the sleep: runs what is due. Returns the microseconds until the next deadline.
+    unsigned long step();
+    // what loop() does after a pass: sleeps until the deadline, within limits
+    static void sleep(unsigned long waitMicros);
+    // runs loop() for this long
+    void run(unsigned long micros);
+    // runs until MQTT is ready and the queue is empty; false if that didn't happen in time
+    bool settle(unsigned long maxMicros = 30000000);
+
+    const char* name() const { return _name; }
+    LedRingDriver& leds() { return _leds; }
+    MqttDriver& mqtt() { return _mqtt; }
+    Persistence& persistence() { return _persistence; }
+    PresetStore& presets() { return _presets; }
+    TaskScheduler& scheduler() { return _scheduler; }
+    WiFiClient& client() { return _client; }
+    host::Flash* flash() const { return _flash; }
+
+private:
+    unsigned long checkNetwork(unsigned long nowMicros);
+    void selectFlash() const { host::select_flash(_flash); }
+
+    char _name[kMaxNameSize];
+    host::Flash* _flash;
+    LedRingDriver _leds;
+    Persistence _persistence;
+    PresetStore _presets;
+    GroupStore _groups;
+    FirmwareManager _firmware;
+    MqttDriver _mqtt;
+    WiFiClient _client;
+    WiFiClient _firmwareClient;
+    TaskScheduler _scheduler;
+    SinkEntry _sinks[3];
+    Controller _controller;
+};
+
+#endif
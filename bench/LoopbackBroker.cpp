@@ -0,0 +1,572 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+#include <algorithm>
+#include <cstring>
+
+#include "LoopbackBroker.h"
+#include "Utilities.h"
+
+using utilities::hash_string;
+
+namespace {
+    constexpr uint8_t kConnect = 0x10;
+    constexpr uint8_t kConnAck = 0x20;
+    constexpr uint8_t kPublish = 0x30;
+    constexpr uint8_t kPubAck = 0x40;
+    constexpr uint8_t kSubscribe = 0x80;
+    constexpr uint8_t kSubAck = 0x90;
+    constexpr uint8_t kUnsubscribe = 0xA0;
+    constexpr uint8_t kUnsubAck = 0xB0;
+    constexpr uint8_t kPingReq = 0xC0;
+    constexpr uint8_t kPingResp = 0xD0;
+    constexpr uint8_t kDisconnect = 0xE0;
+
+    // a length prefixed string from a packet; false if it doesn't fit in the packet or the target
+    bool read_string(const uint8_t* packet, const size_t size, size_t& position, char* target, const size_t targetSize) {
+        if (position + 2 > size) return false;
+        const size_t length = static_cast<size_t>(packet[position] << 8 | packet[position + 1]);
+        position += 2;
+        if (position + length > size || length >= targetSize) return false;
+        memcpy(target, packet + position, length);
+        target[length] = '\0';
+        position += length;
+        return true;
+    }
+
+    // a length prefixed field that we skip or keep as bytes
+    bool read_bytes(const uint8_t* packet, const size_t size, size_t& position, const uint8_t*& data, size_t& length) {
+        if (position + 2 > size) return false;
+        length = static_cast<size_t>(packet[position] << 8 | packet[position + 1]);
+        position += 2;
+        if (position + length > size) return false;
+        data = packet + position;
+        position += length;
+        return true;
+    }
+}
+
+// One client connection: the bytes from the client are handled as soon as a packet is complete,
+// and the bytes to the client wait in a ring buffer until it reads them.
+class LoopbackBroker::Session : public host::Connection {
+public:
+    static constexpr size_t kMaxClientIdSize = 64;
+    static constexpr size_t kMaxSubscriptions = 48;
+    static constexpr size_t kInboundSize = 2048;
+    static constexpr size_t kOutboundSize = 32768;
+    static constexpr size_t kMaxWillPayloadSize = 64;
+
+    explicit Session(LoopbackBroker* broker) : _broker(broker) {}
+
+    bool isFree() const { return !_isHeldByClient; }
+    bool isLive() const { return _isHeldByClient && _isOpen && _isConnected; }
+    const char* clientId() const { return _clientId; }
+
+    void start() {
+        _isHeldByClient = true;
+        _isOpen = true;
+        _isConnected = false;
+        _clientId[0] = '\0';
+        _hasWill = false;
+        _subscriptionCount = 0;
+        _inboundSize = 0;
+        _outStart = 0;
+        _outSize = 0;
+    }
+
+    // closes from the broker's side
+    void end() {
+        _isOpen = false;
+        _isConnected = false;
+        _subscriptionCount = 0;
+    }
+
+    size_t send(const uint8_t* data, const size_t size) override {
+        if (!_isOpen) return 0;
+        size_t taken = 0;
+        while (taken < size && _isOpen) {
+            const size_t count = std::min(size - taken, kInboundSize - _inboundSize);
+            memcpy(_inbound + _inboundSize, data + taken, count);
+            _inboundSize += count;
+            taken += count;
+            if (!handlePackets()) break;
+        }
+        return taken;
+    }
+
+    size_t available() const override { return _outSize; }
+
+    size_t receive(uint8_t* buffer, const size_t size) override {
+        const size_t count = std::min(size, _outSize);
+        for (size_t i = 0; i < count; i++) {
+            buffer[i] = _outbound[(_outStart + i) % kOutboundSize];
+        }
+        _outStart = (_outStart + count) % kOutboundSize;
+        _outSize -= count;
+        return count;
+    }
+
+    bool isOpen() const override { return _isOpen; }
+
+    void close() override {
+        if (_isOpen) {
+            _isOpen = false;
+            if (_isConnected) _broker->lose(*this);
+            _isConnected = false;
+        }
+        _isHeldByClient = false;
+    }
+
+    // a message on a topic the session subscribed to, without the retain flag unless it comes from the store
+    void deliver(const char* topic, const uint8_t* payload, const size_t length, const bool isRetained) {
+        if (!isLive()) return;
+        for (size_t i = 0; i < _subscriptionCount; i++) {
+            if (!matches(_subscriptions[i], topic)) continue;
+            const size_t topicLength = strlen(topic);
+            uint8_t header[2 + kMaxTopicSize];
+            header[0] = static_cast<uint8_t>(topicLength >> 8);
+            header[1] = static_cast<uint8_t>(topicLength & 0xFF);
+            memcpy(header + 2, topic, topicLength);
+            if (writePacket(isRetained ? kPublish | 1 : kPublish, header, 2 + topicLength, payload, length)) {
+                _broker->_counters.deliveries++;
+                _broker->_counters.deliveredBytes += topicLength + length;
+            }
+            // one copy, even if several subscriptions match
+            return;
+        }
+    }
+
+    const char* will(const uint8_t*& payload, size_t& length, bool& isRetained) const {
+        if (!_hasWill) return nullptr;
+        payload = reinterpret_cast<const uint8_t*>(_willPayload);
+        length = _willLength;
+        isRetained = _isWillRetained;
+        return _willTopic;
+    }
+
+private:
+    LoopbackBroker* _broker;
+    bool _isHeldByClient = false;
+    bool _isOpen = false;
+    bool _isConnected = false;
+    char _clientId[kMaxClientIdSize] = {};
+    bool _hasWill = false;
+    bool _isWillRetained = false;
+    char _willTopic[kMaxTopicSize] = {};
+    char _willPayload[kMaxWillPayloadSize] = {};
+    size_t _willLength = 0;
+    char _subscriptions[kMaxSubscriptions][kMaxTopicSize] = {};
+    size_t _subscriptionCount = 0;
+    uint8_t _inbound[kInboundSize] = {};
+    size_t _inboundSize = 0;
+    uint8_t _outbound[kOutboundSize] = {};
+    size_t _outStart = 0;
+    size_t _outSize = 0;
+
+    // handles the complete packets in the inbound buffer; false if the connection ended
+    bool handlePackets() {
+        while (_isOpen) {
+            size_t remaining = 0;
+            size_t headerSize = 1;
+            uint32_t multiplier = 1;
+            uint8_t digit;
+            do {
+                if (headerSize >= _inboundSize) return true;
+                if (headerSize == 5) {
+                    end();
+                    return false;
+                }
+                digit = _inbound[headerSize++];
+                remaining += (digit & 127) * multiplier;
+                multiplier <<= 7;
+            } while ((digit & 128) != 0);
+            const size_t total = headerSize + remaining;
+            if (total > kInboundSize) {
+                end();
+                return false;
+            }
+            if (total > _inboundSize) return true;
+            handle(_inbound[0], _inbound + headerSize, remaining);
+            memmove(_inbound, _inbound + total, _inboundSize - total);
+            _inboundSize -= total;
+        }
+        return false;
+    }
+
+    void handle(const uint8_t header, const uint8_t* packet, const size_t size) {
+        if (_broker->_isSilent) return;
+        const uint8_t type = header & 0xF0;
+        if (!_isConnected && type != kConnect) {
+            end();
+            return;
+        }
+        switch (type) {
+            case kConnect:
+                handleConnect(packet, size);
+                break;
+            case kPublish:
+                handlePublish(header, packet, size);
+                break;
+            case kSubscribe:
+            case kUnsubscribe:
+                handleSubscription(type == kSubscribe, packet, size);
+                break;
+            case kPingReq: {
+                _broker->_counters.pings++;
+                writePacket(kPingResp, nullptr, 0, nullptr, 0);
+                break;
+            }
+            case kDisconnect:
+                _broker->_counters.disconnects++;
+                // a clean disconnect doesn't publish the will
+                _hasWill = false;
+                end();
+                break;
+            default:
+                break;
+        }
+    }
+
+    void handleConnect(const uint8_t* packet, const size_t size) {
+        size_t position = 0;
+        char protocol[8];
+        if (_isConnected || !read_string(packet, size, position, protocol, sizeof(protocol)) || position + 4 > size) {
+            end();
+            return;
+        }
+        const uint8_t flags = packet[position + 1];
+        position += 4;
+        const bool isIdRead = read_string(packet, size, position, _clientId, sizeof(_clientId));
+        _hasWill = (flags & 0x04) != 0;
+        bool isValid = isIdRead;
+        if (_hasWill && isValid) {
+            const uint8_t* willPayload;
+            isValid = read_string(packet, size, position, _willTopic, sizeof(_willTopic)) &&
+                read_bytes(packet, size, position, willPayload, _willLength) && _willLength < kMaxWillPayloadSize;
+            if (isValid) memcpy(_willPayload, willPayload, _willLength);
+            _isWillRetained = (flags & 0x20) != 0;
+        }
+        const uint8_t code = !isValid ? 2 : _broker->_connackCode;
+        const uint8_t answer[] = { 0, code };
+        writePacket(kConnAck, answer, sizeof(answer), nullptr, 0);
+        if (code != 0) {
+            _broker->_counters.refusals++;
+            _hasWill = false;
+            end();
+            return;
+        }
+        // a new connection with the same id takes over
+        for (Session* other : _broker->_sessions) {
+            if (other != this && other->isLive() && strcmp(other->_clientId, _clientId) == 0) {
+                _broker->_counters.takeovers++;
+                other->_hasWill = false;
+                other->end();
+            }
+        }
+        _isConnected = true;
+        _broker->_counters.connects++;
+    }
+
+    void handlePublish(const uint8_t header, const uint8_t* packet, const size_t size) {
+        size_t position = 0;
+        char topic[kMaxTopicSize];
+        if (!read_string(packet, size, position, topic, sizeof(topic))) return;
+        const uint8_t qos = (header >> 1) & 0x03;
+        if (qos > 0) {
+            if (position + 2 > size) return;
+            const uint8_t answer[] = { packet[position], packet[position + 1] };
+            position += 2;
+            writePacket(kPubAck, answer, sizeof(answer), nullptr, 0);
+        }
+        _broker->publish(topic, packet + position, size - position, (header & 0x01) != 0);
+    }
+
+    void handleSubscription(const bool isSubscribing, const uint8_t* packet, const size_t size) {
+        if (size < 2) return;
+        const uint8_t id[] = { packet[0], packet[1] };
+        size_t position = 2;
+        uint8_t grants[16];
+        size_t grantCount = 0;
+        char filter[kMaxTopicSize];
+        while (position < size && read_string(packet, size, position, filter, sizeof(filter))) {
+            if (!isSubscribing) {
+                _broker->_counters.unsubscribes++;
+                removeSubscription(filter);
+                continue;
+            }
+            position++;   // requested QoS; we deliver at 0
+            _broker->_counters.subscribes++;
+            const bool isAdded = addSubscription(filter);
+            if (grantCount < sizeof(grants)) grants[grantCount++] = isAdded ? 0x00 : 0x80;
+            if (isAdded) _broker->deliverRetained(*this, filter);
+        }
+        if (isSubscribing) {
+            // the acknowledgement goes after the retained messages, as with most brokers
+            uint8_t answer[2 + sizeof(grants)];
+            memcpy(answer, id, 2);
+            memcpy(answer + 2, grants, grantCount);
+            writePacket(kSubAck, answer, 2 + grantCount, nullptr, 0);
+        } else {
+            writePacket(kUnsubAck, id, sizeof(id), nullptr, 0);
+        }
+    }
+
+    bool addSubscription(const char* filter) {
+        for (size_t i = 0; i < _subscriptionCount; i++) {
+            if (strcmp(_subscriptions[i], filter) == 0) return true;
+        }
+        if (_subscriptionCount >= kMaxSubscriptions) return false;
+        strcpy(_subscriptions[_subscriptionCount++], filter);
+        return true;
+    }
+
+    void removeSubscription(const char* filter) {
+        for (size_t i = 0; i < _subscriptionCount; i++) {
+            if (strcmp(_subscriptions[i], filter) != 0) continue;
+            // the last one moves into the gap
+            if (i != --_subscriptionCount) strcpy(_subscriptions[i], _subscriptions[_subscriptionCount]);
+            return;
+        }
+    }
+
+    // the fixed header, then head and tail; all or nothing
+    bool writePacket(const uint8_t header, const uint8_t* head, const size_t headSize, const uint8_t* tail, const size_t tailSize) {
+        uint8_t fixed[5];
+        size_t fixedSize = 0;
+        fixed[fixedSize++] = header;
+        size_t remaining = headSize + tailSize;
+        do {
+            uint8_t digit = remaining & 127;
+            remaining >>= 7;
+            if (remaining > 0) digit |= 0x80;
+            fixed[fixedSize++] = digit;
+        } while (remaining > 0);
+        if (_outSize + fixedSize + headSize + tailSize > kOutboundSize) {
+            _broker->_counters.overflows++;
+            return false;
+        }
+        append(fixed, fixedSize);
+        append(head, headSize);
+        append(tail, tailSize);
+        return true;
+    }
+
+    void append(const uint8_t* data, const size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            _outbound[(_outStart + _outSize++) % kOutboundSize] = data[i];
+        }
+    }
+};
+
+LoopbackBroker::LoopbackBroker(const size_t maxClients, const size_t maxRetained) {
+    _sessions.reserve(maxClients);
+    for (size_t i = 0; i < maxClients; i++) _sessions.push_back(new Session(this));
+    // a power of two, at most half full
+    size_t slots = 16;
+    while (slots < 2 * maxRetained) slots <<= 1;
+    _retained.resize(slots);
+}
+
+LoopbackBroker::~LoopbackBroker() {
+    if (_isListening) host::stop_listening(this);
+    for (const Session* session : _sessions) delete session;
+}
+
+bool LoopbackBroker::listen(const char* host, const uint16_t port) {
+    _isListening = host::listen(host, port, this);
+    return _isListening;
+}
+
+host::Connection* LoopbackBroker::accept() {
+    _counters.attempts++;
+    if (!_isAccepting) return nullptr;
+    for (Session* session : _sessions) {
+        if (!session->isFree()) continue;
+        session->start();
+        return session;
+    }
+    return nullptr;
+}
+
+void LoopbackBroker::inject(const char* topic, const char* payload, const bool isRetained) {
+    inject(topic, reinterpret_cast<const uint8_t*>(payload), strlen(payload), isRetained);
+}
+
+void LoopbackBroker::inject(const char* topic, const uint8_t* payload, const size_t length, const bool isRetained) {
+    publish(topic, payload, length, isRetained);
+}
+
+void LoopbackBroker::observe(const Observer observer, void* context) {
+    _observer = observer;
+    _observerContext = context;
+}
+
+bool LoopbackBroker::drop(const char* clientId) {
+    Session* session = findSession(clientId);
+    if (session == nullptr) return false;
+    lose(*session);
+    session->end();
+    return true;
+}
+
+void LoopbackBroker::dropAll() {
+    for (Session* session : _sessions) {
+        if (!session->isLive()) continue;
+        lose(*session);
+        session->end();
+    }
+}
+
+bool LoopbackBroker::isConnected(const char* clientId) const {
+    return findSession(clientId) != nullptr;
+}
+
+size_t LoopbackBroker::clientCount() const {
+    size_t count = 0;
+    for (const Session* session : _sessions) {
+        if (session->isLive()) count++;
+    }
+    return count;
+}
+
+size_t LoopbackBroker::retainedBytes() const {
+    size_t bytes = 0;
+    for (const RetainedMessage& message : _retained) {
+        if (message.isUsed && !message.isDeleted) bytes += strlen(message.topic) + strlen(message.payload);
+    }
+    return bytes;
+}
+
+const char* LoopbackBroker::retained(const char* topic) const {
+    size_t length;
+    const RetainedMessage* message = const_cast<LoopbackBroker*>(this)->findRetained(topic, hash_string(topic, length));
+    return message != nullptr && message->isUsed && !message->isDeleted ? message->payload : nullptr;
+}
+
+// + matches one level, # the rest (including the parent level), like MQTT 3.1.1. Topics starting with $ aren't
+// matched by wildcards at the first level.
+bool LoopbackBroker::matches(const char* filter, const char* topic) {
+    if (topic[0] == '$' && (filter[0] == '+' || filter[0] == '#')) return false;
+    while (*filter != '\0') {
+        if (*filter == '#') return true;
+        if (*filter == '+') {
+            while (*topic != '\0' && *topic != '/') topic++;
+            filter++;
+        } else {
+            while (*filter != '\0' && *filter != '/') {
+                if (*filter++ != *topic++) return false;
+            }
+            if (*topic != '\0' && *topic != '/') return false;
+        }
+        if (*filter == '\0') return *topic == '\0';
+        // filter is at a /
+        if (*topic == '\0') return strcmp(filter, "/#") == 0;
+        filter++;
+        topic++;
+    }
+    return *topic == '\0';
+}
+
+// *** private methods ***
+
+void LoopbackBroker::publish(const char* topic, const uint8_t* payload, const size_t length, const bool isRetained) {
+    if (strlen(topic) >= kMaxTopicSize) return;
+    _counters.published++;
+    _counters.publishedBytes += strlen(topic) + length;
+    if (_observer != nullptr) _observer(_observerContext, topic, payload, length, isRetained);
+    if (isRetained) {
+        _counters.retainedPublished++;
+        retain(topic, payload, length);
+    }
+    for (Session* session : _sessions) session->deliver(topic, payload, length, false);
+}
+
+// an empty payload deletes what is retained
+void LoopbackBroker::retain(const char* topic, const uint8_t* payload, const size_t length) {
+    size_t topicLength;
+    const uint32_t hash = hash_string(topic, topicLength);
+    if (topicLength >= kMaxTopicSize || length >= kMaxRetainedPayloadSize) return;
+    RetainedMessage* message = findRetained(topic, hash);
+    if (message == nullptr) return;
+    const bool wasKept = message->isUsed && !message->isDeleted;
+    if (length == 0) {
+        if (wasKept) {
+            message->isDeleted = true;
+            _retainedCount--;
+        }
+        return;
+    }
+    if (!wasKept) {
+        if (2 * (_retainedCount + 1) > _retained.size()) return;
+        _retainedCount++;
+    }
+    message->hash = hash;
+    message->isUsed = true;
+    message->isDeleted = false;
+    memcpy(message->topic, topic, topicLength + 1);
+    memcpy(message->payload, payload, length);
+    message->payload[length] = '\0';
+}
+
+// the entry with the topic, or else the first free or deleted one on its path
+LoopbackBroker::RetainedMessage* LoopbackBroker::findRetained(const char* topic, const uint32_t hash) {
+    const size_t mask = _retained.size() - 1;
+    RetainedMessage* reusable = nullptr;
+    for (size_t slot = hash & mask, probes = 0; probes < _retained.size(); slot = (slot + 1) & mask, probes++) {
+        RetainedMessage& message = _retained[slot];
+        if (!message.isUsed) return reusable != nullptr ? reusable : &message;
+        if (message.hash == hash && strcmp(message.topic, topic) == 0) return &message;
+        if (message.isDeleted && reusable == nullptr) reusable = &message;
+    }
+    return reusable;
+}
+
+void LoopbackBroker::deliverRetained(Session& session, const char* filter) {
+    const bool hasWildcard = strpbrk(filter, "+#") != nullptr;
+    if (!hasWildcard) {
+        size_t length;
+        const RetainedMessage* message = findRetained(filter, hash_string(filter, length));
+        if (message != nullptr && message->isUsed && !message->isDeleted) {
+            session.deliver(message->topic, reinterpret_cast<const uint8_t*>(message->payload), strlen(message->payload), true);
+        }
+        return;
+    }
+    for (const RetainedMessage& message : _retained) {
+        if (message.isUsed && !message.isDeleted && matches(filter, message.topic)) {
+            session.deliver(message.topic, reinterpret_cast<const uint8_t*>(message.payload), strlen(message.payload), true);
+        }
+    }
+}
+
+// the connection ended without a DISCONNECT
+void LoopbackBroker::lose(Session& session) {
+    _counters.lostClients++;
+    const uint8_t* payload;
+    size_t length;
+    bool isRetained;
+    const char* willTopic = session.will(payload, length, isRetained);
+    // the session is gone before the will goes out, so it doesn't get its own will
+    session.end();
+    if (willTopic == nullptr) return;
+    _counters.wills++;
+    char topic[kMaxTopicSize];
+    uint8_t willPayload[Session::kMaxWillPayloadSize];
+    strcpy(topic, willTopic);
+    memcpy(willPayload, payload, length);
+    publish(topic, willPayload, length, isRetained);
+}
+
+LoopbackBroker::Session* LoopbackBroker::findSession(const char* clientId) const {
+    for (Session* session : _sessions) {
+        if (session->isLive() && strcmp(session->clientId(), clientId) == 0) return session;
+    }
+    return nullptr;
+}
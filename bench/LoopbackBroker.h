@@ -0,0 +1,122 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// An MQTT 3.1.1 broker in the same process, for host tests and simulations that shouldn't depend on a Mosquitto.
+// Clients reach it with WiFiClient once it listens on a host and port. It handles what the firmware uses:
+// connect with a will, QoS 0 and 1 publishes, retained messages, subscriptions with + and # wildcards, pings and
+// disconnects. Everything it delivers is QoS 0, and it handles a packet as soon as it is complete, so there is no
+// network delay; simulations add that themselves. All memory is allocated by the constructor.
+// Tests can inject messages, watch every publish, refuse or drop clients, and read the counters.
+
+#ifndef HEADER_BENCH_LOOPBACK_BROKER
+#define HEADER_BENCH_LOOPBACK_BROKER
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "HostNetwork.h"
+
+class LoopbackBroker : public host::Endpoint {
+public:
+    struct Counters {
+        // connections clients opened, whether they got connected or not
+        uint32_t attempts;
+        uint32_t connects;
+        uint32_t refusals;
+        uint32_t takeovers;
+        uint32_t disconnects;
+        uint32_t lostClients;
+        uint32_t wills;
+        uint32_t subscribes;
+        uint32_t unsubscribes;
+        uint32_t pings;
+        uint32_t published;
+        uint64_t publishedBytes;
+        uint32_t retainedPublished;
+        uint32_t deliveries;
+        uint64_t deliveredBytes;
+        // messages that didn't fit in a client's receive buffer
+        uint32_t overflows;
+    };
+
+    // sees every message published to the broker, before it is delivered
+    using Observer = void (*)(void* context, const char* topic, const uint8_t* payload, size_t length, bool isRetained);
+
+    static constexpr size_t kMaxTopicSize = 128;
+    static constexpr size_t kMaxRetainedPayloadSize = 128;
+
+    explicit LoopbackBroker(size_t maxClients = 16, size_t maxRetained = 1024);
+    ~LoopbackBroker() override;
+    LoopbackBroker(const LoopbackBroker&) = delete;
+    LoopbackBroker& operator=(const LoopbackBroker&) = delete;
+
+    bool listen(const char* host, uint16_t port);
+    host::Connection* accept() override;
+
+    // false makes connecting fail like a closed port; a non-zero code refuses in the CONNACK instead (e.g. 5)
+    void setAccepting(bool isAccepting) { _isAccepting = isAccepting; }
+    void setConnackCode(uint8_t code) { _connackCode = code; }
+    // takes connections and packets but never answers, like a hung broker
+    void setSilent(bool isSilent) { _isSilent = isSilent; }
+    // publishes like a client would, e.g. a command from a home automation system
+    void inject(const char* topic, const char* payload, bool isRetained = false);
+    void inject(const char* topic, const uint8_t* payload, size_t length, bool isRetained = false);
+    void observe(Observer observer, void* context);
+    // closes the connection from the broker's side; the will is published like for a lost connection
+    bool drop(const char* clientId);
+    void dropAll();
+
+    bool isConnected(const char* clientId) const;
+    size_t clientCount() const;
+    size_t retainedCount() const { return _retainedCount; }
+    size_t retainedBytes() const;
+    // nullptr if nothing is retained on the topic
+    const char* retained(const char* topic) const;
+    const Counters& counters() const { return _counters; }
+    void resetCounters() { _counters = {}; }
+
+    static bool matches(const char* filter, const char* topic);
+
+private:
+    class Session;
+
+    struct RetainedMessage {
+        uint32_t hash;
+        bool isUsed;
+        bool isDeleted;
+        char topic[kMaxTopicSize];
+        char payload[kMaxRetainedPayloadSize];
+    };
+
+    std::vector<Session*> _sessions;
+    // open addressing on the topic hash; deleted entries keep their slot, so searches go on past them
+    std::vector<RetainedMessage> _retained;
+    size_t _retainedCount = 0;
+    Counters _counters = {};
+    Observer _observer = nullptr;
+    void* _observerContext = nullptr;
+    bool _isAccepting = true;
+    uint8_t _connackCode = 0;
+    bool _isSilent = false;
+    bool _isListening = false;
+
+    void publish(const char* topic, const uint8_t* payload, size_t length, bool isRetained);
+    void retain(const char* topic, const uint8_t* payload, size_t length);
+    RetainedMessage* findRetained(const char* topic, uint32_t hash);
+    void deliverRetained(Session& session, const char* filter);
+    void lose(Session& session);
+    Session* findSession(const char* clientId) const;
+
+    friend class Session;
+};
+
+#endif
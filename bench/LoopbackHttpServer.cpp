@@ -0,0 +1,182 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+#include <cstdio>
+#include <cstring>
+
+#include "LoopbackHttpServer.h"
+
+namespace {
+    constexpr size_t kMaxRequestSize = 1024;
+
+    void append(std::vector<uint8_t>& target, const char* text) {
+        target.insert(target.end(), text, text + strlen(text));
+    }
+}
+
+// One connection: the request is answered as soon as its headers are complete, and the server closes its side
+// right away. The client can still read what was sent.
+class LoopbackHttpServer::Exchange : public host::Connection {
+public:
+    explicit Exchange(LoopbackHttpServer* server) : _server(server) {}
+
+    bool isFree() const { return !_isHeldByClient; }
+
+    void start() {
+        _isHeldByClient = true;
+        _isOpen = true;
+        _request.clear();
+        _response.clear();
+        _position = 0;
+    }
+
+    size_t send(const uint8_t* data, const size_t size) override {
+        if (!_isOpen) return 0;
+        _request.append(reinterpret_cast<const char*>(data), size);
+        if (_request.find("\r\n\r\n") != std::string::npos) {
+            handleRequest();
+        } else if (_request.size() > kMaxRequestSize) {
+            _isOpen = false;
+        }
+        return size;
+    }
+
+    size_t available() const override { return _response.size() - _position; }
+
+    size_t receive(uint8_t* buffer, const size_t size) override {
+        const size_t count = std::min(size, available());
+        memcpy(buffer, _response.data() + _position, count);
+        _position += count;
+        return count;
+    }
+
+    bool isOpen() const override { return _isOpen; }
+
+    void close() override {
+        _isOpen = false;
+        _isHeldByClient = false;
+    }
+
+private:
+    void handleRequest() {
+        char path[256];
+        if (sscanf(_request.c_str(), "GET %255s HTTP/1.", path) == 1) {
+            unsigned long first = 0;
+            const size_t range = _request.find("\r\nRange: bytes=");
+            const bool isRange = range != std::string::npos &&
+                sscanf(_request.c_str() + range, "\r\nRange: bytes=%lu-", &first) == 1;
+            _server->respond(path, isRange, first, _response);
+        }
+        _isOpen = false;
+    }
+
+    LoopbackHttpServer* _server;
+    std::string _request;
+    std::vector<uint8_t> _response;
+    size_t _position = 0;
+    bool _isHeldByClient = false;
+    bool _isOpen = false;
+};
+
+LoopbackHttpServer::LoopbackHttpServer(const size_t maxConnections) {
+    _exchanges.reserve(maxConnections);
+    for (size_t i = 0; i < maxConnections; i++) _exchanges.push_back(new Exchange(this));
+}
+
+LoopbackHttpServer::~LoopbackHttpServer() {
+    if (_isListening) host::stop_listening(this);
+    for (const Exchange* exchange : _exchanges) delete exchange;
+}
+
+bool LoopbackHttpServer::listen(const char* host, const uint16_t port) {
+    _isListening = host::listen(host, port, this);
+    return _isListening;
+}
+
+host::Connection* LoopbackHttpServer::accept() {
+    for (Exchange* exchange : _exchanges) {
+        if (!exchange->isFree()) continue;
+        exchange->start();
+        return exchange;
+    }
+    return nullptr;
+}
+
+void LoopbackHttpServer::serve(const char* path, std::vector<uint8_t> content) {
+    for (File& file : _files) {
+        if (file.path == path) {
+            file.content = std::move(content);
+            return;
+        }
+    }
+    _files.push_back({ path, std::move(content) });
+}
+
+void LoopbackHttpServer::serve(const char* path, const char* text) {
+    serve(path, std::vector<uint8_t>(text, text + strlen(text)));
+}
+
+void LoopbackHttpServer::dropAt(const char* path, const size_t offset) {
+    _drops.push_back({ path, offset });
+}
+
+void LoopbackHttpServer::reset() {
+    _drops.clear();
+    _rangeStarts.clear();
+    _counters = {};
+    _rangeError = 0;
+}
+
+// *** private methods ***
+
+void LoopbackHttpServer::respond(const char* path, const bool isRange, const size_t first, std::vector<uint8_t>& response) {
+    _counters.requests++;
+    const File* file = nullptr;
+    for (const File& candidate : _files) {
+        if (candidate.path == path) file = &candidate;
+    }
+    char header[256];
+    if (file == nullptr) {
+        _counters.notFound++;
+        append(response, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        return;
+    }
+    const size_t size = file->content.size();
+    if (isRange) {
+        _counters.rangeRequests++;
+        _rangeStarts.push_back(first);
+        if (first >= size) {
+            snprintf(header, sizeof(header), "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */%zu\r\n"
+                "Content-Length: 0\r\nConnection: close\r\n\r\n", size);
+            append(response, header);
+            return;
+        }
+        snprintf(header, sizeof(header), "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes %ld-%zu/%zu\r\n"
+            "Content-Length: %zu\r\nConnection: close\r\n\r\n", static_cast<long>(first) + _rangeError, size - 1, size, size - first);
+    } else {
+        snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n", size);
+    }
+    append(response, header);
+
+    // the first drop for the file decides where this response ends, if it is in it
+    size_t end = size;
+    for (auto drop = _drops.begin(); drop != _drops.end(); ++drop) {
+        if (drop->path != path) continue;
+        if (drop->offset >= first && drop->offset < size) {
+            end = drop->offset;
+            _counters.drops++;
+        }
+        _drops.erase(drop);
+        break;
+    }
+    response.insert(response.end(), file->content.begin() + static_cast<long>(first), file->content.begin() + static_cast<long>(end));
+    _counters.bodyBytes += end - first;
+}
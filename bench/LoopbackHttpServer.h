@@ -0,0 +1,86 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// An HTTP server in the same process, for the firmware download tests. Clients reach it with WiFiClient once it
+// listens on a host and port. It answers GET requests with files from memory, honours a Range of bytes=<first>-,
+// and closes the connection after every response. Tests can drop a response at a given offset in the file, and
+// send a Content-Range that doesn't match the request.
+
+#ifndef HEADER_BENCH_LOOPBACK_HTTP_SERVER
+#define HEADER_BENCH_LOOPBACK_HTTP_SERVER
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "HostNetwork.h"
+
+class LoopbackHttpServer : public host::Endpoint {
+public:
+    struct Counters {
+        uint32_t requests;
+        uint32_t rangeRequests;
+        uint32_t notFound;
+        // responses that were cut short
+        uint32_t drops;
+        uint64_t bodyBytes;
+    };
+
+    explicit LoopbackHttpServer(size_t maxConnections = 4);
+    ~LoopbackHttpServer() override;
+    LoopbackHttpServer(const LoopbackHttpServer&) = delete;
+    LoopbackHttpServer& operator=(const LoopbackHttpServer&) = delete;
+
+    bool listen(const char* host, uint16_t port);
+    host::Connection* accept() override;
+
+    // the path is the part of the URL after the host, e.g. /firmware/device.1.0
+    void serve(const char* path, std::vector<uint8_t> content);
+    void serve(const char* path, const char* text);
+    // The next response for the path stops at this offset in the file, if it gets that far, and the connection
+    // closes. Every response for the path uses up one, in the order they were added.
+    void dropAt(const char* path, size_t offset);
+    // moves the first byte in the Content-Range of partial responses, which then no longer matches the request
+    void setRangeError(long offset) { _rangeError = offset; }
+    // the first byte of every range request, in order
+    const std::vector<size_t>& rangeStarts() const { return _rangeStarts; }
+    const Counters& counters() const { return _counters; }
+    void reset();
+
+private:
+    class Exchange;
+
+    struct File {
+        std::string path;
+        std::vector<uint8_t> content;
+    };
+
+    struct Drop {
+        std::string path;
+        size_t offset;
+    };
+
+    std::vector<Exchange*> _exchanges;
+    std::vector<File> _files;
+    std::vector<Drop> _drops;
+    std::vector<size_t> _rangeStarts;
+    Counters _counters = {};
+    long _rangeError = 0;
+    bool _isListening = false;
+
+    // the response to a GET, with range the first byte asked for (0 if none)
+    void respond(const char* path, bool isRange, size_t first, std::vector<uint8_t>& response);
+
+    friend class Exchange;
+};
+
+#endif
@@ -0,0 +1,291 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+#include <chrono>
+#include <cstdarg>
+#include <thread>
+
+#include "Arduino.h"
+#include "Host.h"
+#include "NeoPixelBus.h"
+
+HardwareSerial Serial;
+
+namespace {
+    using SteadyClock = std::chrono::steady_clock;
+    const SteadyClock::time_point start_time = SteadyClock::now();
+
+    bool is_virtual = false;
+    uint64_t virtual_now = 0;
+
+    struct PendingEvent {
+        uint64_t at;
+        host::Event event;
+        void* context;
+    };
+
+    constexpr size_t kMaxEvents = 64;
+    PendingEvent pending_events[kMaxEvents];
+    size_t pending_count = 0;
+
+    host::Waits wait_counts = {};
+    bool is_echoing_serial = false;
+    uint32_t random_state = 1;
+
+    host::LedOutput led_state = {};
+    bool is_simulating_show_time = false;
+    constexpr uint64_t kMicrosPerLed = 30;
+    constexpr uint64_t kResetMicros = 50;
+
+    // the index of the earliest event due at or before the time, or pending_count if there is none
+    size_t earliest_due(const uint64_t time) {
+        size_t earliest = pending_count;
+        for (size_t i = 0; i < pending_count; i++) {
+            if (pending_events[i].at > time) continue;
+            if (earliest == pending_count || pending_events[i].at < pending_events[earliest].at) earliest = i;
+        }
+        return earliest;
+    }
+}
+
+namespace host {
+    void use_virtual_clock() {
+        is_virtual = true;
+    }
+
+    bool is_virtual_clock() {
+        return is_virtual;
+    }
+
+    uint64_t now_micros() {
+        if (is_virtual) return virtual_now;
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(SteadyClock::now() - start_time).count());
+    }
+
+    void advance_micros(const uint64_t micros) {
+        if (!is_virtual) return;
+        const uint64_t target = virtual_now + micros;
+        // events can schedule new ones, so look again after each
+        for (size_t index = earliest_due(target); index < pending_count; index = earliest_due(target)) {
+            const PendingEvent due = pending_events[index];
+            pending_events[index] = pending_events[--pending_count];
+            if (due.at > virtual_now) virtual_now = due.at;
+            due.event(due.context);
+        }
+        virtual_now = target;
+    }
+
+    bool schedule(const uint64_t atMicros, const Event event, void* context) {
+        if (!is_virtual || pending_count >= kMaxEvents) return false;
+        pending_events[pending_count++] = { atMicros, event, context };
+        return true;
+    }
+
+    const Waits& waits() {
+        return wait_counts;
+    }
+
+    void reset_waits() {
+        wait_counts = {};
+    }
+
+    void echo_serial(const bool isEchoing) {
+        is_echoing_serial = isEchoing;
+    }
+
+    void seed_random(const uint32_t seed) {
+        random_state = seed != 0 ? seed : 1;
+    }
+
+    // xorshift32
+    uint32_t next_random() {
+        random_state ^= random_state << 13;
+        random_state ^= random_state >> 17;
+        random_state ^= random_state << 5;
+        return random_state;
+    }
+
+    const LedOutput& led_output() {
+        return led_state;
+    }
+
+    void simulate_show_time(const bool isSimulated) {
+        is_simulating_show_time = isSimulated;
+    }
+
+    void show_pixels(const RgbColor* pixels, const uint16_t count) {
+        led_state.count = count < kMaxLeds ? count : kMaxLeds;
+        for (uint16_t i = 0; i < led_state.count; i++) {
+            led_state.pixels[3 * i] = pixels[i].R;
+            led_state.pixels[3 * i + 1] = pixels[i].G;
+            led_state.pixels[3 * i + 2] = pixels[i].B;
+        }
+        if (is_simulating_show_time) advance_micros(kMicrosPerLed * count + kResetMicros);
+        led_state.shows++;
+        led_state.lastShowMicros = now_micros();
+    }
+}
+
+unsigned long millis() {
+    return static_cast<unsigned long>(host::now_micros() / 1000);
+}
+
+unsigned long micros() {
+    return static_cast<unsigned long>(host::now_micros());
+}
+
+void delay(const unsigned long ms) {
+    wait_counts.delays++;
+    wait_counts.delayedMicros += ms * 1000ULL;
+    if (is_virtual) {
+        host::advance_micros(ms * 1000ULL);
+    } else {
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    }
+}
+
+void delayMicroseconds(const unsigned int us) {
+    if (is_virtual) {
+        host::advance_micros(us);
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(us));
+    }
+}
+
+void yield() {
+    wait_counts.yields++;
+    if (is_virtual) host::advance_micros(host::kYieldMicros);
+}
+
+void pinMode(uint8_t /*pin*/, uint8_t /*mode*/) {}
+
+void digitalWrite(uint8_t /*pin*/, uint8_t /*value*/) {}
+
+#if !defined(__GLIBC__) || !__GLIBC_PREREQ(2, 38)
+extern "C" size_t strlcpy(char* destination, const char* source, const size_t size) {
+    const size_t length = strlen(source);
+    if (size > 0) {
+        const size_t copied = length < size - 1 ? length : size - 1;
+        memcpy(destination, source, copied);
+        destination[copied] = '\0';
+    }
+    return length;
+}
+
+extern "C" size_t strlcat(char* destination, const char* source, const size_t size) {
+    const size_t used = strnlen(destination, size);
+    if (used == size) return size + strlen(source);
+    return used + strlcpy(destination + used, source, size - used);
+}
+#endif
+
+// *** HardwareSerial ***
+
+void HardwareSerial::begin(unsigned long /*baud*/) {}
+
+size_t HardwareSerial::write(const char* text, const size_t length) {
+    if (is_echoing_serial) fwrite(text, 1, length, stderr);
+    return length;
+}
+
+size_t HardwareSerial::write(const uint8_t* data, const size_t length) {
+    return write(reinterpret_cast<const char*>(data), length);
+}
+
+size_t HardwareSerial::print(const char* text) {
+    return write(text, strlen(text));
+}
+
+size_t HardwareSerial::println(const char* text) {
+    return print(text) + print("\r\n");
+}
+
+int HardwareSerial::printf(const char* format, ...) {
+    char buffer[256];
+    va_list arguments;
+    va_start(arguments, format);
+    const int length = vsnprintf(buffer, sizeof(buffer), format, arguments);
+    va_end(arguments);
+    if (length < 0) return length;
+    write(buffer, std::min(static_cast<size_t>(length), sizeof(buffer) - 1));
+    return length;
+}
+
+// *** String ***
+
+String::String(const char* text) {
+    assign(text, strlen(text));
+}
+
+String::String(const String& other) {
+    assign(other.c_str(), other._length);
+}
+
+String::String(String&& other) noexcept : _buffer(other._buffer), _length(other._length) {
+    other._buffer = nullptr;
+    other._length = 0;
+}
+
+String::~String() {
+    free(_buffer);
+}
+
+String& String::operator=(const String& other) {
+    if (this != &other) assign(other.c_str(), other._length);
+    return *this;
+}
+
+String& String::operator=(String&& other) noexcept {
+    if (this != &other) {
+        free(_buffer);
+        _buffer = other._buffer;
+        _length = other._length;
+        other._buffer = nullptr;
+        other._length = 0;
+    }
+    return *this;
+}
+
+String& String::operator+=(const char* text) {
+    const size_t addedLength = strlen(text);
+    auto* buffer = static_cast<char*>(realloc(_buffer, _length + addedLength + 1));
+    if (buffer == nullptr) return *this;
+    if (_buffer == nullptr) buffer[0] = '\0';
+    memcpy(buffer + _length, text, addedLength + 1);
+    _buffer = buffer;
+    _length += addedLength;
+    return *this;
+}
+
+bool String::operator==(const char* text) const {
+    return strcmp(c_str(), text) == 0;
+}
+
+long String::toInt() const {
+    return strtol(c_str(), nullptr, 10);
+}
+
+// like the core, an empty string has no buffer
+bool String::assign(const char* text, const size_t length) {
+    if (length == 0) {
+        free(_buffer);
+        _buffer = nullptr;
+        _length = 0;
+        return true;
+    }
+    auto* buffer = static_cast<char*>(realloc(_buffer, length + 1));
+    if (buffer == nullptr) return false;
+    memmove(buffer, text, length);
+    buffer[length] = '\0';
+    _buffer = buffer;
+    _length = length;
+    return true;
+}
@@ -0,0 +1,65 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// Host stand-in for the parts of the ESP8266 Arduino core the firmware uses. See Host.h for how the programs
+// in bench/ control time, flash and the network behind it.
+
+#ifndef HEADER_HOST_ARDUINO
+#define HEADER_HOST_ARDUINO
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "pgmspace.h"
+#include "WString.h"
+
+#define INPUT 0
+#define OUTPUT 1
+#define LOW 0
+#define HIGH 1
+#define LED_BUILTIN 2
+#define D5 14
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+
+// the core has these, glibc only from 2.38 on
+#if !defined(__GLIBC__) || !__GLIBC_PREREQ(2, 38)
+extern "C" size_t strlcpy(char* destination, const char* source, size_t size);
+extern "C" size_t strlcat(char* destination, const char* source, size_t size);
+#endif
+
+class HardwareSerial {
+public:
+    void begin(unsigned long baud);
+    size_t write(const char* text, size_t length);
+    size_t write(const uint8_t* data, size_t length);
+    // the UART FIFO is 128 bytes
+    int availableForWrite() { return 128; }
+    size_t print(const char* text);
+    size_t println(const char* text = "");
+    int printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,48 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// The Arduino Stream and Client interfaces, as far as the firmware and PubSubClient use them
+
+#ifndef HEADER_HOST_CLIENT
+#define HEADER_HOST_CLIENT
+
+#include "Arduino.h"
+
+class Stream {
+public:
+    virtual ~Stream() = default;
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual size_t write(uint8_t data) = 0;
+    virtual size_t write(const uint8_t* data, size_t size) = 0;
+    virtual void flush() = 0;
+
+    // waits up to the timeout for more data
+    size_t readBytes(char* buffer, size_t length);
+    void setTimeout(const unsigned long timeout) { _timeout = timeout; }
+
+protected:
+    unsigned long _timeout = 1000; // ms
+};
+
+class Client : public Stream {
+public:
+    // return 1 if connected
+    virtual int connect(const char* host, uint16_t port) = 0;
+    virtual int read(uint8_t* buffer, size_t size) = 0;
+    virtual void stop() = 0;
+    virtual uint8_t connected() = 0;
+    virtual operator bool() = 0;
+    using Stream::read;
+};
+
+#endif
@@ -0,0 +1,50 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// The emulated EEPROM, which Persistence only reads to migrate old state. It starts erased (all 0xFF).
+
+#ifndef HEADER_HOST_EEPROM
+#define HEADER_HOST_EEPROM
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+class EEPROMClass {
+public:
+    static constexpr size_t kSize = 4096;
+
+    EEPROMClass() { memset(_data, 0xFF, sizeof(_data)); }
+    void begin(const size_t size) { _size = size < kSize ? size : kSize; }
+    void end() { _size = 0; }
+
+    template <typename T>
+    T& get(const int address, T& value) {
+        if (address >= 0 && address + sizeof(T) <= _size) memcpy(&value, _data + address, sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    const T& put(const int address, const T& value) {
+        if (address >= 0 && address + sizeof(T) <= _size) memcpy(_data + address, &value, sizeof(T));
+        return value;
+    }
+
+    bool commit() { return _size > 0; }
+
+private:
+    uint8_t _data[kSize];
+    size_t _size = 0;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
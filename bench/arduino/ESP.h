@@ -0,0 +1,46 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// The ESP object. Flash goes to the selected host::Flash, the cycle counter follows the clock at 80 MHz,
+// and random() is the seeded generator from Host.h.
+
+#ifndef HEADER_HOST_ESP
+#define HEADER_HOST_ESP
+
+#include "Arduino.h"
+#include "flash_hal.h"
+
+class EspClass {
+public:
+    uint32_t random();
+    uint32_t getCycleCount();
+    uint8_t getCpuFreqMHz() { return kCpuFreqMHz; }
+    // as host::heap() says
+    uint32_t getFreeHeap();
+    uint8_t getHeapFragmentation();
+    uint32_t getMaxFreeBlockSize();
+    // There's nothing to restart on the host, so this only counts. FirmwareManager restarts after an update.
+    void restart();
+    uint32_t restarts() const { return _restarts; }
+
+    // absolute flash addresses and sectors, like the core. Only the file system partition exists.
+    bool flashRead(uint32_t address, uint32_t* data, size_t size);
+    bool flashWrite(uint32_t address, const uint32_t* data, size_t size);
+    bool flashEraseSector(uint32_t sector);
+
+private:
+    static constexpr uint8_t kCpuFreqMHz = 80;
+    uint32_t _restarts = 0;
+};
+
+extern EspClass ESP;
+
+#endif
@@ -0,0 +1,73 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// HTTPClient for the host: an HTTP/1.1 GET over any WiFiClient, as far as FirmwareManager uses it. It asks the
+// server to close the connection after the response, and leaves the body on the stream for the caller to read.
+
+#ifndef HEADER_HOST_ESP8266HTTPCLIENT
+#define HEADER_HOST_ESP8266HTTPCLIENT
+
+#include "WiFiClient.h"
+#include "WString.h"
+
+#define HTTPC_ERROR_CONNECTION_FAILED (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED (-2)
+#define HTTPC_ERROR_CONNECTION_LOST (-5)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+#define HTTP_CODE_OK 200
+#define HTTP_CODE_PARTIAL_CONTENT 206
+#define HTTP_CODE_NOT_FOUND 404
+
+class HTTPClient {
+public:
+    HTTPClient() = default;
+    ~HTTPClient() { end(); }
+    HTTPClient(const HTTPClient&) = delete;
+    HTTPClient& operator=(const HTTPClient&) = delete;
+
+    // http://host[:port]/path or https://...
+    bool begin(WiFiClient& client, const char* url);
+    void setTimeout(uint16_t timeout) { _timeout = timeout; }
+    // the response headers header() can return
+    void collectHeaders(const char* headers[], size_t count);
+    void addHeader(const char* name, const char* value);
+    // the status code, or a negative HTTPC_ERROR
+    int GET();
+    // the Content-Length, or -1 if there was none
+    int getSize() const { return _size; }
+    String header(const char* name) const;
+    WiFiClient* getStreamPtr() { return _client; }
+    void end();
+
+private:
+    static constexpr size_t kMaxHostSize = 64;
+    static constexpr size_t kMaxPathSize = 128;
+    static constexpr size_t kMaxRequestHeadersSize = 256;
+    static constexpr size_t kMaxLineSize = 256;
+    static constexpr size_t kMaxCollectedHeaders = 4;
+    static constexpr size_t kMaxHeaderValueSize = 96;
+
+    // a line without the CRLF; false if the connection closed or the timeout passed first
+    bool readLine(char* line, size_t size);
+
+    WiFiClient* _client = nullptr;
+    char _host[kMaxHostSize] = {};
+    uint16_t _port = 0;
+    char _path[kMaxPathSize] = {};
+    char _requestHeaders[kMaxRequestHeadersSize] = {};
+    const char* _collectedNames[kMaxCollectedHeaders] = {};
+    char _collectedValues[kMaxCollectedHeaders][kMaxHeaderValueSize] = {};
+    size_t _collectedCount = 0;
+    uint16_t _timeout = 5000; // ms
+    int _size = -1;
+};
+
+#endif
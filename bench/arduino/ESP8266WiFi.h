@@ -0,0 +1,55 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// The WiFi object, connecting to the fake access point from HostNetwork.h
+
+#ifndef HEADER_HOST_ESP8266WIFI
+#define HEADER_HOST_ESP8266WIFI
+
+#include "WiFiClient.h"
+
+enum wl_status_t {
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 7
+};
+
+enum WiFiMode_t {
+    WIFI_OFF = 0,
+    WIFI_STA = 1
+};
+
+class IPAddress {
+public:
+    IPAddress(const uint8_t a, const uint8_t b, const uint8_t c, const uint8_t d) : _bytes{a, b, c, d} {}
+    uint8_t operator[](const int index) const { return _bytes[index]; }
+private:
+    uint8_t _bytes[4];
+};
+
+class ESP8266WiFiClass {
+public:
+    bool mode(WiFiMode_t mode) { return mode == WIFI_STA; }
+    void setAutoReconnect(bool /*isAutoReconnecting*/) {}
+    bool hostname(const char* name) { return name != nullptr && name[0] != '\0'; }
+    wl_status_t begin(const char* ssid, const char* password);
+    bool reconnect();
+    wl_status_t status();
+    uint8_t* macAddress(uint8_t* mac);
+    IPAddress localIP();
+};
+
+extern ESP8266WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,136 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+#include "ESP.h"
+#include "EEPROM.h"
+#include "Host.h"
+#include "Updater.h"
+
+EspClass ESP;
+EEPROMClass EEPROM;
+UpdaterClass Update;
+
+namespace {
+    host::Flash default_flash;
+    host::Flash* selected_flash = &default_flash;
+    constexpr uint32_t kFirstSector = FS_PHYS_ADDR / host::Flash::kSectorSize;
+}
+
+namespace host {
+    Flash::Flash() {
+        memset(_data, 0xFF, sizeof(_data));
+    }
+
+    bool Flash::read(const uint32_t address, uint32_t* data, const size_t size) {
+        if (!isInRange(address, size) || _isUnpowered) return false;
+        memcpy(data, _data + address, size);
+        _reads++;
+        return true;
+    }
+
+    bool Flash::write(const uint32_t address, const uint32_t* data, const size_t size) {
+        if (!isInRange(address, size) || _isUnpowered) return false;
+        if (_isNextWriteFailing) {
+            _isNextWriteFailing = false;
+            return false;
+        }
+        if (_writesUntilFailure > 0 && --_writesUntilFailure == 0) {
+            // the power went while writing: only the first half made it
+            const auto* bytes = reinterpret_cast<const uint8_t*>(data);
+            for (size_t i = 0; i < size / 2; i++) _data[address + i] &= bytes[i];
+            _isUnpowered = true;
+            return false;
+        }
+        const auto* bytes = reinterpret_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i++) _data[address + i] &= bytes[i];
+        _writes++;
+        _bytesWritten += size;
+        return true;
+    }
+
+    bool Flash::eraseSector(const uint16_t sector) {
+        if (sector >= kSectorCount || _isUnpowered) return false;
+        memset(_data + sector * kSectorSize, 0xFF, kSectorSize);
+        _erases[sector]++;
+        return true;
+    }
+
+    uint32_t Flash::totalErases() const {
+        uint32_t total = 0;
+        for (const uint32_t count : _erases) total += count;
+        return total;
+    }
+
+    void Flash::resetCounters() {
+        memset(_erases, 0, sizeof(_erases));
+        _reads = 0;
+        _writes = 0;
+        _bytesWritten = 0;
+    }
+
+    // the core wants 4 byte aligned addresses and sizes
+    bool Flash::isInRange(const uint32_t address, const size_t size) const {
+        return address % 4 == 0 && size % 4 == 0 && address + size <= sizeof(_data);
+    }
+
+    void select_flash(Flash* flash) {
+        selected_flash = flash != nullptr ? flash : &default_flash;
+    }
+
+    Flash& flash() {
+        return *selected_flash;
+    }
+
+    Heap& heap() {
+        static Heap values;
+        return values;
+    }
+}
+
+uint32_t EspClass::random() {
+    return host::next_random();
+}
+
+uint32_t EspClass::getCycleCount() {
+    return static_cast<uint32_t>(host::now_micros() * kCpuFreqMHz);
+}
+
+uint32_t EspClass::getFreeHeap() {
+    return host::heap().freeHeap;
+}
+
+uint8_t EspClass::getHeapFragmentation() {
+    return host::heap().fragmentation;
+}
+
+uint32_t EspClass::getMaxFreeBlockSize() {
+    return host::heap().maxFreeBlock;
+}
+
+void EspClass::restart() {
+    _restarts++;
+    Serial.println("ESP.restart() called");
+}
+
+bool EspClass::flashRead(const uint32_t address, uint32_t* data, const size_t size) {
+    if (address < FS_PHYS_ADDR) return false;
+    return host::flash().read(address - FS_PHYS_ADDR, data, size);
+}
+
+bool EspClass::flashWrite(const uint32_t address, const uint32_t* data, const size_t size) {
+    if (address < FS_PHYS_ADDR) return false;
+    return host::flash().write(address - FS_PHYS_ADDR, data, size);
+}
+
+bool EspClass::flashEraseSector(const uint32_t sector) {
+    if (sector < kFirstSector || sector - kFirstSector >= host::Flash::kSectorCount) return false;
+    return host::flash().eraseSector(static_cast<uint16_t>(sector - kFirstSector));
+}
@@ -0,0 +1,127 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+#include <strings.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "ESP8266HTTPClient.h"
+
+bool HTTPClient::begin(WiFiClient& client, const char* url) {
+    end();
+    if (url == nullptr) return false;
+    uint16_t port;
+    const char* rest;
+    if (strncmp(url, "http://", 7) == 0) {
+        port = 80;
+        rest = url + 7;
+    } else if (strncmp(url, "https://", 8) == 0) {
+        port = 443;
+        rest = url + 8;
+    } else {
+        return false;
+    }
+    const char* path = strchr(rest, '/');
+    if (path == nullptr) path = rest + strlen(rest);
+    const char* colon = static_cast<const char*>(memchr(rest, ':', static_cast<size_t>(path - rest)));
+    const size_t hostLength = static_cast<size_t>((colon != nullptr ? colon : path) - rest);
+    if (hostLength == 0 || hostLength >= sizeof(_host)) return false;
+    if (colon != nullptr) port = static_cast<uint16_t>(atoi(colon + 1));
+    memcpy(_host, rest, hostLength);
+    _host[hostLength] = '\0';
+    const int length = snprintf(_path, sizeof(_path), "%s", *path != '\0' ? path : "/");
+    if (length < 0 || static_cast<size_t>(length) >= sizeof(_path)) return false;
+    _port = port;
+    _client = &client;
+    _requestHeaders[0] = '\0';
+    _size = -1;
+    return true;
+}
+
+void HTTPClient::collectHeaders(const char* headers[], const size_t count) {
+    _collectedCount = count < kMaxCollectedHeaders ? count : kMaxCollectedHeaders;
+    for (size_t i = 0; i < _collectedCount; i++) {
+        _collectedNames[i] = headers[i];
+        _collectedValues[i][0] = '\0';
+    }
+}
+
+void HTTPClient::addHeader(const char* name, const char* value) {
+    const size_t used = strlen(_requestHeaders);
+    snprintf(_requestHeaders + used, sizeof(_requestHeaders) - used, "%s: %s\r\n", name, value);
+}
+
+int HTTPClient::GET() {
+    if (_client == nullptr || _client->connect(_host, _port) == 0) return HTTPC_ERROR_CONNECTION_FAILED;
+    char request[kMaxPathSize + kMaxHostSize + kMaxRequestHeadersSize + 64];
+    const int length = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n%s\r\n",
+        _path, _host, _requestHeaders);
+    if (length <= 0 || static_cast<size_t>(length) >= sizeof(request)) return HTTPC_ERROR_SEND_HEADER_FAILED;
+    if (_client->write(reinterpret_cast<const uint8_t*>(request), static_cast<size_t>(length)) != static_cast<size_t>(length)) {
+        return HTTPC_ERROR_SEND_HEADER_FAILED;
+    }
+
+    char line[kMaxLineSize];
+    int code;
+    if (!readLine(line, sizeof(line))) return HTTPC_ERROR_READ_TIMEOUT;
+    if (sscanf(line, "HTTP/1.%*d %d", &code) != 1) return HTTPC_ERROR_CONNECTION_LOST;
+    for (size_t i = 0; i < _collectedCount; i++) _collectedValues[i][0] = '\0';
+    _size = -1;
+    while (true) {
+        if (!readLine(line, sizeof(line))) return HTTPC_ERROR_READ_TIMEOUT;
+        if (line[0] == '\0') break;
+        char* colon = strchr(line, ':');
+        if (colon == nullptr) continue;
+        *colon = '\0';
+        const char* value = colon + 1;
+        while (*value == ' ') value++;
+        if (strcasecmp(line, "Content-Length") == 0) _size = atoi(value);
+        for (size_t i = 0; i < _collectedCount; i++) {
+            if (strcasecmp(line, _collectedNames[i]) == 0) {
+                snprintf(_collectedValues[i], sizeof(_collectedValues[i]), "%s", value);
+            }
+        }
+    }
+    return code;
+}
+
+String HTTPClient::header(const char* name) const {
+    for (size_t i = 0; i < _collectedCount; i++) {
+        if (strcasecmp(name, _collectedNames[i]) == 0) return String(_collectedValues[i]);
+    }
+    return String();
+}
+
+void HTTPClient::end() {
+    if (_client != nullptr) _client->stop();
+    _client = nullptr;
+}
+
+// *** private methods ***
+
+bool HTTPClient::readLine(char* line, const size_t size) {
+    size_t length = 0;
+    const unsigned long start = millis();
+    while (true) {
+        if (_client->available() == 0) {
+            if (!_client->connected() || millis() - start >= _timeout) return false;
+            yield();
+            continue;
+        }
+        const int value = _client->read();
+        if (value < 0 || value == '\r') continue;
+        if (value == '\n') break;
+        if (length + 1 < size) line[length++] = static_cast<char>(value);
+    }
+    line[length] = '\0';
+    return true;
+}
@@ -0,0 +1,135 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// Controls the host stand-ins of the Arduino core: time, serial output, the simulated flash, the heap and the LED
+// output.
+// Only the host programs in bench/ use this; the firmware itself sees the normal Arduino API.
+
+#ifndef HEADER_HOST
+#define HEADER_HOST
+
+#include <cstddef>
+#include <cstdint>
+
+namespace host {
+    // --- time ---
+
+    // Time is real by default. A virtual clock only moves when the firmware waits (delay, yield) or a program
+    // advances it, so runs are repeatable and a simulated hour takes only as long as the code needs.
+    void use_virtual_clock();
+    bool is_virtual_clock();
+    uint64_t now_micros();
+    // moves the virtual clock forward, running the events that become due on the way
+    void advance_micros(uint64_t micros);
+
+    using Event = void (*)(void* context);
+    // Runs event(context) when the virtual clock reaches atMicros, e.g. a message arriving from the network.
+    // Returns false if too many events are waiting.
+    bool schedule(uint64_t atMicros, Event event, void* context);
+
+    // how far yield() moves the virtual clock, so a loop that only yields still sees time pass
+    constexpr uint64_t kYieldMicros = 50;
+
+    // the times the firmware gave the CPU away, i.e. the loop's wake-ups
+    struct Waits {
+        uint32_t delays;
+        uint32_t yields;
+        uint64_t delayedMicros;
+    };
+    const Waits& waits();
+    void reset_waits();
+
+    // --- serial ---
+
+    // Serial output goes to stderr if echoed, and is dropped otherwise (the default)
+    void echo_serial(bool isEchoing);
+
+    // --- random ---
+
+    // ESP.random() is a seeded generator, so runs can be repeated
+    void seed_random(uint32_t seed);
+    uint32_t next_random();
+
+    // --- flash ---
+
+    // The file system partition, which is all FlashRegion uses. Like NOR flash, writes can only clear bits,
+    // so writing without erasing first shows up as corrupted data.
+    class Flash {
+    public:
+        static constexpr uint32_t kSectorSize = 4096;
+        static constexpr uint16_t kSectorCount = 32;
+
+        Flash();
+        // addresses are relative to the start of the partition
+        bool read(uint32_t address, uint32_t* data, size_t size);
+        bool write(uint32_t address, const uint32_t* data, size_t size);
+        bool eraseSector(uint16_t sector);
+        // After this many more successful writes, writes fail and the flash is unpowered until restored,
+        // e.g. to simulate a power cut in the middle of a journal append. 0 means never.
+        void failAfterWrites(uint32_t writes) { _writesUntilFailure = writes; }
+        void restorePower() { _writesUntilFailure = 0; _isUnpowered = false; }
+        // the next write fails without changing anything, but the flash stays powered, like a failed verify
+        void failNextWrite() { _isNextWriteFailing = true; }
+
+        uint32_t erases(uint16_t sector) const { return sector < kSectorCount ? _erases[sector] : 0; }
+        uint32_t totalErases() const;
+        uint32_t reads() const { return _reads; }
+        uint32_t writes() const { return _writes; }
+        uint32_t bytesWritten() const { return _bytesWritten; }
+        void resetCounters();
+
+    private:
+        bool isInRange(uint32_t address, size_t size) const;
+
+        uint8_t _data[kSectorCount * kSectorSize];
+        uint32_t _erases[kSectorCount] = {};
+        uint32_t _reads = 0;
+        uint32_t _writes = 0;
+        uint32_t _bytesWritten = 0;
+        uint32_t _writesUntilFailure = 0;
+        bool _isUnpowered = false;
+        bool _isNextWriteFailing = false;
+    };
+
+    // Selects the flash that ESP.flashRead/flashWrite/flashEraseSector work on, e.g. one per simulated device.
+    // nullptr selects the default one.
+    void select_flash(Flash* flash);
+    Flash& flash();
+
+    // --- heap ---
+
+    // What ESP reports about the heap. The host has no way to know the device's, so these are typical values
+    // once connected, which programs can change, e.g. to see what happens when memory runs low.
+    struct Heap {
+        uint32_t freeHeap = 40000;
+        uint8_t fragmentation = 5;
+        uint32_t maxFreeBlock = 30000;
+    };
+    Heap& heap();
+
+    // --- LEDs ---
+
+    constexpr uint16_t kMaxLeds = 256;
+
+    // what NeoPixelBus::Show() last sent to the LEDs
+    struct LedOutput {
+        uint32_t shows;
+        uint64_t lastShowMicros;
+        uint16_t count;
+        uint8_t pixels[3 * kMaxLeds];   // red, green, blue
+    };
+    const LedOutput& led_output();
+    // Show() of a bit-banged strip keeps the CPU busy for 30 us per LED plus the reset time. The virtual clock moves
+    // forward that long, so latencies include it. Off by default, as benchmarks measure the real time.
+    void simulate_show_time(bool isSimulated);
+}
+
+#endif
@@ -0,0 +1,78 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// The network behind the WiFi and client stand-ins. WiFiClient connects to an in-process endpoint if one listens
+// on the host and port (e.g. the loopback broker), and opens a TCP socket otherwise (e.g. a local Mosquitto).
+// The fake WiFi connects to an access point that programs can switch off or make slow, to inject failures.
+
+#ifndef HEADER_HOST_NETWORK
+#define HEADER_HOST_NETWORK
+
+#include <cstddef>
+#include <cstdint>
+
+namespace host {
+    // The server side of an in-process connection. The client only talks to it through these.
+    class Connection {
+    public:
+        virtual ~Connection() = default;
+        // the client's bytes to the server; returns how many it took
+        virtual size_t send(const uint8_t* data, size_t size) = 0;
+        // the server's bytes to the client
+        virtual size_t available() const = 0;
+        virtual size_t receive(uint8_t* buffer, size_t size) = 0;
+        virtual bool isOpen() const = 0;
+        // the client hangs up
+        virtual void close() = 0;
+    };
+
+    class Endpoint {
+    public:
+        virtual ~Endpoint() = default;
+        // nullptr refuses the connection
+        virtual Connection* accept() = 0;
+    };
+
+    // Clients connecting to host:port reach the endpoint. Returns false if there's no room for another one.
+    bool listen(const char* host, uint16_t port, Endpoint* endpoint);
+    void stop_listening(Endpoint* endpoint);
+    Endpoint* find_endpoint(const char* host, uint16_t port);
+
+    // The access point the fake WiFi connects to
+    struct AccessPoint {
+        bool isAvailable = true;
+        // from WiFi.begin() or WiFi.reconnect() until connected
+        unsigned long associateMillis = 100;
+    };
+    AccessPoint& access_point();
+    // drops the WiFi link, like a restart of the access point. Open connections break.
+    void drop_wifi();
+    // True if the fake WiFi is connected, or was never started (e.g. a fleet simulation doesn't use it)
+    bool is_link_up();
+
+    struct WifiCounters {
+        uint32_t begins;
+        uint32_t reconnects;
+        uint32_t drops;
+    };
+    const WifiCounters& wifi_counters();
+
+    // How the TLS servers behave. The stand-in doesn't encrypt, it only keeps the session bookkeeping.
+    struct TlsConditions {
+        bool resumesSessions = true;
+        bool supportsMaxFragmentLength = true;
+        uint32_t handshakes = 0;
+        uint32_t resumptions = 0;
+    };
+    TlsConditions& tls();
+}
+
+#endif
@@ -0,0 +1,61 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// NeoPixelBus without the hardware: Show() hands the pixels to host::led_output() instead of the output pin
+
+#ifndef HEADER_HOST_NEOPIXELBUS
+#define HEADER_HOST_NEOPIXELBUS
+
+#include <cstdint>
+#include "Host.h"
+
+struct NeoGrbFeature {};
+struct NeoEsp8266BitBang800KbpsMethod {};
+
+struct RgbColor {
+    RgbColor() : R(0), G(0), B(0) {}
+    RgbColor(const uint8_t red, const uint8_t green, const uint8_t blue) : R(red), G(green), B(blue) {}
+    uint8_t R;
+    uint8_t G;
+    uint8_t B;
+};
+
+namespace host {
+    void show_pixels(const RgbColor* pixels, uint16_t count);
+}
+
+template <typename Feature, typename Method>
+class NeoPixelBus {
+public:
+    NeoPixelBus(const uint16_t count, uint8_t /*pin*/) : _count(count), _pixels(new RgbColor[count]) {}
+    ~NeoPixelBus() { delete[] _pixels; }
+    NeoPixelBus(const NeoPixelBus&) = delete;
+    NeoPixelBus& operator=(const NeoPixelBus&) = delete;
+
+    void Begin() {}
+    void Show() { host::show_pixels(_pixels, _count); }
+    bool CanShow() const { return true; }
+    uint16_t PixelCount() const { return _count; }
+
+    void SetPixelColor(const uint16_t index, const RgbColor color) {
+        if (index < _count) _pixels[index] = color;
+    }
+
+    RgbColor GetPixelColor(const uint16_t index) const {
+        return index < _count ? _pixels[index] : RgbColor();
+    }
+
+private:
+    uint16_t _count;
+    RgbColor* _pixels;
+};
+
+#endif
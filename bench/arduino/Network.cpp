@@ -0,0 +1,365 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+
+#include "ESP8266WiFi.h"
+#include "Host.h"
+#include "HostNetwork.h"
+#include "WiFiClientSecure.h"
+#include "WiFiUdp.h"
+
+ESP8266WiFiClass WiFi;
+
+namespace {
+    struct Listener {
+        char host[64];
+        uint16_t port;
+        host::Endpoint* endpoint;
+    };
+
+    constexpr size_t kMaxListeners = 8;
+    Listener listeners[kMaxListeners] = {};
+
+    enum class Link : uint8_t {
+        Off,            // WiFi.begin() wasn't called
+        Associating,
+        Up,
+        Down
+    };
+
+    Link wifi_link = Link::Off;
+    uint64_t association_start = 0;
+    host::AccessPoint access_point_state;
+    host::WifiCounters wifi_count = {};
+    host::TlsConditions tls_state;
+
+    void start_association() {
+        wifi_link = Link::Associating;
+        association_start = host::now_micros();
+    }
+
+    // opens a blocking TCP connection; returns the socket or -1
+    int open_socket(const char* host, const uint16_t port) {
+        addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        char service[8];
+        snprintf(service, sizeof(service), "%u", port);
+        addrinfo* addresses = nullptr;
+        if (getaddrinfo(host, service, &hints, &addresses) != 0) return -1;
+        int result = -1;
+        for (const addrinfo* address = addresses; address != nullptr && result < 0; address = address->ai_next) {
+            const int candidate = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+            if (candidate < 0) continue;
+            if (connect(candidate, address->ai_addr, address->ai_addrlen) == 0) {
+                // MQTT packets are small; don't let Nagle hold them back
+                const int isSet = 1;
+                setsockopt(candidate, IPPROTO_TCP, TCP_NODELAY, &isSet, sizeof(isSet));
+                result = candidate;
+            } else {
+                close(candidate);
+            }
+        }
+        freeaddrinfo(addresses);
+        return result;
+    }
+}
+
+namespace host {
+    bool listen(const char* host, const uint16_t port, Endpoint* endpoint) {
+        for (auto& listener : listeners) {
+            if (listener.endpoint != nullptr) continue;
+            strlcpy(listener.host, host, sizeof(listener.host));
+            listener.port = port;
+            listener.endpoint = endpoint;
+            return true;
+        }
+        return false;
+    }
+
+    void stop_listening(Endpoint* endpoint) {
+        for (auto& listener : listeners) {
+            if (listener.endpoint == endpoint) listener = {};
+        }
+    }
+
+    Endpoint* find_endpoint(const char* host, const uint16_t port) {
+        for (const auto& listener : listeners) {
+            if (listener.endpoint != nullptr && listener.port == port && strcmp(listener.host, host) == 0) return listener.endpoint;
+        }
+        return nullptr;
+    }
+
+    AccessPoint& access_point() {
+        return access_point_state;
+    }
+
+    void drop_wifi() {
+        if (wifi_link != Link::Up) return;
+        wifi_link = Link::Down;
+        wifi_count.drops++;
+    }
+
+    bool is_link_up() {
+        return wifi_link == Link::Off || WiFi.status() == WL_CONNECTED;
+    }
+
+    const WifiCounters& wifi_counters() {
+        return wifi_count;
+    }
+
+    TlsConditions& tls() {
+        return tls_state;
+    }
+}
+
+// *** ESP8266WiFiClass ***
+
+wl_status_t ESP8266WiFiClass::begin(const char* /*ssid*/, const char* /*password*/) {
+    wifi_count.begins++;
+    start_association();
+    return status();
+}
+
+bool ESP8266WiFiClass::reconnect() {
+    wifi_count.reconnects++;
+    start_association();
+    return true;
+}
+
+wl_status_t ESP8266WiFiClass::status() {
+    switch (wifi_link) {
+        case Link::Off:
+            return WL_IDLE_STATUS;
+        case Link::Associating:
+            if (!access_point_state.isAvailable) return WL_NO_SSID_AVAIL;
+            if (host::now_micros() - association_start < access_point_state.associateMillis * 1000ULL) return WL_DISCONNECTED;
+            wifi_link = Link::Up;
+            return WL_CONNECTED;
+        case Link::Up:
+            if (access_point_state.isAvailable) return WL_CONNECTED;
+            host::drop_wifi();
+            return WL_CONNECTION_LOST;
+        case Link::Down:
+            break;
+    }
+    return WL_CONNECTION_LOST;
+}
+
+uint8_t* ESP8266WiFiClass::macAddress(uint8_t* mac) {
+    constexpr uint8_t kMac[] = { 0x5C, 0xCF, 0x7F, 0x00, 0x00, 0x01 };
+    memcpy(mac, kMac, sizeof(kMac));
+    return mac;
+}
+
+IPAddress ESP8266WiFiClass::localIP() {
+    return wifi_link == Link::Up ? IPAddress(192, 168, 1, 50) : IPAddress(0, 0, 0, 0);
+}
+
+// *** Stream ***
+
+size_t Stream::readBytes(char* buffer, const size_t length) {
+    size_t count = 0;
+    const unsigned long start = millis();
+    while (count < length) {
+        const int value = read();
+        if (value >= 0) {
+            buffer[count++] = static_cast<char>(value);
+        } else if (millis() - start >= _timeout) {
+            break;
+        } else {
+            yield();
+        }
+    }
+    return count;
+}
+
+// *** WiFiClient ***
+
+WiFiClient::~WiFiClient() {
+    stop();
+}
+
+int WiFiClient::connect(const char* host, const uint16_t port) {
+    stop();
+    if (!host::is_link_up()) return 0;
+    host::Endpoint* endpoint = host::find_endpoint(host, port);
+    if (endpoint != nullptr) {
+        _connection = endpoint->accept();
+        return _connection != nullptr ? 1 : 0;
+    }
+    _socket = open_socket(host, port);
+    return _socket >= 0 ? 1 : 0;
+}
+
+int WiFiClient::connect(const String& host, const uint16_t port) {
+    return connect(host.c_str(), port);
+}
+
+size_t WiFiClient::write(const uint8_t data) {
+    return write(&data, 1);
+}
+
+size_t WiFiClient::write(const uint8_t* data, const size_t size) {
+    if (!host::is_link_up()) return 0;
+    if (_connection != nullptr) return _connection->send(data, size);
+    if (_socket < 0) return 0;
+    size_t sent = 0;
+    while (sent < size) {
+        const ssize_t result = send(_socket, data + sent, size - sent, MSG_NOSIGNAL);
+        if (result < 0 && errno == EINTR) continue;
+        if (result <= 0) {
+            stop();
+            break;
+        }
+        sent += static_cast<size_t>(result);
+    }
+    return sent;
+}
+
+int WiFiClient::available() {
+    if (!host::is_link_up()) return 0;
+    if (_connection != nullptr) return static_cast<int>(_connection->available());
+    if (_socket < 0) return 0;
+    int count = 0;
+    if (ioctl(_socket, FIONREAD, &count) < 0) return 0;
+    return count;
+}
+
+int WiFiClient::read() {
+    uint8_t value;
+    return read(&value, 1) == 1 ? value : -1;
+}
+
+int WiFiClient::read(uint8_t* buffer, const size_t size) {
+    if (!host::is_link_up()) return -1;
+    if (_connection != nullptr) {
+        const size_t count = _connection->receive(buffer, size);
+        return count > 0 ? static_cast<int>(count) : -1;
+    }
+    if (_socket < 0) return -1;
+    const ssize_t count = recv(_socket, buffer, size, MSG_DONTWAIT);
+    return count > 0 ? static_cast<int>(count) : -1;
+}
+
+int WiFiClient::peek() {
+    if (_socket < 0 || !host::is_link_up()) return -1;
+    uint8_t value;
+    return recv(_socket, &value, 1, MSG_PEEK | MSG_DONTWAIT) == 1 ? value : -1;
+}
+
+void WiFiClient::stop() {
+    if (_connection != nullptr) {
+        _connection->close();
+        _connection = nullptr;
+    }
+    if (_socket >= 0) {
+        close(_socket);
+        _socket = -1;
+    }
+}
+
+// like the core, still connected while there is data to read
+uint8_t WiFiClient::connected() {
+    if (!host::is_link_up()) return 0;
+    if (_connection != nullptr) return _connection->isOpen() || _connection->available() > 0;
+    if (_socket < 0) return 0;
+    uint8_t value;
+    const ssize_t result = recv(_socket, &value, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (result > 0) return 1;
+    return result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) ? 1 : 0;
+}
+
+// *** BearSSL::WiFiClientSecure ***
+
+namespace BearSSL {
+    int WiFiClientSecure::connect(const char* host, const uint16_t port) {
+        if (WiFiClient::connect(host, port) == 0) return 0;
+        br_ssl_session_parameters* parameters = _session != nullptr ? _session->getSession() : nullptr;
+        if (parameters != nullptr && parameters->session_id_len > 0 && tls_state.resumesSessions) {
+            tls_state.resumptions++;
+            return 1;
+        }
+        tls_state.handshakes++;
+        if (parameters != nullptr) {
+            for (auto& byte : parameters->session_id) byte = static_cast<uint8_t>(host::next_random());
+            parameters->session_id_len = sizeof(parameters->session_id);
+        }
+        return 1;
+    }
+
+    void WiFiClientSecure::setBufferSizes(const int receive, const int transmit) {
+        _receiveBufferSize = receive;
+        _transmitBufferSize = transmit;
+    }
+
+    bool WiFiClientSecure::probeMaxFragmentLength(const char* /*host*/, uint16_t /*port*/, const uint16_t length) {
+        // the extension allows 512, 1024, 2048 and 4096 bytes
+        return tls_state.supportsMaxFragmentLength && length >= 512 && length <= 4096 && (length & (length - 1)) == 0;
+    }
+}
+
+// *** WiFiUDP ***
+
+WiFiUDP::~WiFiUDP() {
+    stop();
+}
+
+uint8_t WiFiUDP::begin(const uint16_t port) {
+    stop();
+    _socket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (_socket < 0) return 0;
+    const int isSet = 1;
+    setsockopt(_socket, SOL_SOCKET, SO_REUSEADDR, &isSet, sizeof(isSet));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        stop();
+        return 0;
+    }
+    fcntl(_socket, F_SETFL, fcntl(_socket, F_GETFL) | O_NONBLOCK);
+    return 1;
+}
+
+void WiFiUDP::stop() {
+    if (_socket >= 0) close(_socket);
+    _socket = -1;
+    _size = 0;
+    _position = 0;
+}
+
+int WiFiUDP::parsePacket() {
+    _size = 0;
+    _position = 0;
+    if (_socket < 0) return 0;
+    const ssize_t size = recv(_socket, _packet, sizeof(_packet), 0);
+    if (size <= 0) return 0;
+    _size = static_cast<size_t>(size);
+    return static_cast<int>(_size);
+}
+
+int WiFiUDP::read(uint8_t* buffer, const size_t size) {
+    const size_t count = std::min(size, _size - _position);
+    if (count == 0) return -1;
+    memcpy(buffer, _packet + _position, count);
+    _position += count;
+    return static_cast<int>(count);
+}
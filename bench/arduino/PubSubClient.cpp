@@ -0,0 +1,283 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+#include "PubSubClient.h"
+
+PubSubClient::PubSubClient() {
+    setBufferSize(MQTT_MAX_PACKET_SIZE);
+}
+
+PubSubClient::~PubSubClient() {
+    free(_buffer);
+}
+
+bool PubSubClient::setBufferSize(const uint16_t size) {
+    if (size == 0) return false;
+    auto* buffer = static_cast<uint8_t*>(_buffer == nullptr ? malloc(size) : realloc(_buffer, size));
+    if (buffer == nullptr) return false;
+    _buffer = buffer;
+    _bufferSize = size;
+    return true;
+}
+
+bool PubSubClient::connect(const char* id, const char* willTopic, const uint8_t willQos, const bool willRetain, const char* willMessage) {
+    return connect(id, nullptr, nullptr, willTopic, willQos, willRetain, willMessage);
+}
+
+bool PubSubClient::connect(const char* id, const char* user, const char* password,
+                           const char* willTopic, const uint8_t willQos, const bool willRetain, const char* willMessage, const bool cleanSession) {
+    if (connected()) return true;
+    const int result = _client->connected() ? 1 : _client->connect(_domain, _port);
+    if (result != 1) {
+        _state = MQTT_CONNECT_FAILED;
+        return false;
+    }
+    _messageId = 1;
+    uint16_t position = kHeaderRoom;
+    constexpr uint8_t kProtocol[] = { 0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04 };
+    memcpy(_buffer + position, kProtocol, sizeof(kProtocol));
+    position += sizeof(kProtocol);
+
+    uint8_t flags = cleanSession ? 0x02 : 0x00;
+    if (willTopic != nullptr) flags |= 0x04 | static_cast<uint8_t>(willQos << 3) | static_cast<uint8_t>(willRetain << 5);
+    if (user != nullptr) {
+        flags |= 0x80;
+        if (password != nullptr) flags |= 0x40;
+    }
+    _buffer[position++] = flags;
+    _buffer[position++] = static_cast<uint8_t>(_keepAlive >> 8);
+    _buffer[position++] = static_cast<uint8_t>(_keepAlive & 0xFF);
+
+    bool isWritten = writeString(id, position);
+    if (willTopic != nullptr) isWritten = isWritten && writeString(willTopic, position) && writeString(willMessage, position);
+    if (user != nullptr) {
+        isWritten = isWritten && writeString(user, position);
+        if (password != nullptr) isWritten = isWritten && writeString(password, position);
+    }
+    if (!isWritten || !write(kConnect, position - kHeaderRoom)) {
+        _client->stop();
+        _state = MQTT_CONNECT_FAILED;
+        return false;
+    }
+
+    _lastInActivity = _lastOutActivity = millis();
+    while (_client->available() == 0) {
+        if (millis() - _lastInActivity >= _socketTimeout * 1000UL) {
+            _state = MQTT_CONNECTION_TIMEOUT;
+            _client->stop();
+            return false;
+        }
+        yield();
+    }
+    uint8_t headerLength;
+    const uint32_t length = readPacket(headerLength);
+    if (length == 4 && (_buffer[0] & 0xF0) == kConnAck) {
+        if (_buffer[3] == 0) {
+            _lastInActivity = millis();
+            _isPingOutstanding = false;
+            _state = MQTT_CONNECTED;
+            return true;
+        }
+        _state = _buffer[3];
+    } else {
+        _state = MQTT_CONNECT_FAILED;
+    }
+    _client->stop();
+    return false;
+}
+
+void PubSubClient::disconnect() {
+    _buffer[0] = kDisconnect;
+    _buffer[1] = 0;
+    _client->write(_buffer, 2);
+    _state = MQTT_DISCONNECTED;
+    _client->flush();
+    _client->stop();
+    _lastInActivity = _lastOutActivity = millis();
+}
+
+bool PubSubClient::publish(const char* topic, const char* payload, const bool retained) {
+    return publish(topic, reinterpret_cast<const uint8_t*>(payload), payload != nullptr ? strlen(payload) : 0, retained);
+}
+
+bool PubSubClient::publish(const char* topic, const uint8_t* payload, const unsigned int length, const bool retained) {
+    if (!connected()) return false;
+    if (_bufferSize < kHeaderRoom + 2 + strlen(topic) + length) return false;
+    uint16_t position = kHeaderRoom;
+    writeString(topic, position);
+    if (length > 0) memcpy(_buffer + position, payload, length);
+    position += length;
+    return write(retained ? kPublish | 1 : kPublish, position - kHeaderRoom);
+}
+
+bool PubSubClient::subscribe(const char* topic, const uint8_t qos) {
+    if (qos > 1 || !connected()) return false;
+    if (_bufferSize < kHeaderRoom + 2 + 2 + strlen(topic) + 1) return false;
+    uint16_t position = kHeaderRoom;
+    const uint16_t id = nextMessageId();
+    _buffer[position++] = static_cast<uint8_t>(id >> 8);
+    _buffer[position++] = static_cast<uint8_t>(id & 0xFF);
+    writeString(topic, position);
+    _buffer[position++] = qos;
+    return write(kSubscribe, position - kHeaderRoom);
+}
+
+bool PubSubClient::unsubscribe(const char* topic) {
+    if (!connected()) return false;
+    if (_bufferSize < kHeaderRoom + 2 + 2 + strlen(topic)) return false;
+    uint16_t position = kHeaderRoom;
+    const uint16_t id = nextMessageId();
+    _buffer[position++] = static_cast<uint8_t>(id >> 8);
+    _buffer[position++] = static_cast<uint8_t>(id & 0xFF);
+    writeString(topic, position);
+    return write(kUnsubscribe, position - kHeaderRoom);
+}
+
+bool PubSubClient::loop() {
+    if (!connected()) return false;
+    const unsigned long now = millis();
+    const unsigned long keepAlive = _keepAlive * 1000UL;
+    if (now - _lastInActivity > keepAlive || now - _lastOutActivity > keepAlive) {
+        if (_isPingOutstanding) {
+            _state = MQTT_CONNECTION_TIMEOUT;
+            _client->stop();
+            return false;
+        }
+        _buffer[0] = kPingReq;
+        _buffer[1] = 0;
+        _client->write(_buffer, 2);
+        _lastOutActivity = _lastInActivity = now;
+        _isPingOutstanding = true;
+    }
+    if (_client->available() == 0) return true;
+
+    uint8_t headerLength;
+    const uint32_t length = readPacket(headerLength);
+    if (length == 0) return connected();
+    _lastInActivity = now;
+    const uint8_t type = _buffer[0] & 0xF0;
+    if (type == kPublish) {
+        if (!_callback) return true;
+        // the topic moves one byte forward, so it can be zero terminated in place
+        const uint16_t topicLength = static_cast<uint16_t>(_buffer[headerLength + 1] << 8 | _buffer[headerLength + 2]);
+        memmove(_buffer + headerLength + 2, _buffer + headerLength + 3, topicLength);
+        _buffer[headerLength + 2 + topicLength] = 0;
+        auto* topic = reinterpret_cast<char*>(_buffer + headerLength + 2);
+        const uint32_t payloadStart = headerLength + 3 + topicLength;
+        if ((_buffer[0] & 0x06) == 0x02) {
+            const uint16_t id = static_cast<uint16_t>(_buffer[payloadStart] << 8 | _buffer[payloadStart + 1]);
+            _callback(topic, _buffer + payloadStart + 2, length - payloadStart - 2);
+            _buffer[0] = kPubAck;
+            _buffer[1] = 2;
+            _buffer[2] = static_cast<uint8_t>(id >> 8);
+            _buffer[3] = static_cast<uint8_t>(id & 0xFF);
+            _client->write(_buffer, 4);
+            _lastOutActivity = now;
+        } else {
+            _callback(topic, _buffer + payloadStart, length - payloadStart);
+        }
+    } else if (type == kPingReq) {
+        _buffer[0] = kPingResp;
+        _buffer[1] = 0;
+        _client->write(_buffer, 2);
+    } else if (type == kPingResp) {
+        _isPingOutstanding = false;
+    }
+    return true;
+}
+
+bool PubSubClient::connected() {
+    if (_client == nullptr) return false;
+    if (_client->connected()) return _state == MQTT_CONNECTED;
+    if (_state == MQTT_CONNECTED) {
+        _state = MQTT_CONNECTION_LOST;
+        _client->flush();
+        _client->stop();
+    }
+    return false;
+}
+
+// *** private methods ***
+
+bool PubSubClient::readByte(uint8_t& value) {
+    const unsigned long start = millis();
+    while (_client->available() == 0) {
+        yield();
+        if (millis() - start >= _socketTimeout * 1000UL) return false;
+    }
+    value = static_cast<uint8_t>(_client->read());
+    return true;
+}
+
+uint32_t PubSubClient::readPacket(uint8_t& headerLength) {
+    uint32_t length = 0;
+    if (!readByte(_buffer[length++])) return 0;
+    uint32_t remaining = 0;
+    uint32_t multiplier = 1;
+    uint8_t digit;
+    do {
+        if (length == 5) {
+            // invalid remaining length
+            _state = MQTT_DISCONNECTED;
+            _client->stop();
+            return 0;
+        }
+        if (!readByte(digit)) return 0;
+        _buffer[length++] = digit;
+        remaining += (digit & 127) * multiplier;
+        multiplier <<= 7;
+    } while ((digit & 128) != 0);
+    headerLength = static_cast<uint8_t>(length - 1);
+
+    uint32_t total = length;
+    for (uint32_t i = 0; i < remaining; i++) {
+        if (!readByte(digit)) return 0;
+        if (length < _bufferSize) _buffer[length++] = digit;
+        total++;
+    }
+    // too big for the buffer, so it is dropped
+    return total > _bufferSize ? 0 : length;
+}
+
+// puts the fixed header in front of the content that starts at kHeaderRoom, and sends the packet
+bool PubSubClient::write(const uint8_t header, const uint16_t length) {
+    uint8_t encoded[4];
+    uint8_t encodedLength = 0;
+    uint16_t remaining = length;
+    do {
+        uint8_t digit = remaining & 127;
+        remaining >>= 7;
+        if (remaining > 0) digit |= 0x80;
+        encoded[encodedLength++] = digit;
+    } while (remaining > 0);
+
+    const uint16_t start = kHeaderRoom - 1 - encodedLength;
+    _buffer[start] = header;
+    memcpy(_buffer + start + 1, encoded, encodedLength);
+    const size_t size = 1 + encodedLength + length;
+    _lastOutActivity = millis();
+    return _client->write(_buffer + start, size) == size;
+}
+
+bool PubSubClient::writeString(const char* text, uint16_t& position) {
+    const size_t length = strlen(text);
+    if (position + 2 + length > _bufferSize) return false;
+    _buffer[position++] = static_cast<uint8_t>(length >> 8);
+    _buffer[position++] = static_cast<uint8_t>(length & 0xFF);
+    memcpy(_buffer + position, text, length);
+    position += static_cast<uint16_t>(length);
+    return true;
+}
+
+uint16_t PubSubClient::nextMessageId() {
+    if (++_messageId == 0) _messageId = 1;
+    return _messageId;
+}
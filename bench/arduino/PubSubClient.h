@@ -0,0 +1,103 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// PubSubClient for the host: the same interface and behaviour as the library (MQTT 3.1.1, QoS 0 publishing,
+// one incoming packet per loop(), a buffer allocated once), over any Client. Like on the ESP8266, the callback is
+// a std::function.
+
+#ifndef HEADER_HOST_PUBSUBCLIENT
+#define HEADER_HOST_PUBSUBCLIENT
+
+#include <functional>
+#include "Client.h"
+
+#define MQTT_CONNECTION_TIMEOUT     (-4)
+#define MQTT_CONNECTION_LOST        (-3)
+#define MQTT_CONNECT_FAILED         (-2)
+#define MQTT_DISCONNECTED           (-1)
+#define MQTT_CONNECTED               0
+#define MQTT_CONNECT_BAD_PROTOCOL    1
+#define MQTT_CONNECT_BAD_CLIENT_ID   2
+#define MQTT_CONNECT_UNAVAILABLE     3
+#define MQTT_CONNECT_BAD_CREDENTIALS 4
+#define MQTT_CONNECT_UNAUTHORIZED    5
+
+#define MQTT_MAX_PACKET_SIZE 256
+#define MQTT_KEEPALIVE 15
+#define MQTT_SOCKET_TIMEOUT 15
+
+class PubSubClient {
+public:
+    using Callback = std::function<void(char* topic, uint8_t* payload, unsigned int length)>;
+
+    PubSubClient();
+    ~PubSubClient();
+    PubSubClient(const PubSubClient&) = delete;
+    PubSubClient& operator=(const PubSubClient&) = delete;
+
+    PubSubClient& setClient(Client& client) { _client = &client; return *this; }
+    PubSubClient& setServer(const char* domain, uint16_t port) { _domain = domain; _port = port; return *this; }
+    PubSubClient& setCallback(Callback callback) { _callback = std::move(callback); return *this; }
+    PubSubClient& setKeepAlive(uint16_t seconds) { _keepAlive = seconds; return *this; }
+    PubSubClient& setSocketTimeout(uint16_t seconds) { _socketTimeout = seconds; return *this; }
+    bool setBufferSize(uint16_t size);
+    uint16_t getBufferSize() const { return _bufferSize; }
+
+    bool connect(const char* id) { return connect(id, nullptr, nullptr, nullptr, 0, false, nullptr); }
+    bool connect(const char* id, const char* willTopic, uint8_t willQos, bool willRetain, const char* willMessage);
+    bool connect(const char* id, const char* user, const char* password,
+                 const char* willTopic, uint8_t willQos, bool willRetain, const char* willMessage, bool cleanSession = true);
+    void disconnect();
+    bool publish(const char* topic, const char* payload, bool retained = false);
+    bool publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained = false);
+    bool subscribe(const char* topic, uint8_t qos = 0);
+    bool unsubscribe(const char* topic);
+    // keeps the connection alive and handles at most one incoming packet
+    bool loop();
+    bool connected();
+    int state() const { return _state; }
+
+private:
+    static constexpr uint8_t kConnect = 0x10;
+    static constexpr uint8_t kConnAck = 0x20;
+    static constexpr uint8_t kPublish = 0x30;
+    static constexpr uint8_t kPubAck = 0x40;
+    static constexpr uint8_t kSubscribe = 0x82;
+    static constexpr uint8_t kUnsubscribe = 0xA2;
+    static constexpr uint8_t kPingReq = 0xC0;
+    static constexpr uint8_t kPingResp = 0xD0;
+    static constexpr uint8_t kDisconnect = 0xE0;
+    // room for the fixed header in front of a packet, which is written last
+    static constexpr uint16_t kHeaderRoom = 5;
+
+    bool readByte(uint8_t& value);
+    // reads a whole packet into the buffer; returns its length, or 0 if it didn't come (in time) or didn't fit
+    uint32_t readPacket(uint8_t& headerLength);
+    bool write(uint8_t header, uint16_t length);
+    bool writeString(const char* text, uint16_t& position);
+    uint16_t nextMessageId();
+
+    Client* _client = nullptr;
+    const char* _domain = nullptr;
+    uint16_t _port = 0;
+    Callback _callback;
+    uint8_t* _buffer = nullptr;
+    uint16_t _bufferSize = 0;
+    uint16_t _keepAlive = MQTT_KEEPALIVE;
+    uint16_t _socketTimeout = MQTT_SOCKET_TIMEOUT;
+    uint16_t _messageId = 0;
+    unsigned long _lastOutActivity = 0;
+    unsigned long _lastInActivity = 0;
+    bool _isPingOutstanding = false;
+    int _state = MQTT_DISCONNECTED;
+};
+
+#endif
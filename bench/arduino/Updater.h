@@ -0,0 +1,59 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// Update, counting what is written instead of flashing it
+
+#ifndef HEADER_HOST_UPDATER
+#define HEADER_HOST_UPDATER
+
+#include <cstddef>
+#include <cstdint>
+
+class UpdaterClass {
+public:
+    bool begin(const size_t size) {
+        if (_isRunning) return false;
+        _isRunning = true;
+        _size = size;
+        _written = 0;
+        return true;
+    }
+
+    size_t write(const uint8_t* /*data*/, const size_t length) {
+        if (!_isRunning) return 0;
+        _written += length;
+        return length;
+    }
+
+    // Without evenIfRemaining it only succeeds if the whole image was written; either way the update stops
+    bool end(const bool evenIfRemaining = false) {
+        const bool isComplete = _isRunning && (evenIfRemaining || _written == _size);
+        _isRunning = false;
+        if (isComplete) _commits++;
+        return isComplete;
+    }
+
+    uint8_t getError() const { return 0; }
+    bool isRunning() const { return _isRunning; }
+    // bytes written to the current or last image, and the images that were committed
+    size_t written() const { return _written; }
+    uint32_t commits() const { return _commits; }
+
+private:
+    bool _isRunning = false;
+    size_t _size = 0;
+    size_t _written = 0;
+    uint32_t _commits = 0;
+};
+
+extern UpdaterClass Update;
+
+#endif
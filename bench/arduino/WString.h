@@ -0,0 +1,42 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// The Arduino String, as far as the firmware and the other stand-ins use it. Like the core's, it keeps its
+// text on the heap with malloc and realloc, so the allocation audit sees what a String costs.
+
+#ifndef HEADER_HOST_WSTRING
+#define HEADER_HOST_WSTRING
+
+#include <cstddef>
+
+class String {
+public:
+    String(const char* text = "");
+    String(const String& other);
+    String(String&& other) noexcept;
+    ~String();
+    String& operator=(const String& other);
+    String& operator=(String&& other) noexcept;
+    String& operator+=(const char* text);
+    bool operator==(const char* text) const;
+
+    const char* c_str() const { return _buffer != nullptr ? _buffer : ""; }
+    size_t length() const { return _length; }
+    long toInt() const;
+
+private:
+    bool assign(const char* text, size_t length);
+
+    char* _buffer = nullptr;
+    size_t _length = 0;
+};
+
+#endif
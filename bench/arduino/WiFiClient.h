@@ -0,0 +1,45 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// A TCP client: to an in-process endpoint if one listens on the host and port, and over a socket otherwise
+
+#ifndef HEADER_HOST_WIFICLIENT
+#define HEADER_HOST_WIFICLIENT
+
+#include "Client.h"
+#include "HostNetwork.h"
+
+class WiFiClient : public Client {
+public:
+    WiFiClient() = default;
+    ~WiFiClient() override;
+    WiFiClient(const WiFiClient&) = delete;
+    WiFiClient& operator=(const WiFiClient&) = delete;
+
+    int connect(const char* host, uint16_t port) override;
+    virtual int connect(const String& host, uint16_t port);
+    size_t write(uint8_t data) override;
+    size_t write(const uint8_t* data, size_t size) override;
+    int available() override;
+    int read() override;
+    int read(uint8_t* buffer, size_t size) override;
+    int peek() override;
+    void flush() override {}
+    void stop() override;
+    uint8_t connected() override;
+    operator bool() override { return connected() != 0; }
+
+private:
+    host::Connection* _connection = nullptr;
+    int _socket = -1;
+};
+
+#endif
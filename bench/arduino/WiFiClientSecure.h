@@ -0,0 +1,59 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// BearSSL::WiFiClientSecure without the encryption: it connects like WiFiClient, and keeps the session bookkeeping
+// as host::tls() says the server behaves, so session resumption can be followed.
+
+#ifndef HEADER_HOST_WIFICLIENTSECURE
+#define HEADER_HOST_WIFICLIENTSECURE
+
+#include <cstring>
+#include "WiFiClient.h"
+
+struct br_ssl_session_parameters {
+    uint8_t session_id[32];
+    uint8_t session_id_len;
+};
+
+namespace BearSSL {
+    // like the core, the parameters are only for the client to see
+    class Session {
+        friend class WiFiClientSecure;
+    public:
+        Session() { memset(&_parameters, 0, sizeof(_parameters)); }
+    private:
+        br_ssl_session_parameters* getSession() { return &_parameters; }
+        br_ssl_session_parameters _parameters;
+    };
+
+    class X509List {
+    public:
+        explicit X509List(const char* /*pem*/) {}
+    };
+
+    class WiFiClientSecure : public WiFiClient {
+    public:
+        using WiFiClient::connect;
+        int connect(const char* host, uint16_t port) override;
+        void setSession(Session* session) { _session = session; }
+        void setTrustAnchors(const X509List* /*anchors*/) {}
+        void setBufferSizes(int receive, int transmit);
+        int receiveBufferSize() const { return _receiveBufferSize; }
+        static bool probeMaxFragmentLength(const char* host, uint16_t port, uint16_t length);
+
+    private:
+        Session* _session = nullptr;
+        int _receiveBufferSize = 16384;
+        int _transmitBufferSize = 512;
+    };
+}
+
+#endif
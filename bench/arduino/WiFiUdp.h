@@ -0,0 +1,44 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// WiFiUDP over a real UDP socket, so a local sender can stream to the firmware
+
+#ifndef HEADER_HOST_WIFIUDP
+#define HEADER_HOST_WIFIUDP
+
+#include <cstddef>
+#include <cstdint>
+
+class WiFiUDP {
+public:
+    WiFiUDP() = default;
+    ~WiFiUDP();
+    WiFiUDP(const WiFiUDP&) = delete;
+    WiFiUDP& operator=(const WiFiUDP&) = delete;
+
+    // listens on all interfaces; returns 1 if that worked
+    uint8_t begin(uint16_t port);
+    void stop();
+    // Takes the next packet and returns its size, or 0 if none is waiting. Like the core, it drops what's left
+    // of the previous one.
+    int parsePacket();
+    int available() const { return static_cast<int>(_size - _position); }
+    int read(uint8_t* buffer, size_t size);
+
+private:
+    static constexpr size_t kMaxPacketSize = 1500;
+    int _socket = -1;
+    uint8_t _packet[kMaxPacketSize] = {};
+    size_t _size = 0;
+    size_t _position = 0;
+};
+
+#endif
@@ -0,0 +1,103 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// The SHA-256 interface FirmwareManager uses, with the same results as BearSSL's, so tests can check digests.
+
+#ifndef HEADER_HOST_BEARSSL_HASH
+#define HEADER_HOST_BEARSSL_HASH
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+constexpr size_t br_sha256_SIZE = 32;
+
+struct br_sha256_context {
+    uint8_t buf[64];
+    uint64_t count;
+    uint32_t val[8];
+};
+
+namespace host_sha256 {
+    constexpr uint32_t kRoundConstants[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+    };
+
+    inline uint32_t rotate(const uint32_t value, const int bits) { return value >> bits | value << (32 - bits); }
+
+    inline void compress(uint32_t* state, const uint8_t* block) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = static_cast<uint32_t>(block[4 * i]) << 24 | static_cast<uint32_t>(block[4 * i + 1]) << 16 |
+                static_cast<uint32_t>(block[4 * i + 2]) << 8 | block[4 * i + 3];
+        }
+        for (int i = 16; i < 64; i++) {
+            const uint32_t s0 = rotate(w[i - 15], 7) ^ rotate(w[i - 15], 18) ^ w[i - 15] >> 3;
+            const uint32_t s1 = rotate(w[i - 2], 17) ^ rotate(w[i - 2], 19) ^ w[i - 2] >> 10;
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t v[8];
+        memcpy(v, state, sizeof(v));
+        for (int i = 0; i < 64; i++) {
+            const uint32_t t1 = v[7] + (rotate(v[4], 6) ^ rotate(v[4], 11) ^ rotate(v[4], 25)) +
+                ((v[4] & v[5]) ^ (~v[4] & v[6])) + kRoundConstants[i] + w[i];
+            const uint32_t t2 = (rotate(v[0], 2) ^ rotate(v[0], 13) ^ rotate(v[0], 22)) +
+                ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+            memmove(v + 1, v, 7 * sizeof(v[0]));
+            v[4] += t1;
+            v[0] = t1 + t2;
+        }
+        for (int i = 0; i < 8; i++) state[i] += v[i];
+    }
+}
+
+inline void br_sha256_init(br_sha256_context* context) {
+    constexpr uint32_t kInitial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(context->val, kInitial, sizeof(kInitial));
+    context->count = 0;
+}
+
+inline void br_sha256_update(br_sha256_context* context, const void* data, const size_t length) {
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < length; i++) {
+        context->buf[context->count++ % 64] = bytes[i];
+        if (context->count % 64 == 0) host_sha256::compress(context->val, context->buf);
+    }
+}
+
+// like BearSSL, this leaves the context as it was, so more data can follow
+inline void br_sha256_out(const br_sha256_context* context, void* out) {
+    br_sha256_context last = *context;
+    const uint64_t bits = context->count * 8;
+    const uint8_t padding = 0x80;
+    br_sha256_update(&last, &padding, 1);
+    const uint8_t zero = 0;
+    while (last.count % 64 != 56) br_sha256_update(&last, &zero, 1);
+    for (int i = 7; i >= 0; i--) {
+        const auto byte = static_cast<uint8_t>(bits >> (8 * i));
+        br_sha256_update(&last, &byte, 1);
+    }
+    auto* digest = static_cast<uint8_t*>(out);
+    for (int i = 0; i < 8; i++) {
+        for (int j = 0; j < 4; j++) digest[4 * i + j] = static_cast<uint8_t>(last.val[i] >> (24 - 8 * j));
+    }
+}
+
+#endif
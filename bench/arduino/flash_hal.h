@@ -0,0 +1,22 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// Where the file system partition starts, here 2 MB into a 4 MB flash, and how big it is on the host
+
+#ifndef HEADER_HOST_FLASH_HAL
+#define HEADER_HOST_FLASH_HAL
+
+#include "Host.h"
+
+#define FS_PHYS_ADDR 0x200000
+#define FS_PHYS_SIZE (host::Flash::kSectorCount * host::Flash::kSectorSize)
+
+#endif
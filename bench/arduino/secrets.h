@@ -0,0 +1,27 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// The configuration for host builds: a broker on this machine, without authentication
+
+#ifndef SECRETS_H
+#define SECRETS_H
+
+constexpr auto kConfigSsid = "host-wifi";
+constexpr auto kConfigWifiPassword = "host-password";
+constexpr auto kConfigDeviceName = "led-ring-host";
+constexpr auto kConfigMqttBroker = "localhost";
+static const int kConfigMqttPort = 1883;
+constexpr auto kConfigMqttUser = "";
+constexpr auto kConfigMqttPassword = "";
+constexpr auto kConfigBaseFirmwareUrl = "http://localhost:8080/firmware/";
+constexpr char kConfigRootCaCertificate[] = "";
+
+#endif
@@ -0,0 +1,261 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// Messages per second through the MQTT callback, before and after the hashed topic dispatch. Both take the same
+// messages from the loopback broker through PubSubClient, one per loop(). After: MqttDriver routing to typed
+// handlers. Before: the callback as it was, copying the topic and payload, splitting the topic with next_token,
+// and the strcmp chain of Controller::handleMqttMessage and processLedProperty (without its serial output).
+// Also times the loop() calls that publish the Homie description to the loopback broker, against the time slice
+// they should keep to. The virtual clock stands still while they run, so a slice only ends when the description
+// is out, and its time is what the whole description takes here.
+
+#include <ESP8266WiFi.h>
+#include <PubSubClient.h>
+#include <vector>
+
+#include "Host.h"
+#include "LedRingConfig.h"
+#include "LoopbackBroker.h"
+#include "MqttDriver.h"
+#include "Utilities.h"
+#include "harness.h"
+#include "secrets.h"
+
+using utilities::next_token;
+
+namespace {
+    constexpr size_t kTopicSize = 128;
+    constexpr size_t kMessageCount = 5;
+    // MqttDriver::kPublishSliceMicros
+    constexpr double kPublishSliceMicros = 5000;
+
+    struct Message {
+        char topic[kTopicSize];
+        const char* payload;
+    };
+
+    // a mix of what a home automation system sends, and a setter nobody handles
+    Message messages[kMessageCount];
+
+    void make_messages() {
+        const char* node = led_ring_config::kSegments[0].node;
+        const struct {
+            const char* property;
+            const char* payload;
+        } kinds[kMessageCount] = {
+            { kColorProperty, "120,100,50" }, { kModeProperty, "3" }, { kSceneProperty, "240,100,30,1,2000" },
+            { kRecallProperty, "4" }, { "unknown", "1" }
+        };
+        for (size_t i = 0; i < kMessageCount; i++) {
+            snprintf(messages[i].topic, kTopicSize, "homie/%s/%s/%s/set", kConfigDeviceName, node, kinds[i].property);
+            messages[i].payload = kinds[i].payload;
+        }
+    }
+
+    // what the handlers and the old chain end up with, so neither can be optimized away
+    struct Sink {
+        int values[5];
+        long mode;
+        uint32_t handled;
+    } sink;
+
+    // *** before ***
+
+    constexpr size_t kLegacyTopicBufferSize = 255;
+    constexpr size_t kLegacyPayloadBufferSize = 255;
+
+    void legacy_process_led_property(const uint8_t /*segment*/, const char* property, const char* payload) {
+        if (strcmp(property, kColorProperty) == 0) {
+            int h, s, v;
+            if (sscanf(payload, "%d,%d,%d", &h, &s, &v) == 3) {
+                sink.values[0] = h;
+                sink.values[1] = s;
+                sink.values[2] = v;
+                sink.handled++;
+            }
+        } else if (strcmp(property, kModeProperty) == 0) {
+            sink.mode = strtol(payload, nullptr, 10);
+            sink.handled++;
+        }
+    }
+
+    void legacy_handle_message(const char* node, const char* property, const char* payload) {
+        if (node == nullptr) return;
+        const uint8_t segment = led_ring_config::find_segment(node);
+        if (segment != led_ring_config::kNoSegment) {
+            legacy_process_led_property(segment, property, payload);
+        } else if (strcmp(node, kFirmwareNode) == 0 && strcmp(property, kUpdateProperty) == 0) {
+            sink.handled++;
+        }
+    }
+
+    bool legacy_parse_topic(char* topic, const char*& node, const char*& property, bool& isSetter) {
+        if (next_token(&topic, '/') == nullptr) return false;
+        if (next_token(&topic, '/') == nullptr) return false;
+        node = next_token(&topic, '/');
+        if (node == nullptr) return false;
+        property = next_token(&topic, '/');
+        if (property == nullptr) return false;
+        const char* set = next_token(&topic, '/');
+        isSetter = set != nullptr && strcmp(set, "set") == 0;
+        return true;
+    }
+
+    void legacy_callback(char* topic, uint8_t* payload, const unsigned length) {
+        if (length == 0 || length > kLegacyPayloadBufferSize - 1) return;
+        char topicCopy[kLegacyTopicBufferSize];
+        strlcpy(topicCopy, topic, sizeof(topicCopy));
+        const char* node;
+        const char* property;
+        bool isSetter;
+        if (!legacy_parse_topic(topicCopy, node, property, isSetter)) return;
+        char payloadCopy[kLegacyPayloadBufferSize];
+        for (unsigned i = 0; i < length; i++) {
+            payloadCopy[i] = static_cast<char>(payload[i]);
+        }
+        payloadCopy[length] = '\0';
+        legacy_handle_message(node, property, payloadCopy);
+    }
+
+    // *** after ***
+
+    void handle_values(uint8_t /*segment*/, const char* payload, const size_t length) {
+        if (utilities::parse_ints(payload, length, sink.values, 5) >= 3) sink.handled++;
+    }
+
+    void handle_number(uint8_t /*segment*/, const char* payload, const size_t length) {
+        if (utilities::parse_ints(payload, length, sink.values, 1) == 1) {
+            sink.mode = sink.values[0];
+            sink.handled++;
+        }
+    }
+
+    // runs the driver until it is connected, has announced itself and published what was queued
+    bool settle(MqttDriver& driver) {
+        for (int i = 0; i < 10000; i++) {
+            driver.loop();
+            host::advance_micros(1000);
+            if (driver.state() == MqttState::Ready && driver.publishQueue().depth() == 0) return true;
+        }
+        return false;
+    }
+
+    // the callback's own share is what it takes more than the baseline
+    void report(const char* path, const double nanos, const double baselineNanos) {
+        bench::Json("dispatch_rate").add("path", path).add("messages_per_second", 1e9 / nanos)
+            .add("callback_ns", nanos - baselineNanos).add("handled", sink.handled).print();
+    }
+
+    // Connects a fresh driver each round and times every loop() while it announces itself.
+    void measure_announcement() {
+        std::vector<double> slices;
+        uint32_t publishes = 0;
+        const uint64_t rounds = bench::scaled(200);
+        for (uint64_t round = 0; round < rounds; round++) {
+            WiFiClient client;
+            MqttDriver driver;
+            driver.begin(&client, kConfigDeviceName);
+            driver.setNetworkAvailable(true);
+            for (int i = 0; i < 1000 && driver.state() != MqttState::Announcing; i++) {
+                driver.loop();
+                host::advance_micros(1000);
+            }
+            const uint32_t publishedBefore = driver.traffic().published;
+            while (driver.state() == MqttState::Announcing) {
+                const double start = bench::now_nanos();
+                driver.loop();
+                slices.push_back((bench::now_nanos() - start) / 1000);
+                host::advance_micros(1000);
+            }
+            publishes += driver.traffic().published - publishedBefore;
+            driver.disconnect();
+        }
+        const size_t sliceCount = slices.size();
+        const bench::Summary summary = bench::summarize(slices);
+        bench::Json("announce_slice").add("rounds", static_cast<uint32_t>(rounds))
+            .add("slices", static_cast<uint32_t>(sliceCount)).add("publishes_per_round", static_cast<double>(publishes) / rounds)
+            .add("budget_us", kPublishSliceMicros).add("budget_share_max", summary.max / kPublishSliceMicros)
+            .add("us_per_publish", summary.median * sliceCount / publishes).add("slice_us", summary).print();
+    }
+
+    size_t next_message = 0;
+
+    const Message& take_message() {
+        const Message& message = messages[next_message];
+        next_message = (next_message + 1) % kMessageCount;
+        return message;
+    }
+
+    // a plain PubSubClient with the callback, subscribed to the topics of the messages; returns the median ns per message
+    double measure_client(const char* name, PubSubClient::Callback callback, LoopbackBroker& broker) {
+        WiFiClient client;
+        PubSubClient mqtt;
+        mqtt.setClient(client);
+        mqtt.setBufferSize(512);
+        mqtt.setServer(kConfigMqttBroker, kConfigMqttPort);
+        mqtt.setCallback(std::move(callback));
+        if (!mqtt.connect(name)) {
+            fprintf(stderr, "%s could not connect\n", name);
+            exit(1);
+        }
+        for (const Message& message : messages) mqtt.subscribe(message.topic);
+        while (client.available() > 0 && mqtt.loop()) {}
+        sink = {};
+        const bench::Summary summary = bench::measure(name, 200000, [&mqtt, &broker] {
+            const Message& message = take_message();
+            broker.inject(message.topic, message.payload);
+            mqtt.loop();
+        });
+        mqtt.disconnect();
+        return summary.median;
+    }
+}
+
+int main(const int argc, char** argv) {
+    bench::init(argc, argv);
+    host::use_virtual_clock();
+    make_messages();
+    LoopbackBroker broker;
+    broker.listen(kConfigMqttBroker, kConfigMqttPort);
+
+    // the broker and PubSubClient, without a callback that does anything
+    const double baselineNanos = measure_client("dispatch_none", [](char*, uint8_t*, unsigned) {}, broker);
+
+    {
+        WiFiClient client;
+        MqttDriver driver;
+        driver.begin(&client, kConfigDeviceName);
+        driver.setPropertyHandler(SettableProperty::Color, handle_values);
+        driver.setPropertyHandler(SettableProperty::Scene, handle_values);
+        driver.setPropertyHandler(SettableProperty::Mode, handle_number);
+        driver.setPropertyHandler(SettableProperty::RecallPreset, handle_number);
+        driver.setNetworkAvailable(true);
+        if (!settle(driver)) {
+            fprintf(stderr, "MqttDriver did not get ready\n");
+            return 1;
+        }
+        sink = {};
+        const uint32_t receivedBefore = driver.traffic().received;
+        const bench::Summary summary = bench::measure("dispatch_table", 200000, [&driver, &broker] {
+            const Message& message = take_message();
+            broker.inject(message.topic, message.payload);
+            driver.loop();
+        });
+        report("table", summary.median, baselineNanos);
+        if (sink.handled != driver.traffic().received - receivedBefore) fprintf(stderr, "Not every message reached a handler\n");
+        driver.disconnect();
+    }
+
+    const double legacyNanos = measure_client("dispatch_strcmp", legacy_callback, broker);
+    report("strcmp", legacyNanos, baselineNanos);
+    measure_announcement();
+    return 0;
+}
@@ -0,0 +1,64 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// The render cost per effect: the effect alone for a few ring sizes, and a whole frame through LedRingDriver
+// (effect, conversion, dithering and Show() on the NeoPixelBus stand-in), with the frames on a virtual clock.
+
+#include "Effects.h"
+#include "Host.h"
+#include "LedRingDriver.h"
+#include "harness.h"
+
+namespace {
+    void measure_effect(const Effect* effect, const uint8_t mode, const uint16_t ledCount) {
+        HsvPixel pixels[host::kMaxLeds];
+        const LedState state = { 120, 100, 50, mode };
+        uint32_t frame = 0;
+        char name[64];
+        snprintf(name, sizeof(name), "effect_%s_%u", effect->name, ledCount);
+        bench::measure(name, 20000, [&] {
+            effect->render(state, frame++, pixels, ledCount);
+            bench::keep(pixels);
+        });
+    }
+
+    void measure_driver_frame(const Effect* effect, const uint8_t mode) {
+        LedRingDriver driver;
+        driver.begin();
+        driver.onStateCommitted(0, { 120, 100, 50, mode });
+        const unsigned long period = driver.scheduler().periodMicros();
+        const uint32_t showsBefore = host::led_output().shows;
+        char name[64];
+        snprintf(name, sizeof(name), "frame_%s_%u", effect->name, LedRingDriver::kLedCount);
+        const bench::Summary summary = bench::measure(name, 5000, [&] {
+            host::advance_micros(period);
+            driver.loop();
+        });
+        bench::Json("frame_counts").add("effect", effect->name).add("leds", LedRingDriver::kLedCount)
+            .add("rendered", driver.scheduler().renderedFrames()).add("dropped", driver.scheduler().droppedFrames())
+            .add("shows", host::led_output().shows - showsBefore).add("pushes", driver.pushes())
+            .add("unchanged", driver.unchangedPushes()).add("median_us", summary.median / 1000).print();
+    }
+}
+
+int main(const int argc, char** argv) {
+    bench::init(argc, argv);
+    host::use_virtual_clock();
+
+    for (uint8_t mode = 0; mode < effects::count(); mode++) {
+        const Effect* effect = effects::find(mode);
+        for (const uint16_t ledCount : { static_cast<uint16_t>(12), static_cast<uint16_t>(60), host::kMaxLeds }) {
+            measure_effect(effect, mode, ledCount);
+        }
+        measure_driver_frame(effect, mode);
+    }
+    return 0;
+}
@@ -0,0 +1,133 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// The hot pure C++ kernels: formatting, topic building and hashing, parsing, and the colour conversion
+// (next to the float path it replaced).
+// Built without the Arduino core, like on a PC.
+
+#include <algorithm>
+#include <vector>
+
+#include "ColorConversion.h"
+#include "LedState.h"
+#include "Utilities.h"
+#include "float_color.h"
+#include "harness.h"
+
+using namespace utilities;
+
+int main(const int argc, char** argv) {
+    bench::init(argc, argv);
+
+    char buffer[128];
+    bench::measure("snprintf_t", 200000, [&buffer] {
+        bench::keep(snprintf_t(buffer, "%u,%u,%u", 120u, 100u, 50u));
+    });
+
+    bench::measure("build_topic", 200000, [&buffer] {
+        build_topic(buffer, sizeof(buffer), "homie/led-ring-host", "led", "color");
+        bench::keep(buffer);
+    });
+
+    bench::measure("next_token", 200000, [&buffer] {
+        strcpy(buffer, "120,100,50");
+        char* start = buffer;
+        int total = 0;
+        for (char* token = next_token(&start, ','); token != nullptr; token = next_token(&start, ',')) total += token[0];
+        bench::keep(total);
+    });
+
+    bench::measure("parse_ints", 200000, [] {
+        int values[5];
+        bench::keep(parse_ints("120,100,50,0,2000", 17, values, 5));
+        bench::keep(values);
+    });
+
+    int value = 0;
+    bench::measure("scale_clamped", 1000000, [&value] {
+        value = (value + 7) % 400;
+        bench::keep(scale_clamped(value, 0, 360, 0, 255));
+    });
+
+    // the routing key of an incoming topic
+    bench::measure("hash_string", 500000, [] {
+        size_t length;
+        bench::keep(hash_string("led/color/set", length));
+        bench::keep(length);
+    });
+
+    LedState state = { 120, 100, 50, 0 };
+    bench::measure("serializeHsv", 200000, [&state, &buffer] {
+        state.hue = static_cast<uint16_t>((state.hue + 1) % 361);
+        bench::keep(state.serializeHsv(buffer, sizeof(buffer)));
+    });
+
+    HsvPixel pixel = { 0, 100, 100 };
+    bench::measure("hsv_to_rgb", 1000000, [&pixel] {
+        pixel.hue = static_cast<uint16_t>((pixel.hue + 1) % 361);
+        bench::keep(color::hsv_to_rgb(pixel));
+    });
+
+    // the float path it replaced, for comparison: three scale_clamped calls and the HsbColor conversion
+    bench::measure("hsv_to_rgb_float", 1000000, [&pixel] {
+        pixel.hue = static_cast<uint16_t>((pixel.hue + 1) % 361);
+        bench::keep(float_color::hsv_to_rgb(pixel));
+    });
+
+    // a frame of a 60 LED ring: gamma corrected at 16 bits, then dithered to 8
+    constexpr uint16_t kLedCount = 60;
+    HsvPixel frame[kLedCount];
+    for (uint16_t i = 0; i < kLedCount; i++) frame[i] = { static_cast<uint16_t>(i * 6), 100, 30 };
+    Rgb16Pixel levels[kLedCount];
+    RgbPixel output[kLedCount];
+    uint8_t errors[3 * kLedCount] = {};
+    bench::measure("hsv_to_rgb_frame60", 20000, [&] {
+        color::hsv_to_rgb(frame, output, kLedCount);
+        bench::keep(output);
+    });
+
+    bench::measure("hsv_to_rgb_float_frame60", 20000, [&] {
+        for (uint16_t i = 0; i < kLedCount; i++) output[i] = float_color::hsv_to_rgb(frame[i]);
+        bench::keep(output);
+    });
+
+    bench::measure("hsv_to_rgb16_frame60", 20000, [&] {
+        color::hsv_to_rgb16(frame, levels, kLedCount);
+        bench::keep(levels);
+    });
+
+    bench::measure("dither_frame60", 20000, [&] {
+        bench::keep(color::dither(levels, errors, output, kLedCount, 39));
+        bench::keep(output);
+    });
+
+    // The whole output stage per frame, for a few ring sizes, and the part of the dither period it takes
+    // (LedRingDriver::kDitherPeriodMicros, the Show() time times 4 but at least 2.5 ms). Dim levels, so every
+    // channel dithers.
+    for (const uint16_t ledCount : { 12, 60, 256 }) {
+        std::vector<HsvPixel> ring(ledCount);
+        for (uint16_t i = 0; i < ledCount; i++) ring[i] = { static_cast<uint16_t>(i * 360 / ledCount), 100, 3 };
+        std::vector<Rgb16Pixel> ringLevels(ledCount);
+        std::vector<RgbPixel> ringOutput(ledCount);
+        std::vector<uint8_t> ringErrors(3 * ledCount);
+        char name[32];
+        snprintf(name, sizeof(name), "output_stage_%u", ledCount);
+        const bench::Summary summary = bench::measure(name, 10000, [&] {
+            color::hsv_to_rgb16(ring.data(), ringLevels.data(), ledCount);
+            bench::keep(color::dither(ringLevels.data(), ringErrors.data(), ringOutput.data(), ledCount, 1));
+            bench::keep(ringOutput.data());
+        });
+        const unsigned long ditherPeriod = std::max(2500UL, 4 * (30UL * ledCount + 50));
+        bench::Json("output_stage_budget").add("leds", ledCount).add("dither_hz", 1000000.0 / ditherPeriod)
+            .add("frame_us", summary.median / 1000).add("period_share", summary.median / 1000 / ditherPeriod).print();
+    }
+    return 0;
+}
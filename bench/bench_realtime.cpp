@@ -0,0 +1,172 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// The realtime stream end to end: a sender thread streams DDP frames over UDP on the loopback interface, and the
+// receiver runs like in the sketch, with a realtime and a render task. Each frame carries its number in the first
+// pixel, so the time from sending to Show() is known per frame. Reports latency and the frame rate that was kept up
+// for a few sender rates. Runs on the real clock, as the packets go through the host's network stack.
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "Host.h"
+#include "LedRingDriver.h"
+#include "RealtimeReceiver.h"
+#include "TaskScheduler.h"
+#include "harness.h"
+
+namespace {
+    constexpr size_t kHeaderSize = 10;
+    constexpr uint8_t kVersion1 = 0x40;
+    constexpr uint8_t kPushFlag = 0x01;
+    constexpr uint8_t kRgb8Type = 0x0B;
+    constexpr uint8_t kDisplayId = 1;
+    constexpr size_t kDataSize = 3 * LedRingDriver::kLedCount;
+    static_assert(kDataSize >= 3, "Need a pixel for the frame number");
+
+    // the realtime and render tasks of the Controller
+    class Receiver {
+    public:
+        Receiver() : _receiver(&_leds), _scheduler(micros) {}
+
+        void begin() {
+            _leds.begin();
+            _receiver.begin();
+            _scheduler.add(TaskScheduler::Task::bind<&Receiver::runRealtime>(this));
+            _renderTask = _scheduler.add(TaskScheduler::Task::bind<&Receiver::runRender>(this));
+        }
+
+        unsigned long step() { return _scheduler.run(); }
+        const DdpStream& stream() const { return _receiver.stream(); }
+        const LedRingDriver& leds() const { return _leds; }
+
+    private:
+        unsigned long runRealtime(unsigned long) {
+            if (_receiver.loop()) _scheduler.trigger(_renderTask);
+            return _receiver.microsUntilDue();
+        }
+
+        unsigned long runRender(unsigned long) {
+            _leds.loop();
+            return _leds.microsUntilDue();
+        }
+
+        LedRingDriver _leds;
+        RealtimeReceiver _receiver;
+        TaskScheduler _scheduler;
+        uint8_t _renderTask = TaskScheduler::kNoTask;
+    };
+
+    // sends the frames at a fixed rate, and notes when each went out
+    void send_frames(const unsigned framesPerSecond, const uint32_t frames, std::vector<std::atomic<uint64_t>>& sent) {
+        const int socket = ::socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(DdpStream::kPort);
+        uint8_t packet[kHeaderSize + kDataSize] = {};
+        packet[2] = kRgb8Type;
+        packet[3] = kDisplayId;
+        packet[8] = static_cast<uint8_t>(kDataSize >> 8);
+        packet[9] = static_cast<uint8_t>(kDataSize & 0xFF);
+        const auto period = std::chrono::nanoseconds(1000000000 / framesPerSecond);
+        auto next = std::chrono::steady_clock::now();
+        for (uint32_t frame = 1; frame <= frames; frame++) {
+            std::this_thread::sleep_until(next);
+            next += period;
+            // sequence numbers run from 1 to 15
+            packet[0] = kVersion1 | kPushFlag;
+            packet[1] = static_cast<uint8_t>((frame - 1) % 15 + 1);
+            uint8_t* data = packet + kHeaderSize;
+            data[0] = static_cast<uint8_t>(frame >> 16);
+            data[1] = static_cast<uint8_t>(frame >> 8);
+            data[2] = static_cast<uint8_t>(frame);
+            for (size_t i = 3; i < kDataSize; i++) data[i] = static_cast<uint8_t>(frame + i);
+            sent[frame].store(host::now_micros(), std::memory_order_release);
+            sendto(socket, packet, sizeof(packet), 0, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+        }
+        close(socket);
+    }
+
+    // The sketch yields for waits under a millisecond, so the WiFi stack can run. On the host the sender needs the
+    // CPU then, so short waits sleep as well.
+    void sleep(const unsigned long waitMicros) {
+        if (waitMicros == 0) return;
+        if (waitMicros >= 1000) {
+            delay(std::min(waitMicros, 100000UL) / 1000);
+        } else {
+            delayMicroseconds(static_cast<unsigned int>(waitMicros));
+        }
+    }
+
+    void measure_stream(Receiver& receiver, const unsigned framesPerSecond) {
+        const uint32_t frames = static_cast<uint32_t>(bench::scaled(framesPerSecond * 5));
+        std::vector<std::atomic<uint64_t>> sent(frames + 1);
+        const DdpStream& stream = receiver.stream();
+        const uint32_t framesBefore = stream.frames();
+        const uint32_t shownBefore = stream.shownFrames();
+        const uint32_t skippedBefore = stream.skippedFrames();
+        const uint32_t gapsBefore = stream.gaps();
+        const uint32_t showsBefore = host::led_output().shows;
+
+        std::vector<double> latencies;
+        latencies.reserve(frames);
+        uint32_t shows = host::led_output().shows;
+        uint64_t firstShow = 0;
+        uint64_t lastShow = 0;
+        std::thread sender(send_frames, framesPerSecond, frames, std::ref(sent));
+        const uint64_t end = host::now_micros() + 1000000ULL * frames / framesPerSecond + 200000;
+        while (host::now_micros() < end) {
+            const unsigned long wait = receiver.step();
+            const host::LedOutput& output = host::led_output();
+            if (output.shows != shows) {
+                shows = output.shows;
+                const uint32_t frame = static_cast<uint32_t>(output.pixels[0]) << 16 | output.pixels[1] << 8 | output.pixels[2];
+                if (frame > 0 && frame <= frames) {
+                    latencies.push_back(static_cast<double>(output.lastShowMicros - sent[frame].load(std::memory_order_acquire)) / 1000);
+                    if (firstShow == 0) firstShow = output.lastShowMicros;
+                    lastShow = output.lastShowMicros;
+                }
+            }
+            sleep(wait);
+        }
+        sender.join();
+
+        const uint32_t shown = host::led_output().shows - showsBefore;
+        const double seconds = static_cast<double>(lastShow - firstShow) / 1000000;
+        bench::Json("realtime_stream").add("sent_fps", framesPerSecond).add("frames", frames)
+            .add("received", stream.frames() - framesBefore).add("played", stream.shownFrames() - shownBefore)
+            .add("skipped", stream.skippedFrames() - skippedBefore).add("gaps", stream.gaps() - gapsBefore)
+            .add("shows", shown).add("shown_fps", seconds > 0 ? (shown - 1) / seconds : 0.0)
+            .add("latency_ms", bench::summarize(latencies))
+            .add("playout_delay_ms", static_cast<double>(DdpStream::kPlayoutDelayMicros) / 1000).print();
+
+        // the stream times out, and the LEDs go back to the committed state
+        const uint64_t timeout = host::now_micros() + DdpStream::kTimeoutMicros + 100000;
+        while (host::now_micros() < timeout) sleep(receiver.step());
+    }
+}
+
+int main(const int argc, char** argv) {
+    bench::init(argc, argv);
+    Receiver receiver;
+    receiver.begin();
+    // up to the push limit of the driver (10 ms), and beyond it
+    for (const unsigned framesPerSecond : { 30U, 60U, 100U, 200U }) {
+        measure_stream(receiver, framesPerSecond);
+    }
+    return 0;
+}
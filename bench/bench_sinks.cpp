@@ -0,0 +1,102 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// The loop cost with 1 to 8 state sinks: a pass of the scheduler that only polls MQTT, and one in which a scene
+// arrives and is committed to every sink. The LEDs are the first sink, the others do nothing, alternately right away
+// and deferred. A sink that does nothing should cost next to nothing, and an idle pass shouldn't see the sinks at all.
+
+#include "Controller.h"
+#include "FirmwareManager.h"
+#include "Host.h"
+#include "LedRingDriver.h"
+#include "LoopbackBroker.h"
+#include "MqttDriver.h"
+#include "PresetStore.h"
+#include "TaskScheduler.h"
+#include "harness.h"
+#include "secrets.h"
+
+namespace {
+    constexpr unsigned long kMqttPollMicros = 20000;    // Controller::kMqttPollInterval
+
+    struct NoopSink {
+        void onStateCommitted(uint8_t, const LedState&) {}
+    };
+
+    // one poll period: the MQTT task, and whatever it triggers
+    void run_poll(TaskScheduler& scheduler) {
+        host::advance_micros(kMqttPollMicros);
+        while (scheduler.run() == 0) {}
+    }
+
+    template <size_t SinkCount>
+    void measure_sinks(LoopbackBroker& broker, bench::Json& perSink) {
+        LedRingDriver leds;
+        NoopSink noops[SinkCount];
+        SinkEntry sinks[SinkCount];
+        sinks[0] = make_sink(&leds);
+        for (size_t i = 1; i < SinkCount; i++) {
+            sinks[i] = i % 2 == 1 ? make_sink(&noops[i]) : make_sink(&noops[i], CommitPolicy::RateLimited, 0);
+        }
+        FirmwareManager firmware;
+        MqttDriver mqtt;
+        PresetStore presets;
+        WiFiClient client;
+        TaskScheduler scheduler(micros);
+        Controller controller(&leds, &firmware, &mqtt, &presets, sinks, "host");
+        const LedState states[Controller::kSegmentCount] = {};
+        controller.beginLed(states);
+        mqtt.begin(&client, kConfigDeviceName, kConfigMqttBroker, kConfigMqttPort);
+        mqtt.setNetworkAvailable(true);
+        controller.listenToMqtt();
+        controller.schedule(&scheduler);
+        // connected, announced, and the subscriptions acknowledged
+        for (int i = 0; i < 200; i++) run_poll(scheduler);
+
+        char topic[128];
+        snprintf(topic, sizeof(topic), "homie/%s/%s/%s/set", kConfigDeviceName, led_ring_config::kSegments[0].node, kSceneProperty);
+        // full colours, so the LEDs don't dither
+        const char* scenes[] = { "0,100,100,0", "120,100,100,0" };
+        char name[64];
+        snprintf(name, sizeof(name), "loop_idle_%zu_sinks", SinkCount);
+        const bench::Summary idle = bench::measure(name, 20000, [&] { run_poll(scheduler); });
+        uint32_t count = 0;
+        snprintf(name, sizeof(name), "loop_scene_%zu_sinks", SinkCount);
+        const bench::Summary scene = bench::measure(name, 20000, [&] {
+            broker.inject(topic, scenes[count++ % 2]);
+            run_poll(scheduler);
+        });
+        char key[32];
+        snprintf(key, sizeof(key), "idle_%zu", SinkCount);
+        perSink.add(key, idle.median);
+        snprintf(key, sizeof(key), "scene_%zu", SinkCount);
+        perSink.add(key, scene.median);
+        mqtt.disconnect();
+    }
+}
+
+int main(const int argc, char** argv) {
+    bench::init(argc, argv);
+    host::use_virtual_clock();
+    LoopbackBroker broker;
+    broker.listen(kConfigMqttBroker, kConfigMqttPort);
+    bench::Json perSink("loop_by_sinks");
+    measure_sinks<1>(broker, perSink);
+    measure_sinks<2>(broker, perSink);
+    measure_sinks<3>(broker, perSink);
+    measure_sinks<4>(broker, perSink);
+    measure_sinks<5>(broker, perSink);
+    measure_sinks<6>(broker, perSink);
+    measure_sinks<7>(broker, perSink);
+    measure_sinks<8>(broker, perSink);
+    perSink.print();
+    return 0;
+}
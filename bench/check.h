@@ -0,0 +1,56 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// Assertions for the host tests. A failed check prints where and what, and the test goes on so one run shows
+// all failures; main returns check::result(), which is non-zero if any check failed.
+
+#ifndef HEADER_BENCH_CHECK
+#define HEADER_BENCH_CHECK
+
+#include <cstdio>
+
+namespace check {
+    inline unsigned& failures() {
+        static unsigned count = 0;
+        return count;
+    }
+
+    inline bool expect(const bool isTrue, const char* expression, const char* file, const int line) {
+        if (!isTrue) {
+            failures()++;
+            fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+        }
+        return isTrue;
+    }
+
+    inline bool expect_equal(const long long actual, const long long expected, const char* expression, const char* file, const int line) {
+        if (actual != expected) {
+            failures()++;
+            fprintf(stderr, "%s:%d: check failed: %s is %lld, expected %lld\n", file, line, expression, actual, expected);
+        }
+        return actual == expected;
+    }
+
+    inline int result(const char* name) {
+        if (failures() == 0) {
+            printf("%s: passed\n", name);
+            return 0;
+        }
+        printf("%s: %u check(s) failed\n", name, failures());
+        return 1;
+    }
+}
+
+#define CHECK(expression) check::expect((expression), #expression, __FILE__, __LINE__)
+#define CHECK_EQUAL(actual, expected) \
+    check::expect_equal(static_cast<long long>(actual), static_cast<long long>(expected), #actual, __FILE__, __LINE__)
+
+#endif
@@ -0,0 +1,333 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// A fleet of devices on one broker, each with a flash of its own, to see what the broker and the network get to
+// handle: the boot of the whole fleet, a colour sweep with the time from command to acknowledgement (the device
+// publishing the new colour), and a reconnect storm after every connection dropped at once. A monitor client
+// subscribes to homie/# to see what the fleet publishes, and the retained volume is what a new subscriber gets.
+//   fleet_sim [--devices N] [--broker host] [--port port]   against a broker over TCP, e.g. a local Mosquitto
+//   fleet_sim --loopback [--devices N]                       against the loopback broker, on the virtual clock
+// Against a real broker, retained messages from earlier runs count as well.
+
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "Device.h"
+#include "Host.h"
+#include "LoopbackBroker.h"
+#include "harness.h"
+#include "secrets.h"
+
+namespace {
+    constexpr unsigned kDefaultDevices = 32;
+    constexpr auto kDeviceNameFormat = "fleet-%03u";
+    constexpr auto kDeviceTopicFormat = "homie/fleet-%u/%63s";
+    constexpr auto kMonitorId = "fleet-monitor";
+    constexpr auto kCensusId = "fleet-census";
+    constexpr uint16_t kMonitorBufferSize = 1024;
+    constexpr uint64_t kBootTimeoutMicros = 60000000;
+    constexpr uint64_t kAckTimeoutMicros = 5000000;
+    // the first retry comes within a second, but a loaded broker can take longer to answer
+    constexpr uint64_t kReconnectTimeoutMicros = 60000000;
+    // the retained messages of a device have arrived once nothing came for this long
+    constexpr uint64_t kCensusQuietMicros = 100000;
+    constexpr uint32_t kSweepRounds = 10;
+    const char* const kColors[] = { "0,100,100", "120,100,50", "240,80,30", "60,50,75" };
+
+    struct Settings {
+        unsigned devices = kDefaultDevices;
+        const char* broker = kConfigMqttBroker;
+        uint16_t port = kConfigMqttPort;
+        bool isLoopback = false;
+    };
+
+    Settings parse(const int argc, char** argv) {
+        Settings settings;
+        for (int i = 1; i < argc; i++) {
+            if (strcmp(argv[i], "--devices") == 0 && i + 1 < argc) {
+                settings.devices = static_cast<unsigned>(std::max(1, atoi(argv[++i])));
+            } else if (strcmp(argv[i], "--broker") == 0 && i + 1 < argc) {
+                settings.broker = argv[++i];
+            } else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+                settings.port = static_cast<uint16_t>(atoi(argv[++i]));
+            } else if (strcmp(argv[i], "--loopback") == 0) {
+                settings.isLoopback = true;
+            }
+        }
+        return settings;
+    }
+
+    double millis_since(const uint64_t startMicros) {
+        return static_cast<double>(host::now_micros() - startMicros) / 1000;
+    }
+
+    class Fleet {
+    public:
+        explicit Fleet(const Settings& settings) : _settings(settings) {
+            snprintf(_colorPath, sizeof(_colorPath), "%s/%s", led_ring_config::kSegments[0].node, kColorProperty);
+            for (unsigned i = 0; i < settings.devices; i++) {
+                char name[Device::kMaxNameSize];
+                snprintf(name, sizeof(name), kDeviceNameFormat, i);
+                _flashes.push_back(std::make_unique<host::Flash>());
+                _devices.push_back(std::make_unique<Device>(name, _flashes.back().get()));
+            }
+            _hasColor.resize(settings.devices, false);
+            _expected.resize(settings.devices, nullptr);
+            _sentAt.resize(settings.devices, 0);
+        }
+
+        bool begin() {
+            _monitor.setClient(_monitorClient).setServer(_settings.broker, _settings.port).setBufferSize(kMonitorBufferSize);
+            _monitor.setCallback([this](char* topic, uint8_t* payload, const unsigned int length) {
+                received(topic, payload, length);
+            });
+            if (!_monitor.connect(kMonitorId) || !_monitor.subscribe("homie/#")) return false;
+            for (auto& device : _devices) device->begin(_settings.broker, _settings.port);
+            return true;
+        }
+
+        // steps every device once, sleeps until the first one is due, and handles what the monitor got meanwhile
+        void step() {
+            unsigned long wait = ULONG_MAX;
+            for (auto& device : _devices) wait = std::min(wait, device->step());
+            Device::sleep(wait);
+            poll(_monitor, _monitorClient);
+        }
+
+        template <typename Done>
+        bool runUntil(const uint64_t maxMicros, Done&& done) {
+            const uint64_t end = host::now_micros() + maxMicros;
+            while (host::now_micros() < end && !done()) step();
+            return done();
+        }
+
+        // ready, nothing left to publish, and the colour is out (the state publishing is rate limited, so it can come last)
+        bool isSettled() const {
+            for (size_t i = 0; i < _devices.size(); i++) {
+                const MqttDriver& mqtt = _devices[i]->mqtt();
+                if (mqtt.state() != MqttState::Ready || mqtt.publishQueue().depth() > 0 || !_hasColor[i]) return false;
+            }
+            return true;
+        }
+
+        // sends the colour to every device at once; the acknowledgements come in through the monitor
+        void sendColor(const char* color) {
+            char topic[LoopbackBroker::kMaxTopicSize];
+            for (unsigned i = 0; i < _devices.size(); i++) {
+                snprintf(topic, sizeof(topic), "homie/%s/%s/set", _devices[i]->name(), _colorPath);
+                _expected[i] = color;
+                _sentAt[i] = host::now_micros();
+                _monitor.publish(topic, color);
+            }
+        }
+
+        size_t pendingAcks() const {
+            size_t count = 0;
+            for (const char* color : _expected) count += color != nullptr ? 1 : 0;
+            return count;
+        }
+
+        // what a new subscriber gets per device, one device at a time so the loopback broker's buffer keeps up
+        std::vector<double> countRetained(uint64_t& bytes) {
+            WiFiClient client;
+            PubSubClient census;
+            uint32_t messages = 0;
+            census.setClient(client).setServer(_settings.broker, _settings.port).setBufferSize(kMonitorBufferSize);
+            census.setCallback([&messages, &bytes](char* topic, uint8_t*, const unsigned int length) {
+                messages++;
+                bytes += strlen(topic) + length;
+            });
+            std::vector<double> perDevice;
+            if (!census.connect(kCensusId)) return perDevice;
+            char filter[LoopbackBroker::kMaxTopicSize];
+            for (const auto& device : _devices) {
+                snprintf(filter, sizeof(filter), "homie/%s/#", device->name());
+                const uint32_t before = messages;
+                census.subscribe(filter);
+                uint64_t quietSince = host::now_micros();
+                uint32_t seen = messages;
+                while (host::now_micros() - quietSince < kCensusQuietMicros) {
+                    step();
+                    poll(census, client);
+                    if (messages != seen) {
+                        seen = messages;
+                        quietSince = host::now_micros();
+                    }
+                }
+                census.unsubscribe(filter);
+                perDevice.push_back(messages - before);
+            }
+            census.disconnect();
+            return perDevice;
+        }
+
+        MqttTraffic traffic() const {
+            MqttTraffic total = {};
+            for (const auto& device : _devices) {
+                total.published += device->mqtt().traffic().published;
+                total.publishedBytes += device->mqtt().traffic().publishedBytes;
+                total.received += device->mqtt().traffic().received;
+            }
+            return total;
+        }
+
+        size_t size() const { return _devices.size(); }
+        Device& device(const size_t index) { return *_devices[index]; }
+        std::vector<double>& latencies() { return _latencies; }
+        uint32_t seenMessages() const { return _seenMessages; }
+        uint64_t seenBytes() const { return _seenBytes; }
+
+    private:
+        // the client handles one packet per loop(), so it is called until the socket is empty
+        static void poll(PubSubClient& client, WiFiClient& socket) {
+            client.loop();
+            while (socket.available() > 0 && client.loop()) {}
+        }
+
+        void received(const char* topic, const uint8_t* payload, const unsigned int length) {
+            _seenMessages++;
+            _seenBytes += strlen(topic) + length;
+            unsigned index;
+            char path[64];
+            if (sscanf(topic, kDeviceTopicFormat, &index, path) != 2 || index >= _expected.size()) return;
+            if (strcmp(path, _colorPath) != 0) return;
+            _hasColor[index] = true;
+            const char* expected = _expected[index];
+            if (expected == nullptr) return;
+            if (length != strlen(expected) || memcmp(payload, expected, length) != 0) return;
+            _latencies.push_back(millis_since(_sentAt[index]));
+            _expected[index] = nullptr;
+        }
+
+        Settings _settings;
+        char _colorPath[32] = {};
+        std::vector<std::unique_ptr<host::Flash>> _flashes;
+        std::vector<std::unique_ptr<Device>> _devices;
+        WiFiClient _monitorClient;
+        PubSubClient _monitor;
+        std::vector<bool> _hasColor;
+        // the colour each device should acknowledge, nullptr if none, and when it was sent
+        std::vector<const char*> _expected;
+        std::vector<uint64_t> _sentAt;
+        std::vector<double> _latencies;
+        uint32_t _seenMessages = 0;
+        uint64_t _seenBytes = 0;
+    };
+
+    bench::Json result(const char* name, const Fleet& fleet, const Settings& settings) {
+        bench::Json json(name);
+        json.add("devices", static_cast<uint32_t>(fleet.size())).add("broker", settings.isLoopback ? "loopback" : settings.broker);
+        return json;
+    }
+
+    bool boot(Fleet& fleet, const Settings& settings) {
+        const uint64_t start = host::now_micros();
+        const bool isSettled = fleet.runUntil(kBootTimeoutMicros, [&fleet] { return fleet.isSettled(); });
+        const double duration = millis_since(start);
+        const MqttTraffic traffic = fleet.traffic();
+        uint64_t retainedBytes = 0;
+        std::vector<double> retained = fleet.countRetained(retainedBytes);
+        double retainedCount = 0;
+        for (const double count : retained) retainedCount += count;
+        result("fleet_boot", fleet, settings).add("settled", isSettled).add("boot_ms", duration)
+            .add("published", traffic.published).add("published_bytes", traffic.publishedBytes)
+            .add("retained", retainedCount).add("retained_bytes", retainedBytes)
+            .add("retained_per_device", bench::summarize(retained)).print();
+        return isSettled;
+    }
+
+    // Every round sends a colour to all devices at once. The acknowledgement waits for the rate limit on the
+    // state publishing, so the latency is mostly that.
+    void sweep(Fleet& fleet, const Settings& settings) {
+        const uint64_t rounds = bench::scaled(kSweepRounds);
+        const MqttTraffic before = fleet.traffic();
+        const uint32_t seenBefore = fleet.seenMessages();
+        const uint64_t start = host::now_micros();
+        uint32_t missing = 0;
+        for (uint64_t round = 0; round < rounds; round++) {
+            fleet.sendColor(kColors[round % (sizeof(kColors) / sizeof(kColors[0]))]);
+            fleet.runUntil(kAckTimeoutMicros, [&fleet] { return fleet.pendingAcks() == 0; });
+            missing += static_cast<uint32_t>(fleet.pendingAcks());
+        }
+        const double seconds = millis_since(start) / 1000;
+        const MqttTraffic after = fleet.traffic();
+        result("fleet_sweep", fleet, settings).add("rounds", rounds).add("missing_acks", missing)
+            .add("publish_per_second", (after.published - before.published) / seconds)
+            .add("received_per_second", (after.received - before.received) / seconds)
+            .add("monitor_per_second", (fleet.seenMessages() - seenBefore) / seconds)
+            .add("ack_ms", bench::summarize(fleet.latencies())).print();
+    }
+
+    // Every connection drops at once, like a broker restart: with the loopback broker from its side, with a
+    // real broker by closing the device's socket. The time until a device is ready again includes the jitter.
+    void reconnect_storm(Fleet& fleet, const Settings& settings, LoopbackBroker* broker) {
+        const MqttTraffic before = fleet.traffic();
+        if (broker != nullptr) broker->resetCounters();
+        const uint64_t start = host::now_micros();
+        for (size_t i = 0; i < fleet.size(); i++) {
+            if (broker != nullptr) {
+                broker->drop(fleet.device(i).name());
+            } else {
+                fleet.device(i).client().stop();
+            }
+        }
+        std::vector<bool> isLost(fleet.size(), false);
+        std::vector<double> reconnects(fleet.size(), 0);
+        const bool isBack = fleet.runUntil(kReconnectTimeoutMicros, [&] {
+            size_t count = 0;
+            for (size_t i = 0; i < fleet.size(); i++) {
+                const bool isReady = fleet.device(i).mqtt().state() == MqttState::Ready;
+                if (!isReady) isLost[i] = true;
+                if (isLost[i] && isReady && reconnects[i] == 0) reconnects[i] = millis_since(start);
+                if (reconnects[i] > 0) count++;
+            }
+            return count == fleet.size() && fleet.isSettled();
+        });
+        const double duration = millis_since(start);
+        const MqttTraffic after = fleet.traffic();
+        bench::Json json = result("fleet_reconnect", fleet, settings);
+        json.add("reconnected", isBack).add("storm_ms", duration)
+            .add("published", after.published - before.published)
+            .add("published_bytes", after.publishedBytes - before.publishedBytes);
+        if (broker != nullptr) json.add("attempts", broker->counters().attempts).add("overflows", broker->counters().overflows);
+        json.add("reconnect_ms", bench::summarize(reconnects)).print();
+    }
+}
+
+int main(const int argc, char** argv) {
+    bench::init(argc, argv);
+    const Settings settings = parse(argc, argv);
+    if (settings.devices > MqttDriver::kMaxInstances) {
+        fprintf(stderr, "fleet_sim: at most %u devices (LED_RING_MQTT_INSTANCES)\n", MqttDriver::kMaxInstances);
+        return 2;
+    }
+    std::unique_ptr<LoopbackBroker> broker;
+    if (settings.isLoopback) {
+        host::use_virtual_clock();
+        host::seed_random(24);
+        // the devices, the monitor and the census
+        broker = std::make_unique<LoopbackBroker>(settings.devices + 2, 64 * settings.devices);
+        broker->listen(settings.broker, settings.port);
+    }
+    Fleet fleet(settings);
+    if (!fleet.begin()) {
+        fprintf(stderr, "fleet_sim: can't reach the broker at %s:%u\n", settings.broker, settings.port);
+        return 1;
+    }
+    if (!boot(fleet, settings)) return 1;
+    sweep(fleet, settings);
+    reconnect_storm(fleet, settings, broker.get());
+    for (size_t i = 0; i < fleet.size(); i++) fleet.device(i).mqtt().disconnect();
+    return 0;
+}
@@ -0,0 +1,68 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// The conversion LedRingDriver used before color::hsv_to_rgb: the percentages scaled to floats with
+// utilities::scale_clamped, and NeoPixelBus turning the HsbColor into an RgbColor (its algorithm, copied).
+// Serves as the reference for the accuracy test and as the baseline for the benchmark.
+
+#ifndef HEADER_BENCH_FLOAT_COLOR
+#define HEADER_BENCH_FLOAT_COLOR
+
+#include "Pixel.h"
+#include "Utilities.h"
+
+namespace float_color {
+    struct Channels {
+        float red;
+        float green;
+        float blue;
+    };
+
+    inline Channels hsb_to_rgb(const HsvPixel& pixel) {
+        float h = utilities::scale_clamped(pixel.hue, 0, 360, 0.0f, 1.0f);
+        const float s = utilities::scale_clamped(pixel.saturation, 0, 100, 0.0f, 1.0f);
+        const float v = utilities::scale_clamped(pixel.value, 0, 100, 0.0f, 1.0f);
+        if (s == 0.0f) return { v, v, v };
+        if (h >= 1.0f) h -= 1.0f;
+        h *= 6.0f;
+        const int sector = static_cast<int>(h);
+        const float f = h - static_cast<float>(sector);
+        const float p = v * (1.0f - s);
+        const float q = v * (1.0f - s * f);
+        const float t = v * (1.0f - s * (1.0f - f));
+        switch (sector) {
+            case 0: return { v, t, p };
+            case 1: return { q, v, p };
+            case 2: return { p, v, t };
+            case 3: return { p, q, v };
+            case 4: return { t, p, v };
+            default: return { v, p, q };
+        }
+    }
+
+    // what NeoPixelBus does: truncating to bytes
+    inline RgbPixel hsv_to_rgb(const HsvPixel& pixel) {
+        const Channels c = hsb_to_rgb(pixel);
+        return { static_cast<uint8_t>(c.red * 255.0f), static_cast<uint8_t>(c.green * 255.0f), static_cast<uint8_t>(c.blue * 255.0f) };
+    }
+
+    // the exact result, to measure the accuracy against
+    inline RgbPixel hsv_to_rgb_rounded(const HsvPixel& pixel) {
+        const Channels c = hsb_to_rgb(pixel);
+        return {
+            static_cast<uint8_t>(c.red * 255.0f + 0.5f),
+            static_cast<uint8_t>(c.green * 255.0f + 0.5f),
+            static_cast<uint8_t>(c.blue * 255.0f + 0.5f)
+        };
+    }
+}
+
+#endif
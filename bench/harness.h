@@ -0,0 +1,184 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// Repeated measurements with a summary per result, printed as one line of JSON on stdout, e.g.
+//   {"name":"snprintf_t","unit":"ns/op","runs":31,"iterations":20000,"median":61.2,"p10":60.8,"p90":63.0,...}
+// Every run times a batch of iterations after a warm-up. The median of the runs is robust against the odd run that
+// got interrupted, and p10-p90 shows how noisy the machine was. Compare medians between builds to find regressions.
+// Programs take --runs N to change the number of runs, --quick for a few short runs (e.g. to check they work),
+// and -v to see the firmware's log on stderr.
+
+#ifndef HEADER_BENCH_HARNESS
+#define HEADER_BENCH_HARNESS
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "Logger.h"
+
+namespace bench {
+    struct Options {
+        uint32_t runs = 31;
+        // multiplies the iterations (and simulated durations) a program asks for
+        double scale = 1.0;
+        bool isVerbose = false;
+    };
+
+    inline Options& options() {
+        static Options values;
+        return values;
+    }
+
+    inline void init(const int argc, char** argv) {
+        Options& values = options();
+        for (int i = 1; i < argc; i++) {
+            if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+                values.runs = static_cast<uint32_t>(std::max(1, atoi(argv[++i])));
+            } else if (strcmp(argv[i], "--quick") == 0) {
+                values.runs = 5;
+                values.scale = 0.1;
+            } else if (strcmp(argv[i], "-v") == 0) {
+                values.isVerbose = true;
+            }
+        }
+        // without begin(), the log goes nowhere
+        if (values.isVerbose) {
+            utilities::logger::begin(
+                [](const char* text, const size_t length) { fwrite(text, 1, length, stderr); },
+                []() -> size_t { return SIZE_MAX; });
+        }
+    }
+
+    inline uint64_t scaled(const uint64_t count) {
+        const auto result = static_cast<uint64_t>(static_cast<double>(count) * options().scale);
+        return result > 0 ? result : 1;
+    }
+
+    // keeps the optimizer from dropping a result nothing uses
+    template <typename T>
+    inline void keep(const T& value) {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    // makes the optimizer assume memory changed, so loads aren't hoisted out of the measured loop
+    inline void clobber() {
+        asm volatile("" : : : "memory");
+    }
+
+    inline double now_nanos() {
+        using Clock = std::chrono::steady_clock;
+        return std::chrono::duration<double, std::nano>(Clock::now().time_since_epoch()).count();
+    }
+
+    struct Summary {
+        size_t count;
+        double median;
+        double p10;
+        double p90;
+        double p99;
+        double min;
+        double max;
+        double mean;
+    };
+
+    // sorts the values; percentiles interpolate between the nearest ranks
+    inline Summary summarize(std::vector<double>& values) {
+        Summary summary = {};
+        summary.count = values.size();
+        if (values.empty()) return summary;
+        std::sort(values.begin(), values.end());
+        const auto percentile = [&values](const double fraction) {
+            const double rank = fraction * static_cast<double>(values.size() - 1);
+            const auto lower = static_cast<size_t>(rank);
+            const size_t upper = std::min(lower + 1, values.size() - 1);
+            return values[lower] + (values[upper] - values[lower]) * (rank - static_cast<double>(lower));
+        };
+        summary.median = percentile(0.5);
+        summary.p10 = percentile(0.1);
+        summary.p90 = percentile(0.9);
+        summary.p99 = percentile(0.99);
+        summary.min = values.front();
+        summary.max = values.back();
+        double total = 0;
+        for (const double value : values) total += value;
+        summary.mean = total / static_cast<double>(values.size());
+        return summary;
+    }
+
+    // one result as a line of JSON
+    class Json {
+    public:
+        explicit Json(const char* name) { append("{\"name\":\"%s\"", name); }
+
+        Json& add(const char* key, const char* value) { return append(",\"%s\":\"%s\"", key, value); }
+        Json& add(const char* key, const double value) { return append(",\"%s\":%.6g", key, value); }
+        Json& add(const char* key, const uint64_t value) { return append(",\"%s\":%llu", key, static_cast<unsigned long long>(value)); }
+        Json& add(const char* key, const uint32_t value) { return add(key, static_cast<uint64_t>(value)); }
+        Json& add(const char* key, const int value) { return append(",\"%s\":%d", key, value); }
+        Json& add(const char* key, const bool value) { return append(",\"%s\":%s", key, value ? "true" : "false"); }
+
+        // median, p10, p90, p99, min, max and mean, with the key as prefix if given, e.g. latency_median
+        Json& add(const char* prefix, const Summary& summary) {
+            char key[64];
+            const auto name = [&key, prefix](const char* statistic) {
+                snprintf(key, sizeof(key), "%s%s%s", prefix, prefix[0] != '\0' ? "_" : "", statistic);
+                return key;
+            };
+            add(name("median"), summary.median);
+            add(name("p10"), summary.p10);
+            add(name("p90"), summary.p90);
+            add(name("p99"), summary.p99);
+            add(name("min"), summary.min);
+            add(name("max"), summary.max);
+            return add(name("mean"), summary.mean);
+        }
+
+        void print() {
+            printf("%s}\n", _line);
+            fflush(stdout);
+        }
+
+    private:
+        template <typename... Arguments>
+        Json& append(const char* format, Arguments... arguments) {
+            const int length = snprintf(_line + _length, sizeof(_line) - _length, format, arguments...);
+            if (length > 0) _length = std::min(_length + static_cast<size_t>(length), sizeof(_line) - 1);
+            return *this;
+        }
+
+        char _line[2048] = {};
+        size_t _length = 0;
+    };
+
+    // Times body() for the given iterations per run, and prints the nanoseconds per iteration.
+    template <typename Body>
+    Summary measure(const char* name, const uint64_t iterations, Body&& body) {
+        const uint64_t count = scaled(iterations);
+        for (uint64_t i = 0; i < count / 10 + 1; i++) body();
+        std::vector<double> samples;
+        samples.reserve(options().runs);
+        for (uint32_t run = 0; run < options().runs; run++) {
+            const double start = now_nanos();
+            for (uint64_t i = 0; i < count; i++) body();
+            samples.push_back((now_nanos() - start) / static_cast<double>(count));
+        }
+        const Summary summary = summarize(samples);
+        Json(name).add("unit", "ns/op").add("runs", options().runs).add("iterations", count).add("", summary).print();
+        return summary;
+    }
+}
+
+#endif
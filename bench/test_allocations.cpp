@@ -0,0 +1,114 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// The sketch itself, built with the allocation audit: setup() and then loop() for a few simulated minutes while
+// commands arrive over MQTT, the broker drops the connection and the state is persisted. Any allocation after
+// setup() makes loop() end the program with exit code 1. With --allocate the test allocates in between loops on
+// purpose, to show that this is caught; that run must fail. Run with -v to see the sketch's log.
+
+#include <cstdlib>
+
+#include "AllocationAudit.h"
+#include "Host.h"
+#include "LoopbackBroker.h"
+#include "MqttDriver.h"
+#include "check.h"
+#include "harness.h"
+#include "secrets.h"
+
+void setup();
+void loop();
+
+namespace {
+    char topic[128];
+
+    void run_loop(const unsigned long micros) {
+        const uint64_t end = host::now_micros() + micros;
+        while (host::now_micros() < end) loop();
+    }
+
+    void send(LoopbackBroker& broker, const char* node, const char* property, const char* payload) {
+        snprintf(topic, sizeof(topic), "homie/%s/%s/%s/set", kConfigDeviceName, node, property);
+        broker.inject(topic, payload);
+    }
+
+    bool is_ready(const LoopbackBroker& broker) {
+        snprintf(topic, sizeof(topic), "homie/%s/$state", kConfigDeviceName);
+        const char* state = broker.retained(topic);
+        return state != nullptr && strcmp(state, kStateReady) == 0;
+    }
+
+    // every command the sketch handles, a few times over
+    void send_traffic(LoopbackBroker& broker) {
+        const char* led = led_ring_config::kSegments[0].node;
+        for (int round = 0; round < 3; round++) {
+            send(broker, led, kColorProperty, round % 2 == 0 ? "120,100,50" : "240,80,30");
+            run_loop(100000);
+            send(broker, led, kModeProperty, "2");
+            run_loop(100000);
+            send(broker, led, kSceneProperty, "30,60,35,0,500");
+            run_loop(1000000);
+            send(broker, led, kStoreProperty, "3");
+            run_loop(100000);
+            send(broker, led, kRecallProperty, "3");
+            run_loop(100000);
+            send(broker, led, kDeleteProperty, "3");
+            run_loop(100000);
+            send(broker, "device", kGroupsProperty, round % 2 == 0 ? "kitchen,hall" : "");
+            run_loop(500000);
+            snprintf(topic, sizeof(topic), "homie/$broadcast/kitchen/%s/%s/set", led, kColorProperty);
+            broker.inject(topic, "0,100,100");
+            run_loop(100000);
+            send(broker, led, kColorProperty, "not a color");
+            send(broker, led, "unknown", "1");
+            // the state gets persisted after the debounce
+            run_loop(3000000);
+        }
+    }
+}
+
+int main(const int argc, char** argv) {
+    bench::init(argc, argv);
+    bool isAllocating = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--allocate") == 0) isAllocating = true;
+    }
+    host::use_virtual_clock();
+    // never deleted: the sketch's clients are globals, and hang up on it when the program ends
+    LoopbackBroker& broker = *new LoopbackBroker();
+    broker.listen(kConfigMqttBroker, kConfigMqttPort);
+
+    // the sketch logs to serial; with -v that shows e.g. the size of an allocation that failed the audit
+    host::echo_serial(bench::options().isVerbose);
+    setup();
+    run_loop(10000000);
+    CHECK(is_ready(broker));
+
+    send_traffic(broker);
+    // a reconnect, with the announcement skipped and the subscriptions made again
+    broker.dropAll();
+    run_loop(5000000);
+    CHECK(is_ready(broker));
+    send_traffic(broker);
+    // long enough for keep alive pings
+    run_loop(60000000);
+    CHECK(broker.counters().pings > 0);
+
+    if (isAllocating) {
+        // volatile, so the compiler can't leave the pair out
+        void* volatile memory = malloc(24);
+        free(memory);
+        loop();
+        fprintf(stderr, "test_allocations: loop() didn't notice the allocation\n");
+    }
+    CHECK_EQUAL(allocation_audit::allocations(), 0u);
+    return check::result("test_allocations");
+}
@@ -0,0 +1,150 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// The integer HSV to RGB conversion against the float path it replaced, over every input: hue 0-360,
+// saturation and value 0-100. The batch conversion must match the single pixel one with the gamma table applied,
+// and the 16 bit one must stay within a few 1/256 of a step of the float conversion with exact gamma.
+
+#include <cmath>
+#include <cstdlib>
+
+#include "ColorConversion.h"
+#include "check.h"
+#include "float_color.h"
+
+namespace {
+    int difference(const uint8_t actual, const uint8_t expected) {
+        return abs(static_cast<int>(actual) - static_cast<int>(expected));
+    }
+
+    void test_against_float() {
+        // per channel, how many results are off by 0, 1, 2 and more
+        unsigned long long histogram[4] = {};
+        int worst = 0;
+        HsvPixel worstPixel = {};
+        for (uint16_t hue = 0; hue <= 360; hue++) {
+            for (uint8_t saturation = 0; saturation <= 100; saturation++) {
+                for (uint8_t value = 0; value <= 100; value++) {
+                    const HsvPixel pixel = { hue, saturation, value };
+                    const RgbPixel actual = color::hsv_to_rgb(pixel);
+                    const RgbPixel expected = float_color::hsv_to_rgb_rounded(pixel);
+                    for (const int delta : { difference(actual.red, expected.red), difference(actual.green, expected.green),
+                                             difference(actual.blue, expected.blue) }) {
+                        histogram[delta < 3 ? delta : 3]++;
+                        if (delta > worst) {
+                            worst = delta;
+                            worstPixel = pixel;
+                        }
+                    }
+                }
+            }
+        }
+        printf("hsv_to_rgb against float: %llu exact, %llu off by 1, %llu off by 2, %llu worse; worst %d at %u,%u,%u\n",
+               histogram[0], histogram[1], histogram[2], histogram[3], worst, worstPixel.hue, worstPixel.saturation, worstPixel.value);
+        CHECK_EQUAL(histogram[0] + histogram[1] + histogram[2] + histogram[3], 3ULL * 361 * 101 * 101);
+        CHECK(worst <= 2);
+    }
+
+    void test_exact_corners() {
+        // the primaries, grey levels and black come out exactly
+        const RgbPixel red = color::hsv_to_rgb({ 0, 100, 100 });
+        CHECK(red == (RgbPixel{ 255, 0, 0 }));
+        const RgbPixel green = color::hsv_to_rgb({ 120, 100, 100 });
+        CHECK(green == (RgbPixel{ 0, 255, 0 }));
+        const RgbPixel blue = color::hsv_to_rgb({ 240, 100, 100 });
+        CHECK(blue == (RgbPixel{ 0, 0, 255 }));
+        const RgbPixel wrapped = color::hsv_to_rgb({ 360, 100, 100 });
+        CHECK(wrapped == red);
+        for (uint8_t value = 0; value <= 100; value++) {
+            const RgbPixel grey = color::hsv_to_rgb({ 200, 0, value });
+            CHECK(grey.red == grey.green && grey.green == grey.blue);
+            const RgbPixel black = color::hsv_to_rgb({ static_cast<uint16_t>(value * 3), value, 0 });
+            CHECK(black == (RgbPixel{ 0, 0, 0 }));
+        }
+        // out of range inputs are clamped like scale_clamped did
+        const RgbPixel clamped = color::hsv_to_rgb({ 1000, 200, 200 });
+        CHECK(clamped == red);
+    }
+
+    void test_batches() {
+        constexpr uint16_t kCount = 361;
+        HsvPixel pixels[kCount];
+        for (uint16_t i = 0; i < kCount; i++) {
+            pixels[i] = { i, static_cast<uint8_t>(i % 101), static_cast<uint8_t>(100 - i % 101) };
+        }
+        RgbPixel output[kCount];
+        color::hsv_to_rgb(pixels, output, kCount);
+        for (uint16_t i = 0; i < kCount; i++) {
+            const RgbPixel rgb = color::hsv_to_rgb(pixels[i]);
+            CHECK(output[i] == (RgbPixel{ color::gamma(rgb.red), color::gamma(rgb.green), color::gamma(rgb.blue) }));
+        }
+    }
+
+    // gamma 2.2 of a float channel (0-1) as an 8.8 level
+    double gamma16_of(const float channel) {
+        return pow(channel, 2.2) * 0xFF00;
+    }
+
+    // The 16 bit conversion against the float one with exact gamma, over every input. Going through the 8 bit
+    // conversion and the gamma table first is off by several 8 bit steps at the bright end, which dithering can't fix.
+    void test_16_bit_precision() {
+        double worst = 0;
+        double worstThrough8Bits = 0;
+        HsvPixel worstPixel = {};
+        for (uint16_t hue = 0; hue <= 360; hue++) {
+            for (uint8_t saturation = 0; saturation <= 100; saturation++) {
+                for (uint8_t value = 0; value <= 100; value++) {
+                    const HsvPixel pixel = { hue, saturation, value };
+                    Rgb16Pixel actual;
+                    color::hsv_to_rgb16(&pixel, &actual, 1);
+                    const float_color::Channels expected = float_color::hsb_to_rgb(pixel);
+                    const RgbPixel rgb = color::hsv_to_rgb(pixel);
+                    for (const double delta : { fabs(color::gamma16(rgb.red) - gamma16_of(expected.red)),
+                                                fabs(color::gamma16(rgb.green) - gamma16_of(expected.green)),
+                                                fabs(color::gamma16(rgb.blue) - gamma16_of(expected.blue)) }) {
+                        worstThrough8Bits = delta > worstThrough8Bits ? delta : worstThrough8Bits;
+                    }
+                    for (const double delta : { fabs(actual.red - gamma16_of(expected.red)), fabs(actual.green - gamma16_of(expected.green)),
+                                                fabs(actual.blue - gamma16_of(expected.blue)) }) {
+                        if (delta > worst) {
+                            worst = delta;
+                            worstPixel = pixel;
+                        }
+                    }
+                }
+            }
+        }
+        printf("hsv_to_rgb16 against float: worst %.2f/256 of a step at %u,%u,%u, through 8 bits %.2f\n",
+               worst, worstPixel.hue, worstPixel.saturation, worstPixel.value, worstThrough8Bits);
+        CHECK(worst <= 4);
+    }
+
+    void test_gamma_tables() {
+        CHECK_EQUAL(color::gamma(0), 0);
+        CHECK_EQUAL(color::gamma(255), 255);
+        CHECK_EQUAL(color::gamma16(255), 0xFF00);
+        for (int level = 1; level < 256; level++) {
+            CHECK(color::gamma(level) >= color::gamma(level - 1));
+            CHECK(color::gamma16(level) >= color::gamma16(level - 1));
+            // the 8 bit table is the 16 bit one rounded
+            CHECK(difference(color::gamma(level), static_cast<uint8_t>((color::gamma16(level) + 0x80) >> 8)) <= 1);
+        }
+    }
+}
+
+int main() {
+    test_against_float();
+    test_exact_corners();
+    test_batches();
+    test_16_bit_precision();
+    test_gamma_tables();
+    return check::result("test_color");
+}
@@ -0,0 +1,317 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// Connection management against failing stand-ins: an access point that is off, a broker that refuses, one that
+// hangs and one that drops everyone at once. Stepping never blocks for longer than a bounded slice, retries back off
+// exponentially, the jitter spreads the retries of a fleet, and reconnecting resumes the TLS session when it can.
+// Runs on the virtual clock.
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <WiFiClientSecure.h>
+
+#include "Device.h"
+#include "Host.h"
+#include "HostNetwork.h"
+#include "LoopbackBroker.h"
+#include "WifiDriver.h"
+#include "check.h"
+#include "harness.h"
+#include "secrets.h"
+
+namespace {
+    // WifiDriver::kConnectTimeout and kMaxRetryDelay
+    constexpr uint64_t kWifiConnectMicros = 15000000;
+    constexpr uint64_t kWifiMaxRetryMicros = 120000000;
+    // MqttDriver::kSocketTimeout, kInitialRetryDelay and kMaxRetryDelay
+    constexpr uint64_t kSocketTimeoutMicros = 2000000;
+    constexpr uint64_t kMqttInitialRetryMicros = 1000000;
+    constexpr uint64_t kMqttMaxRetryMicros = 60000000;
+    // what a step may take when nothing hangs
+    constexpr uint64_t kMaxStepMicros = 10000;
+
+    uint32_t wifi_attempts() {
+        return host::wifi_counters().begins + host::wifi_counters().reconnects;
+    }
+
+    // steps the device until the time is up or done() is true, and keeps track of the longest step
+    template <typename Done>
+    bool run_device(Device& device, const uint64_t micros, uint64_t& longestStep, Done done) {
+        const uint64_t end = host::now_micros() + micros;
+        while (host::now_micros() < end) {
+            const uint64_t start = host::now_micros();
+            const unsigned long wait = device.step();
+            longestStep = std::max(longestStep, host::now_micros() - start);
+            if (done()) return true;
+            Device::sleep(wait);
+        }
+        return false;
+    }
+
+    // The access point is off for ten minutes. The driver gives up on each attempt after the connect timeout, and
+    // waits longer after every failure, up to the maximum.
+    void test_wifi_backoff(WifiDriver& wifi) {
+        host::AccessPoint& accessPoint = host::access_point();
+        accessPoint.isAvailable = false;
+        wifi.begin();
+        std::vector<uint64_t> attemptStarts = { host::now_micros() };
+        uint64_t longestStep = 0;
+        const uint64_t end = host::now_micros() + 600000000;
+        while (host::now_micros() < end) {
+            const uint32_t attempts = wifi_attempts();
+            const uint64_t start = host::now_micros();
+            CHECK(!wifi.loop());
+            longestStep = std::max(longestStep, host::now_micros() - start);
+            if (wifi_attempts() != attempts) attemptStarts.push_back(start);
+            delay(100);
+        }
+        CHECK(longestStep <= kMaxStepMicros);
+        CHECK(attemptStarts.size() >= 5);
+        uint64_t longestGap = 0;
+        for (size_t i = 1; i < attemptStarts.size(); i++) {
+            const uint64_t gap = attemptStarts[i] - attemptStarts[i - 1];
+            // a timeout plus at least half the first delay, and at most a timeout plus the maximum delay
+            CHECK(gap >= kWifiConnectMicros + 1000000);
+            CHECK(gap <= kWifiConnectMicros + kWifiMaxRetryMicros + 200000);
+            longestGap = std::max(longestGap, gap);
+        }
+        // the delay doubled a few times
+        CHECK(longestGap >= attemptStarts[1] - attemptStarts[0] + 8000000);
+        CHECK(wifi.state() == WifiState::WaitingToRetry || wifi.state() == WifiState::Connecting);
+
+        // back on: connected by the next attempt, and loop() says so once
+        accessPoint.isAvailable = true;
+        uint32_t connects = 0;
+        const uint64_t giveUp = host::now_micros() + kWifiConnectMicros + kWifiMaxRetryMicros + 1000000;
+        while (host::now_micros() < giveUp && wifi.state() != WifiState::Connected) {
+            if (wifi.loop()) connects++;
+            delay(100);
+        }
+        for (int i = 0; i < 10; i++) {
+            if (wifi.loop()) connects++;
+        }
+        CHECK(wifi.state() == WifiState::Connected);
+        CHECK_EQUAL(connects, 1u);
+
+        // a drop starts a new attempt right away
+        const uint32_t attempts = wifi_attempts();
+        host::drop_wifi();
+        accessPoint.isAvailable = false;
+        wifi.loop();
+        CHECK(wifi.state() == WifiState::Connecting);
+        CHECK_EQUAL(wifi_attempts(), attempts + 1);
+        accessPoint.isAvailable = true;
+        delay(accessPoint.associateMillis);
+        CHECK(wifi.loop());
+        bench::Json("wifi_backoff").add("attempts", static_cast<uint32_t>(attemptStarts.size()))
+            .add("longest_gap_s", static_cast<double>(longestGap) / 1000000).add("longest_step_us", longestStep).print();
+    }
+
+    // A broker that refuses, one that hangs and the network going down, for one device. The rest of the loop keeps
+    // running: an animation keeps showing frames while the driver waits.
+    void test_mqtt_failures(LoopbackBroker& broker) {
+        Device device(kConfigDeviceName);
+        device.begin(kConfigMqttBroker, kConfigMqttPort);
+        uint64_t longestStep = 0;
+        CHECK(device.settle());
+        char topic[128];
+        snprintf(topic, sizeof(topic), "homie/%s/%s/%s/set", kConfigDeviceName, led_ring_config::kSegments[0].node, kSceneProperty);
+        broker.inject(topic, "0,100,100,2");
+        CHECK(!run_device(device, 2000000, longestStep, [] { return false; }));
+        CHECK(longestStep <= kMaxStepMicros);
+
+        // refused in the CONNACK: retries back off from the initial delay to the maximum
+        broker.setConnackCode(5);
+        broker.resetCounters();
+        broker.dropAll();
+        const uint32_t shows = host::led_output().shows;
+        CHECK(!run_device(device, 300000000, longestStep, [] { return false; }));
+        CHECK(longestStep <= kMaxStepMicros);
+        const uint32_t refusals = broker.counters().refusals;
+        // 1 + 2 + 4 + ... + 32 s, then 60 s each, with at least half of each delay waited
+        CHECK(refusals >= 5 && refusals <= 14);
+        CHECK(host::led_output().shows - shows >= 300 * LedRingDriver::kFramesPerSecond);
+        CHECK(device.mqtt().state() == MqttState::WaitingToRetry);
+
+        // hung: every attempt waits for the socket timeout, and no longer
+        broker.setConnackCode(0);
+        broker.setSilent(true);
+        broker.resetCounters();
+        longestStep = 0;
+        CHECK(!run_device(device, 300000000, longestStep, [] { return false; }));
+        CHECK(longestStep >= kSocketTimeoutMicros && longestStep <= kSocketTimeoutMicros + kMaxStepMicros);
+        const uint32_t hungAttempts = broker.counters().attempts;
+        CHECK(hungAttempts >= 3 && hungAttempts <= 14);
+        const uint64_t hungStep = longestStep;
+
+        // back: connected again within one maximum delay
+        broker.setSilent(false);
+        longestStep = 0;
+        CHECK(run_device(device, kMqttMaxRetryMicros + kSocketTimeoutMicros, longestStep,
+            [&] { return device.mqtt().state() == MqttState::Ready; }));
+        CHECK(device.settle());
+        char stateTopic[128];
+        snprintf(stateTopic, sizeof(stateTopic), "homie/%s/$state", kConfigDeviceName);
+        CHECK(broker.retained(stateTopic) != nullptr && strcmp(broker.retained(stateTopic), kStateReady) == 0);
+
+        // no network: the driver doesn't try, and reconnects soon after the network is back
+        WiFi.begin(kConfigSsid, kConfigWifiPassword);
+        CHECK(run_device(device, 1000000, longestStep, [] { return host::is_link_up(); }));
+        broker.resetCounters();
+        host::access_point().isAvailable = false;
+        host::drop_wifi();
+        CHECK(run_device(device, 1000000, longestStep,
+            [&] { return device.mqtt().state() == MqttState::WaitingForNetwork; }));
+        CHECK(!run_device(device, 60000000, longestStep, [] { return false; }));
+        CHECK_EQUAL(broker.counters().attempts, 0u);
+        host::access_point().isAvailable = true;
+        WiFi.reconnect();
+        const uint64_t back = host::now_micros();
+        CHECK(run_device(device, 10000000, longestStep, [&] { return device.mqtt().state() == MqttState::Ready; }));
+        // the network check, then at most the initial delay
+        CHECK(host::now_micros() - back <= Device::kNetworkCheckInterval * 1000 + kMqttInitialRetryMicros + 200000);
+        CHECK(longestStep <= kMaxStepMicros);
+        device.mqtt().disconnect();
+
+        bench::Json("mqtt_failures").add("refusals", refusals).add("hung_attempts", hungAttempts)
+            .add("hung_step_ms", static_cast<double>(hungStep) / 1000).print();
+    }
+
+    // A broker restart drops a fleet at once. The jitter spreads the reconnects instead of having them all arrive
+    // in the same poll.
+    void test_reconnect_spread(LoopbackBroker& broker) {
+        constexpr size_t kDevices = 8;
+        char names[kDevices][16];
+        std::vector<std::unique_ptr<Device>> devices;
+        for (size_t i = 0; i < kDevices; i++) {
+            snprintf(names[i], sizeof(names[i]), "spread%zu", i);
+            devices.push_back(std::make_unique<Device>(names[i]));
+            devices.back()->begin(kConfigMqttBroker, kConfigMqttPort);
+        }
+        const auto all_ready = [&] {
+            return std::all_of(devices.begin(), devices.end(),
+                [](const std::unique_ptr<Device>& device) { return device->mqtt().state() == MqttState::Ready; });
+        };
+        const auto step_all = [&](const uint64_t micros, const auto& done) {
+            const uint64_t end = host::now_micros() + micros;
+            while (host::now_micros() < end && !done()) {
+                unsigned long wait = ULONG_MAX;
+                for (auto& device : devices) wait = std::min(wait, device->step());
+                Device::sleep(wait);
+            }
+            return done();
+        };
+        CHECK(step_all(10000000, all_ready));
+
+        broker.dropAll();
+        const uint64_t dropped = host::now_micros();
+        std::vector<bool> isLost(kDevices, false);
+        std::vector<double> reconnects(kDevices, 0);
+        CHECK(step_all(kMqttInitialRetryMicros + 1000000, [&] {
+            size_t count = 0;
+            for (size_t i = 0; i < kDevices; i++) {
+                const bool isReady = devices[i]->mqtt().state() == MqttState::Ready;
+                if (!isReady) isLost[i] = true;
+                if (isLost[i] && isReady && reconnects[i] == 0) {
+                    reconnects[i] = static_cast<double>(host::now_micros() - dropped) / 1000;
+                }
+                if (reconnects[i] > 0) count++;
+            }
+            return count == kDevices;
+        }));
+        const auto [first, last] = std::minmax_element(reconnects.begin(), reconnects.end());
+        // the first retry comes after half to all of the initial delay, plus a few polls to notice the loss and connect
+        CHECK(*first >= kMqttInitialRetryMicros / 2000.0);
+        CHECK(*last <= kMqttInitialRetryMicros / 1000.0 + 200);
+        CHECK(*last - *first >= 100);
+        for (auto& device : devices) device->mqtt().disconnect();
+        bench::Json("reconnect_spread").add("devices", static_cast<uint32_t>(kDevices))
+            .add("reconnect_ms", bench::summarize(reconnects)).print();
+    }
+
+    // Reconnecting resumes the TLS session if the server kept it, and needs a full handshake if it didn't. The
+    // clients are WifiDriver's own, which don't need the WiFi started to connect.
+    void test_tls_sessions() {
+        WifiDriver wifi;
+        WiFiClient* client = wifi.client();
+        const auto reconnect = [client] {
+            client->stop();
+            return client->connect(kConfigMqttBroker, kConfigMqttPort) == 1;
+        };
+
+        host::tls().resumesSessions = true;
+        CHECK(reconnect());
+        CHECK_EQUAL(wifi.sessionMisses(), 1U);
+        CHECK_EQUAL(wifi.sessionHits(), 0U);
+        CHECK(reconnect());
+        CHECK(reconnect());
+        CHECK_EQUAL(wifi.sessionHits(), 2U);
+        CHECK_EQUAL(wifi.sessionMisses(), 1U);
+        // the firmware client keeps sessions of its own
+        CHECK(wifi.firmwareClient()->connect(kConfigMqttBroker, kConfigMqttPort) == 1);
+        wifi.firmwareClient()->stop();
+        CHECK_EQUAL(wifi.sessionMisses(), 2U);
+
+        host::tls().resumesSessions = false;
+        CHECK(reconnect());
+        CHECK(reconnect());
+        CHECK_EQUAL(wifi.sessionHits(), 2U);
+        CHECK_EQUAL(wifi.sessionMisses(), 4U);
+        client->stop();
+        host::tls().resumesSessions = true;
+        bench::Json("tls_sessions").add("hits", wifi.sessionHits()).add("misses", wifi.sessionMisses())
+            .add("handshakes", host::tls().handshakes).add("resumptions", host::tls().resumptions).print();
+    }
+
+    // The firmware client asks for small TLS records, so it fits next to the MQTT client. A server that can't do that
+    // gets the full buffer only if the heap has room for it.
+    void test_fragment_length(WifiDriver& wifi) {
+        auto* client = static_cast<BearSSL::WiFiClientSecure*>(wifi.firmwareClient());
+        const auto connect = [client] {
+            const bool isConnected = client->connect(kConfigMqttBroker, kConfigMqttPort) == 1;
+            client->stop();
+            return isConnected;
+        };
+        const uint32_t largestBlock = host::heap().maxFreeBlock;
+        CHECK(connect());
+        CHECK_EQUAL(client->receiveBufferSize(), 4096);
+
+        host::tls().supportsMaxFragmentLength = false;
+        host::heap().maxFreeBlock = 30000;
+        CHECK(connect());
+        CHECK_EQUAL(client->receiveBufferSize(), 16384);
+        host::heap().maxFreeBlock = 20000;
+        CHECK(!connect());
+
+        host::tls().supportsMaxFragmentLength = true;
+        CHECK(connect());
+        host::heap().maxFreeBlock = largestBlock;
+    }
+}
+
+int main(const int argc, char** argv) {
+    bench::init(argc, argv);
+    host::use_virtual_clock();
+    host::seed_random(15);
+    LoopbackBroker broker;
+    broker.listen(kConfigMqttBroker, kConfigMqttPort);
+
+    test_mqtt_failures(broker);
+    test_reconnect_spread(broker);
+    test_tls_sessions();
+    // last, as the WiFi stays started once begun
+    WifiDriver wifi;
+    test_wifi_backoff(wifi);
+    test_fragment_length(wifi);
+    return check::result("test_connections");
+}
@@ -0,0 +1,143 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// DDP packets straight into DdpStream, one per frame, with the frame number in the first pixel. Lost packets count
+// as gaps and a packet overtaken by a later one is dropped as late. After losing a burst of any length the stream
+// goes on with at most one packet dropped, also if the burst was more than half the sequence cycle, where the next
+// packet looks like an old one. Prints the counts per burst length as JSON lines.
+
+#include <cstring>
+#include <memory>
+
+#include "DdpStream.h"
+#include "check.h"
+#include "harness.h"
+
+namespace {
+    constexpr size_t kHeaderSize = 10;
+    constexpr uint8_t kVersion1 = 0x40;
+    constexpr uint8_t kPushFlag = 0x01;
+    constexpr uint8_t kRgb8Type = 0x0B;
+    constexpr uint8_t kDisplayId = 1;
+    constexpr uint8_t kSequenceCount = 15;
+    constexpr size_t kDataSize = 3 * DdpStream::kLedCount;
+    constexpr unsigned long kFrameMicros = 20000;
+
+    using Packet = uint8_t[kHeaderSize + kDataSize];
+
+    // a whole frame with the push flag, its number in the first pixel
+    void make_packet(Packet& packet, const uint8_t sequence, const uint8_t frame) {
+        memset(packet, 0, sizeof(packet));
+        packet[0] = kVersion1 | kPushFlag;
+        packet[1] = sequence;
+        packet[2] = kRgb8Type;
+        packet[3] = kDisplayId;
+        packet[8] = static_cast<uint8_t>(kDataSize >> 8);
+        packet[9] = static_cast<uint8_t>(kDataSize & 0xFF);
+        packet[kHeaderSize] = frame;
+    }
+
+    // sends the frames with their sequence numbers, and keeps the virtual time
+    class Sender {
+    public:
+        explicit Sender(DdpStream& stream, const bool hasSequence = true) : _stream(stream), _hasSequence(hasSequence) {}
+
+        // the frame goes out if it isn't lost; its number is taken either way
+        bool send(const bool isLost = false) {
+            _frame++;
+            _now += kFrameMicros;
+            if (isLost) return true;
+            Packet packet;
+            make_packet(packet, _hasSequence ? static_cast<uint8_t>((_frame - 1) % kSequenceCount + 1) : 0, static_cast<uint8_t>(_frame));
+            return _stream.feed(packet, sizeof(packet), _now);
+        }
+
+        // the frame number the stream shows now, or -1 if none is due
+        int shown() {
+            const RgbPixel* pixels = _stream.next(_now + DdpStream::kPlayoutDelayMicros);
+            return pixels == nullptr ? -1 : pixels[0].red;
+        }
+
+        uint32_t frame() const { return _frame; }
+
+    private:
+        DdpStream& _stream;
+        bool _hasSequence;
+        uint32_t _frame = 0;
+        unsigned long _now = 0;
+    };
+
+    void test_in_order() {
+        for (const bool hasSequence : { true, false }) {
+            const auto stream = std::make_unique<DdpStream>();
+            Sender sender(*stream, hasSequence);
+            for (int i = 0; i < 40; i++) {
+                CHECK(sender.send());
+                CHECK_EQUAL(sender.shown(), sender.frame());
+            }
+            CHECK_EQUAL(stream->frames(), 40);
+            CHECK_EQUAL(stream->gaps(), 0);
+            CHECK_EQUAL(stream->latePackets(), 0);
+        }
+    }
+
+    // frames 1 2 4 3 5: 4 jumps a gap, 3 is late, 5 carries on
+    void test_overtaken() {
+        const auto stream = std::make_unique<DdpStream>();
+        unsigned long now = 0;
+        for (const uint8_t frame : { 1, 2, 4, 3, 5 }) {
+            Packet packet;
+            make_packet(packet, frame, frame);
+            now += kFrameMicros;
+            CHECK(stream->feed(packet, sizeof(packet), now));
+        }
+        CHECK_EQUAL(stream->frames(), 4);
+        CHECK_EQUAL(stream->gaps(), 1);
+        CHECK_EQUAL(stream->latePackets(), 1);
+        const RgbPixel* pixels = stream->next(now + DdpStream::kPlayoutDelayMicros);
+        CHECK(pixels != nullptr && pixels[0].red == 5);
+    }
+
+    // every burst length up to two sequence cycles, starting at every position in the cycle
+    void test_burst_loss() {
+        constexpr int kAfter = 20;
+        for (uint32_t burst = 1; burst <= 2U * kSequenceCount; burst++) {
+            uint32_t worstDropped = 0;
+            for (uint32_t start = 1; start <= kSequenceCount; start++) {
+                const auto stream = std::make_unique<DdpStream>();
+                Sender sender(*stream);
+                for (uint32_t i = 0; i < start; i++) sender.send();
+                for (uint32_t i = 0; i < burst; i++) sender.send(true);
+                const uint32_t before = stream->frames();
+                for (int i = 0; i < kAfter; i++) sender.send();
+                const uint32_t dropped = kAfter - (stream->frames() - before);
+                worstDropped = dropped > worstDropped ? dropped : worstDropped;
+                // A burst of whole cycles can't be told from nothing lost, and one short of a cycle repeats the
+                // sequence number of the last packet, like a duplicate, so those aren't counted as gaps.
+                const uint32_t lost = burst % kSequenceCount;
+                const bool isLate = lost > kSequenceCount / 2;
+                CHECK_EQUAL(dropped, isLate ? 1 : 0);
+                CHECK_EQUAL(stream->latePackets(), isLate ? 1 : 0);
+                CHECK_EQUAL(stream->gaps(), lost == kSequenceCount - 1 ? 0 : lost);
+                CHECK_EQUAL(sender.shown(), sender.frame() % 256);
+            }
+            bench::Json("ddp_burst_loss").add("lost", burst).add("dropped_after", worstDropped).print();
+        }
+    }
+}
+
+int main(const int argc, char** argv) {
+    bench::init(argc, argv);
+    test_in_order();
+    test_overtaken();
+    test_burst_loss();
+    return check::result("test_ddp");
+}
@@ -0,0 +1,124 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// Temporal dithering at every 16 bit level and a few thresholds. Levels within the threshold of an 8 bit level are
+// rounded and never change. The others average out to the exact level over 256 frames, with pulses of the rarer 8 bit
+// level at most 256 / threshold frames apart, which is what keeps them fast enough not to flicker. Prints how many
+// levels between two 8 bit levels still dither at the thresholds of a few ring lengths as JSON lines.
+
+#include <algorithm>
+#include <initializer_list>
+
+#include "ColorConversion.h"
+#include "LedRingDriver.h"
+#include "check.h"
+#include "harness.h"
+
+namespace {
+    constexpr uint16_t kFullLevel = 0xFF00;
+    constexpr int kFrames = 512;
+
+    void test_level(const uint16_t level, const uint8_t minFraction) {
+        const uint8_t fraction = level & 0xFF;
+        const bool isRounded = fraction < minFraction || 256 - fraction < minFraction;
+        const Rgb16Pixel pixel = { level, level, level };
+        // any starting error, like the driver's spread
+        uint8_t errors[3] = { static_cast<uint8_t>(level * 97), 0, 255 };
+        RgbPixel output;
+        const auto floor = static_cast<uint8_t>(level >> 8);
+        // frames since the last pulse of the rarer level, and the longest wait for one
+        const bool isPulseHigh = fraction <= 128;
+        int sinceLastPulse = -1;
+        int longestWait = 0;
+        uint32_t sum = 0;
+        bool isOk = true;
+        for (int frame = 0; frame < kFrames && isOk; frame++) {
+            const bool isDithering = color::dither(&pixel, errors, &output, 1, minFraction);
+            if (isRounded) {
+                const auto rounded = static_cast<uint8_t>((level + 0x80) >> 8);
+                isOk = CHECK(!isDithering) && CHECK_EQUAL(output.red, rounded) && CHECK_EQUAL(output.blue, rounded);
+                continue;
+            }
+            isOk = CHECK(isDithering) && CHECK(output.red == floor || output.red == floor + 1);
+            if (frame >= kFrames - 256) sum += output.red;
+            if ((output.red != floor) == isPulseHigh) {
+                if (sinceLastPulse >= 0) longestWait = sinceLastPulse > longestWait ? sinceLastPulse : longestWait;
+                sinceLastPulse = 0;
+            }
+            if (sinceLastPulse >= 0) sinceLastPulse++;
+        }
+        if (isRounded || !isOk) return;
+        // 256 frames of 8 bits add up to the 8.8 level
+        CHECK_EQUAL(sum, level);
+        const int distance = isPulseHigh ? fraction : 256 - fraction;
+        CHECK(longestWait <= (256 + distance - 1) / distance);
+        CHECK(longestWait <= (256 + minFraction - 1) / minFraction);
+    }
+
+    // the threshold LedRingDriver uses for a ring of this length
+    uint8_t ring_threshold(const uint16_t ledCount) {
+        return static_cast<uint8_t>(std::min<unsigned long>(dither_timing::min_fraction(ledCount), LedRingDriver::kNoDithering));
+    }
+
+    void test_all_levels() {
+        // 1 dithers everything between two levels; then the 12 and 60 LED thresholds; 129 dithers nothing
+        for (const uint8_t minFraction : { uint8_t{ 1 }, ring_threshold(12), ring_threshold(60), uint8_t{ 128 }, uint8_t{ 129 } }) {
+            for (uint32_t level = 0; level <= kFullLevel; level++) {
+                test_level(static_cast<uint16_t>(level), minFraction);
+            }
+        }
+    }
+
+    // The longer the ring, the slower the dither rate and the higher the threshold. At 60 LEDs only the levels near
+    // the middle between two 8 bit levels dither, and from 68 LEDs none do.
+    void test_ring_lengths() {
+        for (const uint16_t ledCount : { 12, 24, 60, 67, 68, 144 }) {
+            const uint8_t minFraction = ring_threshold(ledCount);
+            uint16_t dithered = 0;
+            for (uint16_t fraction = 1; fraction < 256; fraction++) {
+                const Rgb16Pixel pixel = { static_cast<uint16_t>(0x4000 + fraction), 0x4000, 0x4000 };
+                uint8_t errors[3] = {};
+                RgbPixel output;
+                if (color::dither(&pixel, errors, &output, 1, minFraction)) dithered++;
+            }
+            bench::Json("dither_levels").add("leds", ledCount).add("dither_hz", 1000000UL / dither_timing::period_micros(ledCount))
+                .add("min_fraction", minFraction).add("dithered_fractions", dithered).print();
+            if (ledCount == 12) CHECK_EQUAL(dithered, 179);
+            if (ledCount == 60) CHECK(minFraction == 114 && dithered == 29);
+            if (ledCount >= 68) CHECK_EQUAL(dithered, 0);
+        }
+    }
+
+    // a channel that dithers doesn't make the others move
+    void test_mixed_pixel() {
+        const Rgb16Pixel pixels[2] = { { 0x1080, 0x2000, 0x30FF }, { 0x4000, 0x5001, 0x6000 } };
+        uint8_t errors[6] = {};
+        RgbPixel output[2];
+        for (int frame = 0; frame < 16; frame++) {
+            CHECK(color::dither(pixels, errors, output, 2, 39));
+            CHECK(output[0].red == 0x10 || output[0].red == 0x11);
+            CHECK_EQUAL(output[0].green, 0x20);
+            CHECK_EQUAL(output[0].blue, 0x31);
+            CHECK_EQUAL(output[1].red, 0x40);
+            CHECK_EQUAL(output[1].green, 0x50);
+            CHECK_EQUAL(output[1].blue, 0x60);
+        }
+        CHECK(!color::dither(pixels + 1, errors + 3, output + 1, 1, 39));
+    }
+}
+
+int main(const int argc, char** argv) {
+    bench::init(argc, argv);
+    test_all_levels();
+    test_ring_lengths();
+    test_mixed_pixel();
+    return check::result("test_dither");
+}
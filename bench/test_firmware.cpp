@@ -0,0 +1,166 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// The firmware download against a server that drops the connection at random offsets: it resumes with a Range
+// request from where it stopped, rejects a Content-Range that doesn't continue there, gives up after the attempt
+// limit, and never commits an image whose SHA-256 digest doesn't match. Runs on the virtual clock, against the
+// loopback HTTP server and the Update stand-in.
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <ESP.h>
+
+#include "FirmwareManager.h"
+#include "Host.h"
+#include "LoopbackHttpServer.h"
+#include "Updater.h"
+#include "check.h"
+#include "harness.h"
+
+namespace {
+    constexpr auto kServerHost = "firmware.local";
+    constexpr uint16_t kServerPort = 8080;
+    constexpr auto kBaseUrl = "http://firmware.local:8080/firmware/";
+    constexpr auto kMachineId = "ring";
+    constexpr auto kVersion = "2.0";
+    constexpr auto kImagePath = "/firmware/ring.2.0";
+    constexpr auto kDigestPath = "/firmware/ring.2.0.sha256";
+    constexpr size_t kImageSize = 50000;
+    // FirmwareManager::kMaxAttempts
+    constexpr uint32_t kMaxAttempts = 5;
+    constexpr uint32_t kResumeRounds = 20;
+
+    // as written by sha256sum
+    std::string digest_line(const std::vector<uint8_t>& image) {
+        br_sha256_context context;
+        br_sha256_init(&context);
+        br_sha256_update(&context, image.data(), image.size());
+        uint8_t digest[br_sha256_SIZE];
+        br_sha256_out(&context, digest);
+        char text[2 * br_sha256_SIZE + 1];
+        for (size_t i = 0; i < br_sha256_SIZE; i++) snprintf(text + 2 * i, 3, "%02x", digest[i]);
+        return std::string(text) + "  ring.2.0\n";
+    }
+
+    struct Outcome {
+        bool isUpdated;
+        uint32_t restarts;
+        uint32_t commits;
+    };
+
+    // runs an update and tells what changed
+    Outcome run_update(FirmwareManager& firmware) {
+        const uint32_t restarts = ESP.restarts();
+        const uint32_t commits = Update.commits();
+        const bool isUpdated = firmware.update(kVersion);
+        CHECK(!Update.isRunning());
+        return { isUpdated, ESP.restarts() - restarts, Update.commits() - commits };
+    }
+
+    // Up to one drop less than the attempt limit, at random offsets. Every resume must ask for the first byte it
+    // doesn't have yet, so the range requests start at the drop offsets.
+    void test_resume(LoopbackHttpServer& server, FirmwareManager& firmware) {
+        uint32_t drops = 0;
+        for (uint32_t round = 0; round < kResumeRounds; round++) {
+            server.reset();
+            std::vector<size_t> offsets(host::next_random() % kMaxAttempts);
+            for (size_t& offset : offsets) offset = 1 + host::next_random() % (kImageSize - 1);
+            std::sort(offsets.begin(), offsets.end());
+            for (const size_t offset : offsets) server.dropAt(kImagePath, offset);
+
+            const Outcome outcome = run_update(firmware);
+            CHECK(outcome.isUpdated);
+            CHECK_EQUAL(outcome.restarts, 1);
+            CHECK_EQUAL(outcome.commits, 1);
+            CHECK_EQUAL(firmware.received(), kImageSize);
+            CHECK(server.rangeStarts() == offsets);
+            CHECK_EQUAL(Update.written(), kImageSize);
+            drops += static_cast<uint32_t>(offsets.size());
+        }
+        bench::Json("firmware_resume").add("rounds", kResumeRounds).add("drops", drops).print();
+    }
+
+    // a server that answers the range request with a different part than was asked for
+    void test_mismatched_range(LoopbackHttpServer& server, FirmwareManager& firmware) {
+        for (const long error : { -1L, 1L, 512L }) {
+            server.reset();
+            server.dropAt(kImagePath, kImageSize / 2);
+            server.setRangeError(error);
+            const Outcome outcome = run_update(firmware);
+            CHECK(!outcome.isUpdated);
+            CHECK_EQUAL(outcome.commits, 0);
+            CHECK_EQUAL(outcome.restarts, 0);
+            CHECK_EQUAL(server.counters().rangeRequests, 1);
+            CHECK(strcmp(firmware.errorMessage(), "Server can't resume the download") == 0);
+        }
+        server.reset();
+    }
+
+    // a connection that keeps dropping; every attempt gets further, but the limit ends it
+    void test_attempt_limit(LoopbackHttpServer& server, FirmwareManager& firmware) {
+        server.reset();
+        for (uint32_t i = 1; i <= 2 * kMaxAttempts; i++) server.dropAt(kImagePath, i * 1000);
+        const Outcome outcome = run_update(firmware);
+        CHECK(!outcome.isUpdated);
+        CHECK_EQUAL(outcome.commits, 0);
+        CHECK_EQUAL(server.counters().drops, kMaxAttempts);
+        CHECK_EQUAL(server.counters().rangeRequests, kMaxAttempts - 1);
+        char expected[80];
+        snprintf(expected, sizeof(expected), "Interrupted at %u of %u bytes after %u attempts",
+            static_cast<unsigned>(kMaxAttempts * 1000), static_cast<unsigned>(kImageSize), static_cast<unsigned>(kMaxAttempts));
+        CHECK(strcmp(firmware.errorMessage(), expected) == 0);
+        server.reset();
+    }
+
+    // The digest is checked before the last chunk goes to flash, so the image can't be committed, also not by
+    // aborting it.
+    void test_digest_mismatch(LoopbackHttpServer& server, FirmwareManager& firmware, const std::vector<uint8_t>& image) {
+        std::vector<uint8_t> corrupted = image;
+        corrupted[kImageSize / 3] ^= 0x01;
+        server.reset();
+        server.serve(kImagePath, corrupted);
+        server.dropAt(kImagePath, kImageSize / 4);
+        const Outcome outcome = run_update(firmware);
+        CHECK(!outcome.isUpdated);
+        CHECK_EQUAL(outcome.commits, 0);
+        CHECK_EQUAL(outcome.restarts, 0);
+        CHECK_EQUAL(firmware.received(), kImageSize);
+        CHECK(Update.written() < kImageSize);
+        CHECK(strcmp(firmware.errorMessage(), "SHA-256 digest mismatch") == 0);
+        server.serve(kImagePath, image);
+    }
+}
+
+int main(const int argc, char** argv) {
+    bench::init(argc, argv);
+    host::use_virtual_clock();
+    host::seed_random(17);
+    std::vector<uint8_t> image(kImageSize);
+    for (uint8_t& byte : image) byte = static_cast<uint8_t>(host::next_random());
+
+    LoopbackHttpServer server;
+    server.listen(kServerHost, kServerPort);
+    // no compressed image, so the plain one is fetched
+    server.serve(kImagePath, image);
+    server.serve(kDigestPath, digest_line(image).c_str());
+
+    WiFiClient client;
+    FirmwareManager firmware;
+    firmware.begin(&client, kBaseUrl, kMachineId);
+
+    test_resume(server, firmware);
+    test_mismatched_range(server, firmware);
+    test_attempt_limit(server, firmware);
+    test_digest_mismatch(server, firmware, image);
+    return check::result("test_firmware");
+}
@@ -0,0 +1,286 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// The journal on a simulated flash: the newest record survives a restart, erases are spread over the sectors,
+// the boot scan stays short however full the journal is, and a write cut short by a power failure costs at most
+// that record, also if it was the first of a sector and more followed. A group change that can't be written leaves the
+// groups a restart finds, also in RAM. Prints the erase counts and the boot scan
+// cost as JSON lines.
+
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "FlashRegion.h"
+#include "GroupStore.h"
+#include "Host.h"
+#include "Journal.h"
+#include "Persistence.h"
+#include "check.h"
+#include "harness.h"
+
+namespace {
+    constexpr uint16_t kSectorCount = flash_layout::kJournalSectorCount;
+
+    struct Payload {
+        uint32_t counter;
+        uint8_t filler[12];
+    };
+
+    Payload make_payload(const uint32_t counter) {
+        Payload payload = { counter, {} };
+        for (size_t i = 0; i < sizeof(payload.filler); i++) payload.filler[i] = static_cast<uint8_t>(counter + i);
+        return payload;
+    }
+
+    // a fresh (erased) flash for every case, selected for ESP.flashRead and friends
+    std::unique_ptr<host::Flash> fresh_flash() {
+        auto flash = std::make_unique<host::Flash>();
+        host::select_flash(flash.get());
+        return flash;
+    }
+
+    // what begin() finds after a restart, or 0 if nothing
+    uint32_t restart_and_read(uint32_t* scanReads = nullptr) {
+        EspFlashRegion region(flash_layout::kJournalFirstSector, kSectorCount);
+        Journal journal(&region, sizeof(Payload));
+        Payload payload = {};
+        const bool isFound = journal.begin(&payload);
+        if (scanReads != nullptr) *scanReads = journal.scanReads();
+        if (!isFound) return 0;
+        const Payload expected = make_payload(payload.counter);
+        CHECK(memcmp(&payload, &expected, sizeof(payload)) == 0);
+        return payload.counter;
+    }
+
+    uint16_t records_per_sector() {
+        EspFlashRegion region(flash_layout::kJournalFirstSector, kSectorCount);
+        const Journal journal(&region, sizeof(Payload));
+        return static_cast<uint16_t>(FlashRegion::kSectorSize / journal.recordSize());
+    }
+
+    void test_empty() {
+        const auto flash = fresh_flash();
+        CHECK_EQUAL(restart_and_read(), 0);
+    }
+
+    void test_newest_survives_restart() {
+        const auto flash = fresh_flash();
+        const uint32_t total = 3 * records_per_sector() * kSectorCount + 17;
+        EspFlashRegion region(flash_layout::kJournalFirstSector, kSectorCount);
+        Journal journal(&region, sizeof(Payload));
+        Payload payload;
+        CHECK(!journal.begin(&payload));
+        for (uint32_t counter = 1; counter <= total; counter++) {
+            const Payload next = make_payload(counter);
+            CHECK(journal.append(&next));
+            // now and then, a restart in between
+            if (counter % 97 == 0) {
+                CHECK_EQUAL(restart_and_read(), counter);
+                CHECK(journal.begin(&payload));
+            }
+        }
+        CHECK_EQUAL(restart_and_read(), total);
+    }
+
+    // A sector is erased when the journal moves into it, so every sector is erased once per round through them.
+    // Before the journal, every save erased the one EEPROM sector.
+    void test_wear_levelling() {
+        const auto flash = fresh_flash();
+        const uint16_t recordsPerSector = records_per_sector();
+        const uint32_t appends = 10UL * recordsPerSector * kSectorCount;
+        EspFlashRegion region(flash_layout::kJournalFirstSector, kSectorCount);
+        Journal journal(&region, sizeof(Payload));
+        for (uint32_t counter = 1; counter <= appends; counter++) {
+            const Payload next = make_payload(counter);
+            journal.append(&next);
+        }
+        uint32_t minErases = UINT32_MAX;
+        uint32_t maxErases = 0;
+        for (uint16_t sector = 0; sector < kSectorCount; sector++) {
+            minErases = std::min(minErases, flash->erases(sector));
+            maxErases = std::max(maxErases, flash->erases(sector));
+        }
+        CHECK_EQUAL(flash->totalErases(), appends / recordsPerSector);
+        CHECK_EQUAL(journal.erases(), flash->totalErases());
+        CHECK_EQUAL(minErases, 10);
+        CHECK_EQUAL(maxErases, 10);
+        // nothing outside the journal's sectors
+        CHECK_EQUAL(flash->erases(kSectorCount), 0);
+        bench::Json("journal_wear").add("appends", appends).add("records_per_sector", static_cast<uint32_t>(recordsPerSector))
+            .add("sectors", static_cast<uint32_t>(kSectorCount)).add("erases", flash->totalErases())
+            .add("max_erases_per_sector", maxErases).add("eeprom_erases", appends)
+            .add("appends_per_sector_erase", static_cast<double>(appends) / maxErases).print();
+    }
+
+    // however far the journal got, begin() reads the first slot of every sector and then searches one sector
+    void test_boot_scan() {
+        const uint16_t recordsPerSector = records_per_sector();
+        // the first slots, the binary search, and the newest record
+        uint32_t bound = kSectorCount + 1;
+        for (uint32_t range = 1; range < recordsPerSector; range *= 2) bound++;
+        const uint32_t positions[] = { 1, 2, recordsPerSector - 1U, recordsPerSector, recordsPerSector + 1U,
+                                       2U * recordsPerSector + 50, 4U * recordsPerSector - 1, 4U * recordsPerSector,
+                                       9U * recordsPerSector + 73 };
+        for (const uint32_t appends : positions) {
+            const auto flash = fresh_flash();
+            EspFlashRegion region(flash_layout::kJournalFirstSector, kSectorCount);
+            Journal journal(&region, sizeof(Payload));
+            for (uint32_t counter = 1; counter <= appends; counter++) {
+                const Payload next = make_payload(counter);
+                journal.append(&next);
+            }
+            uint32_t scanReads = 0;
+            CHECK_EQUAL(restart_and_read(&scanReads), appends);
+            CHECK(scanReads <= bound);
+
+            std::vector<double> samples;
+            for (uint32_t run = 0; run < bench::options().runs; run++) {
+                const double start = bench::now_nanos();
+                bench::keep(restart_and_read());
+                samples.push_back(bench::now_nanos() - start);
+            }
+            bench::Json("journal_boot_scan").add("appends", appends).add("reads", scanReads).add("max_reads", bound)
+                .add("ns", bench::summarize(samples)).print();
+        }
+    }
+
+    // The power fails halfway through an append, at every position in the first rounds through the sectors.
+    // After the restart, the record before it is the newest, and appending goes on from there.
+    void test_torn_writes() {
+        const uint32_t last = 2U * records_per_sector() * kSectorCount + 3;
+        for (uint32_t good = 0; good <= last; good++) {
+            const auto flash = fresh_flash();
+            {
+                EspFlashRegion region(flash_layout::kJournalFirstSector, kSectorCount);
+                Journal journal(&region, sizeof(Payload));
+                for (uint32_t counter = 1; counter <= good; counter++) {
+                    const Payload next = make_payload(counter);
+                    journal.append(&next);
+                }
+                flash->failAfterWrites(1);
+                const Payload torn = make_payload(good + 1);
+                CHECK(!journal.append(&torn));
+            }
+            flash->restorePower();
+            if (!CHECK_EQUAL(restart_and_read(), good)) continue;
+
+            EspFlashRegion region(flash_layout::kJournalFirstSector, kSectorCount);
+            Journal journal(&region, sizeof(Payload));
+            Payload payload;
+            journal.begin(&payload);
+            const Payload next = make_payload(good + 2);
+            CHECK(journal.append(&next));
+            CHECK_EQUAL(restart_and_read(), good + 2);
+        }
+    }
+
+    // Writing the first record of a sector fails, but the device runs on and appends more to that sector. Those
+    // are newer than anything in the other sectors, so they are what a restart finds, and appending after the
+    // restart goes on after them instead of erasing them.
+    void test_failed_first_write() {
+        const uint16_t recordsPerSector = records_per_sector();
+        constexpr uint32_t kLater = 3;
+        for (uint32_t sector = 1; sector <= 2U * kSectorCount; sector++) {
+            const uint32_t good = sector * recordsPerSector;
+            const auto flash = fresh_flash();
+            {
+                EspFlashRegion region(flash_layout::kJournalFirstSector, kSectorCount);
+                Journal journal(&region, sizeof(Payload));
+                for (uint32_t counter = 1; counter <= good; counter++) {
+                    const Payload next = make_payload(counter);
+                    journal.append(&next);
+                }
+                flash->failAfterWrites(1);
+                const Payload failed = make_payload(good + 1);
+                CHECK(!journal.append(&failed));
+                flash->restorePower();
+                for (uint32_t counter = good + 2; counter <= good + 1 + kLater; counter++) {
+                    const Payload next = make_payload(counter);
+                    CHECK(journal.append(&next));
+                }
+            }
+            if (!CHECK_EQUAL(restart_and_read(), good + 1 + kLater)) continue;
+
+            EspFlashRegion region(flash_layout::kJournalFirstSector, kSectorCount);
+            Journal journal(&region, sizeof(Payload));
+            Payload payload;
+            journal.begin(&payload);
+            const uint32_t erases = flash->totalErases();
+            const Payload next = make_payload(good + 2 + kLater);
+            CHECK(journal.append(&next));
+            CHECK_EQUAL(flash->totalErases(), erases);
+            CHECK_EQUAL(restart_and_read(), good + 2 + kLater);
+        }
+    }
+
+    // Persistence on top of it: what was put is there after a restart
+    void test_persistence() {
+        const auto flash = fresh_flash();
+        {
+            Persistence persistence;
+            persistence.begin();
+            const LedState state = { 200, 80, 40, 2 };
+            CHECK(persistence.put(0, &state));
+        }
+        Persistence persistence;
+        persistence.begin();
+        const LedState expected = { 200, 80, 40, 2 };
+        CHECK(persistence.get()[0] == expected);
+    }
+
+    // the groups a fresh GroupStore reads after a restart, serialized
+    std::string restart_and_read_groups() {
+        GroupStore store;
+        store.begin();
+        char list[GroupStore::kMaxListSize];
+        CHECK(store.serialize(list, sizeof(list)));
+        return list;
+    }
+
+    // Writing new groups fails after the sector was erased. If the flash still works, the old groups are written
+    // back; if the power went, there are none. Either way, RAM has what a restart finds.
+    void test_failed_group_change() {
+        constexpr auto kOld = "kitchen,hall";
+        constexpr auto kNew = "garden";
+        GroupStore::GroupList oldGroups, newGroups;
+        CHECK(GroupStore::parse(kOld, strlen(kOld), oldGroups));
+        CHECK(GroupStore::parse(kNew, strlen(kNew), newGroups));
+        for (const bool isPowerCut : { false, true }) {
+            const auto flash = fresh_flash();
+            GroupStore store;
+            store.begin();
+            CHECK(store.set(oldGroups));
+            if (isPowerCut) flash->failAfterWrites(1);
+            else flash->failNextWrite();
+            CHECK(!store.set(newGroups));
+            char list[GroupStore::kMaxListSize];
+            CHECK(store.serialize(list, sizeof(list)));
+            CHECK(strcmp(list, isPowerCut ? GroupStore::kNoGroups : kOld) == 0);
+            flash->restorePower();
+            CHECK(restart_and_read_groups() == list);
+        }
+    }
+}
+
+int main(const int argc, char** argv) {
+    bench::init(argc, argv);
+    test_empty();
+    test_newest_survives_restart();
+    test_wear_levelling();
+    test_boot_scan();
+    test_torn_writes();
+    test_failed_first_write();
+    test_persistence();
+    test_failed_group_change();
+    host::select_flash(nullptr);
+    return check::result("test_journal");
+}
@@ -0,0 +1,218 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// The preset store on a simulated flash: what every operation costs in flash reads, writes and erases, that a
+// preset survives a restart and a cut store doesn't recall garbage, and how long a recall takes, both on its own
+// and from the MQTT command to the LEDs showing the preset (on the virtual clock, through the loopback broker).
+
+#include <memory>
+
+#include "Device.h"
+#include "Host.h"
+#include "LoopbackBroker.h"
+#include "PresetStore.h"
+#include "check.h"
+#include "harness.h"
+#include "secrets.h"
+
+namespace {
+    // Controller::kMqttPollInterval
+    constexpr unsigned long kMqttPollMillis = 20;
+
+    struct FlashCount {
+        uint32_t reads;
+        uint32_t writes;
+        uint32_t erases;
+    };
+
+    FlashCount count(const host::Flash& flash) {
+        return { flash.reads(), flash.writes(), flash.totalErases() };
+    }
+
+    // the flash operations body() does, checked against what was expected, and printed
+    template <typename Body>
+    void check_operation(const char* name, host::Flash& flash, const FlashCount expected, Body&& body) {
+        const FlashCount before = count(flash);
+        body();
+        const FlashCount after = count(flash);
+        const FlashCount done = { after.reads - before.reads, after.writes - before.writes, after.erases - before.erases };
+        CHECK_EQUAL(done.reads, expected.reads);
+        CHECK_EQUAL(done.writes, expected.writes);
+        CHECK_EQUAL(done.erases, expected.erases);
+        bench::Json("preset_flash_operations").add("operation", name).add("reads", done.reads).add("writes", done.writes)
+            .add("erases", done.erases).print();
+    }
+
+    void test_operations() {
+        host::Flash flash;
+        host::select_flash(&flash);
+        PresetStore store;
+        const LedState state = { 240, 100, 60, 2 };
+        LedState recalled = {};
+
+        check_operation("store", flash, { 0, 1, 1 }, [&] { CHECK(store.store(3, state)); });
+        check_operation("recall", flash, { 1, 0, 0 }, [&] { CHECK(store.recall(3, recalled)); });
+        CHECK(recalled == state);
+        check_operation("recall_empty", flash, { 1, 0, 0 }, [&] { CHECK(!store.recall(4, recalled)); });
+        check_operation("delete", flash, { 0, 0, 1 }, [&] { CHECK(store.remove(3)); });
+        check_operation("recall_deleted", flash, { 1, 0, 0 }, [&] { CHECK(!store.recall(3, recalled)); });
+        // out of range is refused before touching the flash
+        check_operation("invalid", flash, { 0, 0, 0 }, [&] {
+            CHECK(!store.store(PresetStore::kPresetCount, state));
+            CHECK(!store.recall(PresetStore::kPresetCount, recalled));
+            CHECK(!store.remove(PresetStore::kPresetCount));
+        });
+        CHECK(recalled == state);
+        host::select_flash(nullptr);
+    }
+
+    void test_presets_are_independent() {
+        host::Flash flash;
+        host::select_flash(&flash);
+        {
+            PresetStore store;
+            for (uint8_t preset = 0; preset < PresetStore::kPresetCount; preset++) {
+                CHECK(store.store(preset, { static_cast<uint16_t>(preset * 20), 100, static_cast<uint8_t>(preset + 10), preset }));
+            }
+            CHECK(store.remove(7));
+        }
+        // after a restart
+        PresetStore store;
+        for (uint8_t preset = 0; preset < PresetStore::kPresetCount; preset++) {
+            LedState state = {};
+            const bool isFound = store.recall(preset, state);
+            if (preset == 7) {
+                CHECK(!isFound);
+                continue;
+            }
+            CHECK(isFound);
+            CHECK(state == (LedState{ static_cast<uint16_t>(preset * 20), 100, static_cast<uint8_t>(preset + 10), preset }));
+        }
+        host::select_flash(nullptr);
+    }
+
+    // the power fails halfway through writing the preset: it is gone, not garbage, and the others are untouched
+    void test_torn_store() {
+        host::Flash flash;
+        host::select_flash(&flash);
+        PresetStore store;
+        const LedState kept = { 120, 100, 50, 0 };
+        CHECK(store.store(1, kept));
+        CHECK(store.store(2, kept));
+        flash.failAfterWrites(1);
+        CHECK(!store.store(2, { 10, 20, 30, 1 }));
+        flash.restorePower();
+        LedState state = {};
+        CHECK(!store.recall(2, state));
+        CHECK(store.recall(1, state));
+        CHECK(state == kept);
+        host::select_flash(nullptr);
+    }
+
+    void measure_recall() {
+        host::Flash flash;
+        host::select_flash(&flash);
+        PresetStore store;
+        CHECK(store.store(5, { 200, 90, 80, 1 }));
+        LedState state;
+        bench::measure("preset_recall", 20000, [&store, &state] {
+            bench::keep(store.recall(5, state));
+            bench::keep(state);
+        });
+        host::select_flash(nullptr);
+    }
+
+    // runs the device until the LEDs show the pixels, or the time runs out; returns when they were shown
+    bool run_until_shown(Device& device, const uint8_t* pixels, const size_t size, uint64_t& shownMicros) {
+        const uint64_t end = host::now_micros() + 1000000;
+        while (host::now_micros() < end) {
+            Device::sleep(device.step());
+            const host::LedOutput& output = host::led_output();
+            if (memcmp(output.pixels, pixels, size) == 0) {
+                shownMicros = output.lastShowMicros;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // From the recall command arriving at the broker to the LEDs showing the preset. The device polls MQTT every
+    // 20 ms, so the commands arrive at random moments within that.
+    void test_recall_over_mqtt() {
+        host::use_virtual_clock();
+        host::seed_random(10);
+        LoopbackBroker broker;
+        broker.listen(kConfigMqttBroker, kConfigMqttPort);
+        host::Flash flash;
+        Device device(kConfigDeviceName, &flash);
+        device.begin(kConfigMqttBroker, kConfigMqttPort);
+        CHECK(device.settle());
+
+        char topic[128];
+        const char* node = led_ring_config::kSegments[0].node;
+        const auto send = [&topic, &broker, node](const char* property, const char* payload) {
+            snprintf(topic, sizeof(topic), "homie/%s/%s/%s/set", kConfigDeviceName, node, property);
+            broker.inject(topic, payload);
+        };
+        // full colors don't dither, so the output is the same every frame
+        constexpr size_t kSize = 3 * LedRingDriver::kLedCount;
+        uint8_t blue[kSize];
+        uint8_t red[kSize];
+        uint64_t shownMicros;
+        // PubSubClient takes one packet per poll, so give it time for the acknowledgements of the subscriptions
+        device.run(1000000);
+        send(kSceneProperty, "240,100,100,0");
+        device.run(500000);
+        memcpy(blue, host::led_output().pixels, kSize);
+        send(kStoreProperty, "6");
+        device.run(500000);
+        send(kSceneProperty, "0,100,100,0");
+        device.run(500000);
+        memcpy(red, host::led_output().pixels, kSize);
+        CHECK(memcmp(red, blue, kSize) != 0);
+
+        const uint32_t presetWrites = device.presets().writes();
+        const uint32_t presetErases = device.presets().erases();
+        std::vector<double> latencies;
+        const uint32_t recalls = static_cast<uint32_t>(bench::scaled(200));
+        for (uint32_t i = 0; i < recalls; i++) {
+            // a random moment within the poll interval
+            device.run(host::next_random() % (kMqttPollMillis * 1000));
+            const uint64_t sent = host::now_micros();
+            send(kRecallProperty, "6");
+            if (!CHECK(run_until_shown(device, blue, kSize, shownMicros))) break;
+            latencies.push_back(static_cast<double>(shownMicros - sent) / 1000);
+            send(kSceneProperty, "0,100,100,0");
+            CHECK(run_until_shown(device, red, kSize, shownMicros));
+        }
+        // recalling doesn't write the preset; the state itself is journaled by Persistence after the debounce
+        CHECK_EQUAL(device.presets().writes(), presetWrites);
+        CHECK_EQUAL(device.presets().erases(), presetErases);
+        CHECK(device.presets().reads() >= recalls);
+        const bench::Summary latency = bench::summarize(latencies);
+        // the poll interval, and a push waits for the end of the frame period at most
+        CHECK(latency.max <= kMqttPollMillis + 1000.0 / LedRingDriver::kFramesPerSecond);
+        bench::Json("preset_recall_over_mqtt").add("recalls", recalls).add("latency_ms", latency)
+            .add("preset_reads", device.presets().reads()).add("preset_writes", device.presets().writes())
+            .add("journal_writes", device.persistence().journal().writes()).print();
+        device.mqtt().disconnect();
+    }
+}
+
+int main(const int argc, char** argv) {
+    bench::init(argc, argv);
+    test_operations();
+    test_presets_are_independent();
+    test_torn_store();
+    measure_recall();
+    test_recall_over_mqtt();
+    return check::result("test_presets");
+}
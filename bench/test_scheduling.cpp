@@ -0,0 +1,140 @@
+// Copyright 2025 Rik Essenius
+// 
+//   Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//   except in compliance with the License. You may obtain a copy of the License at
+// 
+//       http://www.apache.org/licenses/LICENSE-2.0
+// 
+//    Unless required by applicable law or agreed to in writing, software distributed under the License
+//    is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and limitations under the License.
+
+// The main loop on the virtual clock: how long a colour from MQTT takes to reach the LEDs, and how often the
+// loop wakes up when there is nothing to do, with a dithered colour, and with an animation. The loop sleeps until
+// the next deadline like the sketch does, so every scheduler pass is a wake-up.
+
+#include "Device.h"
+#include "Host.h"
+#include "LoopbackBroker.h"
+#include "check.h"
+#include "harness.h"
+#include "secrets.h"
+
+namespace {
+    // Controller::kMqttPollInterval and Device::kNetworkCheckInterval
+    constexpr unsigned long kMqttPollMillis = 20;
+    constexpr double kPollsPerSecond = 1000.0 / kMqttPollMillis + 1000.0 / Device::kNetworkCheckInterval;
+    constexpr size_t kSize = 3 * LedRingDriver::kLedCount;
+
+    char topic[128];
+
+    void send(LoopbackBroker& broker, const char* property, const char* payload) {
+        snprintf(topic, sizeof(topic), "homie/%s/%s/%s/set", kConfigDeviceName, led_ring_config::kSegments[0].node, property);
+        broker.inject(topic, payload);
+    }
+
+    struct Activity {
+        double passes;
+        double taskRuns;
+        double delays;
+        double shows;
+    };
+
+    // per second, over a while
+    Activity measure_activity(const char* name, Device& device, const unsigned long seconds) {
+        const uint32_t passes = device.scheduler().passes();
+        const uint32_t taskRuns = device.scheduler().taskRuns();
+        const uint32_t shows = host::led_output().shows;
+        host::reset_waits();
+        device.run(seconds * 1000000UL);
+        const Activity activity = {
+            static_cast<double>(device.scheduler().passes() - passes) / seconds,
+            static_cast<double>(device.scheduler().taskRuns() - taskRuns) / seconds,
+            static_cast<double>(host::waits().delays) / seconds,
+            static_cast<double>(host::led_output().shows - shows) / seconds
+        };
+        bench::Json("loop_activity").add("state", name).add("wakeups_per_second", activity.passes)
+            .add("task_runs_per_second", activity.taskRuns).add("sleeps_per_second", activity.delays)
+            .add("shows_per_second", activity.shows).print();
+        return activity;
+    }
+
+    // runs until the LEDs differ from what they showed; returns when that was shown
+    bool run_until_changed(Device& device, const uint8_t* before, uint64_t& shownMicros) {
+        const uint64_t end = host::now_micros() + 1000000;
+        while (host::now_micros() < end) {
+            Device::sleep(device.step());
+            const host::LedOutput& output = host::led_output();
+            if (memcmp(output.pixels, before, kSize) != 0) {
+                shownMicros = output.lastShowMicros;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Colours sent at random moments. Full colours, so nothing dithers and every change shows in one push.
+    void test_message_to_light(LoopbackBroker& broker, Device& device) {
+        const char* colors[] = { "0,100,100", "120,100,100", "240,100,100" };
+        std::vector<double> latencies;
+        const uint32_t messages = static_cast<uint32_t>(bench::scaled(300));
+        uint8_t before[kSize];
+        for (uint32_t i = 0; i < messages; i++) {
+            device.run(host::next_random() % 200000);
+            memcpy(before, host::led_output().pixels, kSize);
+            const uint64_t sent = host::now_micros();
+            send(broker, kColorProperty, colors[(i + 1) % 3]);
+            uint64_t shownMicros;
+            if (!CHECK(run_until_changed(device, before, shownMicros))) break;
+            latencies.push_back(static_cast<double>(shownMicros - sent) / 1000);
+        }
+        const bench::Summary latency = bench::summarize(latencies);
+        // the message waits for the next poll at most, and the push for the end of the frame period
+        CHECK(latency.max <= kMqttPollMillis + 1000.0 / LedRingDriver::kFramesPerSecond);
+        bench::Json("message_to_light").add("messages", messages).add("latency_ms", latency).print();
+    }
+}
+
+int main(const int argc, char** argv) {
+    bench::init(argc, argv);
+    host::use_virtual_clock();
+    host::seed_random(14);
+    LoopbackBroker broker;
+    broker.listen(kConfigMqttBroker, kConfigMqttPort);
+    host::Flash flash;
+    Device device(kConfigDeviceName, &flash);
+    device.begin(kConfigMqttBroker, kConfigMqttPort);
+    CHECK(device.settle());
+    // the acknowledgements of the subscriptions take a poll each
+    device.run(1000000);
+
+    const unsigned long seconds = static_cast<unsigned long>(bench::scaled(60));
+    send(broker, kSceneProperty, "240,100,100,0");
+    device.run(3000000);
+    // idle: only the MQTT poll and the network check wake the loop
+    const Activity idle = measure_activity("idle", device, seconds);
+    CHECK(idle.passes <= kPollsPerSecond + 1);
+    CHECK(idle.delays <= kPollsPerSecond + 1);
+    CHECK(idle.shows == 0);
+
+    // a level between two 8 bit levels: frames go out at the dither rate, but no faster
+    constexpr double kDitherShowsPerSecond = 1000000.0 / LedRingDriver::kDitherPeriodMicros;
+    send(broker, kSceneProperty, "30,60,35,0");
+    device.run(3000000);
+    const Activity dithering = measure_activity("dithering", device, seconds);
+    CHECK(dithering.shows > 0 && dithering.shows <= kDitherShowsPerSecond + 1);
+    CHECK(dithering.delays <= kDitherShowsPerSecond + kPollsPerSecond + 1);
+
+    // an animation renders at the frame rate, and its levels dither in between
+    send(broker, kSceneProperty, "0,100,60,2");
+    device.run(3000000);
+    const Activity animated = measure_activity("animated", device, seconds);
+    CHECK(animated.shows > 0 && animated.shows <= kDitherShowsPerSecond + 1);
+    CHECK(animated.taskRuns >= LedRingDriver::kFramesPerSecond);
+
+    send(broker, kSceneProperty, "0,100,100,0");
+    device.run(3000000);
+    test_message_to_light(broker, device);
+    device.mqtt().disconnect();
+    return check::result("test_scheduling");
+}
@@ -28,93 +28,120 @@
 //   )rootca";
 //   #endif
 
+#include "AllocationAudit.h"
 #include "Controller.h"
 #include "WifiDriver.h"
 #include "MqttDriver.h"
 #include "FirmwareManager.h"
+#include "GroupStore.h"
 #include "LedRingDriver.h"
 #include "Persistence.h"
+#include "PresetStore.h"
+#include "RealtimeReceiver.h"
+#include "Stats.h"
+#include "TaskScheduler.h"
 #include "Utilities.h"
 
-using utilities::set_logger;
+namespace logger = utilities::logger;
 
 namespace {
 	  constexpr auto kName = "LedRingController";
     constexpr auto kVersion = "0.0.7";
-    LedState desired_led_state;
+    const LedState* desired_led_states = nullptr;
     
     LedRingDriver led_ring_driver;
     Persistence persistence;
+    PresetStore preset_store;
+    GroupStore group_store;
     FirmwareManager firmware_manager;
     WifiDriver wifi_driver;
     MqttDriver mqtt_driver;
-    Controller controller(&led_ring_driver, &firmware_manager, &mqtt_driver, kVersion); 
+    RealtimeReceiver realtime_receiver(&led_ring_driver);
+    TaskScheduler scheduler(micros);
 
-    constexpr unsigned long kControllerInterval = 50; // ms
     constexpr unsigned long kNetworkCheckInterval = 500; // ms
+    // every flash write erases a sector, so wait until e.g. dragging a color slider has stopped
+    constexpr unsigned long kPersistenceDebounce = 2000; // ms
+    constexpr unsigned long kMqttStateInterval = 250; // ms, so at most 4 state updates per second
 
-    unsigned long last_controller_update = 0;
-    unsigned long last_network_check = 0;
+    // the MQTT publish queue holds on to the state while we're not connected, so all sinks always accept
+    SinkEntry state_sinks[] = {
+        make_sink(&led_ring_driver, CommitPolicy::Immediate),
+        make_sink(&persistence, CommitPolicy::Debounced, kPersistenceDebounce),
+        make_sink(&mqtt_driver, CommitPolicy::RateLimited, kMqttStateInterval)
+    };
+    Controller controller(&led_ring_driver, &firmware_manager, &mqtt_driver, &preset_store, state_sinks, kVersion);
+    // waits shorter than this aren't worth a delay(), and longer ones are cut short so the log keeps draining
+    constexpr unsigned long kMinSleepMicros = 1000;
+    constexpr unsigned long kMaxSleepMicros = 100000;
 }
 
 void setup() {
     Serial.begin(115200);
-    set_logger([](const char* msg){ Serial.println(msg); });
+    logger::begin(
+        [](const char* text, const size_t length) { Serial.write(text, length); },
+        []() -> size_t { return Serial.availableForWrite(); });
     delay(250);
     pinMode(LED_BUILTIN, OUTPUT);
     digitalWrite(LED_BUILTIN, LOW);
     Serial.printf("\nStarting %s %s\n", kName, kVersion);
-    controller.addStateSink(&led_ring_driver);
-    controller.addStateSink(&persistence);
-    controller.addStateSink(&mqtt_driver);
     persistence.begin();
-    desired_led_state = *persistence.get();
-    Serial.printf("Desired state: %d, %d,%d @ %d\n", desired_led_state.hue, desired_led_state.saturation, desired_led_state.value, desired_led_state.mode);
-    controller.beginLed(desired_led_state);
+    desired_led_states = persistence.get();
+    Serial.printf("Desired state: %d, %d,%d @ %d\n", desired_led_states[0].hue, desired_led_states[0].saturation, desired_led_states[0].value, desired_led_states[0].mode);
+    controller.beginLed(desired_led_states);
     Serial.printf("Switched on leds");
     
-    if (!wifi_driver.begin()) {
-        Serial.println("Could not connect to WiFi. Rebooting...");
-        ESP.restart();
-    }
-    wifi_driver.printStatus();
+    // connecting happens in the background, so the leds work without a network too
+    wifi_driver.begin();
 
     Serial.printf("Initiating firmware manager...\n");
-    firmware_manager.begin(wifi_driver.client(), kConfigBaseFirmwareUrl, wifi_driver.macAddress()); 
+    firmware_manager.begin(wifi_driver.firmwareClient(), kConfigBaseFirmwareUrl, wifi_driver.macAddress()); 
     
-    Serial.println("Connecting to MQTT...");
     mqtt_driver.begin(wifi_driver.client(), kConfigDeviceName);
-    if (!mqtt_driver.isConnected()) {
-        Serial.println("Could not connect to MQTT broker. Rebooting...");
-        ESP.restart();
-    };
+    if (group_store.begin()) {
+        Serial.printf("Member of %u group(s)\n", group_store.count());
+    }
+    controller.joinGroups(&group_store);
     controller.listenToMqtt();
+    controller.streamRealtime(&realtime_receiver);
     mqtt_driver.publishDeviceProperty(kMacAddressProperty, wifi_driver.macAddress());
-    mqtt_driver.publishDeviceProperty(kIpAddressProperty, wifi_driver.ipAddress());
     mqtt_driver.publishFirmwareProperty(kNameProperty, kName);
     mqtt_driver.publishFirmwareProperty(kVersionProperty, kVersion);
     
+    controller.schedule(&scheduler);
+    scheduler.add([](unsigned long) { 
+        if (wifi_driver.loop()) {
+            // the address is only known once connected. Queued until MQTT is connected too.
+            mqtt_driver.publishDeviceProperty(kIpAddressProperty, wifi_driver.ipAddress());
+            realtime_receiver.begin();
+        }
+        mqtt_driver.setNetworkAvailable(wifi_driver.isConnected());
+        return kNetworkCheckInterval * 1000UL; 
+    });
+
     Serial.println("Starting loop");
     digitalWrite(LED_BUILTIN, HIGH);
-
+    // from now on, logging must not block the loop
+    logger::defer();
+    // and nothing may allocate (only counted in a host build with LED_RING_ALLOC_AUDIT=1)
+    allocation_audit::arm();
 }
 
 void loop() {
-      const unsigned long now = millis();
-
-    // Run controller loop at a regular interval
-    if (now - last_controller_update >= kControllerInterval) {
-        controller.loop();
-        last_controller_update = now;
+    unsigned long wait;
+    {
+        STATS_TIME(Stage::Loop);
+        // runs whatever is due: animation frames, MQTT, commits, flash and the network check
+        wait = scheduler.run();
     }
+    // only ever fails in a host build with LED_RING_ALLOC_AUDIT=1, which is there to find allocations
+    if (!allocation_audit::verify()) allocation_audit::fail();
+    logger::drain();
 
-    // Periodically check network status
-    if (now - last_network_check >= kNetworkCheckInterval) {
-        wifi_driver.loop();
-        mqtt_driver.loop(); 
-        last_network_check = now;
+    // Sleep until the next deadline. delay() lets the WiFi stack run meanwhile.
+    if (wait >= kMinSleepMicros) {
+        delay(std::min(wait, kMaxSleepMicros) / 1000);
+    } else {
+        yield();
     }
-
-    // Let the background tasks run
-    delay(1);
 }